@@ -0,0 +1,259 @@
+/**
+ * Append log client: reserve slots with FETCH_ADD, write records with WRITE_WITH_IMM.
+ *
+ * Many clients can run this concurrently against one applog_server. Each reservation is a single
+ * remote atomic on the log tail (optionally reserving a batch of slots at once); the record WRITE
+ * carries its slot index as imm_data so the server can advance the commit watermark.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "applog_common.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+
+#define WINDOW 32
+#define WRID_FETCH_ADD 1
+#define WRID_READ_WM 2
+#define WRID_WRITE_BASE 1000
+
+static double elapsed_sec(const struct timespec *start, const struct timespec *end)
+{
+    double s = (double)(end->tv_sec - start->tv_sec);
+    double ns = (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+    return s + ns;
+}
+
+// Reap one CQE and account for it; returns the completed wr_id through *wr_id.
+static int reap_one(struct ibv_cq *cq, int *inflight, uint64_t *wr_id)
+{
+    struct ibv_wc wc;
+    if (poll_one(cq, &wc))
+    {
+        LOG_ERR("poll_one: CQE error");
+        return -1;
+    }
+    if (wc.wr_id >= WRID_WRITE_BASE)
+        (*inflight)--;
+    *wr_id = wc.wr_id;
+    return 0;
+}
+
+static int wait_wr(struct ibv_cq *cq, int *inflight, uint64_t want)
+{
+    uint64_t got = 0;
+    do
+    {
+        if (reap_one(cq, inflight, &got))
+            return -1;
+    } while (got != want);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <server-ip> <port> [records] [batch]\n", argv[0]);
+        return 1;
+    }
+    const char *ip = argv[1];
+    const char *port = argv[2];
+    uint64_t records = (argc >= 4) ? strtoull(argv[3], NULL, 10) : 10000;
+    uint64_t batch = (argc >= 5) ? strtoull(argv[4], NULL, 10) : 1;
+    const char *src_ip = getenv("RDMA_SRC_IP");
+    if (records == 0 || batch == 0 || batch > WINDOW)
+    {
+        fprintf(stderr, "records must be > 0 and batch in 1..%d\n", WINDOW);
+        return 1;
+    }
+    uint64_t writer = (uint64_t)getpid();
+
+    rdma_ctx c = {0};
+    LOGF("SLOW", "create CM channel + ID");
+    if (cm_create_channel_and_id(&c))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    LOGF("SLOW", "resolve %s:%s", ip, port);
+    if (cm_client_resolve(&c, ip, port, src_ip))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    LOGF("SLOW", "build PD/CQ/QP");
+    if (build_pd_cq_qp(&c, IBV_QPT_RC, 2 * WINDOW + 4, WINDOW + 4, 1, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    // Atomics and READ both consume initiator depth; 1 is enough since we keep one outstanding.
+    LOGF("SLOW", "rdma_connect");
+    if (cm_client_connect_only(&c, 1, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    struct rdma_conn_param connp = {0};
+    LOGF("SLOW", "wait ESTABLISHED");
+    if (cm_wait_connected(&c, &connp))
+    {
+        err = 1;
+        goto cleanup;
+    }
+
+    struct applog_info info = {0};
+    if (connp.private_data && connp.private_data_len >= sizeof(info))
+    {
+        memcpy(&info, connp.private_data, sizeof(info));
+    }
+    else
+    {
+        fprintf(stderr, "No or short private_data\n");
+        err = 2;
+        goto cleanup;
+    }
+    uint32_t slot_size = 0;
+    uint64_t nslots = 0;
+    unpack_applog_info(&info, &c.remote_addr, &c.remote_rkey, &slot_size, &nslots);
+    LOGF("SLOW", "log addr=%#lx rkey=0x%x slots=%" PRIu64 " slot_size=%u", (unsigned long)c.remote_addr,
+         c.remote_rkey, nslots, slot_size);
+
+    // TX ring: one slot-sized staging buffer per in-flight WRITE. RX: 8-byte atomic/READ landing words.
+    LOGF("FAST", "register TX ring (%d x %u) + atomic result words", WINDOW, slot_size);
+    if (alloc_and_reg(&c, &c.buf_tx, &c.mr_tx, (size_t)WINDOW * slot_size, IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (alloc_and_reg(&c, &c.buf_rx, &c.mr_rx, 64, IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    uint64_t *fa_result = (uint64_t *)c.buf_rx;
+    uint64_t *wm_result = fa_result + 1;
+
+    struct timespec t0, t1, r0, r1;
+    double reserve_secs = 0.0;
+    uint64_t reservations = 0;
+    uint64_t written = 0;
+    uint64_t posted = 0;
+    int inflight = 0;
+    int full = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (written < records && !full)
+    {
+        uint64_t want = records - written < batch ? records - written : batch;
+        clock_gettime(CLOCK_MONOTONIC, &r0);
+        if (post_fetch_add(c.qp, c.mr_rx, fa_result, c.remote_addr + APPLOG_TAIL_OFF, c.remote_rkey, want,
+                           WRID_FETCH_ADD, 1))
+        {
+            err_errno("post_fetch_add");
+            err = 1;
+            goto cleanup;
+        }
+        // Record WRITEs keep completing while we wait; they free TX ring slots.
+        if (wait_wr(c.cq, &inflight, WRID_FETCH_ADD))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &r1);
+        reserve_secs += elapsed_sec(&r0, &r1);
+        reservations++;
+
+        uint64_t first = *fa_result;
+        if (first >= nslots)
+        {
+            LOGF("DATA", "log full at tail=%" PRIu64, first);
+            break;
+        }
+        uint64_t n = nslots - first < want ? nslots - first : want;
+        full = n < want;
+        for (uint64_t j = 0; j < n; j++)
+        {
+            uint64_t wr_id = 0;
+            while (inflight >= WINDOW)
+            {
+                if (reap_one(c.cq, &inflight, &wr_id))
+                {
+                    err = 1;
+                    goto cleanup;
+                }
+            }
+            // RC completes in order, so the ring entry `posted % WINDOW` is free once inflight < WINDOW.
+            uint32_t idx = (uint32_t)(posted % WINDOW);
+            char *rec = (char *)c.buf_tx + (size_t)idx * slot_size;
+            struct applog_rec_hdr *h = (struct applog_rec_hdr *)rec;
+            h->magic = APPLOG_REC_MAGIC;
+            h->len = slot_size - (uint32_t)sizeof(*h);
+            h->writer = writer;
+            h->seq = written + j;
+            memset(rec + sizeof(*h), (int)(h->seq & 0xff), h->len);
+
+            uint64_t slot = first + j;
+            if (post_write_imm(c.qp, c.mr_tx, rec, c.remote_addr + applog_slot_off(slot, slot_size), c.remote_rkey,
+                               slot_size, (uint32_t)slot, WRID_WRITE_BASE + idx, 1))
+            {
+                err_errno("post_write_imm");
+                err = 1;
+                goto cleanup;
+            }
+            inflight++;
+            posted++;
+        }
+        written += n;
+    }
+    while (inflight > 0)
+    {
+        uint64_t wr_id = 0;
+        if (reap_one(c.cq, &inflight, &wr_id))
+        {
+            err = 1;
+            goto cleanup;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // The server publishes the contiguous commit point in the log header; fetch it one-sided.
+    if (post_read(c.qp, c.mr_rx, wm_result, c.remote_addr + APPLOG_WATERMARK_OFF, c.remote_rkey, sizeof(uint64_t),
+                  WRID_READ_WM, 1) ||
+        wait_wr(c.cq, &inflight, WRID_READ_WM))
+    {
+        err = 1;
+        goto cleanup;
+    }
+
+    double secs = elapsed_sec(&t0, &t1);
+    printf("Append log client %" PRIu64 ": wrote %" PRIu64 " records in %.3f s (%.0f records/s)\n", writer, written,
+           secs, secs > 0 ? (double)written / secs : 0.0);
+    printf("Append log client %" PRIu64 ": %" PRIu64 " FETCH_ADD reservations, avg %.2f us, server watermark snapshot=%" PRIu64
+           "\n",
+           writer, reservations, reservations ? reserve_secs * 1e6 / (double)reservations : 0.0, *wm_result);
+
+    rdma_disconnect(c.id);
+
+cleanup:
+    mem_free_all(&c);
+    destroy_qp(&c);
+    if (c.cq)
+        cq_ts_destroy(c.cq);
+    if (c.pd)
+        ibv_dealloc_pd(c.pd);
+    if (c.id)
+        rdma_destroy_id(c.id);
+    if (c.ec)
+        rdma_destroy_event_channel(c.ec);
+    return err;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Shared append log layout (one registered region on the server):
+ *
+ *   offset 0                 : tail      (uint64, FETCH_ADD target: next free slot index)
+ *   offset 8                 : watermark (uint64, server-owned: slots [0, watermark) are committed)
+ *   offset APPLOG_HDR_BYTES  : slot 0, slot 1, ... each slot_size bytes
+ *
+ * Writers reserve slots with one FETCH_ADD on `tail`, WRITE_WITH_IMM their record into the slot
+ * (imm_data = slot index), and the server folds those notifications into a contiguous watermark.
+ */
+
+#define APPLOG_HDR_BYTES 64
+#define APPLOG_TAIL_OFF 0
+#define APPLOG_WATERMARK_OFF 8
+#define APPLOG_REC_MAGIC 0x41504c47u /* "APLG" */
+
+struct applog_info
+{
+    uint64_t addr;      // base of the log region (header + slots)
+    uint32_t rkey;      // rkey for this connection's registration of the region
+    uint32_t slot_size; // bytes per slot, multiple of 8
+    uint64_t nslots;    // number of slots after the header
+} __attribute__((packed));
+
+struct applog_rec_hdr
+{
+    uint32_t magic;
+    uint32_t len; // payload bytes following the header
+    uint64_t writer;
+    uint64_t seq;
+};
+
+static inline struct applog_info pack_applog_info(uint64_t addr, uint32_t rkey, uint32_t slot_size, uint64_t nslots)
+{
+    struct applog_info info = {
+        .addr = htonll_u64(addr), .rkey = htonl(rkey), .slot_size = htonl(slot_size), .nslots = htonll_u64(nslots)};
+    return info;
+}
+
+static inline void unpack_applog_info(const struct applog_info *info, uint64_t *addr, uint32_t *rkey,
+                                      uint32_t *slot_size, uint64_t *nslots)
+{
+    if (addr)
+        *addr = ntohll_u64(info->addr);
+    if (rkey)
+        *rkey = ntohl(info->rkey);
+    if (slot_size)
+        *slot_size = ntohl(info->slot_size);
+    if (nslots)
+        *nslots = ntohll_u64(info->nslots);
+}
+
+static inline uint64_t applog_slot_off(uint64_t slot, uint32_t slot_size)
+{
+    return APPLOG_HDR_BYTES + slot * (uint64_t)slot_size;
+}
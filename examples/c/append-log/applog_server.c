@@ -0,0 +1,296 @@
+/**
+ * Append log server: expose a slotted log to many writers and publish a commit watermark.
+ *
+ * The server CPU never serializes writers. Slot reservation is a remote FETCH_ADD on the log's
+ * tail word; the server only folds WRITE_WITH_IMM notifications (imm_data = slot index) into
+ * the contiguous watermark stored in the log header, where readers can fetch it with RDMA READ.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "applog_common.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+
+#define DEFAULT_PORT "7474"
+#define MAX_CLIENTS 64
+#define RECV_DEPTH 64
+#define RECV_BUF_SZ 64
+
+struct applog_conn
+{
+    rdma_ctx c;
+    struct ibv_mr *mr_log; // this connection's registration of the shared log region
+    int established;
+    int done;
+    uint64_t commits;
+};
+
+static double elapsed_sec(const struct timespec *start, const struct timespec *end)
+{
+    double s = (double)(end->tv_sec - start->tv_sec);
+    double ns = (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+    return s + ns;
+}
+
+static struct applog_conn *find_conn(struct applog_conn *conns, int n, struct rdma_cm_id *id)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (conns[i].c.id == id)
+            return &conns[i];
+    }
+    return NULL;
+}
+
+static int conn_setup(struct applog_conn *a, struct rdma_event_channel *ec, struct rdma_cm_id *id, void *log,
+                      size_t log_len, uint32_t slot_size, uint64_t nslots)
+{
+    a->c.ec = ec;
+    a->c.id = id;
+    if (build_pd_cq_qp(&a->c, IBV_QPT_RC, 2 * RECV_DEPTH, 16, RECV_DEPTH, 1))
+        return -1;
+
+    // The same log memory is registered once per PD; all QPs on the HCA then see one atomic word.
+    a->mr_log = ibv_reg_mr(a->c.pd, log, log_len,
+                           IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ |
+                               IBV_ACCESS_REMOTE_ATOMIC);
+    if (!a->mr_log)
+        return err_errno("ibv_reg_mr log");
+    dump_mr(a->mr_log, "log", log, log_len);
+
+    if (alloc_and_reg(&a->c, &a->c.buf_rx, &a->c.mr_rx, RECV_DEPTH * RECV_BUF_SZ, IBV_ACCESS_LOCAL_WRITE))
+        return -1;
+    for (int i = 0; i < RECV_DEPTH; i++)
+    {
+        if (post_recv(a->c.qp, a->c.mr_rx, (char *)a->c.buf_rx + i * RECV_BUF_SZ, RECV_BUF_SZ, (uint64_t)i))
+            return err_errno("ibv_post_recv");
+    }
+
+    struct applog_info info = pack_applog_info((uintptr_t)log, a->mr_log->rkey, slot_size, nslots);
+    return cm_server_accept_with_priv(&a->c, &info, sizeof(info));
+}
+
+static void conn_destroy(struct applog_conn *a)
+{
+    if (a->mr_log)
+        ibv_dereg_mr(a->mr_log);
+    mem_free_all(&a->c);
+    destroy_qp(&a->c);
+    if (a->c.cq)
+        cq_ts_destroy(a->c.cq);
+    if (a->c.pd)
+        ibv_dealloc_pd(a->c.pd);
+    if (a->c.id)
+        rdma_destroy_id(a->c.id);
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    const char *port = (argc >= 2) ? argv[1] : DEFAULT_PORT;
+    int nclients = (argc >= 3) ? atoi(argv[2]) : 1;
+    uint64_t nslots = (argc >= 4) ? strtoull(argv[3], NULL, 10) : 65536;
+    uint32_t slot_size = (argc >= 5) ? (uint32_t)strtoul(argv[4], NULL, 10) : 256;
+    const char *bind_ip = getenv("RDMA_BIND_IP");
+    if (nclients <= 0 || nclients > MAX_CLIENTS || nslots == 0 || nslots > UINT32_MAX ||
+        slot_size < sizeof(struct applog_rec_hdr) || slot_size % 8)
+    {
+        fprintf(stderr, "Usage: %s <port> [clients<=%d] [slots] [slot-size (multiple of 8)]\n", argv[0],
+                MAX_CLIENTS);
+        return 1;
+    }
+
+    rdma_ctx l = {0};
+    struct applog_conn conns[MAX_CLIENTS];
+    memset(conns, 0, sizeof(conns));
+    int nconns = 0;
+    int ndone = 0;
+    void *log = NULL;
+    uint8_t *committed = NULL;
+    size_t log_len = (size_t)applog_slot_off(nslots, slot_size);
+
+    int rc = posix_memalign(&log, 4096, log_len);
+    if (rc)
+    {
+        LOG_ERR("posix_memalign: %s", strerror(rc));
+        return 1;
+    }
+    memset(log, 0, log_len);
+    committed = calloc((size_t)nslots, 1);
+    if (!committed)
+    {
+        err = 1;
+        goto cleanup;
+    }
+    volatile uint64_t *tail = (volatile uint64_t *)((char *)log + APPLOG_TAIL_OFF);
+    volatile uint64_t *watermark = (volatile uint64_t *)((char *)log + APPLOG_WATERMARK_OFF);
+
+    LOGF("SLOW", "create CM channel + listen (clients=%d slots=%" PRIu64 " slot_size=%u)", nclients, nslots,
+         slot_size);
+    if (cm_create_channel_and_id(&l))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (cm_server_listen_backlog(&l, bind_ip, port, nclients))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    // CM events and CQ completions are serviced from one loop, so CM must not block.
+    if (fcntl(l.ec->fd, F_SETFL, fcntl(l.ec->fd, F_GETFL) | O_NONBLOCK))
+    {
+        err_errno("fcntl O_NONBLOCK");
+        err = 1;
+        goto cleanup;
+    }
+
+    struct timespec t0 = {0}, t1;
+    int started = 0;
+    uint64_t wm = 0;
+    uint64_t commits = 0;
+    uint64_t dup = 0;
+    while (ndone < nclients)
+    {
+        struct rdma_cm_event *ev = NULL;
+        if (rdma_get_cm_event(l.ec, &ev) == 0)
+        {
+            struct rdma_cm_id *id = ev->id;
+            enum rdma_cm_event_type type = ev->event;
+            rdma_ack_cm_event(ev);
+            struct applog_conn *a = find_conn(conns, nconns, id);
+            if (type == RDMA_CM_EVENT_CONNECT_REQUEST)
+            {
+                if (nconns == nclients)
+                {
+                    rdma_reject(id, NULL, 0);
+                    continue;
+                }
+                LOGF("SLOW", "CONNECT_REQUEST -> client %d", nconns);
+                if (conn_setup(&conns[nconns++], l.ec, id, log, log_len, slot_size, nslots))
+                {
+                    err = 1;
+                    goto cleanup;
+                }
+            }
+            else if (type == RDMA_CM_EVENT_ESTABLISHED && a)
+            {
+                a->established = 1;
+                if (!started)
+                {
+                    clock_gettime(CLOCK_MONOTONIC, &t0);
+                    started = 1;
+                }
+            }
+            else if (type == RDMA_CM_EVENT_DISCONNECTED && a && !a->done)
+            {
+                a->done = 1;
+                ndone++;
+                LOGF("SLOW", "client %d disconnected after %" PRIu64 " commits", (int)(a - conns), a->commits);
+            }
+            else if (a && !a->established)
+            {
+                LOG_ERR("client %d failed during setup: %s", (int)(a - conns), rdma_event_str(type));
+                a->done = 1;
+                ndone++;
+            }
+        }
+        else if (errno != EAGAIN)
+        {
+            err_errno("rdma_get_cm_event");
+            err = 1;
+            goto cleanup;
+        }
+
+        for (int i = 0; i < nconns; i++)
+        {
+            struct applog_conn *a = &conns[i];
+            if (!a->established || a->done)
+                continue;
+            struct ibv_wc wcs[16];
+            int n = ibv_poll_cq(a->c.cq, 16, wcs);
+            if (n < 0)
+            {
+                LOG_ERR("ibv_poll_cq failed on client %d", i);
+                err = 1;
+                goto cleanup;
+            }
+            for (int k = 0; k < n; k++)
+            {
+                struct ibv_wc *wc = &wcs[k];
+                if (wc->status != IBV_WC_SUCCESS)
+                {
+                    // Flushes after the peer disconnects are expected; anything else is worth a line.
+                    if (wc->status != IBV_WC_WR_FLUSH_ERR)
+                        LOG_ERR("client %d CQE error: %s", i, ibv_wc_status_str(wc->status));
+                    continue;
+                }
+                if (wc->opcode != IBV_WC_RECV_RDMA_WITH_IMM)
+                    continue;
+                uint64_t slot = ntohl(wc->imm_data);
+                if (slot >= nslots || committed[slot])
+                    dup++;
+                else
+                {
+                    committed[slot] = 1;
+                    commits++;
+                    a->commits++;
+                }
+                // Slide the watermark over every contiguous committed slot.
+                while (wm < nslots && committed[wm])
+                    wm++;
+                *watermark = wm;
+                if (post_recv(a->c.qp, a->c.mr_rx, (char *)a->c.buf_rx + wc->wr_id * RECV_BUF_SZ, RECV_BUF_SZ,
+                              wc->wr_id))
+                {
+                    err_errno("ibv_post_recv");
+                    err = 1;
+                    goto cleanup;
+                }
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // Spot-check that every committed slot holds a well-formed record.
+    uint64_t bad = 0;
+    for (uint64_t s = 0; s < nslots; s++)
+    {
+        if (!committed[s])
+            continue;
+        const struct applog_rec_hdr *h = (const struct applog_rec_hdr *)((char *)log + applog_slot_off(s, slot_size));
+        if (h->magic != APPLOG_REC_MAGIC || h->len > slot_size - sizeof(*h))
+            bad++;
+    }
+
+    double secs = started ? elapsed_sec(&t0, &t1) : 0.0;
+    printf("Append log: tail=%" PRIu64 " watermark=%" PRIu64 " commits=%" PRIu64 " dup/out-of-range=%" PRIu64
+           " malformed=%" PRIu64 "\n",
+           *tail, wm, commits, dup, bad);
+    if (secs > 0)
+        printf("Append log: %.3f s, %.0f records/s, %.2f MiB/s\n", secs, (double)commits / secs,
+               (double)commits * slot_size / (1024.0 * 1024.0) / secs);
+    if (bad)
+        err = 3;
+
+cleanup:
+    for (int i = 0; i < nconns; i++)
+        conn_destroy(&conns[i]);
+    if (l.id)
+        rdma_destroy_id(l.id);
+    if (l.ec)
+        rdma_destroy_event_channel(l.ec);
+    free(committed);
+    free(log);
+    return err;
+}
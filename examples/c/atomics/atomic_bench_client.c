@@ -0,0 +1,397 @@
+/**
+ * Atomics benchmark client: latency and throughput of remote atomics under contention.
+ *
+ * Opens N connections (one thread each) to atomic_bench_server, then runs rounds with 1, 2, 4 ..
+ * N active threads hammering the server's region in one mode:
+ *   fadd   - FETCH_ADD on one shared word
+ *   cas    - CMP_SWAP increment loop on the same word (reports retries)
+ *   ticket - ticket lock acquire / READ+WRITE critical section / release
+ *   shard  - FETCH_ADD on a per-thread shard of a sharded counter
+ *   send   - SEND-based updates applied by the server CPU, `batch` increments per message
+ * Throughput is reported in counter updates per second so every mode is comparable.
+ * The port's sysfs counters are snapshotted around all rounds and reported per GiB of 8-byte updates.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "atomic_bench_common.h"
+#include "atomic_prims.h"
+#include "common.h"
+#include "ib_counters.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+
+#define MAX_THREADS 64
+#define SCRATCH_BYTES 4096
+
+enum ab_mode
+{
+    AB_FADD,
+    AB_CAS,
+    AB_TICKET,
+    AB_SHARD,
+    AB_SEND
+};
+
+struct ab_thread
+{
+    int idx;
+    pthread_t tid;
+    rdma_ctx c;
+    struct ratomic a;
+    double *lat_us; // latency samples for the current round: one per op, or per flush in send mode
+    uint64_t nlat;  // samples in lat_us
+    uint64_t ops;   // ops completed in the current round
+    uint64_t extra; // CAS attempts or lock spin READs
+    int failed;
+};
+
+static struct
+{
+    const char *ip;
+    const char *port;
+    enum ab_mode mode;
+    uint64_t iters;
+    uint64_t batch;
+    unsigned shards;
+    int active; // threads [0, active) run in the current round
+    int quit;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+} g;
+
+static double now_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e6 + (double)t.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int thread_connect(struct ab_thread *t)
+{
+    rdma_ctx *c = &t->c;
+    if (cm_create_channel_and_id(c) || cm_client_resolve(c, g.ip, g.port, getenv("RDMA_SRC_IP")) ||
+        build_pd_cq_qp(c, IBV_QPT_RC, 64, 16, 16, 1) || cm_client_connect_only(c, 1, 1))
+        return -1;
+    struct rdma_conn_param connp = {0};
+    if (cm_wait_connected(c, &connp))
+        return -1;
+    struct remote_buf_info info = {0};
+    if (!connp.private_data || connp.private_data_len < sizeof(info))
+    {
+        LOG_ERR("thread %d: no or short private_data", t->idx);
+        return -1;
+    }
+    memcpy(&info, connp.private_data, sizeof(info));
+    unpack_remote_buf_info(&info, &c->remote_addr, &c->remote_rkey);
+
+    // buf_rx: atomic results / READ landing zone + SEND-mode reply; buf_tx: SEND-mode request.
+    if (alloc_and_reg(c, &c->buf_rx, &c->mr_rx, SCRATCH_BYTES, IBV_ACCESS_LOCAL_WRITE) ||
+        alloc_and_reg(c, &c->buf_tx, &c->mr_tx, sizeof(struct ab_msg), IBV_ACCESS_LOCAL_WRITE))
+        return -1;
+    t->a = (struct ratomic){.qp = c->qp,
+                            .cq = c->cq,
+                            .mr = c->mr_rx,
+                            .scratch = c->buf_rx,
+                            .scratch_len = SCRATCH_BYTES - sizeof(struct ab_msg),
+                            .remote_addr = c->remote_addr,
+                            .rkey = c->remote_rkey};
+    t->lat_us = calloc((size_t)g.iters, sizeof(double));
+    return t->lat_us ? 0 : -1;
+}
+
+// One SEND request carrying `delta` increments; waits for the server's reply RECV.
+static int send_update(struct ab_thread *t, uint64_t delta)
+{
+    rdma_ctx *c = &t->c;
+    struct ab_msg *req = (struct ab_msg *)c->buf_tx;
+    struct ab_msg *rep = (struct ab_msg *)((char *)c->buf_rx + SCRATCH_BYTES - sizeof(struct ab_msg));
+    req->delta = delta;
+    if (post_recv(c->qp, c->mr_rx, rep, sizeof(*rep), 2) || post_send(c->qp, c->mr_tx, req, sizeof(*req), 1, 1))
+        return err_errno("post_send/recv");
+    int got_send = 0, got_recv = 0;
+    while (!got_send || !got_recv)
+    {
+        struct ibv_wc wc;
+        if (poll_one(c->cq, &wc))
+            return -1;
+        if (wc.opcode == IBV_WC_SEND)
+            got_send = 1;
+        else if (wc.opcode == IBV_WC_RECV)
+            got_recv = 1;
+    }
+    return 0;
+}
+
+static int run_round(struct ab_thread *t)
+{
+    uint64_t guess = 0;
+    uint64_t pending = 0;
+    double batch_t0 = 0;
+    unsigned shard = (unsigned)t->idx % g.shards;
+    t->ops = 0;
+    t->nlat = 0;
+    t->extra = 0;
+    for (uint64_t i = 0; i < g.iters; i++)
+    {
+        double t0 = now_us();
+        int rc = 0;
+        switch (g.mode)
+        {
+        case AB_FADD:
+            rc = ratomic_fetch_add(&t->a, AB_OFF_WORD, 1, NULL);
+            break;
+        case AB_CAS:
+            rc = ratomic_cas_incr(&t->a, AB_OFF_WORD, &guess, &t->extra);
+            break;
+        case AB_TICKET:
+        {
+            void *p = NULL;
+            rc = rticket_lock_acquire(&t->a, AB_OFF_LOCK, &t->extra);
+            if (!rc)
+                rc = ratomic_read(&t->a, AB_OFF_PROTECTED, sizeof(uint64_t), &p);
+            if (!rc)
+                rc = ratomic_write_u64(&t->a, AB_OFF_PROTECTED, *(uint64_t *)p + 1);
+            if (!rc)
+                rc = rticket_lock_release(&t->a, AB_OFF_LOCK);
+            break;
+        }
+        case AB_SHARD:
+            rc = rshard_counter_add(&t->a, AB_OFF_SHARDS, shard, 1);
+            break;
+        case AB_SEND:
+            // Increments accumulate locally; one message flushes `batch` of them. The local ones wait on nothing,
+            // so the sample is per flush: the batch's first increment to the server's reply.
+            if (pending++ == 0)
+                batch_t0 = t0;
+            if (pending == g.batch || i + 1 == g.iters)
+            {
+                rc = send_update(t, pending);
+                pending = 0;
+                if (!rc)
+                    t->lat_us[t->nlat++] = now_us() - batch_t0;
+            }
+            break;
+        }
+        if (rc)
+            return -1;
+        if (g.mode != AB_SEND)
+            t->lat_us[t->nlat++] = now_us() - t0;
+        t->ops++;
+    }
+    return 0;
+}
+
+static void *thread_main(void *arg)
+{
+    struct ab_thread *t = arg;
+    for (;;)
+    {
+        pthread_barrier_wait(&g.start);
+        if (g.quit)
+            break;
+        if (t->idx < g.active && !t->failed && run_round(t))
+        {
+            LOG_ERR("thread %d: round failed", t->idx);
+            t->failed = 1;
+        }
+        pthread_barrier_wait(&g.done);
+    }
+    return NULL;
+}
+
+static const char *mode_name(enum ab_mode m)
+{
+    static const char *names[] = {"fadd", "cas", "ticket", "shard", "send"};
+    return names[m];
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <server-ip> <port> <fadd|cas|ticket|shard|send> [max-clients] [iters] [batch]\n",
+                argv[0]);
+        return 1;
+    }
+    g.ip = argv[1];
+    g.port = argv[2];
+    const char *modes[] = {"fadd", "cas", "ticket", "shard", "send"};
+    int mode = -1;
+    for (int i = 0; i < 5; i++)
+    {
+        if (strcmp(argv[3], modes[i]) == 0)
+            mode = i;
+    }
+    int nthreads = (argc >= 5) ? atoi(argv[4]) : 4;
+    g.iters = (argc >= 6) ? strtoull(argv[5], NULL, 10) : 10000;
+    g.batch = (argc >= 7) ? strtoull(argv[6], NULL, 10) : 1;
+    const char *shards_env = getenv("ATOMIC_BENCH_SHARDS");
+    g.shards = (shards_env && *shards_env) ? (unsigned)strtoul(shards_env, NULL, 10) : 8;
+    if (mode < 0 || nthreads <= 0 || nthreads > MAX_THREADS || g.iters == 0 || g.batch == 0 || g.shards == 0 ||
+        g.shards > AB_MAX_SHARDS)
+    {
+        fprintf(stderr, "Invalid mode/clients(1..%d)/iters/batch/ATOMIC_BENCH_SHARDS(1..%d)\n", MAX_THREADS,
+                AB_MAX_SHARDS);
+        return 1;
+    }
+    g.mode = (enum ab_mode)mode;
+
+    struct ab_thread *th = calloc((size_t)nthreads, sizeof(*th));
+    double *all = calloc((size_t)nthreads * g.iters, sizeof(double));
+    int started = 0;
+    if (!th || !all)
+    {
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < nthreads; i++)
+    {
+        th[i].idx = i;
+        if (thread_connect(&th[i]))
+        {
+            LOG_ERR("thread %d: connect failed", i);
+            err = 1;
+            goto cleanup;
+        }
+    }
+    pthread_barrier_init(&g.start, NULL, (unsigned)nthreads + 1);
+    pthread_barrier_init(&g.done, NULL, (unsigned)nthreads + 1);
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&th[i].tid, NULL, thread_main, &th[i]);
+    started = 1;
+
+    // Snapshot the counters so the end-of-run check holds even against a reused server.
+    void *p = NULL;
+    uint64_t protected0 = 0, shard0 = 0;
+    if (ratomic_read(&th[0].a, AB_OFF_PROTECTED, sizeof(uint64_t), &p))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    protected0 = *(uint64_t *)p;
+    if (rshard_counter_sum(&th[0].a, AB_OFF_SHARDS, g.shards, &shard0))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    static struct ib_counters ctr_before, ctr_after;
+    ib_counters_read_verbs(&ctr_before, th[0].c.id->verbs, th[0].c.id->port_num);
+
+    printf("mode=%s iters/client=%" PRIu64 " batch=%" PRIu64 " shards=%u%s\n", mode_name(g.mode), g.iters, g.batch,
+           g.shards, g.mode == AB_SEND ? " (latency per flush)" : "");
+    printf("%8s %14s %10s %10s %10s %10s %12s\n", "clients", "updates/s", "avg_us", "p50_us", "p99_us", "max_us",
+           g.mode == AB_CAS ? "cas_tries/op" : (g.mode == AB_TICKET ? "spins/op" : "-"));
+    uint64_t total_ops = 0;
+    for (int k = 1;; k = (k * 2 > nthreads && k != nthreads) ? nthreads : k * 2)
+    {
+        g.active = k;
+        double t0 = now_us();
+        pthread_barrier_wait(&g.start);
+        pthread_barrier_wait(&g.done);
+        double secs = (now_us() - t0) / 1e6;
+
+        size_t n = 0;
+        uint64_t ops = 0, extra = 0;
+        for (int i = 0; i < k; i++)
+        {
+            if (th[i].failed)
+            {
+                err = 1;
+                goto cleanup;
+            }
+            memcpy(all + n, th[i].lat_us, th[i].nlat * sizeof(double));
+            n += th[i].nlat;
+            ops += th[i].ops;
+            extra += th[i].extra;
+        }
+        total_ops += ops;
+        qsort(all, n, sizeof(double), cmp_double);
+        double sum = 0;
+        for (size_t i = 0; i < n; i++)
+            sum += all[i];
+        printf("%8d %14.0f %10.2f %10.2f %10.2f %10.2f %12.2f\n", k, (double)ops / secs, sum / (double)n,
+               all[n / 2], all[(size_t)((double)(n - 1) * 0.99)], all[n - 1], (double)extra / (double)ops);
+        fflush(stdout);
+        if (k == nthreads)
+            break;
+    }
+    if (ctr_before.n)
+    {
+        ib_counters_read(&ctr_after, ctr_before.dev, ctr_before.port);
+        ib_counters_report("atomics", &ctr_before, &ctr_after, total_ops * sizeof(uint64_t));
+    }
+
+    if (g.mode == AB_TICKET)
+    {
+        if (ratomic_read(&th[0].a, AB_OFF_PROTECTED, sizeof(uint64_t), &p))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        uint64_t delta = *(uint64_t *)p - protected0;
+        printf("ticket lock check: protected counter advanced %" PRIu64 " for %" PRIu64 " acquisitions (%s)\n", delta,
+               total_ops, delta == total_ops ? "OK" : "MISMATCH");
+        if (delta != total_ops)
+            err = 3;
+    }
+    else if (g.mode == AB_SHARD)
+    {
+        uint64_t sum = 0;
+        if (rshard_counter_sum(&th[0].a, AB_OFF_SHARDS, g.shards, &sum))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        printf("sharded counter check: sum advanced %" PRIu64 " for %" PRIu64 " adds (%s)\n", sum - shard0,
+               total_ops, sum - shard0 == total_ops ? "OK" : "MISMATCH");
+        if (sum - shard0 != total_ops)
+            err = 3;
+    }
+
+cleanup:
+    if (started)
+    {
+        g.quit = 1;
+        pthread_barrier_wait(&g.start);
+        for (int i = 0; i < nthreads; i++)
+            pthread_join(th[i].tid, NULL);
+        pthread_barrier_destroy(&g.start);
+        pthread_barrier_destroy(&g.done);
+    }
+    for (int i = 0; th && i < nthreads; i++)
+    {
+        rdma_ctx *c = &th[i].c;
+        if (c->qp)
+            rdma_disconnect(c->id);
+        mem_free_all(c);
+        destroy_qp(c);
+        if (c->cq)
+            cq_ts_destroy(c->cq);
+        if (c->pd)
+            ibv_dealloc_pd(c->pd);
+        if (c->id)
+            rdma_destroy_id(c->id);
+        if (c->ec)
+            rdma_destroy_event_channel(c->ec);
+        free(th[i].lat_us);
+    }
+    free(th);
+    free(all);
+    return err;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Server-exposed region for the atomics benchmark. Hot words sit on their own 64-byte lines so
+ * the modes do not interfere with each other. The region is shared via remote_buf_info.
+ */
+#define AB_OFF_WORD 0           // contended FETCH_ADD / CMP_SWAP word
+#define AB_OFF_LOCK 64          // ticket lock: next_ticket (+0), now_serving (+8)
+#define AB_OFF_PROTECTED 128    // plain counter only touched while holding the ticket lock
+#define AB_OFF_SEND_COUNTER 192 // counter the server CPU updates for SEND-mode requests
+#define AB_OFF_SHARDS 256       // shard i at AB_OFF_SHARDS + i * RSHARD_STRIDE
+#define AB_MAX_SHARDS 56
+#define AB_REGION_BYTES 4096
+
+// SEND-mode request/response: the client ships `delta` accumulated increments, the server
+// replies with the counter value before applying them.
+struct ab_msg
+{
+    uint64_t delta;
+    uint64_t value;
+};
@@ -0,0 +1,228 @@
+/**
+ * Atomics benchmark server: expose one 4 KiB region of hot words and serve SEND-mode requests.
+ *
+ * Atomic, lock and shard modes are one-sided: the server CPU does nothing but keep the
+ * connections up. SEND mode is the CPU baseline: each request RECV is applied to a counter by
+ * this loop and answered with a SEND carrying the previous value.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic_bench_common.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+
+#define DEFAULT_PORT "7475"
+#define MAX_CONNS 128
+#define RECV_DEPTH 32
+
+struct ab_conn
+{
+    rdma_ctx c;
+    struct ibv_mr *mr_region;
+    int established;
+    uint64_t requests;
+};
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static int conn_setup(struct ab_conn *a, struct rdma_event_channel *ec, struct rdma_cm_id *id, void *region)
+{
+    a->c.ec = ec;
+    a->c.id = id;
+    if (build_pd_cq_qp(&a->c, IBV_QPT_RC, 2 * RECV_DEPTH + 4, RECV_DEPTH + 4, RECV_DEPTH, 1))
+        return -1;
+    a->mr_region = ibv_reg_mr(a->c.pd, region, AB_REGION_BYTES,
+                              IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ |
+                                  IBV_ACCESS_REMOTE_ATOMIC);
+    if (!a->mr_region)
+        return err_errno("ibv_reg_mr region");
+
+    // RX slot i pairs with TX reply slot i, so a reply never overwrites an unsent one.
+    size_t ring = RECV_DEPTH * sizeof(struct ab_msg);
+    if (alloc_and_reg(&a->c, &a->c.buf_rx, &a->c.mr_rx, ring, IBV_ACCESS_LOCAL_WRITE) ||
+        alloc_and_reg(&a->c, &a->c.buf_tx, &a->c.mr_tx, ring, IBV_ACCESS_LOCAL_WRITE))
+        return -1;
+    struct ab_msg *rx = (struct ab_msg *)a->c.buf_rx;
+    for (int i = 0; i < RECV_DEPTH; i++)
+    {
+        if (post_recv(a->c.qp, a->c.mr_rx, &rx[i], sizeof(rx[i]), (uint64_t)i))
+            return err_errno("ibv_post_recv");
+    }
+
+    struct remote_buf_info info = pack_remote_buf_info((uintptr_t)region, a->mr_region->rkey);
+    return cm_server_accept_with_priv(&a->c, &info, sizeof(info));
+}
+
+static void conn_destroy(struct ab_conn *a)
+{
+    if (a->mr_region)
+        ibv_dereg_mr(a->mr_region);
+    mem_free_all(&a->c);
+    destroy_qp(&a->c);
+    if (a->c.cq)
+        cq_ts_destroy(a->c.cq);
+    if (a->c.pd)
+        ibv_dealloc_pd(a->c.pd);
+    if (a->c.id)
+        rdma_destroy_id(a->c.id);
+    memset(a, 0, sizeof(*a));
+}
+
+static void print_region(const void *region)
+{
+    const volatile uint64_t *w = (const volatile uint64_t *)region;
+    uint64_t shards = 0;
+    for (int i = 0; i < AB_MAX_SHARDS; i++)
+        shards += w[(AB_OFF_SHARDS + i * 64) / 8];
+    printf("Atomics server: word=%" PRIu64 " lock(next=%" PRIu64 " serving=%" PRIu64 ") protected=%" PRIu64
+           " send_counter=%" PRIu64 " shard_sum=%" PRIu64 "\n",
+           w[AB_OFF_WORD / 8], w[AB_OFF_LOCK / 8], w[AB_OFF_LOCK / 8 + 1], w[AB_OFF_PROTECTED / 8],
+           w[AB_OFF_SEND_COUNTER / 8], shards);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    const char *port = (argc >= 2) ? argv[1] : DEFAULT_PORT;
+    const char *bind_ip = getenv("RDMA_BIND_IP");
+    rdma_ctx l = {0};
+    struct ab_conn *conns = calloc(MAX_CONNS, sizeof(*conns));
+    void *region = NULL;
+    int live = 0;
+    if (!conns)
+        return 1;
+    int rc = posix_memalign(&region, 4096, AB_REGION_BYTES);
+    if (rc)
+    {
+        LOG_ERR("posix_memalign: %s", strerror(rc));
+        free(conns);
+        return 1;
+    }
+    memset(region, 0, AB_REGION_BYTES);
+    volatile uint64_t *send_counter = (volatile uint64_t *)((char *)region + AB_OFF_SEND_COUNTER);
+    signal(SIGINT, on_sigint);
+
+    if (cm_create_channel_and_id(&l) || cm_server_listen_backlog(&l, bind_ip, port, MAX_CONNS))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (fcntl(l.ec->fd, F_SETFL, fcntl(l.ec->fd, F_GETFL) | O_NONBLOCK))
+    {
+        err_errno("fcntl O_NONBLOCK");
+        err = 1;
+        goto cleanup;
+    }
+    printf("Atomics server listening on %s (Ctrl-C to stop)\n", port);
+    fflush(stdout);
+
+    while (!g_stop)
+    {
+        struct rdma_cm_event *ev = NULL;
+        if (rdma_get_cm_event(l.ec, &ev) == 0)
+        {
+            struct rdma_cm_id *id = ev->id;
+            enum rdma_cm_event_type type = ev->event;
+            rdma_ack_cm_event(ev);
+            struct ab_conn *a = NULL;
+            for (int i = 0; i < MAX_CONNS; i++)
+            {
+                if (conns[i].c.id == id)
+                    a = &conns[i];
+            }
+            if (type == RDMA_CM_EVENT_CONNECT_REQUEST)
+            {
+                for (int i = 0; i < MAX_CONNS && !a; i++)
+                {
+                    if (!conns[i].c.id)
+                        a = &conns[i];
+                }
+                if (!a)
+                {
+                    rdma_reject(id, NULL, 0);
+                    continue;
+                }
+                if (conn_setup(a, l.ec, id, region))
+                {
+                    LOG_ERR("connection setup failed; rejecting");
+                    rdma_reject(id, NULL, 0);
+                    conn_destroy(a);
+                }
+            }
+            else if (type == RDMA_CM_EVENT_ESTABLISHED && a)
+            {
+                a->established = 1;
+                live++;
+            }
+            else if (a && (type == RDMA_CM_EVENT_DISCONNECTED || !a->established))
+            {
+                if (a->established && --live == 0)
+                    print_region(region);
+                conn_destroy(a);
+            }
+        }
+        else if (errno != EAGAIN)
+        {
+            err_errno("rdma_get_cm_event");
+            err = 1;
+            goto cleanup;
+        }
+
+        for (int i = 0; i < MAX_CONNS; i++)
+        {
+            struct ab_conn *a = &conns[i];
+            if (!a->established)
+                continue;
+            struct ibv_wc wcs[16];
+            int n = ibv_poll_cq(a->c.cq, 16, wcs);
+            for (int k = 0; k < n; k++)
+            {
+                if (wcs[k].status != IBV_WC_SUCCESS || wcs[k].opcode != IBV_WC_RECV)
+                    continue;
+                uint64_t slot = wcs[k].wr_id;
+                struct ab_msg *req = (struct ab_msg *)a->c.buf_rx + slot;
+                struct ab_msg *rep = (struct ab_msg *)a->c.buf_tx + slot;
+                rep->delta = req->delta;
+                rep->value = *send_counter;
+                *send_counter = rep->value + req->delta;
+                a->requests++;
+                // Re-arm the RECV before replying so the client's next request always finds one.
+                if (post_recv(a->c.qp, a->c.mr_rx, req, sizeof(*req), slot) ||
+                    post_send(a->c.qp, a->c.mr_tx, rep, sizeof(*rep), RECV_DEPTH + slot, 1))
+                    LOG_ERR("client %d: repost/reply failed: %s", i, strerror(errno));
+            }
+        }
+    }
+    print_region(region);
+
+cleanup:
+    for (int i = 0; i < MAX_CONNS; i++)
+    {
+        if (conns[i].c.id)
+            conn_destroy(&conns[i]);
+    }
+    if (l.id)
+        rdma_destroy_id(l.id);
+    if (l.ec)
+        rdma_destroy_event_channel(l.ec);
+    free(conns);
+    free(region);
+    return err;
+}
@@ -0,0 +1,133 @@
+/**
+ * Remote atomic primitives: synchronous FETCH_ADD/CMP_SWAP/READ wrappers, a ticket lock and a
+ * sharded counter. See atomic_prims.h for the memory layout each primitive expects.
+ */
+
+#include "atomic_prims.h"
+
+#include "rdma_ops.h"
+
+static int wait_wr_id(struct ratomic *a, uint64_t wr_id)
+{
+    struct ibv_wc wc;
+    do
+    {
+        if (poll_one(a->cq, &wc))
+        {
+            LOG_ERR("poll_one: CQE error while waiting for wr_id=%lu", (unsigned long)wr_id);
+            return -1;
+        }
+    } while (wc.wr_id != wr_id);
+    return 0;
+}
+
+int ratomic_fetch_add(struct ratomic *a, uint64_t off, uint64_t add, uint64_t *old)
+{
+    uint64_t *dst = (uint64_t *)a->scratch;
+    uint64_t wr_id = ++a->next_wr_id;
+    if (post_fetch_add(a->qp, a->mr, dst, a->remote_addr + off, a->rkey, add, wr_id, 1))
+        return err_errno("post_fetch_add");
+    if (wait_wr_id(a, wr_id))
+        return -1;
+    if (old)
+        *old = *dst;
+    return 0;
+}
+
+int ratomic_cmp_swap(struct ratomic *a, uint64_t off, uint64_t compare, uint64_t swap, uint64_t *old)
+{
+    uint64_t *dst = (uint64_t *)a->scratch;
+    uint64_t wr_id = ++a->next_wr_id;
+    if (post_cmp_swap(a->qp, a->mr, dst, a->remote_addr + off, a->rkey, compare, swap, wr_id, 1))
+        return err_errno("post_cmp_swap");
+    if (wait_wr_id(a, wr_id))
+        return -1;
+    if (old)
+        *old = *dst;
+    return 0;
+}
+
+int ratomic_read(struct ratomic *a, uint64_t off, size_t len, void **out)
+{
+    if (len > a->scratch_len)
+    {
+        LOG_ERR("ratomic_read: len=%zu exceeds scratch=%zu", len, a->scratch_len);
+        return -1;
+    }
+    uint64_t wr_id = ++a->next_wr_id;
+    if (post_read(a->qp, a->mr, a->scratch, a->remote_addr + off, a->rkey, len, wr_id, 1))
+        return err_errno("post_read");
+    if (wait_wr_id(a, wr_id))
+        return -1;
+    *out = a->scratch;
+    return 0;
+}
+
+int ratomic_write_u64(struct ratomic *a, uint64_t off, uint64_t val)
+{
+    uint64_t *src = (uint64_t *)a->scratch;
+    *src = val;
+    uint64_t wr_id = ++a->next_wr_id;
+    if (post_write(a->qp, a->mr, src, a->remote_addr + off, a->rkey, sizeof(val), wr_id, 1))
+        return err_errno("post_write");
+    return wait_wr_id(a, wr_id);
+}
+
+int ratomic_cas_incr(struct ratomic *a, uint64_t off, uint64_t *guess, uint64_t *attempts)
+{
+    for (;;)
+    {
+        uint64_t old = 0;
+        if (ratomic_cmp_swap(a, off, *guess, *guess + 1, &old))
+            return -1;
+        if (attempts)
+            (*attempts)++;
+        if (old == *guess)
+        {
+            *guess = old + 1;
+            return 0;
+        }
+        // Lost the race: the returned value is the freshest view of the word, retry from it.
+        *guess = old;
+    }
+}
+
+int rticket_lock_acquire(struct ratomic *a, uint64_t lock_off, uint64_t *spins)
+{
+    uint64_t ticket = 0;
+    if (ratomic_fetch_add(a, lock_off, 1, &ticket))
+        return -1;
+    for (;;)
+    {
+        void *p = NULL;
+        if (ratomic_read(a, lock_off + 8, sizeof(uint64_t), &p))
+            return -1;
+        if (*(volatile uint64_t *)p == ticket)
+            return 0;
+        if (spins)
+            (*spins)++;
+    }
+}
+
+int rticket_lock_release(struct ratomic *a, uint64_t lock_off)
+{
+    return ratomic_fetch_add(a, lock_off + 8, 1, NULL);
+}
+
+int rshard_counter_add(struct ratomic *a, uint64_t base_off, unsigned shard, uint64_t add)
+{
+    return ratomic_fetch_add(a, base_off + (uint64_t)shard * RSHARD_STRIDE, add, NULL);
+}
+
+int rshard_counter_sum(struct ratomic *a, uint64_t base_off, unsigned nshards, uint64_t *sum)
+{
+    // One READ covers all shards; the sum is a snapshot, not a linearizable total.
+    void *p = NULL;
+    if (ratomic_read(a, base_off, (size_t)nshards * RSHARD_STRIDE, &p))
+        return -1;
+    uint64_t s = 0;
+    for (unsigned i = 0; i < nshards; i++)
+        s += *(const uint64_t *)((const char *)p + (size_t)i * RSHARD_STRIDE);
+    *sum = s;
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+ * Remote synchronization primitives built on RDMA atomics.
+ *
+ * Every call is synchronous: post one signaled WR, spin on the CQ until that wr_id completes.
+ * One struct ratomic per QP/thread; the scratch MR receives fetched values and READ results.
+ */
+
+#include <stdint.h>
+
+#include "common.h"
+
+struct ratomic
+{
+    struct ibv_qp *qp;
+    struct ibv_cq *cq;
+    struct ibv_mr *mr; // registered scratch (LOCAL_WRITE), at least scratch_len bytes
+    void *scratch;
+    size_t scratch_len;
+    uint64_t remote_addr; // base of the server region
+    uint32_t rkey;
+    uint64_t next_wr_id;
+};
+
+int ratomic_fetch_add(struct ratomic *a, uint64_t off, uint64_t add, uint64_t *old);
+int ratomic_cmp_swap(struct ratomic *a, uint64_t off, uint64_t compare, uint64_t swap, uint64_t *old);
+int ratomic_read(struct ratomic *a, uint64_t off, size_t len, void **out);
+int ratomic_write_u64(struct ratomic *a, uint64_t off, uint64_t val);
+
+// CMP_SWAP increment loop; *guess carries the last observed value between calls.
+int ratomic_cas_incr(struct ratomic *a, uint64_t off, uint64_t *guess, uint64_t *attempts);
+
+/*
+ * Ticket lock: two words at lock_off, next_ticket (+0) and now_serving (+8).
+ * acquire = FETCH_ADD(next_ticket) then READ now_serving until it equals our ticket.
+ * release = FETCH_ADD(now_serving, 1) so it never races with other atomics on the word.
+ */
+int rticket_lock_acquire(struct ratomic *a, uint64_t lock_off, uint64_t *spins);
+int rticket_lock_release(struct ratomic *a, uint64_t lock_off);
+
+/*
+ * Sharded counter: nshards words spaced RSHARD_STRIDE apart so concurrent FETCH_ADDs hit
+ * different cache lines (and different HCA atomic units) instead of one hot word.
+ */
+#define RSHARD_STRIDE 64
+int rshard_counter_add(struct ratomic *a, uint64_t base_off, unsigned shard, uint64_t add);
+int rshard_counter_sum(struct ratomic *a, uint64_t base_off, unsigned nshards, uint64_t *sum);
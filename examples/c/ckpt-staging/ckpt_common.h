@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * Checkpoint staging protocol.
+ *
+ * The server exposes `nregions` staging regions of `region_size` bytes back to back in one MR.
+ * The client streams the shard as a ring over those regions: stream byte `off` lands in region
+ * slot (off / region_size) % nregions. Every chunk is a WRITE_WITH_IMM whose imm_data is the
+ * region sequence number (off / region_size); the RECV completion's byte_len tells the server
+ * how much of that region arrived. A full region is persisted while the client fills the next.
+ *
+ * Flow control uses SEND messages: the server returns CKPT_MSG_CREDIT with the number of
+ * regions persisted so far (contiguous from 0). The client may start region q only once
+ * q < credit + nregions. CKPT_MSG_DONE from the client carries the total shard length.
+ */
+
+#define CKPT_MSG_DONE 1
+#define CKPT_MSG_CREDIT 2
+
+struct ckpt_info
+{
+    uint64_t addr;
+    uint32_t rkey;
+    uint32_t nregions;
+    uint64_t region_size;
+} __attribute__((packed));
+
+struct ckpt_msg
+{
+    uint32_t type;
+    uint32_t pad;
+    uint64_t value;
+};
+
+static inline struct ckpt_info pack_ckpt_info(uint64_t addr, uint32_t rkey, uint32_t nregions, uint64_t region_size)
+{
+    struct ckpt_info info = {.addr = htonll_u64(addr),
+                             .rkey = htonl(rkey),
+                             .nregions = htonl(nregions),
+                             .region_size = htonll_u64(region_size)};
+    return info;
+}
+
+static inline void unpack_ckpt_info(const struct ckpt_info *info, uint64_t *addr, uint32_t *rkey, uint32_t *nregions,
+                                    uint64_t *region_size)
+{
+    if (addr)
+        *addr = ntohll_u64(info->addr);
+    if (rkey)
+        *rkey = ntohl(info->rkey);
+    if (nregions)
+        *nregions = ntohl(info->nregions);
+    if (region_size)
+        *region_size = ntohll_u64(info->region_size);
+}
@@ -0,0 +1,244 @@
+/**
+ * Checkpoint staging client: stream a shard into the server's staging regions with
+ * WRITE_WITH_IMM and pace region reuse on the server's persist credits.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../rdma-bulk/rdma_bulk_common.h"
+#include "ckpt_common.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+
+#define RECV_DEPTH 16
+#define WR_ID_DONE (~0ULL)
+
+struct stream
+{
+    rdma_ctx c;
+    uint64_t credit; // regions the server has persisted
+    int send_inflight;
+    int inflight; // unacknowledged WRITE_WITH_IMMs
+    int batch_sizes[64];
+    int batch_head, batch_tail;
+    double stall_secs; // time spent waiting for credits
+};
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// Reap one CQE: a signaled WRITE batch, the DONE send, or a credit message.
+static int reap_one(struct stream *s)
+{
+    struct ibv_wc wc;
+    if (poll_one(s->c.cq, &wc))
+    {
+        LOG_ERR("poll_one: CQE error");
+        return -1;
+    }
+    if (wc.opcode == IBV_WC_RECV)
+    {
+        struct ckpt_msg *m = (struct ckpt_msg *)s->c.buf_rx + wc.wr_id;
+        if (m->type == CKPT_MSG_CREDIT && m->value > s->credit)
+            s->credit = m->value;
+        if (post_recv(s->c.qp, s->c.mr_rx, m, sizeof(*m), wc.wr_id))
+            return err_errno("ibv_post_recv");
+        return 0;
+    }
+    if (wc.wr_id == WR_ID_DONE)
+    {
+        s->send_inflight = 0;
+        return 0;
+    }
+    s->inflight -= s->batch_sizes[s->batch_head];
+    s->batch_head = (s->batch_head + 1) % 64;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <server-ip> <port> [bytes] [chunk]\n", argv[0]);
+        return 1;
+    }
+    const char *ip = argv[1];
+    const char *port = argv[2];
+    uint64_t total = parse_size_bytes((argc >= 4) ? argv[3] : "1G");
+    uint64_t chunk = parse_size_bytes((argc >= 5) ? argv[4] : "4M");
+    if (total == 0 || chunk == 0)
+    {
+        fprintf(stderr, "Invalid size/chunk\n");
+        return 1;
+    }
+
+    struct stream s = {0};
+    if (cm_create_channel_and_id(&s.c) || cm_client_resolve(&s.c, ip, port, NULL))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (build_pd_cq_qp(&s.c, IBV_QPT_RC, 256, 128, RECV_DEPTH, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (alloc_and_reg(&s.c, &s.c.buf_rx, &s.c.mr_rx, RECV_DEPTH * sizeof(struct ckpt_msg), IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < RECV_DEPTH; i++)
+    {
+        if (post_recv(s.c.qp, s.c.mr_rx, (struct ckpt_msg *)s.c.buf_rx + i, sizeof(struct ckpt_msg), (uint64_t)i))
+        {
+            err_errno("ibv_post_recv");
+            err = 1;
+            goto cleanup;
+        }
+    }
+    if (cm_client_connect_only(&s.c, 1, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    struct rdma_conn_param connp = {0};
+    if (cm_wait_connected(&s.c, &connp))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    struct ckpt_info info = {0};
+    if (!connp.private_data || connp.private_data_len < sizeof(info))
+    {
+        fprintf(stderr, "No or short private_data\n");
+        err = 2;
+        goto cleanup;
+    }
+    memcpy(&info, connp.private_data, sizeof(info));
+    uint32_t nregions = 0;
+    uint64_t region_size = 0;
+    unpack_ckpt_info(&info, &s.c.remote_addr, &s.c.remote_rkey, &nregions, &region_size);
+    if (region_size % chunk)
+    {
+        fprintf(stderr, "chunk %" PRIu64 " must divide the server region size %" PRIu64 "\n", chunk, region_size);
+        err = 2;
+        goto cleanup;
+    }
+    printf("Staging %" PRIu64 " bytes into %u regions x %" PRIu64 " bytes, chunk %" PRIu64 "\n", total, nregions,
+           region_size, chunk);
+
+    // One chunk-sized source buffer (the shard contents are synthetic) plus the DONE message.
+    if (alloc_and_reg(&s.c, &s.c.buf_tx, &s.c.mr_tx, (size_t)chunk + sizeof(struct ckpt_msg), IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    memset(s.c.buf_tx, 0x5a, (size_t)chunk);
+    struct ckpt_msg *done = (struct ckpt_msg *)((char *)s.c.buf_tx + chunk);
+
+    const int max_outstanding = 64;
+    const int signal_every = 16;
+    int current_batch = 0;
+    uint64_t sent = 0;
+    uint64_t wr_id = 1;
+    double t0 = now_sec();
+    while (sent < total)
+    {
+        uint64_t seq = sent / region_size;
+        if (seq >= s.credit + nregions)
+        {
+            // The region slot we need still holds data the server has not persisted.
+            double w0 = now_sec();
+            while (seq >= s.credit + nregions)
+            {
+                if (reap_one(&s))
+                {
+                    err = 1;
+                    goto cleanup;
+                }
+            }
+            s.stall_secs += now_sec() - w0;
+        }
+        uint64_t remaining = total - sent;
+        uint64_t this_chunk = remaining < chunk ? remaining : chunk;
+        uint64_t remote = s.c.remote_addr + (seq % nregions) * region_size + sent % region_size;
+        current_batch++;
+        int do_signal = (current_batch == signal_every) || (sent + this_chunk == total);
+        if (post_write_imm(s.c.qp, s.c.mr_tx, s.c.buf_tx, remote, s.c.remote_rkey, (size_t)this_chunk, (uint32_t)seq,
+                           wr_id++, do_signal))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        s.inflight++;
+        if (do_signal)
+        {
+            s.batch_sizes[s.batch_tail] = current_batch;
+            s.batch_tail = (s.batch_tail + 1) % 64;
+            current_batch = 0;
+        }
+        while (s.inflight >= max_outstanding)
+        {
+            if (reap_one(&s))
+            {
+                err = 1;
+                goto cleanup;
+            }
+        }
+        sent += this_chunk;
+    }
+    double t_sent = now_sec();
+
+    done->type = CKPT_MSG_DONE;
+    done->value = total;
+    if (post_send(s.c.qp, s.c.mr_tx, done, sizeof(*done), WR_ID_DONE, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    s.send_inflight = 1;
+    uint64_t total_regions = (total + region_size - 1) / region_size;
+    while (s.batch_head != s.batch_tail || s.send_inflight || s.credit < total_regions)
+    {
+        if (reap_one(&s))
+        {
+            err = 1;
+            goto cleanup;
+        }
+    }
+    double t1 = now_sec();
+
+    double mib = (double)total / (1024.0 * 1024.0);
+    printf("Sent %" PRIu64 " bytes in %.3f s (%.2f MiB/s), %.3f s stalled on credits\n", total, t_sent - t0,
+           mib / (t_sent - t0), s.stall_secs);
+    printf("Durable after %.3f s (%.2f MiB/s end-to-end)\n", t1 - t0, mib / (t1 - t0));
+
+    rdma_disconnect(s.c.id);
+
+cleanup:
+    mem_free_all(&s.c);
+    destroy_qp(&s.c);
+    if (s.c.cq)
+        cq_ts_destroy(s.c.cq);
+    if (s.c.pd)
+        ibv_dealloc_pd(s.c.pd);
+    if (s.c.id)
+        rdma_destroy_id(s.c.id);
+    if (s.c.ec)
+        rdma_destroy_event_channel(s.c.ec);
+    return err;
+}
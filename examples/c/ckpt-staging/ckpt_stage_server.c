@@ -0,0 +1,498 @@
+/**
+ * Checkpoint staging server: receive a shard into a ring of staging regions and persist each
+ * completed region to disk with io_uring (O_DIRECT, registered buffers) while the client fills
+ * the next one. Ingest (network) and persist (disk) throughput are reported separately.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../rdma-bulk/rdma_bulk_common.h"
+#include "ckpt_common.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+#include "uring_io.h"
+
+#define DEFAULT_PORT "7476"
+#define MAX_REGIONS 16
+#define RECV_DEPTH 128
+#define TX_SLOTS 8
+#define DIRECT_ALIGN 4096
+#define FSYNC_USER_DATA (~0ULL)
+
+enum region_state
+{
+    REGION_FREE,
+    REGION_FILLING,
+    REGION_PERSISTING,
+    REGION_PERSISTED
+};
+
+struct region
+{
+    enum region_state state;
+    uint64_t seq;    // stream region sequence currently staged here
+    uint64_t filled; // bytes that arrived for seq
+    int ios_pending;
+};
+
+struct stager
+{
+    rdma_ctx c;
+    struct uring ring;
+    int ring_ok;
+    int fd;
+    char *staging;
+    uint64_t region_size;
+    uint32_t nregions;
+    uint64_t io_size;
+    struct region regions[MAX_REGIONS];
+
+    uint64_t credit;       // regions persisted contiguously from seq 0
+    uint64_t sent_credit;  // last credit value put on the wire
+    int tx_inflight;
+    uint32_t tx_next;
+    int done_received;
+    uint64_t total;        // shard length from CKPT_MSG_DONE
+    uint64_t total_regions;
+    int fsync_pending;
+    int finished;
+
+    // Accounting.
+    uint64_t ingested;
+    uint64_t persisted;
+    int ios_inflight;
+    double t_first_data, t_done, t_persist_end;
+    double persist_busy, busy_since;
+    double fsync_secs, fsync_start;
+};
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int send_credit(struct stager *s)
+{
+    if (s->tx_inflight == TX_SLOTS || s->sent_credit == s->credit)
+        return 0;
+    // The final credit also promises durability, so it waits for the fsync.
+    if (s->done_received && s->credit == s->total_regions && !s->finished)
+        return 0;
+    struct ckpt_msg *m = (struct ckpt_msg *)s->c.buf_tx + s->tx_next;
+    s->tx_next = (s->tx_next + 1) % TX_SLOTS;
+    m->type = CKPT_MSG_CREDIT;
+    m->value = s->credit;
+    if (post_send(s->c.qp, s->c.mr_tx, m, sizeof(*m), 0, 1))
+        return err_errno("post_send credit");
+    s->tx_inflight++;
+    s->sent_credit = s->credit;
+    return 0;
+}
+
+static void io_started(struct stager *s, double now)
+{
+    if (s->ios_inflight++ == 0)
+        s->busy_since = now;
+}
+
+static void io_finished(struct stager *s, double now)
+{
+    if (--s->ios_inflight == 0)
+        s->persist_busy += now - s->busy_since;
+}
+
+static int handle_uring_cqe(struct stager *s, struct io_uring_cqe *cqe);
+
+// Grab an SQE, draining completions if the SQ is full.
+static struct io_uring_sqe *get_sqe(struct stager *s)
+{
+    struct io_uring_sqe *sqe;
+    while (!(sqe = uring_get_sqe(&s->ring)))
+    {
+        struct io_uring_cqe *cqe = NULL;
+        int rc = uring_submit(&s->ring, 1);
+        if (rc < 0 || uring_wait_cqe(&s->ring, &cqe))
+        {
+            LOG_ERR("io_uring submit/wait: %s", strerror(rc < 0 ? -rc : errno));
+            return NULL;
+        }
+        if (handle_uring_cqe(s, cqe))
+            return NULL;
+    }
+    return sqe;
+}
+
+static int persist_region(struct stager *s, uint32_t slot, uint64_t len)
+{
+    struct region *r = &s->regions[slot];
+    char *base = s->staging + (size_t)slot * s->region_size;
+    uint64_t file_off = r->seq * s->region_size;
+    // O_DIRECT needs block-multiple lengths; the tail is trimmed with ftruncate at the end.
+    uint64_t aligned = (len + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    r->state = REGION_PERSISTING;
+    r->ios_pending = 0;
+    for (uint64_t off = 0; off < aligned; off += s->io_size)
+    {
+        uint64_t n = aligned - off < s->io_size ? aligned - off : s->io_size;
+        struct io_uring_sqe *sqe = get_sqe(s);
+        if (!sqe)
+            return -1;
+        uring_prep_write_fixed(sqe, s->fd, base + off, (unsigned)n, file_off + off, slot,
+                               ((uint64_t)slot << 32) | (uint32_t)(off / s->io_size));
+        r->ios_pending++;
+        io_started(s, now_sec());
+    }
+    int rc = uring_submit(&s->ring, 0);
+    if (rc < 0)
+    {
+        LOG_ERR("io_uring_enter: %s", strerror(-rc));
+        return -1;
+    }
+    return 0;
+}
+
+static int start_fsync(struct stager *s)
+{
+    struct io_uring_sqe *sqe = get_sqe(s);
+    if (!sqe)
+        return -1;
+    uring_prep_fsync(sqe, s->fd, FSYNC_USER_DATA);
+    s->fsync_pending = 1;
+    s->fsync_start = now_sec();
+    return uring_submit(&s->ring, 0) < 0 ? -1 : 0;
+}
+
+static int advance_credit(struct stager *s)
+{
+    for (;;)
+    {
+        struct region *r = &s->regions[s->credit % s->nregions];
+        if (r->state != REGION_PERSISTED || r->seq != s->credit)
+            break;
+        r->state = REGION_FREE;
+        s->credit++;
+    }
+    if (s->done_received && s->credit == s->total_regions && !s->fsync_pending && !s->finished)
+    {
+        s->t_persist_end = now_sec();
+        if (start_fsync(s))
+            return -1;
+    }
+    return send_credit(s);
+}
+
+static int handle_uring_cqe(struct stager *s, struct io_uring_cqe *cqe)
+{
+    uint64_t ud = cqe->user_data;
+    int res = cqe->res;
+    uring_cqe_seen(&s->ring);
+    double now = now_sec();
+    if (res < 0)
+    {
+        LOG_ERR("%s failed: %s", ud == FSYNC_USER_DATA ? "fsync" : "write", strerror(-res));
+        return -1;
+    }
+    if (ud == FSYNC_USER_DATA)
+    {
+        s->fsync_pending = 0;
+        s->fsync_secs = now - s->fsync_start;
+        s->finished = 1;
+        return send_credit(s);
+    }
+    io_finished(s, now);
+    s->persisted += (uint64_t)res;
+    struct region *r = &s->regions[ud >> 32];
+    if (--r->ios_pending == 0)
+    {
+        r->state = REGION_PERSISTED;
+        return advance_credit(s);
+    }
+    return 0;
+}
+
+static int region_complete(struct stager *s, uint32_t slot)
+{
+    struct region *r = &s->regions[slot];
+    if (r->state != REGION_FILLING)
+        return 0;
+    if (r->filled == s->region_size)
+        return persist_region(s, slot, r->filled);
+    // A partial region is only complete once DONE says it is the last one.
+    if (s->done_received && r->seq + 1 == s->total_regions && r->filled == s->total - r->seq * s->region_size)
+        return persist_region(s, slot, r->filled);
+    return 0;
+}
+
+static int handle_wc(struct stager *s, const struct ibv_wc *wc)
+{
+    if (wc->status != IBV_WC_SUCCESS)
+    {
+        LOG_ERR("CQE error: %s (opcode=%s)", ibv_wc_status_str(wc->status), wc_opcode_str(wc->opcode));
+        return -1;
+    }
+    if (wc->opcode == IBV_WC_SEND)
+    {
+        s->tx_inflight--;
+        return send_credit(s);
+    }
+    struct ckpt_msg *rx = (struct ckpt_msg *)s->c.buf_rx + wc->wr_id;
+    int rc = 0;
+    if (wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM)
+    {
+        uint64_t seq = ntohl(wc->imm_data);
+        uint32_t slot = (uint32_t)(seq % s->nregions);
+        struct region *r = &s->regions[slot];
+        if (r->state == REGION_FREE)
+        {
+            r->state = REGION_FILLING;
+            r->seq = seq;
+            r->filled = 0;
+        }
+        else if (r->state != REGION_FILLING || r->seq != seq)
+        {
+            LOG_ERR("client overran credits: region seq=%" PRIu64 " hits slot %u busy with seq=%" PRIu64, seq, slot,
+                    r->seq);
+            return -1;
+        }
+        if (s->ingested == 0)
+            s->t_first_data = now_sec();
+        r->filled += wc->byte_len;
+        s->ingested += wc->byte_len;
+        rc = region_complete(s, slot);
+    }
+    else if (wc->opcode == IBV_WC_RECV && rx->type == CKPT_MSG_DONE)
+    {
+        // RC delivers RECV completions in order, so every chunk of the shard has been counted.
+        s->t_done = now_sec();
+        s->done_received = 1;
+        s->total = rx->value;
+        s->total_regions = (s->total + s->region_size - 1) / s->region_size;
+        if (s->total_regions)
+            rc = region_complete(s, (uint32_t)((s->total_regions - 1) % s->nregions));
+        if (!rc)
+            rc = advance_credit(s);
+    }
+    if (rc)
+        return rc;
+    if (post_recv(s->c.qp, s->c.mr_rx, rx, sizeof(*rx), wc->wr_id))
+        return err_errno("ibv_post_recv");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <port> <out-file> [region-size] [regions] [io-size]\n", argv[0]);
+        return 1;
+    }
+    const char *port = argv[1];
+    const char *path = argv[2];
+    struct stager s = {0};
+    s.fd = -1;
+    s.region_size = parse_size_bytes((argc >= 4) ? argv[3] : "64M");
+    s.nregions = (argc >= 5) ? (uint32_t)strtoul(argv[4], NULL, 10) : 4;
+    s.io_size = parse_size_bytes((argc >= 6) ? argv[5] : "1M");
+    const char *bind_ip = getenv("RDMA_BIND_IP");
+    const char *no_direct = getenv("CKPT_NO_DIRECT");
+    if (s.region_size == 0 || s.region_size % DIRECT_ALIGN || s.region_size > (1ULL << 30) || s.nregions < 2 ||
+        s.nregions > MAX_REGIONS || s.io_size == 0 || s.io_size % DIRECT_ALIGN)
+    {
+        fprintf(stderr, "region-size must be a 4K multiple <= 1G, regions 2..%d, io-size a 4K multiple\n",
+                MAX_REGIONS);
+        return 1;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (!(no_direct && *no_direct))
+        flags |= O_DIRECT;
+    s.fd = open(path, flags, 0644);
+    if (s.fd < 0 && (flags & O_DIRECT) && errno == EINVAL)
+    {
+        LOGF("SLOW", "O_DIRECT unsupported on %s; falling back to buffered writes", path);
+        s.fd = open(path, flags & ~O_DIRECT, 0644);
+    }
+    if (s.fd < 0)
+    {
+        err_errno("open output");
+        return 1;
+    }
+
+    // Enough SQ entries for every region's I/O units to be in flight at once.
+    uint64_t units = (s.region_size + s.io_size - 1) / s.io_size * s.nregions + 1;
+    unsigned entries = 8;
+    while (entries < units && entries < 4096)
+        entries <<= 1;
+    int rc = uring_init(&s.ring, entries, 0, 0);
+    if (rc)
+    {
+        LOG_ERR("io_uring_setup: %s", strerror(-rc));
+        err = 1;
+        goto cleanup;
+    }
+    s.ring_ok = 1;
+
+    LOGF("SLOW", "create CM channel + listen");
+    if (cm_create_channel_and_id(&s.c) || cm_server_listen(&s.c, bind_ip, port))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    struct rdma_cm_event *ev = NULL;
+    LOGF("SLOW", "wait CONNECT_REQUEST");
+    if (cm_wait_event(&s.c, RDMA_CM_EVENT_CONNECT_REQUEST, &ev))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    s.c.id = ev->id;
+    rdma_ack_cm_event(ev);
+
+    LOGF("SLOW", "build PD/CQ/QP");
+    if (build_pd_cq_qp(&s.c, IBV_QPT_RC, RECV_DEPTH + TX_SLOTS + 16, TX_SLOTS + 4, RECV_DEPTH, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    uint64_t staging_len = s.region_size * s.nregions;
+    LOGF("SLOW", "register %u staging regions x %" PRIu64 " bytes", s.nregions, s.region_size);
+    if (alloc_and_reg(&s.c, &s.c.buf_remote, &s.c.mr_remote, (size_t)staging_len,
+                      IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    s.staging = s.c.buf_remote;
+    // The same pinned regions double as io_uring fixed buffers: one iovec per region.
+    struct iovec iov[MAX_REGIONS];
+    for (uint32_t i = 0; i < s.nregions; i++)
+    {
+        iov[i].iov_base = s.staging + (size_t)i * s.region_size;
+        iov[i].iov_len = (size_t)s.region_size;
+    }
+    rc = uring_register_buffers(&s.ring, iov, s.nregions);
+    if (rc)
+    {
+        LOG_ERR("io_uring register buffers: %s", strerror(-rc));
+        err = 1;
+        goto cleanup;
+    }
+    if (alloc_and_reg(&s.c, &s.c.buf_rx, &s.c.mr_rx, RECV_DEPTH * sizeof(struct ckpt_msg), IBV_ACCESS_LOCAL_WRITE) ||
+        alloc_and_reg(&s.c, &s.c.buf_tx, &s.c.mr_tx, TX_SLOTS * sizeof(struct ckpt_msg), IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < RECV_DEPTH; i++)
+    {
+        if (post_recv(s.c.qp, s.c.mr_rx, (struct ckpt_msg *)s.c.buf_rx + i, sizeof(struct ckpt_msg), (uint64_t)i))
+        {
+            err_errno("ibv_post_recv");
+            err = 1;
+            goto cleanup;
+        }
+    }
+
+    struct ckpt_info info = pack_ckpt_info((uintptr_t)s.staging, s.c.mr_remote->rkey, s.nregions, s.region_size);
+    LOGF("SLOW", "accept with staging info");
+    if (cm_server_accept_with_priv(&s.c, &info, sizeof(info)))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (cm_wait_event(&s.c, RDMA_CM_EVENT_ESTABLISHED, &ev))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    rdma_ack_cm_event(ev);
+    printf("Checkpoint stager: %u regions x %" PRIu64 " bytes -> %s (%s)\n", s.nregions, s.region_size, path,
+           (fcntl(s.fd, F_GETFL) & O_DIRECT) ? "O_DIRECT" : "buffered");
+    fflush(stdout);
+
+    LOGF("FAST", "stage + persist loop");
+    while (!s.finished || s.sent_credit != s.credit)
+    {
+        struct ibv_wc wcs[16];
+        int n = ibv_poll_cq(s.c.cq, 16, wcs);
+        if (n < 0)
+        {
+            LOG_ERR("ibv_poll_cq failed");
+            err = 1;
+            goto cleanup;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (handle_wc(&s, &wcs[i]))
+            {
+                err = 1;
+                goto cleanup;
+            }
+        }
+        struct io_uring_cqe *cqe = NULL;
+        while (uring_peek_cqe(&s.ring, &cqe) == 0)
+        {
+            if (handle_uring_cqe(&s, cqe))
+            {
+                err = 1;
+                goto cleanup;
+            }
+        }
+    }
+    if (ftruncate(s.fd, (off_t)s.total))
+        err_errno("ftruncate");
+
+    double ingest_secs = s.t_done - s.t_first_data;
+    double persist_wall = s.t_persist_end - s.t_first_data;
+    double mib = (double)s.total / (1024.0 * 1024.0);
+    printf("Ingest : %" PRIu64 " bytes in %.3f s (%.2f MiB/s)\n", s.ingested, ingest_secs,
+           ingest_secs > 0 ? mib / ingest_secs : 0.0);
+    printf("Persist: %" PRIu64 " bytes, disk busy %.3f s (%.2f MiB/s while busy), fsync %.3f s\n", s.persisted,
+           s.persist_busy, s.persist_busy > 0 ? (double)s.persisted / (1024.0 * 1024.0) / s.persist_busy : 0.0,
+           s.fsync_secs);
+    printf("Staged : end-to-end %.3f s (%.2f MiB/s), persist tail after ingest %.3f s; limited by %s\n",
+           persist_wall + s.fsync_secs, mib / (persist_wall + s.fsync_secs), s.t_persist_end - s.t_done,
+           s.persist_busy > ingest_secs ? "persist" : "ingest");
+
+    // Wait for the client to hang up after it saw the final credit.
+    while (rdma_get_cm_event(s.c.ec, &ev) == 0)
+    {
+        enum rdma_cm_event_type type = ev->event;
+        rdma_ack_cm_event(ev);
+        if (type == RDMA_CM_EVENT_DISCONNECTED)
+            break;
+    }
+
+cleanup:
+    if (s.ring_ok)
+        uring_exit(&s.ring);
+    if (s.fd >= 0)
+        close(s.fd);
+    mem_free_all(&s.c);
+    if (s.c.mr_remote)
+        free(s.c.buf_remote);
+    destroy_qp(&s.c);
+    if (s.c.cq)
+        cq_ts_destroy(s.c.cq);
+    if (s.c.pd)
+        ibv_dealloc_pd(s.c.pd);
+    if (s.c.id)
+        rdma_destroy_id(s.c.id);
+    if (s.c.ec)
+        rdma_destroy_event_channel(s.c.ec);
+    return err;
+}
@@ -0,0 +1,173 @@
+/**
+ * CM fan-out client: bring up N RC connections through the event-driven dispatcher, keeping up
+ * to `window` handshakes in flight (window=1 is the serial baseline), then tear them all down.
+ * Reports total bring-up time, connections per second and the per-connection setup latency.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cm_dispatch.h"
+#include "common.h"
+#include "rdma_builders.h"
+
+#define DEFAULT_PORT "7478"
+
+struct fanout;
+
+struct fanout_slot
+{
+    struct fanout *f;
+    double t_start;
+};
+
+struct fanout
+{
+    struct cm_dispatcher d;
+    const char *ip, *port, *src_ip;
+    int total, window;
+    int started, inflight, established, failed, disconnected;
+    struct fanout_slot *slots;
+    double *setup_ms;
+};
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Keep `window` handshakes in flight until every connection has been started.
+static void start_more(struct fanout *f)
+{
+    while (f->inflight < f->window && f->started < f->total)
+    {
+        struct fanout_slot *s = &f->slots[f->started++];
+        s->f = f;
+        s->t_start = now_sec();
+        if (cm_dispatch_connect(&f->d, f->ip, f->port, f->src_ip, s))
+            f->inflight++;
+        else
+            f->failed++;
+    }
+}
+
+static int on_route_resolved(struct cm_conn *c, struct rdma_conn_param *param)
+{
+    (void)param;
+    return build_pd_cq_qp(&c->ctx, IBV_QPT_RC, 16, 8, 8, 1);
+}
+
+static void on_established(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    (void)ev;
+    struct fanout_slot *s = c->user;
+    struct fanout *f = s->f;
+    f->setup_ms[f->established++] = (now_sec() - s->t_start) * 1e3;
+    f->inflight--;
+    start_more(f);
+}
+
+static void on_disconnected(struct cm_conn *c)
+{
+    struct fanout_slot *s = c->user;
+    s->f->disconnected++;
+    cm_conn_destroy(c);
+}
+
+static void on_error(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    struct fanout_slot *s = c->user;
+    struct fanout *f = s->f;
+    LOG_ERR("connection %td failed: %s status=%d", s - f->slots, rdma_event_str(ev->event), ev->status);
+    f->failed++;
+    f->inflight--;
+    cm_conn_destroy(c);
+    start_more(f);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <server_ip> [port] [connections] [window]\n", argv[0]);
+        return 1;
+    }
+    struct fanout f = {.ip = argv[1],
+                       .port = (argc >= 3) ? argv[2] : DEFAULT_PORT,
+                       .src_ip = getenv("RDMA_SRC_IP"),
+                       .total = (argc >= 4) ? atoi(argv[3]) : 64};
+    f.window = (argc >= 5) ? atoi(argv[4]) : f.total;
+    if (f.total < 1 || f.window < 1)
+    {
+        fprintf(stderr, "connections and window must be >= 1\n");
+        return 1;
+    }
+    int err = 0;
+    struct cm_callbacks cb = {.on_route_resolved = on_route_resolved,
+                              .on_established = on_established,
+                              .on_disconnected = on_disconnected,
+                              .on_error = on_error};
+    f.slots = calloc((size_t)f.total, sizeof(*f.slots));
+    f.setup_ms = calloc((size_t)f.total, sizeof(*f.setup_ms));
+    if (cm_dispatch_init(&f.d, &cb) || !f.slots || !f.setup_ms)
+    {
+        err = 1;
+        goto cleanup;
+    }
+
+    double t0 = now_sec();
+    start_more(&f);
+    while (f.established + f.failed < f.total)
+    {
+        if (cm_dispatch_run(&f.d, 1000) < 0)
+        {
+            err = 1;
+            goto cleanup;
+        }
+    }
+    double up = now_sec() - t0;
+
+    double t1 = now_sec();
+    for (struct cm_conn *c = f.d.conns; c; c = c->next)
+    {
+        if (c->state == CM_ST_ESTABLISHED)
+            rdma_disconnect(c->ctx.id);
+    }
+    while (f.d.live > 0)
+    {
+        if (cm_dispatch_run(&f.d, 1000) < 0)
+        {
+            err = 1;
+            goto cleanup;
+        }
+    }
+    double down = now_sec() - t1;
+
+    printf("connections=%d window=%d established=%d failed=%d\n", f.total, f.window, f.established, f.failed);
+    printf("bring-up %.3f s (%.0f conn/s), teardown %.3f s, CM events %" PRIu64 " (ignored %" PRIu64 ")\n", up,
+           (double)f.established / up, down, f.d.events, f.d.ignored);
+    if (f.established)
+    {
+        qsort(f.setup_ms, (size_t)f.established, sizeof(double), cmp_double);
+        printf("per-connection setup ms: p50=%.2f p99=%.2f max=%.2f\n", f.setup_ms[f.established / 2],
+               f.setup_ms[(int)(0.99 * (f.established - 1))], f.setup_ms[f.established - 1]);
+    }
+    if (f.failed)
+        err = 1;
+
+cleanup:
+    cm_dispatch_destroy(&f.d);
+    free(f.slots);
+    free(f.setup_ms);
+    return err;
+}
@@ -0,0 +1,187 @@
+/**
+ * CM fan-out server: accept any number of concurrent connection requests with the event-driven
+ * dispatcher. Each accepted connection gets a small RC QP and is torn down when the peer leaves.
+ *
+ * RDMA_POOL=<n> serves accepts from a pool of n pre-created QPs (rdma_pool.h) instead. The pool is
+ * built on the device of the first request, and a departing connection returns its QP to it.
+ * RDMA_METRICS_PORT=<port> serves connection and pool counters to Prometheus on localhost.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cm_dispatch.h"
+#include "common.h"
+#include "metrics_http.h"
+#include "rdma_builders.h"
+#include "rdma_pool.h"
+
+#define DEFAULT_PORT "7478"
+
+// Written on the dispatcher thread with relaxed atomics; fanout_metrics reads them on the exporter thread.
+struct fanout_stats
+{
+    uint64_t accepted, established, disconnected, failed;
+    int pool_n;     // RDMA_POOL; 0 = build per connection
+    int pool_ready; // set with release ordering once rdma_pool_init is done; the exporter reads pool only then
+    struct rdma_pool pool;
+};
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static int on_connect_request(struct cm_conn *c, const struct cm_event_info *ev, struct rdma_conn_param *param)
+{
+    (void)ev;
+    (void)param;
+    struct fanout_stats *st = c->user;
+    if (st->pool_n && !st->pool.pd)
+    {
+        if (rdma_pool_init(&st->pool, c->ctx.id->verbs, st->pool_n, 16, 8, 8, 0, 0))
+        {
+            rdma_pool_destroy(&st->pool);
+            __atomic_store_n(&st->pool_n, 0, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            __atomic_store_n(&st->pool_ready, 1, __ATOMIC_RELEASE);
+            printf("pool: %d QPs pre-created\n", st->pool_n);
+        }
+    }
+    if (!(st->pool.pd && rdma_pool_acquire(&st->pool, &c->ctx)) &&
+        build_pd_cq_qp(&c->ctx, IBV_QPT_RC, 16, 8, 8, 1))
+        return -1;
+    __atomic_fetch_add(&st->accepted, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void on_established(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    (void)ev;
+    struct fanout_stats *st = c->user;
+    __atomic_fetch_add(&st->established, 1, __ATOMIC_RELAXED);
+}
+
+static void on_disconnected(struct cm_conn *c)
+{
+    struct fanout_stats *st = c->user;
+    __atomic_fetch_add(&st->disconnected, 1, __ATOMIC_RELAXED);
+    rdma_pool_release(&st->pool, &c->ctx);
+    cm_conn_destroy(c);
+}
+
+static void on_error(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    (void)ev;
+    struct fanout_stats *st = c->user;
+    __atomic_fetch_add(&st->failed, 1, __ATOMIC_RELAXED);
+    if (c->state != CM_ST_LISTENING)
+    {
+        rdma_pool_release(&st->pool, &c->ctx);
+        cm_conn_destroy(c);
+    }
+}
+
+// Prometheus section; runs on the exporter thread while the dispatcher updates the counters.
+struct fanout_metrics
+{
+    const struct fanout_stats *st;
+    const struct cm_dispatcher *d;
+};
+
+static void fanout_metrics(FILE *out, void *arg)
+{
+    const struct fanout_metrics *m = arg;
+    const struct fanout_stats *st = m->st;
+    metrics_family(out, "rdma_fanout_connections", "gauge", "Connections currently open.");
+    fprintf(out, "rdma_fanout_connections %d\n", __atomic_load_n(&m->d->live, __ATOMIC_RELAXED) - 1);
+    metrics_family(out, "rdma_fanout_connection_events_total", "counter", "Connection lifecycle events.");
+    fprintf(out, "rdma_fanout_connection_events_total{event=\"accepted\"} %" PRIu64 "\n", metrics_u64(&st->accepted));
+    fprintf(out, "rdma_fanout_connection_events_total{event=\"established\"} %" PRIu64 "\n",
+            metrics_u64(&st->established));
+    fprintf(out, "rdma_fanout_connection_events_total{event=\"disconnected\"} %" PRIu64 "\n",
+            metrics_u64(&st->disconnected));
+    fprintf(out, "rdma_fanout_connection_events_total{event=\"failed\"} %" PRIu64 "\n", metrics_u64(&st->failed));
+    // The pool is this server's MR cache: each entry keeps its buffer registered across connections.
+    metrics_family(out, "rdma_pool_entries", "gauge", "Pre-created QP + registered buffer entries.");
+    fprintf(out, "rdma_pool_entries %d\n", __atomic_load_n(&st->pool_n, __ATOMIC_RELAXED));
+    int ready = __atomic_load_n(&st->pool_ready, __ATOMIC_ACQUIRE);
+    metrics_family(out, "rdma_pool_requests_total", "counter", "Pool acquisitions by result, and releases.");
+    fprintf(out, "rdma_pool_requests_total{result=\"acquired\"} %" PRIu64 "\n",
+            ready ? metrics_u64(&st->pool.acquired) : 0);
+    fprintf(out, "rdma_pool_requests_total{result=\"exhausted\"} %" PRIu64 "\n",
+            ready ? metrics_u64(&st->pool.exhausted) : 0);
+    fprintf(out, "rdma_pool_requests_total{result=\"released\"} %" PRIu64 "\n",
+            ready ? metrics_u64(&st->pool.released) : 0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = (argc >= 2) ? argv[1] : DEFAULT_PORT;
+    int backlog = (argc >= 3) ? atoi(argv[2]) : 1024;
+    struct fanout_stats st = {0};
+    const char *pool_env = getenv("RDMA_POOL");
+    st.pool_n = pool_env ? atoi(pool_env) : 0;
+    struct cm_callbacks cb = {.on_connect_request = on_connect_request,
+                              .on_established = on_established,
+                              .on_disconnected = on_disconnected,
+                              .on_error = on_error};
+    struct cm_dispatcher d;
+    int err = 0;
+    signal(SIGINT, on_sigint);
+    if (cm_dispatch_init(&d, &cb))
+    {
+        cm_dispatch_destroy(&d);
+        return 1;
+    }
+    struct fanout_metrics fm = {.st = &st, .d = &d};
+    if (metrics_http_start(NULL) || metrics_http_add(fanout_metrics, &fm))
+    {
+        cm_dispatch_destroy(&d);
+        return 1;
+    }
+    struct cm_conn *l = cm_dispatch_listen(&d, getenv("RDMA_BIND_IP"), port, backlog, &st);
+    if (!l)
+    {
+        metrics_http_stop();
+        cm_dispatch_destroy(&d);
+        return 1;
+    }
+    printf("CM fan-out server listening on %s (backlog %d, Ctrl-C to stop)\n", port, backlog);
+    fflush(stdout);
+    uint64_t last = 0;
+    while (!g_stop)
+    {
+        int n = cm_dispatch_run(&d, 200);
+        if (n < 0)
+        {
+            err = 1;
+            break;
+        }
+        // Report once a burst has settled rather than per event.
+        if (n == 0 && st.established + st.disconnected != last)
+        {
+            last = st.established + st.disconnected;
+            printf("accepted=%" PRIu64 " established=%" PRIu64 " disconnected=%" PRIu64 " failed=%" PRIu64
+                   " live=%d\n",
+                   st.accepted, st.established, st.disconnected, st.failed, d.live - 1);
+            fflush(stdout);
+        }
+    }
+    metrics_http_stop();
+    for (struct cm_conn *c = d.conns; c; c = c->next)
+        rdma_pool_release(&st.pool, &c->ctx);
+    cm_dispatch_destroy(&d);
+    if (st.pool.pd)
+        printf("pool: acquired=%" PRIu64 " released=%" PRIu64 " exhausted=%" PRIu64 "\n", st.pool.acquired,
+               st.pool.released, st.pool.exhausted);
+    rdma_pool_destroy(&st.pool);
+    return err;
+}
@@ -0,0 +1,328 @@
+/**
+ * Connection setup latency benchmark: open and tear down M RC connections, serially and with all
+ * handshakes in flight at once, and report the latency distribution of every phase:
+ *
+ *   resolve_addr   rdma_resolve_addr -> ADDR_RESOLVED (includes getaddrinfo)
+ *   resolve_route  rdma_resolve_route (or cached path injection) -> ROUTE_RESOLVED
+ *   build_qp       PD + CQ + QP (build_pd_cq_qp), or rdma_pool_acquire with RDMA_POOL set
+ *   reg_mr         allocate and register the connection's buffer (0 when it came from the pool)
+ *   connect        rdma_connect -> ESTABLISHED (REQ/REP/RTU and the server's accept work)
+ *   total          start -> ESTABLISHED
+ *   disconnect     rdma_disconnect -> DISCONNECTED
+ *   destroy        QP/CQ/PD/MR/id teardown
+ *
+ * Runs against cm_fanout_server, which accepts any number of concurrent connections.
+ *
+ * RDMA_POOL=<n> pre-creates n {CQ, QP, registered buffer} entries on the server's device before
+ * the first run (rdma_pool.h). Connections take an entry and give it back on disconnect, so
+ * the parallel run reuses the QPs the serial run released.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../rdma-bulk/rdma_bulk_common.h"
+#include "cm_dispatch.h"
+#include "cm_resolve_cache.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_mem.h"
+#include "rdma_pool.h"
+
+#define DEFAULT_PORT "7478"
+
+enum phase
+{
+    PH_ADDR,
+    PH_ROUTE,
+    PH_BUILD,
+    PH_REG,
+    PH_CONNECT,
+    PH_TOTAL,
+    PH_DISCONNECT,
+    PH_DESTROY,
+    PH_N
+};
+
+static const char *phase_names[PH_N] = {"resolve_addr", "resolve_route", "build_qp", "reg_mr",
+                                        "connect",      "total",         "disconnect", "destroy"};
+
+struct bench;
+
+struct bench_slot
+{
+    struct bench *b;
+    double ms[PH_N];
+    double t_disconnect;
+    int established, pooled;
+};
+
+struct bench
+{
+    struct cm_dispatcher d;
+    const char *ip, *port, *src_ip;
+    uint64_t mr_size;
+    int total, window;
+    int started, inflight, established, failed, down;
+    struct bench_slot *slots;
+    struct rdma_pool *pool; // NULL unless RDMA_POOL is set
+};
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void start_more(struct bench *b)
+{
+    while (b->inflight < b->window && b->started < b->total)
+    {
+        struct bench_slot *s = &b->slots[b->started++];
+        s->b = b;
+        if (cm_dispatch_connect(&b->d, b->ip, b->port, b->src_ip, s))
+            b->inflight++;
+        else
+            b->failed++;
+    }
+}
+
+static int on_route_resolved(struct cm_conn *c, struct rdma_conn_param *param)
+{
+    (void)param;
+    struct bench_slot *s = c->user;
+    double t0 = now_sec();
+    if (s->b->pool && rdma_pool_acquire(s->b->pool, &c->ctx))
+    {
+        s->ms[PH_BUILD] = (now_sec() - t0) * 1e3;
+        s->ms[PH_REG] = 0.0; // pre-registered
+        s->pooled = 1;
+        return 0;
+    }
+    if (build_pd_cq_qp(&c->ctx, IBV_QPT_RC, 16, 8, 8, 1))
+        return -1;
+    double t1 = now_sec();
+    if (alloc_and_reg(&c->ctx, &c->ctx.buf_rx, &c->ctx.mr_rx, (size_t)s->b->mr_size,
+                      IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ))
+        return -1;
+    s->ms[PH_BUILD] = (t1 - t0) * 1e3;
+    s->ms[PH_REG] = (now_sec() - t1) * 1e3;
+    return 0;
+}
+
+static void on_established(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    (void)ev;
+    struct bench_slot *s = c->user;
+    struct bench *b = s->b;
+    s->ms[PH_ADDR] = (c->t_addr_resolved - c->t_start) * 1e3;
+    s->ms[PH_ROUTE] = (c->t_route_resolved - c->t_addr_resolved) * 1e3;
+    s->ms[PH_CONNECT] = (c->t_established - c->t_connect) * 1e3;
+    s->ms[PH_TOTAL] = (c->t_established - c->t_start) * 1e3;
+    s->established = 1;
+    b->established++;
+    b->inflight--;
+    start_more(b);
+}
+
+static void on_disconnected(struct cm_conn *c)
+{
+    struct bench_slot *s = c->user;
+    s->ms[PH_DISCONNECT] = (c->t_disconnected - s->t_disconnect) * 1e3;
+    double t0 = now_sec();
+    if (s->b->pool)
+        rdma_pool_release(s->b->pool, &c->ctx);
+    cm_conn_destroy(c);
+    s->ms[PH_DESTROY] = (now_sec() - t0) * 1e3;
+    s->b->down++;
+}
+
+static void on_error(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    struct bench_slot *s = c->user;
+    struct bench *b = s->b;
+    LOG_ERR("connection %td failed in setup: %s status=%d", s - b->slots, rdma_event_str(ev->event), ev->status);
+    b->failed++;
+    b->inflight--;
+    if (b->pool)
+        rdma_pool_release(b->pool, &c->ctx);
+    cm_conn_destroy(c);
+    start_more(b);
+}
+
+static void report(const struct bench *b, double up, double down)
+{
+    printf("\nwindow=%d connections=%d established=%d failed=%d mr=%" PRIu64 "B\n", b->window, b->total,
+           b->established, b->failed, b->mr_size);
+    printf("  bring-up %.3f s (%.0f conn/s), teardown %.3f s\n", up, up > 0.0 ? (double)b->established / up : 0.0,
+           down);
+    if (b->pool)
+    {
+        int pooled = 0;
+        for (int i = 0; i < b->total; i++)
+            pooled += b->slots[i].pooled;
+        printf("  pool: %d of %d connections used pooled resources\n", pooled, b->total);
+    }
+    if (!b->established)
+        return;
+    printf("  %-14s %9s %9s %9s %9s %9s\n", "phase", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms");
+    double *v = malloc((size_t)b->established * sizeof(double));
+    if (!v)
+        return;
+    for (int p = 0; p < PH_N; p++)
+    {
+        int n = 0;
+        double sum = 0.0;
+        for (int i = 0; i < b->total; i++)
+        {
+            if (b->slots[i].established)
+            {
+                v[n] = b->slots[i].ms[p];
+                sum += v[n++];
+            }
+        }
+        qsort(v, (size_t)n, sizeof(double), cmp_double);
+        printf("  %-14s %9.3f %9.3f %9.3f %9.3f %9.3f\n", phase_names[p], sum / n, v[n / 2],
+               v[(int)(0.90 * (n - 1))], v[(int)(0.99 * (n - 1))], v[n - 1]);
+    }
+    free(v);
+}
+
+// One pass: bring up `total` connections with `window` handshakes in flight, then tear them down
+// with the same concurrency (window=1 disconnects one at a time).
+static int run(struct bench *b)
+{
+    struct cm_callbacks cb = {.on_route_resolved = on_route_resolved,
+                              .on_established = on_established,
+                              .on_disconnected = on_disconnected,
+                              .on_error = on_error};
+    int err = 0;
+    b->slots = calloc((size_t)b->total, sizeof(*b->slots));
+    if (cm_dispatch_init(&b->d, &cb) || !b->slots)
+    {
+        err = 1;
+        goto out;
+    }
+    double t0 = now_sec();
+    start_more(b);
+    while (b->established + b->failed < b->total)
+    {
+        if (cm_dispatch_run(&b->d, 1000) < 0)
+        {
+            err = 1;
+            goto out;
+        }
+    }
+    double up = now_sec() - t0;
+
+    double t1 = now_sec();
+    int issued = 0;
+    while (b->d.live > 0)
+    {
+        for (struct cm_conn *c = b->d.conns; c && issued - b->down < b->window; c = c->next)
+        {
+            struct bench_slot *s = c->user;
+            if (c->state == CM_ST_ESTABLISHED && s->t_disconnect == 0.0)
+            {
+                s->t_disconnect = now_sec();
+                rdma_disconnect(c->ctx.id);
+                issued++;
+            }
+        }
+        if (cm_dispatch_run(&b->d, 1000) < 0)
+        {
+            err = 1;
+            goto out;
+        }
+    }
+    report(b, up, now_sec() - t1);
+    if (b->failed)
+        err = 1;
+
+out:
+    for (struct cm_conn *c = b->d.conns; c && b->pool; c = c->next)
+        rdma_pool_release(b->pool, &c->ctx); // leftovers on error: keep pooled QPs out of cm_conn_destroy
+    cm_dispatch_destroy(&b->d);
+    free(b->slots);
+    b->slots = NULL;
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <server_ip> [port] [connections] [mr-size] [window]\n", argv[0]);
+        fprintf(stderr, "  without a window, runs serial (1) and then parallel (= connections)\n");
+        return 1;
+    }
+    struct bench proto = {.ip = argv[1],
+                          .port = (argc >= 3) ? argv[2] : DEFAULT_PORT,
+                          .src_ip = getenv("RDMA_SRC_IP"),
+                          .total = (argc >= 4) ? atoi(argv[3]) : 64,
+                          .mr_size = (argc >= 5) ? parse_size_bytes(argv[4]) : 64 * 1024};
+    int window = (argc >= 6) ? atoi(argv[5]) : 0;
+    if (proto.total < 1 || proto.mr_size == 0 || window < 0)
+    {
+        fprintf(stderr, "connections and mr-size must be > 0\n");
+        return 1;
+    }
+    int windows[2] = {window ? window : 1, proto.total};
+    int err = 0;
+    // The pool must live on the device the connections resolve to: resolve once up front and keep
+    // that id until the pool is gone.
+    rdma_ctx warm = {0};
+    struct rdma_pool pool = {0};
+    const char *pool_env = getenv("RDMA_POOL");
+    int pool_n = pool_env ? atoi(pool_env) : 0;
+    if (pool_n > 0)
+    {
+        if (cm_create_channel_and_id(&warm) || cm_client_resolve(&warm, proto.ip, proto.port, proto.src_ip))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        double t0 = now_sec();
+        if (rdma_pool_init(&pool, warm.id->verbs, pool_n, 16, 8, 8, (size_t)proto.mr_size,
+                           IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        printf("pool: %d entries x %" PRIu64 "B pre-warmed in %.3f ms\n", pool_n, proto.mr_size,
+               (now_sec() - t0) * 1e3);
+        proto.pool = &pool;
+    }
+    for (int i = 0; i < (window ? 1 : 2); i++)
+    {
+        struct bench b = proto;
+        b.window = windows[i];
+        err |= run(&b);
+    }
+    const struct cm_rcache_stats *rs = cm_rcache_stats();
+    printf("resolve cache: hits=%" PRIu64 " misses=%" PRIu64 " paths_injected=%" PRIu64 " path_fallbacks=%" PRIu64
+           " invalidations=%" PRIu64 "\n",
+           rs->hits, rs->misses, rs->paths_injected, rs->path_fallbacks, rs->invalidations);
+    if (proto.pool)
+        printf("pool: acquired=%" PRIu64 " released=%" PRIu64 " exhausted=%" PRIu64 "\n", pool.acquired,
+               pool.released, pool.exhausted);
+
+cleanup:
+    rdma_pool_destroy(&pool);
+    if (warm.id)
+        rdma_destroy_id(warm.id);
+    if (warm.ec)
+        rdma_destroy_event_channel(warm.ec);
+    return err;
+}
@@ -124,10 +124,9 @@ int main(int argc, char **argv)
 
 cleanup:
     mem_free_all(&c);
-    if (c.qp)
-        rdma_destroy_qp(c.id);
+    destroy_qp(&c);
     if (c.cq)
-        ibv_destroy_cq(c.cq);
+        cq_ts_destroy(c.cq);
     if (c.pd)
         ibv_dealloc_pd(c.pd);
     if (c.id)
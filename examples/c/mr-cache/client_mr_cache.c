@@ -232,10 +232,9 @@ cleanup:
     if (cache_inited)
         mr_cache_cleanup(&cache);
     mem_free_all(&c);
-    if (c.qp)
-        rdma_destroy_qp(c.id);
+    destroy_qp(&c);
     if (c.cq)
-        ibv_destroy_cq(c.cq);
+        cq_ts_destroy(c.cq);
     if (c.pd)
         ibv_dealloc_pd(c.pd);
     if (c.id)
@@ -0,0 +1,170 @@
+/**
+ * Progress sampler thread for the bulk client (see bulk_progress.h).
+ */
+
+#include "bulk_progress.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+static double mono_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static uint64_t rd(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+// Gap and phase accounting, every tick; called with lock held.
+static void tick(struct bulk_progress *pg, double now)
+{
+    uint64_t cqes = rd(&pg->cqes), completed = rd(&pg->completed), wqes = rd(&pg->wqes);
+    int phase = __atomic_load_n(&pg->phase, __ATOMIC_RELAXED);
+    if (cqes != pg->tick_cqes || wqes <= completed)
+        pg->last_cqe = now; // moving, or idle between passes: neither is a stall
+    else if (now - pg->last_cqe > pg->pass.max_cqe_gap)
+        pg->pass.max_cqe_gap = now - pg->last_cqe;
+    pg->tick_cqes = cqes;
+    if (phase >= 0 && phase < BULK_PHASE_N)
+        pg->pass.phase_secs[phase] += now - pg->last_tick;
+    pg->last_tick = now;
+}
+
+static void sample(struct bulk_progress *pg, double now)
+{
+    uint64_t sent = rd(&pg->sent), wqes = rd(&pg->wqes), completed = rd(&pg->completed), cqes = rd(&pg->cqes);
+    // The counters are read one by one; completed may be newer than wqes.
+    uint64_t inflight = wqes > completed ? wqes - completed : 0;
+    double gap = now - pg->last_cqe;
+    double dt = now - pg->prev.t;
+    double mib_s = dt > 0 ? (double)(sent - pg->prev.sent) / (1024.0 * 1024.0) / dt : 0.0;
+    double wqe_s = dt > 0 ? (double)(wqes - pg->prev.wqes) / dt : 0.0;
+    double cqe_s = dt > 0 ? (double)(cqes - pg->prev.cqes) / dt : 0.0;
+    double mib = (double)sent / (1024.0 * 1024.0);
+
+    if (pg->log)
+    {
+        LOGF("DATA",
+             "progress sent=%" PRIu64 "B (%.2f MiB) inflight=%" PRIu64 " completed=%" PRIu64
+             " MiB/s=%.1f wqe/s=%.0f cqe/s=%.0f",
+             sent, mib, inflight, completed, mib_s, wqe_s, cqe_s);
+        if (inflight && gap > 2.0)
+            LOGF("DATA", "no CQE for %.1fs (likely retries/backoff)", gap);
+    }
+    if (pg->csv)
+    {
+        fprintf(pg->csv, "%.2f,%.3f,%" PRIu64 ",%" PRIu64 ",%.2f,%.2f,%.0f,%.0f\n", now - pg->start, mib, inflight,
+                completed, gap, mib_s, wqe_s, cqe_s);
+        fflush(pg->csv);
+    }
+    pg->prev.t = now;
+    pg->prev.sent = sent;
+    pg->prev.wqes = wqes;
+    pg->prev.cqes = cqes;
+}
+
+static void *sampler(void *arg)
+{
+    struct bulk_progress *pg = arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&pg->lock);
+    while (!pg->stop)
+    {
+        next.tv_nsec += BULK_PROGRESS_TICK_MS * 1000000L;
+        if (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        int rc = 0;
+        while (!pg->stop && rc != ETIMEDOUT)
+            rc = pthread_cond_timedwait(&pg->cond, &pg->lock, &next);
+        if (pg->stop)
+            break;
+        double now = mono_sec();
+        tick(pg, now);
+        if ((pg->log || pg->csv) && now >= pg->next_out)
+        {
+            pg->next_out += pg->interval_ms / 1000.0;
+            pthread_mutex_unlock(&pg->lock);
+            sample(pg, now);
+            pthread_mutex_lock(&pg->lock);
+        }
+    }
+    pthread_mutex_unlock(&pg->lock);
+    return NULL;
+}
+
+void bulk_progress_start(struct bulk_progress *pg, FILE *csv, int log, unsigned interval_ms)
+{
+    pg->csv = csv;
+    pg->log = log;
+    pg->interval_ms = interval_ms ? interval_ms : 1000;
+    pg->start = mono_sec();
+    pg->prev.t = pg->start;
+    pg->last_tick = pg->start;
+    pg->next_out = pg->start + pg->interval_ms / 1000.0;
+    pg->last_cqe = pg->start;
+    pg->prev.sent = rd(&pg->sent);
+    pg->prev.wqes = rd(&pg->wqes);
+    pg->prev.cqes = pg->tick_cqes = rd(&pg->cqes);
+    memset(&pg->pass, 0, sizeof(pg->pass));
+    if (csv)
+        fprintf(csv, "time_s,sent_mib,inflight,completed,cqe_gap_s,mib_s,wqe_s,cqe_s\n");
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&pg->cond, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_mutex_init(&pg->lock, NULL);
+    pg->stop = 0;
+    if (pthread_create(&pg->thread, NULL, sampler, pg))
+    {
+        LOG_ERR("progress sampler: pthread_create failed; no progress output or stall/phase times");
+        pthread_cond_destroy(&pg->cond);
+        pthread_mutex_destroy(&pg->lock);
+        return;
+    }
+    pg->running = 1;
+}
+
+void bulk_progress_stop(struct bulk_progress *pg)
+{
+    if (!pg->running)
+        return;
+    pthread_mutex_lock(&pg->lock);
+    pg->stop = 1;
+    pthread_cond_signal(&pg->cond);
+    pthread_mutex_unlock(&pg->lock);
+    pthread_join(pg->thread, NULL);
+    pg->running = 0;
+    double now = mono_sec();
+    tick(pg, now);
+    if (pg->log || pg->csv)
+        sample(pg, now); // the tail of the run, and the only row of one shorter than the interval
+    pthread_cond_destroy(&pg->cond);
+    pthread_mutex_destroy(&pg->lock);
+}
+
+void bulk_progress_take(struct bulk_progress *pg, struct bulk_pass_stats *out)
+{
+    if (!pg->running)
+    {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    pthread_mutex_lock(&pg->lock);
+    tick(pg, mono_sec()); // charge the partial tick before the split
+    *out = pg->pass;
+    memset(&pg->pass, 0, sizeof(pg->pass));
+    pthread_mutex_unlock(&pg->lock);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ * Progress sampling for the bulk client (RDMA_BULK_LOG / RDMA_BULK_CSV).
+ *
+ * The posting thread only bumps the counters below and stores which phase it is in (posting, waiting for a
+ * ring slot, computing CRCs): relaxed stores, no clock read, no formatting. A sampler thread wakes every
+ * BULK_PROGRESS_TICK_MS and does all the timing:
+ *  - the longest time the CQE count stood still while WRs were in flight (RC retransmit stalls);
+ *  - time per phase, by charging each tick to the phase the poster is in (a sampling profile: good to a
+ *    tick per phase change on average, so fine over a run, coarse for one shorter than a second);
+ *  - every RDMA_BULK_LOG_MS (default 1000), the log line and CSV row with the rates over the interval.
+ * The thread runs whether or not progress output is on, so the per-pass figures are always there, and
+ * turning output on does not change the loop it measures. Its CPU time is part of the run's cost: start it
+ * after cpu_cost_start(), whose perf counters only follow threads created later.
+ *
+ * CSV columns: time_s,sent_mib,inflight,completed,cqe_gap_s,mib_s,wqe_s,cqe_s
+ *   sent_mib/completed  totals since the sampler started (all passes of a session)
+ *   inflight            WRs posted and not yet covered by a completion
+ *   cqe_gap_s           time since the CQE count last moved with WRs in flight, to a tick (grows during
+ *                       RC retransmit stalls)
+ *   mib_s/wqe_s/cqe_s   bytes, WRs posted and CQEs reaped per second over the interval
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define BULK_PROGRESS_TICK_MS 10
+
+enum bulk_phase
+{
+    BULK_PHASE_RUN,       // posting, reaping, filling: everything not broken out below
+    BULK_PHASE_SLOT_WAIT, // reaping only because every ring slot is still owned by the NIC
+    BULK_PHASE_CRC,       // CRC32C of a chunk (integrity mode)
+    BULK_PHASE_N
+};
+
+// Sampler figures since the last bulk_progress_take().
+struct bulk_pass_stats
+{
+    double max_cqe_gap; // seconds, to a tick
+    double phase_secs[BULK_PHASE_N];
+};
+
+struct bulk_progress
+{
+    // Written by the posting thread only.
+    uint64_t sent;      // bytes posted
+    uint64_t wqes;      // WRs posted
+    uint64_t completed; // WRs retired by a CQE (a signaled CQE retires its unsignaled batch too)
+    uint64_t cqes;      // CQEs reaped
+    int phase;          // enum bulk_phase
+
+    // Sampler side.
+    FILE *csv;
+    int log;
+    unsigned interval_ms;
+    double start;
+    double last_tick, next_out;
+    uint64_t tick_cqes;
+    double last_cqe; // tick at which cqes last advanced, or nothing was in flight
+    struct bulk_pass_stats pass; // under lock
+    int running;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct
+    {
+        double t;
+        uint64_t sent, wqes, cqes;
+    } prev;
+};
+
+/* Start the sampler, and write the CSV header if csv is set. If the thread cannot start, every figure stays 0. */
+void bulk_progress_start(struct bulk_progress *pg, FILE *csv, int log, unsigned interval_ms);
+/* Write a last row and join the sampler. Safe when never started. */
+void bulk_progress_stop(struct bulk_progress *pg);
+/* Copy out the gap and phase times gathered since the previous call, and start over. */
+void bulk_progress_take(struct bulk_progress *pg, struct bulk_pass_stats *out);
+
+static inline void bulk_progress_phase(struct bulk_progress *pg, enum bulk_phase phase)
+{
+    __atomic_store_n(&pg->phase, (int)phase, __ATOMIC_RELAXED);
+}
+
+// Single writer: a relaxed load-add-store is a plain add, with no locked instruction on the data path.
+static inline void bulk_progress_bump(uint64_t *field, uint64_t n)
+{
+    __atomic_store_n(field, *field + n, __ATOMIC_RELAXED);
+}
+
+static inline void bulk_progress_posted(struct bulk_progress *pg, uint64_t bytes)
+{
+    bulk_progress_bump(&pg->sent, bytes);
+    bulk_progress_bump(&pg->wqes, 1);
+}
+
+/* One CQE that retires wrs WRs. */
+static inline void bulk_progress_cqe(struct bulk_progress *pg, uint64_t wrs)
+{
+    bulk_progress_bump(&pg->completed, wrs);
+    bulk_progress_bump(&pg->cqes, 1);
+}
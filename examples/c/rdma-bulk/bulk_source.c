@@ -0,0 +1,443 @@
+/**
+ * Payload sources for the bulk client (see bulk_source.h).
+ */
+
+#include "bulk_source.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+int bulk_source_parse_kind(const char *s, enum bulk_src_kind *kind)
+{
+    if (!s || !*s || strcmp(s, "mmap") == 0)
+        *kind = BULK_SRC_MMAP;
+    else if (strcmp(s, "pread") == 0)
+        *kind = BULK_SRC_PREAD;
+    else if (strcmp(s, "uring") == 0)
+        *kind = BULK_SRC_URING;
+    else if (strcmp(s, "fill") == 0)
+        *kind = BULK_SRC_FILL;
+    else
+        return -1;
+    return 0;
+}
+
+int bulk_source_parse_produce(const char *s, enum bulk_produce_mode *mode)
+{
+    if (!s || !*s || strcmp(s, "copy") == 0)
+        *mode = BULK_PRODUCE_COPY;
+    else if (strcmp(s, "pattern") == 0)
+        *mode = BULK_PRODUCE_PATTERN;
+    else
+        return -1;
+    return 0;
+}
+
+const char *bulk_source_kind_str(enum bulk_src_kind kind)
+{
+    switch (kind)
+    {
+    case BULK_SRC_FILL:
+        return "fill";
+    case BULK_SRC_MMAP:
+        return "mmap";
+    case BULK_SRC_PREAD:
+        return "pread";
+    case BULK_SRC_URING:
+        return "uring";
+    case BULK_SRC_PRODUCE:
+        return "produce";
+    }
+    return "?";
+}
+
+static struct bulk_slot *slot_for(struct bulk_source *s, uint64_t off)
+{
+    return &s->slots[(off / s->chunk) % s->nslots];
+}
+
+static char *slot_buf(struct bulk_source *s, const struct bulk_slot *slot)
+{
+    return s->ring + (size_t)(slot - s->slots) * s->chunk;
+}
+
+static uint64_t chunk_len(const struct bulk_source *s, uint64_t off)
+{
+    return s->size - off < s->chunk ? s->size - off : s->chunk;
+}
+
+// O_DIRECT reads must cover whole blocks. The read past EOF comes back short; one that ends inside the file (a
+// byte limit below its size) comes back whole. Either way only chunk_len() bytes of it are sent.
+static uint64_t read_len(const struct bulk_source *s, uint64_t len)
+{
+    return s->direct ? (len + 4095) / 4096 * 4096 : len;
+}
+
+int bulk_source_uses_ring(const struct bulk_source *s)
+{
+    return s->kind == BULK_SRC_PREAD || s->kind == BULK_SRC_URING || s->kind == BULK_SRC_PRODUCE;
+}
+
+// Word w of the stream is (w ^ seed) scrambled, so any misplaced or stale chunk shows up.
+static void fill_pattern(char *dst, uint64_t off, uint64_t len)
+{
+    const uint64_t seed = 0x5a5a5a5a5a5a5a5aULL;
+    uint64_t done = 0;
+    while (done < len)
+    {
+        uint64_t pos = off + done;
+        uint64_t word = ((pos / 8) ^ seed) * 0x9e3779b97f4a7c15ULL;
+        uint64_t skip = pos % 8;
+        uint64_t n = 8 - skip < len - done ? 8 - skip : len - done;
+        memcpy(dst + done, (const char *)&word + skip, (size_t)n);
+        done += n;
+    }
+}
+
+static void produce_chunk(struct bulk_source *s, char *dst, uint64_t off, uint64_t len)
+{
+    for (unsigned pass = 0; pass < s->passes; pass++)
+    {
+        if (s->produce == BULK_PRODUCE_PATTERN)
+        {
+            fill_pattern(dst, off, len);
+            continue;
+        }
+        uint64_t done = 0;
+        while (done < len)
+        {
+            size_t at = (size_t)((off + done) % s->dataset_len);
+            size_t n = s->dataset_len - at < len - done ? s->dataset_len - at : (size_t)(len - done);
+            memcpy(dst + done, s->dataset + at, n);
+            done += n;
+        }
+    }
+}
+
+// Queue READ_FIXED for every upcoming chunk whose slot is free, in stream order.
+static int uring_read_ahead(struct bulk_source *s)
+{
+    int queued = 0;
+    while (s->next_read < s->size)
+    {
+        struct bulk_slot *slot = slot_for(s, s->next_read);
+        if (slot->state != BULK_SLOT_FREE)
+            break;
+        struct io_uring_sqe *sqe = uring_get_sqe(&s->ur);
+        if (!sqe)
+            break;
+        uint64_t len = read_len(s, chunk_len(s, s->next_read));
+        uring_prep_read_fixed(sqe, s->fd, slot_buf(s, slot), (unsigned)len, s->next_read, 0,
+                              (uint64_t)(slot - s->slots));
+        slot->state = BULK_SLOT_READING;
+        slot->off = s->next_read;
+        s->next_read += s->chunk;
+        queued++;
+    }
+    if (queued)
+    {
+        int rc = uring_submit(&s->ur, 0);
+        if (rc < 0)
+        {
+            LOG_ERR("io_uring_enter: %s", strerror(-rc));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int uring_reap_one(struct bulk_source *s)
+{
+    struct io_uring_cqe *cqe = NULL;
+    int rc = uring_wait_cqe(&s->ur, &cqe);
+    if (rc)
+    {
+        LOG_ERR("io_uring wait: %s", strerror(-rc));
+        return -1;
+    }
+    struct bulk_slot *slot = &s->slots[cqe->user_data];
+    int res = cqe->res;
+    uring_cqe_seen(&s->ur);
+    if (res < 0 || (uint64_t)res < chunk_len(s, slot->off))
+    {
+        LOG_ERR("file read at %llu: %s", (unsigned long long)slot->off, res < 0 ? strerror(-res) : "short read");
+        return -1;
+    }
+    slot->state = BULK_SLOT_READY;
+    return 0;
+}
+
+int bulk_source_open(struct bulk_source *s, struct ibv_pd *pd, enum bulk_src_kind kind, const char *path,
+                     uint64_t max_bytes, uint64_t chunk, unsigned nslots)
+{
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    s->fd = -1;
+    s->chunk = chunk;
+    s->size = max_bytes;
+    s->nslots = kind == BULK_SRC_FILL ? 1 : nslots;
+    if (s->nslots == 0 || s->nslots > BULK_SRC_MAX_SLOTS)
+    {
+        LOG_ERR("ring depth must be 1..%d", BULK_SRC_MAX_SLOTS);
+        return -1;
+    }
+
+    if (kind == BULK_SRC_PRODUCE)
+    {
+        const char *mode = getenv("RDMA_BULK_PRODUCE");
+        const char *passes = getenv("RDMA_BULK_PRODUCE_PASSES");
+        if (bulk_source_parse_produce(mode, &s->produce))
+        {
+            LOG_ERR("RDMA_BULK_PRODUCE must be copy or pattern");
+            return -1;
+        }
+        s->passes = (passes && *passes) ? (unsigned)strtoul(passes, NULL, 10) : 1;
+        if (s->passes == 0)
+            s->passes = 1;
+        if (s->produce == BULK_PRODUCE_COPY)
+        {
+            // Larger than the ring and the LLC, so the copy streams from DRAM like real serialization.
+            s->dataset_len = (size_t)(s->size < (64ULL << 20) ? s->size : (64ULL << 20));
+            s->dataset = malloc(s->dataset_len);
+            if (!s->dataset)
+                return err_errno("malloc dataset");
+            fill_pattern(s->dataset, 0, s->dataset_len);
+        }
+    }
+    else if (kind != BULK_SRC_FILL)
+    {
+        const char *direct = getenv("RDMA_BULK_FILE_DIRECT");
+        int flags = O_RDONLY;
+        if (kind != BULK_SRC_MMAP && direct && *direct)
+        {
+            if (chunk % 4096)
+            {
+                LOG_ERR("RDMA_BULK_FILE_DIRECT needs a chunk that is a multiple of 4096");
+                return -1;
+            }
+            flags |= O_DIRECT;
+            s->direct = 1;
+        }
+        s->fd = open(path, flags);
+        if (s->fd < 0)
+            return err_errno("open input");
+        struct stat st;
+        if (fstat(s->fd, &st))
+            return err_errno("fstat input");
+        if ((uint64_t)st.st_size < s->size)
+            s->size = (uint64_t)st.st_size;
+        if (s->size == 0)
+        {
+            LOG_ERR("input file %s is empty", path);
+            return -1;
+        }
+    }
+
+    double t0 = now_sec();
+    if (kind == BULK_SRC_MMAP)
+    {
+        s->map_len = (size_t)s->size;
+        s->map = mmap(NULL, s->map_len, PROT_READ, MAP_PRIVATE, s->fd, 0);
+        if (s->map == MAP_FAILED)
+        {
+            s->map = NULL;
+            return err_errno("mmap input");
+        }
+        madvise(s->map, s->map_len, MADV_SEQUENTIAL);
+        // Read-only source: no LOCAL_WRITE, so the pages stay shared with the page cache.
+        s->map_mr = ibv_reg_mr(pd, s->map, s->map_len, 0);
+        if (!s->map_mr)
+            return err_errno("ibv_reg_mr(mmap)");
+    }
+    else
+    {
+        size_t ring_len = (size_t)chunk * s->nslots;
+        void *p = NULL;
+        int rc = posix_memalign(&p, 4096, ring_len);
+        if (rc)
+        {
+            LOG_ERR("posix_memalign: %s", strerror(rc));
+            return -1;
+        }
+        s->ring = p;
+        memset(s->ring, kind == BULK_SRC_FILL ? 0x5a : 0, ring_len);
+        s->ring_mr = ibv_reg_mr(pd, s->ring, ring_len, IBV_ACCESS_LOCAL_WRITE);
+        if (!s->ring_mr)
+            return err_errno("ibv_reg_mr(ring)");
+        if (kind == BULK_SRC_FILL)
+            s->slots[0].state = BULK_SLOT_READY;
+    }
+    s->reg_secs = now_sec() - t0;
+
+    if (kind == BULK_SRC_URING)
+    {
+        int rc = uring_init(&s->ur, s->nslots, 0, 0);
+        if (rc)
+        {
+            LOG_ERR("io_uring_setup: %s", strerror(-rc));
+            return -1;
+        }
+        s->ur_ok = 1;
+        struct iovec iov = {.iov_base = s->ring, .iov_len = (size_t)chunk * s->nslots};
+        rc = uring_register_buffers(&s->ur, &iov, 1);
+        if (rc)
+        {
+            LOG_ERR("io_uring register buffers: %s", strerror(-rc));
+            return -1;
+        }
+        return uring_read_ahead(s);
+    }
+    return 0;
+}
+
+int bulk_source_signal_every(const struct bulk_source *s, int preferred)
+{
+    if (!bulk_source_uses_ring(s))
+        return preferred;
+    // A slot can only be reclaimed by a signaled WR posted after it.
+    int half = (int)s->nslots / 2;
+    if (half < 1)
+        half = 1;
+    return preferred < half ? preferred : half;
+}
+
+int bulk_source_get(struct bulk_source *s, uint64_t off, uint64_t len, void **buf, struct ibv_mr **mr)
+{
+    if (s->kind == BULK_SRC_MMAP)
+    {
+        *buf = (char *)s->map + off;
+        *mr = s->map_mr;
+        return 0;
+    }
+    if (s->kind == BULK_SRC_FILL)
+    {
+        *buf = s->ring;
+        *mr = s->ring_mr;
+        return 0;
+    }
+
+    struct bulk_slot *slot = slot_for(s, off);
+    if (slot->state == BULK_SLOT_POSTED)
+        return 1;
+    double t0 = now_sec();
+    if (s->kind == BULK_SRC_PRODUCE)
+    {
+        produce_chunk(s, slot_buf(s, slot), off, len);
+        slot->off = off;
+        slot->state = BULK_SLOT_READY;
+    }
+    else if (s->kind == BULK_SRC_PREAD)
+    {
+        char *dst = slot_buf(s, slot);
+        uint64_t done = 0;
+        while (done < len)
+        {
+            ssize_t n = pread(s->fd, dst + done, (size_t)(read_len(s, len) - done), (off_t)(off + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return err_errno("pread");
+            if (n == 0)
+            {
+                LOG_ERR("pread: unexpected EOF at %llu", (unsigned long long)(off + done));
+                return -1;
+            }
+            done += (uint64_t)n;
+        }
+        slot->off = off;
+        slot->state = BULK_SLOT_READY;
+    }
+    else
+    {
+        if (slot->state == BULK_SLOT_FREE && uring_read_ahead(s))
+            return -1;
+        while (slot->state == BULK_SLOT_READING)
+        {
+            if (uring_reap_one(s))
+                return -1;
+        }
+    }
+    s->fill_secs += now_sec() - t0;
+    *buf = slot_buf(s, slot);
+    *mr = s->ring_mr;
+    return 0;
+}
+
+void bulk_source_posted(struct bulk_source *s, uint64_t off, uint64_t wr_id)
+{
+    if (!bulk_source_uses_ring(s))
+        return;
+    struct bulk_slot *slot = slot_for(s, off);
+    slot->state = BULK_SLOT_POSTED;
+    slot->wr_id = wr_id;
+}
+
+int bulk_source_completed(struct bulk_source *s, uint64_t done_wr_id)
+{
+    if (!bulk_source_uses_ring(s))
+        return 0;
+    // RC completes WRs in order, so one signaled CQE retires every earlier unsignaled WR too.
+    for (unsigned i = 0; i < s->nslots; i++)
+    {
+        if (s->slots[i].state == BULK_SLOT_POSTED && s->slots[i].wr_id <= done_wr_id)
+            s->slots[i].state = BULK_SLOT_FREE;
+    }
+    return s->kind == BULK_SRC_URING ? uring_read_ahead(s) : 0;
+}
+
+int bulk_source_rewind(struct bulk_source *s)
+{
+    if (!bulk_source_uses_ring(s))
+        return 0;
+    for (unsigned i = 0; i < s->nslots; i++)
+    {
+        if (s->slots[i].state == BULK_SLOT_POSTED)
+        {
+            LOG_ERR("rewind with slot %u still owned by the NIC", i);
+            return -1;
+        }
+        // A shorter pass leaves read-ahead behind it; let those reads land, then drop them.
+        while (s->slots[i].state == BULK_SLOT_READING)
+        {
+            if (uring_reap_one(s))
+                return -1;
+        }
+    }
+    for (unsigned i = 0; i < s->nslots; i++)
+        s->slots[i].state = BULK_SLOT_FREE;
+    s->next_read = 0;
+    return s->kind == BULK_SRC_URING ? uring_read_ahead(s) : 0;
+}
+
+void bulk_source_close(struct bulk_source *s)
+{
+    if (s->ur_ok)
+        uring_exit(&s->ur);
+    if (s->map_mr)
+        ibv_dereg_mr(s->map_mr);
+    if (s->map)
+        munmap(s->map, s->map_len);
+    if (s->ring_mr)
+        ibv_dereg_mr(s->ring_mr);
+    free(s->ring);
+    free(s->dataset);
+    if (s->fd >= 0)
+        close(s->fd);
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+ * Payload sources for the bulk client.
+ *
+ *  fill   one registered buffer of 0x5a filler reused for every chunk (the original benchmark)
+ *  mmap   the input file mapped read-only and registered directly as the WRITE source
+ *  pread  a ring of registered chunk buffers filled synchronously with pread()
+ *  uring  the same ring, refilled ahead of the NIC with io_uring READ_FIXED
+ *  produce  the ring filled by a CPU producer stage (copy from a dataset or generate a pattern),
+ *           which models serialization work overlapping with the NIC reading earlier slots
+ *
+ * Chunk i lives in ring slot i % nslots. A slot is owned by the NIC from bulk_source_posted()
+ * until a signaled completion with a wr_id >= its own is passed to bulk_source_completed().
+ */
+
+#include <infiniband/verbs.h>
+#include <stdint.h>
+
+#include "uring_io.h"
+
+#define BULK_SRC_MAX_SLOTS 64
+
+enum bulk_src_kind
+{
+    BULK_SRC_FILL,
+    BULK_SRC_MMAP,
+    BULK_SRC_PREAD,
+    BULK_SRC_URING,
+    BULK_SRC_PRODUCE
+};
+
+enum bulk_produce_mode
+{
+    BULK_PRODUCE_COPY,   // memcpy from an unregistered dataset (serialize into a send buffer)
+    BULK_PRODUCE_PATTERN // compute a per-offset 64-bit pattern (generate/encode)
+};
+
+enum bulk_slot_state
+{
+    BULK_SLOT_FREE,
+    BULK_SLOT_READING,
+    BULK_SLOT_READY,
+    BULK_SLOT_POSTED
+};
+
+struct bulk_slot
+{
+    enum bulk_slot_state state;
+    uint64_t off; // stream offset of the chunk held in the slot
+    uint64_t wr_id;
+};
+
+struct bulk_source
+{
+    enum bulk_src_kind kind;
+    int fd;
+    int direct; // input opened with O_DIRECT (RDMA_BULK_FILE_DIRECT)
+    uint64_t size; // bytes this source will deliver
+    uint64_t chunk;
+
+    void *map; // BULK_SRC_MMAP
+    size_t map_len;
+    struct ibv_mr *map_mr;
+
+    char *ring; // staging ring (BULK_SRC_FILL uses a single slot)
+    struct ibv_mr *ring_mr;
+    unsigned nslots;
+    struct bulk_slot slots[BULK_SRC_MAX_SLOTS];
+
+    struct uring ur; // BULK_SRC_URING
+    int ur_ok;
+    uint64_t next_read; // read-ahead cursor
+
+    enum bulk_produce_mode produce; // BULK_SRC_PRODUCE
+    unsigned passes;                // repeat the fill to scale CPU cost per byte
+    char *dataset;
+    size_t dataset_len;
+
+    double reg_secs;  // time spent registering (mmap pins and faults in the whole file)
+    double fill_secs; // time the poster spent filling slots (file reads or producer work)
+};
+
+int bulk_source_parse_kind(const char *s, enum bulk_src_kind *kind);
+int bulk_source_parse_produce(const char *s, enum bulk_produce_mode *mode);
+const char *bulk_source_kind_str(enum bulk_src_kind kind);
+
+// Open a source of at most max_bytes (the file length caps it for file sources).
+// BULK_SRC_PRODUCE reads RDMA_BULK_PRODUCE (copy|pattern) and RDMA_BULK_PRODUCE_PASSES.
+int bulk_source_open(struct bulk_source *s, struct ibv_pd *pd, enum bulk_src_kind kind, const char *path,
+                     uint64_t max_bytes, uint64_t chunk, unsigned nslots);
+
+// How many chunks may be posted between signaled WRs without starving the ring.
+int bulk_source_signal_every(const struct bulk_source *s, int preferred);
+
+// Hand out the chunk at stream offset off: 0 ready, 1 slot still owned by the NIC (reap and retry), -1 error.
+int bulk_source_get(struct bulk_source *s, uint64_t off, uint64_t len, void **buf, struct ibv_mr **mr);
+void bulk_source_posted(struct bulk_source *s, uint64_t off, uint64_t wr_id);
+
+// A signaled WR completed: every slot posted with wr_id <= done_wr_id is free again.
+int bulk_source_completed(struct bulk_source *s, uint64_t done_wr_id);
+
+// Restart the stream at offset 0 for another pass (session mode). Nothing may be posted.
+int bulk_source_rewind(struct bulk_source *s);
+
+int bulk_source_uses_ring(const struct bulk_source *s);
+void bulk_source_close(struct bulk_source *s);
@@ -1,5 +1,14 @@
 /**
  * RDMA bulk client: write a large payload to remote memory in fixed chunks.
+ * The payload is filler by default, a file (RDMA_BULK_FILE) sent via mmap, pread or io_uring, or
+ * data produced by the CPU into a ring of TX buffers (RDMA_BULK_PRODUCE) while earlier ones are sent.
+ * RDMA_BULK_MODE=read pulls the server buffer with pipelined RDMA READs instead.
+ * RDMA_BULK_QP=uc streams over an Unreliable Connected QP with sequence numbers in immediate data.
+ * RDMA_BULK_ITERS=n or RDMA_BULK_SESSION=stdin keeps the connection, registrations and CQ warm and
+ * runs many passes over it, reporting each one and the steady state apart from the setup cost.
+ * RDMA_BULK_LOG / RDMA_BULK_CSV report progress from a sampler thread (bulk_progress.h), not the post loop.
+ * At exit the port's sysfs counters (retransmits, out-of-sequence, RNR NAKs, timeouts) are reported as deltas
+ * per GiB moved, when the device exposes them.
  */
 
 #include <inttypes.h>
@@ -8,15 +17,22 @@
 #include <string.h>
 #include <time.h>
 
+#include "bulk_progress.h"
+#include "bulk_source.h"
 #include "common.h"
+#include "cpu_cost.h"
+#include "crc32c.h"
+#include "ib_counters.h"
 #include "rdma_builders.h"
 #include "rdma_bulk_common.h"
 #include "rdma_cm_helpers.h"
 #include "rdma_ctx.h"
 #include "rdma_mem.h"
 #include "rdma_ops.h"
+#include "rdma_stats.h"
 
 #define DEFAULT_PORT "7471"
+#define WRID_ACK 0x41434b00ULL
 
 struct bulk_info
 {
@@ -49,6 +65,388 @@ static double now_sec(void)
     return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
 }
 
+#define BATCH_RING 1024
+
+// Signaled WRs in flight; each entry covers the unsignaled WRs posted before it.
+struct tx_batches
+{
+    int sizes[BATCH_RING];
+    int head, tail;
+    int inflight;
+};
+
+static int reap_batch(struct ibv_cq *cq, struct bulk_source *src, struct tx_batches *b, struct bulk_progress *pg)
+{
+    struct ibv_wc wc;
+    if (poll_one(cq, &wc))
+        return -1;
+    bulk_progress_cqe(pg, (uint64_t)b->sizes[b->head]);
+    b->inflight -= b->sizes[b->head];
+    b->head = (b->head + 1) % BATCH_RING;
+    return bulk_source_completed(src, wc.wr_id);
+}
+
+// Outstanding READs the QP will actually issue (max_rd_atomic after the CM handshake).
+static int negotiated_read_depth(rdma_ctx *c, const struct rdma_conn_param *connp, uint8_t initiator_depth)
+{
+    struct ibv_qp_attr attr;
+    struct ibv_qp_init_attr init;
+    if (ibv_query_qp(c->qp, &attr, IBV_QP_MAX_QP_RD_ATOMIC, &init) == 0 && attr.max_rd_atomic > 0)
+        return attr.max_rd_atomic;
+    // The REP's responder_resources is what the server agreed to serve.
+    return connp->responder_resources < initiator_depth ? connp->responder_resources : initiator_depth;
+}
+
+// Pull total bytes with RDMA READ, keeping up to depth READs in flight into a ring of chunk buffers.
+static int run_pull(rdma_ctx *c, const char *prefix, uint64_t total, uint64_t chunk, int depth,
+                    struct bulk_progress *pg, double *secs_out)
+{
+    // A session keeps the ring registered between passes.
+    if (!c->buf_rx && alloc_and_reg(c, &c->buf_rx, &c->mr_rx, (size_t)chunk * (size_t)depth, IBV_ACCESS_LOCAL_WRITE))
+        return -1;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t issued = 0;
+    uint64_t done = 0;
+    uint64_t wr_id = 0;
+    int inflight = 0;
+    while (done < total)
+    {
+        while (inflight < depth && issued < total)
+        {
+            uint64_t len = total - issued < chunk ? total - issued : chunk;
+            char *dst = (char *)c->buf_rx + (size_t)(wr_id % (uint64_t)depth) * chunk;
+            if (post_read(c->qp, c->mr_rx, dst, c->remote_addr + issued, c->remote_rkey, (size_t)len, wr_id++, 1))
+                return -1;
+            bulk_progress_posted(pg, len);
+            issued += len;
+            inflight++;
+        }
+        // READs complete in order, so the oldest outstanding chunk is the one that finished.
+        struct ibv_wc wc;
+        if (poll_one(c->cq, &wc))
+            return -1;
+        bulk_progress_cqe(pg, 1);
+        done += total - done < chunk ? total - done : chunk;
+        inflight--;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = elapsed_sec(&t0, &t1);
+    double mib = (double)total / (1024.0 * 1024.0);
+    printf("%sRDMA client read %" PRIu64 " bytes in %.3f s (%.2f MiB/s) with %d READs in flight\n", prefix, total,
+           secs, mib / secs, depth);
+    if (secs_out)
+        *secs_out = secs;
+    return 0;
+}
+
+// READ depth to use: the negotiated one, optionally lowered by RDMA_BULK_READ_DEPTH.
+static int pick_read_depth(rdma_ctx *c, const struct rdma_conn_param *connp, uint8_t initiator_depth)
+{
+    const char *read_depth_env = getenv("RDMA_BULK_READ_DEPTH");
+    int depth = negotiated_read_depth(c, connp, initiator_depth);
+    int wanted = (read_depth_env && *read_depth_env) ? atoi(read_depth_env) : depth;
+    if (wanted > depth)
+        printf("RDMA_BULK_READ_DEPTH=%d exceeds the negotiated depth; capping at %d\n", wanted, depth);
+    else if (wanted >= 1)
+        depth = wanted;
+    if (depth > 128)
+        depth = 128; // send queue depth of this QP
+    if (depth == 1)
+        printf("READ depth is 1: every READ waits for the previous one (stop-and-wait)\n");
+    return depth;
+}
+
+// Settings and progress output of the WRITE stream, shared by every pass of a session.
+struct push_cfg
+{
+    uint64_t chunk;
+    int imm;
+    int verify;
+    uint32_t *digests; // one per chunk, right behind the trailer in buf_tx
+    size_t ack_off;    // where the server's bulk_ack lands in buf_tx
+    struct bulk_progress *prog;
+};
+
+struct push_result
+{
+    uint64_t sent;
+    double secs;
+    double max_cqe_gap; // from the sampler thread (bulk_progress.h), like slot_wait and crc_secs
+    double slot_wait;
+    double fill_secs;
+    double fill_overlapped; // fill time spent while WRITEs were still in flight
+    double crc_secs;
+};
+
+// Write total bytes from src to the start of the remote buffer. wr_id keeps counting across passes.
+static int run_push(rdma_ctx *c, struct bulk_source *src, uint64_t total, struct push_cfg *p, uint64_t *wr_id,
+                    struct push_result *r)
+{
+    memset(r, 0, sizeof(*r));
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const uint64_t chunk = p->chunk;
+    const int max_outstanding = 64;
+    const int signal_every = bulk_source_signal_every(src, 16);
+    struct tx_batches batches = {0};
+    int current_batch = 0;
+    uint64_t sent = 0;
+    double fill_start = src->fill_secs;
+    struct bulk_pass_stats ps;
+    bulk_progress_take(p->prog, &ps); // start this pass's stall and phase times from zero
+    while (sent < total)
+    {
+        uint64_t remaining = total - sent;
+        uint64_t this_chunk = remaining < chunk ? remaining : chunk;
+        void *buf = NULL;
+        struct ibv_mr *mr = NULL;
+        double fill_before = src->fill_secs;
+        int rc = bulk_source_get(src, sent, this_chunk, &buf, &mr);
+        if (rc == 1)
+        {
+            // Ring sources hand a slot back only after the NIC is done reading it.
+            bulk_progress_phase(p->prog, BULK_PHASE_SLOT_WAIT);
+            while ((rc = bulk_source_get(src, sent, this_chunk, &buf, &mr)) == 1)
+            {
+                if (reap_batch(c->cq, src, &batches, p->prog))
+                    return -1;
+            }
+            bulk_progress_phase(p->prog, BULK_PHASE_RUN);
+        }
+        if (batches.inflight > 0)
+            r->fill_overlapped += src->fill_secs - fill_before;
+        if (rc < 0)
+            return -1;
+        if (p->verify)
+        {
+            bulk_progress_phase(p->prog, BULK_PHASE_CRC);
+            p->digests[sent / chunk] = htonl(crc32c(0, buf, (size_t)this_chunk));
+            bulk_progress_phase(p->prog, BULK_PHASE_RUN);
+        }
+        current_batch++;
+        int do_signal = (current_batch == signal_every) || (sent + this_chunk == total);
+        int rc_post = p->imm ? post_write_imm(c->qp, mr, buf, c->remote_addr + sent, c->remote_rkey,
+                                              (size_t)this_chunk, (uint32_t)(sent / chunk), *wr_id, do_signal)
+                             : post_write(c->qp, mr, buf, c->remote_addr + sent, c->remote_rkey, (size_t)this_chunk,
+                                          *wr_id, do_signal);
+        if (rc_post)
+            return -1;
+        bulk_source_posted(src, sent, (*wr_id)++);
+        bulk_progress_posted(p->prog, this_chunk);
+        batches.inflight++;
+        if (do_signal)
+        {
+            batches.sizes[batches.tail] = current_batch;
+            batches.tail = (batches.tail + 1) % BATCH_RING;
+            current_batch = 0;
+        }
+        if (batches.inflight >= max_outstanding)
+        {
+            if (reap_batch(c->cq, src, &batches, p->prog))
+                return -1;
+        }
+        sent += this_chunk;
+    }
+    while (batches.head != batches.tail)
+    {
+        if (reap_batch(c->cq, src, &batches, p->prog))
+            return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r->sent = sent;
+    r->secs = elapsed_sec(&t0, &t1);
+    bulk_progress_take(p->prog, &ps);
+    r->max_cqe_gap = ps.max_cqe_gap;
+    r->slot_wait = ps.phase_secs[BULK_PHASE_SLOT_WAIT];
+    r->crc_secs = ps.phase_secs[BULK_PHASE_CRC];
+    r->fill_secs = src->fill_secs - fill_start;
+    return 0;
+}
+
+static void report_push(const char *prefix, const struct push_cfg *p, const struct bulk_source *src,
+                        const struct push_result *r)
+{
+    double mib = (double)r->sent / (1024.0 * 1024.0);
+    printf("%sRDMA client wrote %" PRIu64 " bytes in %.3f s (%.2f MiB/s), longest CQE gap %.0f ms\n", prefix, r->sent,
+           r->secs, mib / r->secs, r->max_cqe_gap * 1e3);
+    if (bulk_source_uses_ring(src))
+    {
+        printf("Ring of %u x %" PRIu64 " bytes: %s %.3f s, waited for free slots %.3f s\n", src->nslots, p->chunk,
+               src->kind == BULK_SRC_PRODUCE ? "producing" : "reading file", r->fill_secs, r->slot_wait);
+        // Slot waits mean the NIC is the bottleneck; fill time with nothing in flight is pure serialization.
+        if (r->fill_secs > 0.0)
+            printf("Fill overlapped with in-flight WRITEs: %.0f%%\n", 100.0 * r->fill_overlapped / r->fill_secs);
+    }
+
+    if (p->verify)
+        printf("CRC32C on the posting thread: %.3f s (%.2f MiB/s)\n", r->crc_secs,
+               r->crc_secs > 0.0 ? mib / r->crc_secs : 0.0);
+}
+
+// Trailing SEND: how many bytes to keep, plus the per-chunk digests in integrity mode.
+// With ack set, also wait for the server's bulk_ack before the buffer may be written again.
+static int send_trailer(rdma_ctx *c, const struct push_cfg *p, uint64_t sent, int ack, struct bulk_ack *out)
+{
+    struct bulk_trailer *trailer = c->buf_tx;
+    struct bulk_ack *reply = (struct bulk_ack *)((char *)c->buf_tx + p->ack_off);
+    uint32_t ndigests = p->verify ? (uint32_t)((sent + p->chunk - 1) / p->chunk) : 0;
+    size_t trailer_len = sizeof(*trailer) + sizeof(uint32_t) * ndigests;
+    if (ack && post_recv(c->qp, c->mr_tx, reply, sizeof(*reply), WRID_ACK))
+        return err_errno("ibv_post_recv");
+    // The SEND lands after every WRITE (RC ordering), so the server can trust the length.
+    // Over UC it may itself be lost; the server then falls back to the disconnect.
+    trailer->len = htonll_u64(sent);
+    trailer->chunk = htonll_u64(p->chunk);
+    trailer->ndigests = htonl(ndigests);
+    trailer->flags = htonl(ack ? BULK_TRAILER_ACK : 0);
+    if (post_send(c->qp, c->mr_tx, trailer, trailer_len, 0, 1))
+        return -1;
+    for (int pending = ack ? 2 : 1; pending > 0; pending--)
+    {
+        struct ibv_wc wc;
+        if (poll_one(c->cq, &wc))
+            return -1;
+    }
+    if (ack)
+    {
+        out->iter = ntohl(reply->iter);
+        out->bad = ntohl(reply->bad);
+    }
+    return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Passes run over one connection, so every pass after the first measures steady state.
+struct session
+{
+    double *mibs; // MiB/s of each pass
+    size_t n, cap;
+    double setup_secs; // create id .. ESTABLISHED, plus registrations
+    uint32_t bad;      // chunks the server reported corrupt
+    uint64_t bytes;    // moved over all passes
+    uint64_t wqes;     // data WRs (WRITEs or READs) over all passes
+};
+
+static int session_add(struct session *ss, uint64_t bytes, double secs)
+{
+    if (ss->n == ss->cap)
+    {
+        size_t cap = ss->cap ? 2 * ss->cap : 64;
+        double *m = realloc(ss->mibs, cap * sizeof(*m));
+        if (!m)
+            return err_errno("realloc session stats");
+        ss->mibs = m;
+        ss->cap = cap;
+    }
+    ss->mibs[ss->n++] = (double)bytes / (1024.0 * 1024.0) / secs;
+    ss->bytes += bytes;
+    return 0;
+}
+
+static void session_report(const struct session *ss)
+{
+    printf("Session: %zu passes on one connection, setup %.1f ms\n", ss->n, ss->setup_secs * 1e3);
+    if (ss->n == 0)
+        return;
+    printf("  first pass   %.2f MiB/s\n", ss->mibs[0]);
+    if (ss->n < 2)
+        return;
+    size_t m = ss->n - 1;
+    double *steady = malloc(m * sizeof(*steady));
+    if (!steady)
+        return;
+    memcpy(steady, ss->mibs + 1, m * sizeof(*steady));
+    qsort(steady, m, sizeof(*steady), cmp_double);
+    double sum = 0.0;
+    for (size_t i = 0; i < m; i++)
+        sum += steady[i];
+    printf("  steady state %.2f MiB/s mean, p50 %.2f, min %.2f, max %.2f over %zu passes\n", sum / (double)m,
+           steady[m / 2], steady[0], steady[m - 1], m);
+    free(steady);
+}
+
+enum session_op
+{
+    SESSION_WRITE,
+    SESSION_READ
+};
+
+// One pass on the warm connection: nothing is resolved, created or registered here.
+static int session_pass(rdma_ctx *c, struct session *ss, enum session_op op, uint64_t bytes, struct bulk_source *src,
+                        struct push_cfg *p, uint64_t *wr_id, int depth)
+{
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "[pass %zu] ", ss->n + 1);
+    if (op == SESSION_READ)
+    {
+        double secs = 0.0;
+        if (run_pull(c, prefix, bytes, p->chunk, depth, p->prog, &secs))
+            return -1;
+        ss->wqes += (bytes + p->chunk - 1) / p->chunk;
+        return session_add(ss, bytes, secs);
+    }
+    struct push_result r;
+    struct bulk_ack ack = {0};
+    if (bulk_source_rewind(src) || run_push(c, src, bytes, p, wr_id, &r))
+        return -1;
+    report_push(prefix, p, src, &r);
+    if (send_trailer(c, p, r.sent, 1, &ack))
+        return -1;
+    if (ack.bad)
+    {
+        printf("%sserver found %u bad chunks\n", prefix, ack.bad);
+        ss->bad += ack.bad;
+    }
+    ss->wqes += (r.sent + p->chunk - 1) / p->chunk;
+    return session_add(ss, r.sent, r.secs);
+}
+
+// One command per line: write [bytes] | read [bytes] | stats | quit. bytes defaults to the size argument.
+static int session_stdin(rdma_ctx *c, struct session *ss, uint64_t remote_len, uint64_t dflt,
+                         struct bulk_source *src, struct push_cfg *p, uint64_t *wr_id, int depth)
+{
+    char line[256];
+    printf("Session ready: write [bytes] | read [bytes] | stats | quit\n");
+    fflush(stdout);
+    while (fgets(line, sizeof(line), stdin))
+    {
+        char cmd[16] = "";
+        char arg[64] = "";
+        int nf = sscanf(line, "%15s %63s", cmd, arg);
+        if (nf < 1)
+            continue;
+        uint64_t bytes = nf >= 2 ? parse_size_bytes(arg) : dflt;
+        if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0)
+            break;
+        if (strcmp(cmd, "stats") == 0 || strcmp(cmd, "s") == 0)
+            session_report(ss);
+        else if (strcmp(cmd, "write") == 0 || strcmp(cmd, "w") == 0)
+        {
+            if (bytes == 0 || bytes > src->size)
+                printf("write needs 1..%" PRIu64 " bytes\n", src->size);
+            else if (session_pass(c, ss, SESSION_WRITE, bytes, src, p, wr_id, depth))
+                return -1;
+        }
+        else if (strcmp(cmd, "read") == 0 || strcmp(cmd, "r") == 0)
+        {
+            if (bytes == 0 || bytes > remote_len)
+                printf("read needs 1..%" PRIu64 " bytes\n", remote_len);
+            else if (session_pass(c, ss, SESSION_READ, bytes, src, p, wr_id, depth))
+                return -1;
+        }
+        else
+            printf("unknown command '%s'\n", cmd);
+        fflush(stdout);
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int err = 0;
@@ -63,8 +461,58 @@ int main(int argc, char **argv)
     const char *chunk_str = (argc >= 5) ? argv[4] : "4M";
     const char *log_env = getenv("RDMA_BULK_LOG");
     const char *csv_env = getenv("RDMA_BULK_CSV");
-    int log_on = (log_env && *log_env) || (csv_env && *csv_env);
-    FILE *csv = NULL;
+    const char *log_ms_env = getenv("RDMA_BULK_LOG_MS");
+    const char *file = getenv("RDMA_BULK_FILE");
+    const char *src_env = getenv("RDMA_BULK_SRC");
+    const char *ring_env = getenv("RDMA_BULK_RING");
+    const char *produce_env = getenv("RDMA_BULK_PRODUCE");
+    const char *verify_env = getenv("RDMA_BULK_VERIFY");
+    const char *mode_env = getenv("RDMA_BULK_MODE");
+    const char *iters_env = getenv("RDMA_BULK_ITERS");
+    const char *session_env = getenv("RDMA_BULK_SESSION");
+    int pull = mode_env && strcmp(mode_env, "read") == 0;
+    int verify = verify_env && *verify_env && strcmp(verify_env, "0") != 0;
+    long iters = (iters_env && *iters_env) ? strtol(iters_env, NULL, 10) : 1;
+    int interactive = session_env && strcmp(session_env, "stdin") == 0;
+    int session = interactive || iters > 1;
+    enum bulk_src_kind kind = BULK_SRC_FILL;
+    enum ibv_qp_type qpt;
+    int imm = 0;
+    if (bulk_qp_from_env(&qpt, &imm))
+    {
+        fprintf(stderr, "RDMA_BULK_QP must be rc or uc\n");
+        return 1;
+    }
+    if (pull && qpt == IBV_QPT_UC)
+    {
+        fprintf(stderr, "UC QPs cannot issue RDMA READ; use RDMA_BULK_MODE=write\n");
+        return 1;
+    }
+    if (iters < 1 || (session_env && *session_env && !interactive))
+    {
+        fprintf(stderr, "RDMA_BULK_ITERS must be >= 1 and RDMA_BULK_SESSION must be stdin\n");
+        return 1;
+    }
+    if (session && imm)
+    {
+        // The sequenced stream ends at its first trailer; sessions need acknowledged RC passes.
+        fprintf(stderr, "Session mode needs RDMA_BULK_QP=rc without RDMA_BULK_IMM\n");
+        return 1;
+    }
+    if (file && *file && bulk_source_parse_kind(src_env, &kind))
+    {
+        fprintf(stderr, "RDMA_BULK_SRC must be mmap, pread or uring\n");
+        return 1;
+    }
+    if (!(file && *file) && produce_env && *produce_env)
+        kind = BULK_SRC_PRODUCE;
+    if (verify && kind == BULK_SRC_FILL)
+    {
+        // Identical filler chunks would hide misplaced writes; use the per-offset pattern.
+        kind = BULK_SRC_PRODUCE;
+        setenv("RDMA_BULK_PRODUCE", "pattern", 0);
+    }
+    unsigned ring_depth = (ring_env && *ring_env) ? (unsigned)strtoul(ring_env, NULL, 10) : 8;
     uint64_t total = parse_size_bytes(size_str);
     uint64_t chunk = parse_size_bytes(chunk_str);
     if (total == 0 || chunk == 0)
@@ -72,8 +520,28 @@ int main(int argc, char **argv)
         fprintf(stderr, "Invalid size/chunk\n");
         return 1;
     }
+    if (verify && chunk < BULK_MIN_VERIFY_CHUNK)
+    {
+        fprintf(stderr, "RDMA_BULK_VERIFY needs a chunk of at least %d bytes\n", BULK_MIN_VERIFY_CHUNK);
+        return 1;
+    }
+    if (file && *file && argc < 4)
+        total = UINT64_MAX; // whole file, capped by the server buffer below
 
     rdma_ctx c = {0};
+    struct bulk_source src = {0};
+    src.fd = -1;
+    struct push_cfg p = {.chunk = chunk, .imm = imm, .verify = verify};
+    struct bulk_progress prog = {0};
+    FILE *csv = NULL;
+    p.prog = &prog;
+    struct session ss = {0};
+    uint64_t wr_id = 1;
+    static struct ib_counters ctr_before, ctr_after;
+    uint64_t moved = 0; // payload bytes the counter deltas are normalized by
+    struct cpu_cost cpu;
+    int cpu_on = 0;
+    double setup_start = now_sec();
     if (cm_create_channel_and_id(&c))
     {
         err = 1;
@@ -84,173 +552,172 @@ int main(int argc, char **argv)
         err = 1;
         goto cleanup;
     }
-    if (build_pd_cq_qp(&c, IBV_QPT_RC, 256, 128, 128, 1))
-    {
-        err = 1;
-        goto cleanup;
-    }
-    if (cm_client_connect_only(&c, 1, 1))
+    if (build_pd_cq_qp(&c, qpt, 256, 128, 128, 1))
     {
         err = 1;
         goto cleanup;
     }
-
+    rdma_stats_label(c.qp, "bulk-client");
+    uint8_t initiator_depth = 1;
+    uint8_t responder_resources = 1;
     struct rdma_conn_param connp = {0};
-    if (cm_wait_connected(&c, &connp))
-    {
-        err = 1;
-        goto cleanup;
-    }
-
     struct bulk_info info = {0};
-    if (connp.private_data && connp.private_data_len >= sizeof(info))
+    if (qpt == IBV_QPT_UC)
     {
-        memcpy(&info, connp.private_data, sizeof(info));
+        if (cm_client_connect_uc(&c, &info, sizeof(info)))
+        {
+            err = 1;
+            goto cleanup;
+        }
     }
     else
     {
-        fprintf(stderr, "No or short private_data\n");
-        err = 2;
-        goto cleanup;
+        cm_rd_atomic_defaults(&c, &initiator_depth, &responder_resources);
+        if (cm_client_connect_only(&c, initiator_depth, responder_resources))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        if (cm_wait_connected(&c, &connp))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        if (connp.private_data && connp.private_data_len >= sizeof(info))
+        {
+            memcpy(&info, connp.private_data, sizeof(info));
+        }
+        else
+        {
+            fprintf(stderr, "No or short private_data\n");
+            err = 2;
+            goto cleanup;
+        }
     }
 
     uint64_t remote_len = 0;
     unpack_bulk_info(&info, &c.remote_addr, &c.remote_rkey, &remote_len);
+    ib_counters_read_verbs(&ctr_before, c.id->verbs, c.id->port_num);
     if (total > remote_len)
     {
         fprintf(stderr, "Requested %" PRIu64 " bytes, remote has %" PRIu64 "; capping\n", total, remote_len);
         total = remote_len;
     }
 
-    if (alloc_and_reg(&c, &c.buf_tx, &c.mr_tx, (size_t)chunk, IBV_ACCESS_LOCAL_WRITE))
-    {
-        err = 1;
-        goto cleanup;
-    }
-    memset(c.buf_tx, 0x5a, (size_t)chunk);
-
-    struct timespec t0, t1;
-    clock_gettime(CLOCK_MONOTONIC, &t0);
-    const int max_outstanding = 64;
-    const int signal_every = 16;
-    int inflight = 0;
-    uint64_t completed = 0;
-    int current_batch = 0;
-    int batch_sizes[1024];
-    int batch_head = 0;
-    int batch_tail = 0;
-    uint64_t sent = 0;
-    uint64_t wr_id = 1;
-    double last_log = now_sec();
-    double last_cqe = last_log;
-    double start_log = last_log;
-    int csv_rows = 0;
     if (csv_env && *csv_env)
     {
         csv = fopen(csv_env, "w");
         if (!csv)
-        {
             LOG_ERR("failed to open CSV: %s", csv_env);
-        }
+    }
+    unsigned log_ms = (log_ms_env && *log_ms_env) ? (unsigned)strtoul(log_ms_env, NULL, 10) : 1000;
+
+    int depth = (pull || session) ? pick_read_depth(&c, &connp, initiator_depth) : 0;
+    if (pull && !session)
+    {
+        cpu_cost_start(&cpu);
+        cpu_on = 1;
+        bulk_progress_start(&prog, csv, log_env && *log_env, log_ms);
+        if (run_pull(&c, "", total, chunk, depth, &prog, NULL))
+            err = 1;
         else
-        {
-            fprintf(csv, "time_s,sent_mib,inflight,completed,cqe_gap_s\n");
-        }
+            moved = total;
+        rdma_disconnect(c.id);
+        goto cleanup;
     }
-    while (sent < total)
+
+    // An interactive session may mix writes into a pull run, so it always has a source.
+    if (!pull || interactive)
     {
-        uint64_t remaining = total - sent;
-        uint64_t this_chunk = remaining < chunk ? remaining : chunk;
-        current_batch++;
-        int do_signal = (current_batch == signal_every) || (sent + this_chunk == total);
-        if (post_write(c.qp, c.mr_tx, c.buf_tx, c.remote_addr + sent, c.remote_rkey, (size_t)this_chunk, wr_id++,
-                       do_signal))
+        if (bulk_source_open(&src, c.pd, kind, file, total, chunk, ring_depth))
         {
             err = 1;
             goto cleanup;
         }
-        inflight++;
-        if (do_signal)
-        {
-            batch_sizes[batch_tail] = current_batch;
-            batch_tail = (batch_tail + 1) % (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0]));
-            current_batch = 0;
-        }
-        if (inflight >= max_outstanding)
+        total = src.size;
+        if (kind != BULK_SRC_FILL)
+            printf("Sending %" PRIu64 " bytes of %s via %s (register %.3f s)\n", total, file,
+                   bulk_source_kind_str(kind), src.reg_secs);
+        // Trailer and digests, then the slot the server's ack lands in.
+        uint32_t ndigests = verify ? (uint32_t)((total + chunk - 1) / chunk) : 0;
+        p.ack_off = sizeof(struct bulk_trailer) + sizeof(uint32_t) * ndigests;
+        if (alloc_and_reg(&c, &c.buf_tx, &c.mr_tx, p.ack_off + sizeof(struct bulk_ack), IBV_ACCESS_LOCAL_WRITE))
         {
-            struct ibv_wc wc;
-            if (poll_one(c.cq, &wc))
-            {
-                err = 1;
-                goto cleanup;
-            }
-            inflight -= batch_sizes[batch_head];
-            completed += (uint64_t)batch_sizes[batch_head];
-            batch_head = (batch_head + 1) % (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0]));
-            last_cqe = now_sec();
-        }
-        sent += this_chunk;
-
-        if (log_on)
-        {
-            double now = now_sec();
-            if (now - last_log >= 1.0)
-            {
-                double mib = (double)sent / (1024.0 * 1024.0);
-                LOGF("DATA", "progress sent=%" PRIu64 "B (%.2f MiB) inflight=%d completed=%" PRIu64,
-                     sent, mib, inflight, completed);
-                if (now - last_cqe > 2.0)
-                {
-                    LOGF("DATA", "no CQE for %.1fs (likely retries/backoff)", now - last_cqe);
-                }
-                if (csv)
-                {
-                    fprintf(csv, "%.2f,%.3f,%d,%" PRIu64 ",%.2f\n",
-                            now - start_log, mib, inflight, completed, now - last_cqe);
-                    fflush(csv);
-                    csv_rows++;
-                }
-                last_log = now;
-            }
+            err = 1;
+            goto cleanup;
         }
+        p.digests = (uint32_t *)((struct bulk_trailer *)c.buf_tx + 1);
+        if (verify)
+            printf("Integrity mode: CRC32C (%s) per %" PRIu64 "-byte chunk\n", crc32c_impl(), chunk);
+        if (imm)
+            printf("Sequenced WRITE_WITH_IMM stream over %s: a lost packet drops its whole %" PRIu64
+                   "-byte chunk%s\n",
+                   qpt == IBV_QPT_UC ? "UC" : "RC", chunk, qpt == IBV_QPT_UC ? "" : " (RC retransmits it)");
     }
-    while (batch_head != batch_tail)
+
+    double run_start = now_sec();
+    cpu_cost_start(&cpu);
+    cpu_on = 1;
+    // After cpu_cost_start: its perf counters only follow threads created later, and the sampler's CPU is
+    // part of the run's cost.
+    bulk_progress_start(&prog, csv, log_env && *log_env, log_ms);
+
+    if (session)
     {
-        struct ibv_wc wc;
-        if (poll_one(c.cq, &wc))
-        {
+        ss.setup_secs = run_start - setup_start;
+        int rc = 0;
+        if (interactive)
+            rc = session_stdin(&c, &ss, remote_len, total, &src, &p, &wr_id, depth);
+        for (long i = 0; !interactive && i < iters && rc == 0; i++)
+            rc = session_pass(&c, &ss, pull ? SESSION_READ : SESSION_WRITE, total, &src, &p, &wr_id, depth);
+        session_report(&ss);
+        moved = ss.bytes;
+        if (rc)
             err = 1;
-            goto cleanup;
-        }
-        inflight -= batch_sizes[batch_head];
-        completed += (uint64_t)batch_sizes[batch_head];
-        batch_head = (batch_head + 1) % (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0]));
-        last_cqe = now_sec();
+        else if (ss.bad)
+            err = 3;
+        rdma_disconnect(c.id);
+        goto cleanup;
     }
-    clock_gettime(CLOCK_MONOTONIC, &t1);
 
-    double secs = elapsed_sec(&t0, &t1);
-    double mib = (double)sent / (1024.0 * 1024.0);
-    printf("RDMA client wrote %" PRIu64 " bytes in %.3f s (%.2f MiB/s)\n", sent, secs, mib / secs);
+    struct push_result r;
+    if (run_push(&c, &src, total, &p, &wr_id, &r))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    report_push("", &p, &src, &r);
+    moved = r.sent;
+    if (send_trailer(&c, &p, r.sent, 0, NULL))
+    {
+        err = 1;
+        goto cleanup;
+    }
 
     rdma_disconnect(c.id);
 
 cleanup:
-    if (csv)
+    bulk_progress_stop(&prog);
+    if (cpu_on)
     {
-        if (csv_rows == 0)
-        {
-            double now = now_sec();
-            fprintf(csv, "%.2f,%.3f,%d,%" PRIu64 ",%.2f\n",
-                    now - start_log, mib, inflight, completed, now - last_cqe);
-        }
-        fclose(csv);
+        // Every data WR carries one chunk, the last one possibly short.
+        cpu_cost_stop(&cpu);
+        if (moved)
+            cpu_cost_report("client", &cpu, moved, session ? ss.wqes : (moved + chunk - 1) / chunk, "wqe");
     }
+    if (ctr_before.n)
+    {
+        ib_counters_read(&ctr_after, ctr_before.dev, ctr_before.port);
+        ib_counters_report("client", &ctr_before, &ctr_after, moved);
+    }
+    if (csv)
+        fclose(csv);
+    free(ss.mibs);
+    bulk_source_close(&src);
     mem_free_all(&c);
-    if (c.qp)
-        rdma_destroy_qp(c.id);
+    destroy_qp(&c);
     if (c.cq)
-        ibv_destroy_cq(c.cq);
+        cq_ts_destroy(c.cq);
     if (c.pd)
         ibv_dealloc_pd(c.pd);
     if (c.id)
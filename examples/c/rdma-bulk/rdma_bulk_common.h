@@ -1,9 +1,64 @@
 #pragma once
 
 #include <ctype.h>
+#include <infiniband/verbs.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/*
+ * Trailer the client SENDs after its last WRITE (RC ordering puts it behind every chunk):
+ * bytes written, chunk size and, in integrity mode, one CRC32C per chunk following the header.
+ * All fields are big-endian on the wire.
+ *
+ * In session mode (RDMA_BULK_ITERS > 1 or RDMA_BULK_SESSION=stdin) each iteration ends with a trailer
+ * flagged BULK_TRAILER_ACK. The server checks it, reposts its RECV and SENDs back a bulk_ack.
+ * The client does not overwrite the buffer until that ack arrives.
+ */
+#define BULK_MIN_VERIFY_CHUNK 4096
+#define BULK_TRAILER_ACK 0x1u
+
+struct bulk_ack
+{
+    uint32_t iter; // 1-based iteration the server finished
+    uint32_t bad;  // chunks whose digest did not match (0 without digests)
+} __attribute__((packed));
+
+struct bulk_trailer
+{
+    uint64_t len;
+    uint64_t chunk;
+    uint32_t ndigests;
+    uint32_t flags; // BULK_TRAILER_ACK
+} __attribute__((packed));
+
+// Largest trailer a server exposing `total` bytes must be ready to receive.
+static inline size_t bulk_trailer_max(uint64_t total)
+{
+    return sizeof(struct bulk_trailer) + sizeof(uint32_t) * (size_t)(total / BULK_MIN_VERIFY_CHUNK + 1);
+}
+
+/*
+ * Transport for the WRITE stream, set the same on both sides: RDMA_BULK_QP=rc (default) or uc.
+ * UC drops a damaged message instead of going back N, so every chunk is sent as WRITE_WITH_IMM
+ * with its chunk index as immediate data and the server counts the gaps. RDMA_BULK_IMM=1 sends
+ * the same sequenced stream over RC for comparison. Returns -1 for an unknown QP type.
+ */
+#define BULK_IMM_RECVS 256
+
+static inline int bulk_qp_from_env(enum ibv_qp_type *qpt, int *imm)
+{
+    const char *qp_env = getenv("RDMA_BULK_QP");
+    const char *imm_env = getenv("RDMA_BULK_IMM");
+    *qpt = IBV_QPT_RC;
+    if (qp_env && strcmp(qp_env, "uc") == 0)
+        *qpt = IBV_QPT_UC;
+    else if (qp_env && *qp_env && strcmp(qp_env, "rc") != 0)
+        return -1;
+    *imm = *qpt == IBV_QPT_UC || (imm_env && *imm_env && strcmp(imm_env, "0") != 0);
+    return 0;
+}
 
 static inline uint64_t parse_size_bytes(const char *s)
 {
@@ -1,18 +1,35 @@
 /**
  * RDMA bulk server: expose a large buffer and wait for client RDMA WRITEs.
+ * With an output file, the received bytes are written out after the client disconnects.
+ * If the client sent per-chunk CRC32C digests, the buffer is verified with several threads first.
+ * In sequenced mode (RDMA_BULK_QP=uc or RDMA_BULK_IMM=1) every chunk arrives as WRITE_WITH_IMM and
+ * the server counts missing chunk indices and the spacing between arrivals.
+ * A session client (RDMA_BULK_ITERS / RDMA_BULK_SESSION) writes many times over one connection; every
+ * iteration's trailer is checked and acknowledged here before the client reuses the buffer.
+ * RDMA_METRICS_PORT=<port> serves the QP counters and the session totals to Prometheus on localhost.
+ * The port's sysfs counters are snapshotted around the transfer and reported per GiB received.
  */
 
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "common.h"
+#include "cpu_cost.h"
+#include "crc32c.h"
+#include "ib_counters.h"
+#include "metrics_http.h"
 #include "rdma_builders.h"
 #include "rdma_cm_helpers.h"
 #include "rdma_ctx.h"
 #include "rdma_mem.h"
+#include "rdma_ops.h"
+#include "rdma_stats.h"
 #include "rdma_bulk_common.h"
 
 #define DEFAULT_PORT "7471"
@@ -37,17 +54,407 @@ static double elapsed_sec(const struct timespec *start, const struct timespec *e
     return s + ns;
 }
 
+struct verify_job
+{
+    const char *buf;
+    uint64_t len;
+    uint64_t chunk;
+    const uint32_t *digests; // big-endian, one per chunk
+    uint32_t first, last;    // chunk range [first, last)
+    uint32_t bad;
+    uint32_t first_bad;
+};
+
+static void *verify_worker(void *arg)
+{
+    struct verify_job *j = arg;
+    for (uint32_t i = j->first; i < j->last; i++)
+    {
+        uint64_t off = (uint64_t)i * j->chunk;
+        uint64_t n = j->len - off < j->chunk ? j->len - off : j->chunk;
+        if (crc32c(0, j->buf + off, (size_t)n) != ntohl(j->digests[i]))
+        {
+            if (j->bad++ == 0)
+                j->first_bad = i;
+        }
+    }
+    return NULL;
+}
+
+// Check every chunk against the client's digests, split across threads; returns bad chunk count.
+static uint32_t verify_chunks(const char *buf, uint64_t len, uint64_t chunk, const uint32_t *digests,
+                              uint32_t ndigests)
+{
+    const char *env = getenv("RDMA_BULK_VERIFY_THREADS");
+    long nthreads = (env && *env) ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > 64)
+        nthreads = 64;
+    if ((uint32_t)nthreads > ndigests)
+        nthreads = (long)ndigests;
+    pthread_t tids[64];
+    struct verify_job jobs[64];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint32_t per = ndigests / (uint32_t)nthreads;
+    uint32_t extra = ndigests % (uint32_t)nthreads;
+    uint32_t next = 0;
+    long started = 0;
+    for (long t = 0; t < nthreads; t++)
+    {
+        uint32_t n = per + ((uint32_t)t < extra ? 1 : 0);
+        jobs[t] = (struct verify_job){
+            .buf = buf, .len = len, .chunk = chunk, .digests = digests, .first = next, .last = next + n};
+        next += n;
+        if (pthread_create(&tids[t], NULL, verify_worker, &jobs[t]))
+            verify_worker(&jobs[t]); // fall back to checking this range inline
+        else
+            started = t + 1;
+    }
+    uint32_t bad = 0;
+    uint32_t first_bad = ndigests;
+    for (long t = 0; t < nthreads; t++)
+    {
+        if (t < started)
+            pthread_join(tids[t], NULL);
+        bad += jobs[t].bad;
+        if (jobs[t].bad && jobs[t].first_bad < first_bad)
+            first_bad = jobs[t].first_bad;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = elapsed_sec(&t0, &t1);
+    printf("Verified %u chunks with %ld threads (CRC32C %s) in %.3f s (%.2f MiB/s): %s\n", ndigests, nthreads,
+           crc32c_impl(), secs, (double)len / (1024.0 * 1024.0) / secs, bad ? "MISMATCH" : "OK");
+    if (bad)
+        printf("  %u bad chunks, first at chunk %u (offset %" PRIu64 ")\n", bad, first_bad,
+               (uint64_t)first_bad * chunk);
+    return bad;
+}
+
+// chunks, lost and reordered are read by bulk_metrics on the exporter thread: the one writer stores them with
+// relaxed atomics.
+struct imm_stream
+{
+    uint32_t expected; // next chunk index
+    uint64_t chunks;
+    uint64_t lost;
+    uint64_t gaps;
+    uint64_t reordered;
+    double *gap_us; // arrival spacing, for the tail
+    size_t ngap, cap;
+    double last;
+    uint32_t trailer_bytes; // nonzero once the trailer SEND arrived
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void imm_arrival(struct imm_stream *st, uint32_t seq)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    double now = (double)t.tv_sec * 1e6 + (double)t.tv_nsec / 1e3;
+    if (st->chunks && st->ngap == st->cap)
+    {
+        size_t cap = st->cap ? 2 * st->cap : 4096;
+        double *g = realloc(st->gap_us, cap * sizeof(*g));
+        if (g)
+        {
+            st->gap_us = g;
+            st->cap = cap;
+        }
+    }
+    if (st->chunks && st->ngap < st->cap)
+        st->gap_us[st->ngap++] = now - st->last;
+    st->last = now;
+    __atomic_store_n(&st->chunks, st->chunks + 1, __ATOMIC_RELAXED);
+    if (seq < st->expected)
+    {
+        __atomic_store_n(&st->reordered, st->reordered + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (seq > st->expected)
+    {
+        __atomic_store_n(&st->lost, st->lost + (seq - st->expected), __ATOMIC_RELAXED);
+        st->gaps++;
+    }
+    st->expected = seq + 1;
+}
+
+// Drain WRITE_WITH_IMM completions until the trailer SEND arrives or the client disconnects.
+static int receive_imm_stream(rdma_ctx *c, struct imm_stream *st, size_t recv_len)
+{
+    if (fcntl(c->ec->fd, F_SETFL, fcntl(c->ec->fd, F_GETFL) | O_NONBLOCK))
+        return err_errno("fcntl O_NONBLOCK");
+    int disconnected = 0;
+    uint64_t empty = 0; // polls that found nothing, for RDMA_STATS
+    while (!st->trailer_bytes)
+    {
+        struct ibv_wc wcs[32];
+        int n = ibv_poll_cq(c->cq, 32, wcs);
+        if (n < 0)
+        {
+            LOG_ERR("ibv_poll_cq failed");
+            return -1;
+        }
+        if (n == 0)
+            empty++;
+        else
+        {
+            rdma_stats_on_cqes(c->cq, wcs, n, empty);
+            empty = 0;
+        }
+        for (int k = 0; k < n; k++)
+        {
+            if (wcs[k].status == IBV_WC_WR_FLUSH_ERR)
+                return 0; // QP moved to error by the disconnect
+            if (wcs[k].status != IBV_WC_SUCCESS)
+            {
+                LOG_ERR("WC status=%s", ibv_wc_status_str(wcs[k].status));
+                return -1;
+            }
+            if (wcs[k].opcode == IBV_WC_RECV)
+                st->trailer_bytes = wcs[k].byte_len ? wcs[k].byte_len : 1;
+            else if (wcs[k].opcode == IBV_WC_RECV_RDMA_WITH_IMM)
+                imm_arrival(st, ntohl(wcs[k].imm_data));
+            // Every RECV shares the trailer buffer: WRITE_WITH_IMM consumes a RECV but writes no bytes to it.
+            if (post_recv(c->qp, c->mr_rx, c->buf_rx, recv_len, wcs[k].wr_id))
+                return err_errno("ibv_post_recv");
+        }
+        if (n == 0 && disconnected)
+            break;
+        struct rdma_cm_event *ev = NULL;
+        if (!disconnected && rdma_get_cm_event(c->ec, &ev) == 0)
+        {
+            disconnected = ev->event == RDMA_CM_EVENT_DISCONNECTED;
+            rdma_ack_cm_event(ev);
+        }
+        else if (!disconnected && errno != EAGAIN)
+            return err_errno("rdma_get_cm_event");
+    }
+    return 0;
+}
+
+static void report_imm_stream(struct imm_stream *st, uint64_t nchunks)
+{
+    // Chunks after the last one that arrived are only known missing from the trailer's count.
+    if (nchunks > st->expected)
+    {
+        __atomic_store_n(&st->lost, st->lost + (nchunks - st->expected), __ATOMIC_RELAXED);
+        st->gaps++;
+    }
+    uint64_t sent = st->chunks + st->lost;
+    printf("Sequenced stream: %" PRIu64 " chunks arrived, %" PRIu64 " lost in %" PRIu64 " gaps (%.3f%%)",
+           st->chunks, st->lost, st->gaps, sent ? 100.0 * (double)st->lost / (double)sent : 0.0);
+    if (st->reordered)
+        printf(", %" PRIu64 " out of order", st->reordered);
+    printf("%s\n", nchunks ? "" : " (trailer lost: tail loss unknown)");
+    if (st->ngap)
+    {
+        qsort(st->gap_us, st->ngap, sizeof(double), cmp_double);
+        double p50 = st->gap_us[st->ngap / 2];
+        double p99 = st->gap_us[(size_t)(0.99 * (double)(st->ngap - 1))];
+        printf("Arrival spacing: p50=%.1f us p99=%.1f us max=%.1f us\n", p50, p99, st->gap_us[st->ngap - 1]);
+    }
+}
+
+// iters, received and bad are read by bulk_metrics on the exporter thread.
+struct session
+{
+    uint32_t iters;
+    uint64_t last_received;
+    uint64_t received; // over all iterations
+    uint32_t bad;      // over all iterations
+    double last_ack;
+};
+
+// One session iteration finished: check the trailer, then SEND the ack so the client may overwrite the buffer.
+static int finish_iteration(rdma_ctx *c, struct session *ss, uint32_t trailer_bytes, uint64_t total)
+{
+    const struct bulk_trailer *trailer = c->buf_rx;
+    uint64_t received = ntohll_u64(trailer->len);
+    uint64_t chunk = ntohll_u64(trailer->chunk);
+    uint32_t ndigests = ntohl(trailer->ndigests);
+    if (received > total)
+        received = total;
+    if (trailer_bytes < sizeof(*trailer) + sizeof(uint32_t) * (uint64_t)ndigests)
+        ndigests = 0;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    double now = (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+    double secs = now - ss->last_ack;
+    ss->last_ack = now;
+    __atomic_fetch_add(&ss->iters, 1, __ATOMIC_RELAXED);
+    ss->last_received = received;
+    __atomic_fetch_add(&ss->received, received, __ATOMIC_RELAXED);
+    printf("Iteration %u: %" PRIu64 " bytes, %.3f s since the previous ack (%.2f MiB/s)\n", ss->iters, received, secs,
+           (double)received / (1024.0 * 1024.0) / secs);
+    uint32_t bad = 0;
+    if (ndigests && chunk && (received + chunk - 1) / chunk == ndigests)
+        bad = verify_chunks(c->buf_remote, received, chunk, (const uint32_t *)(trailer + 1), ndigests);
+    __atomic_fetch_add(&ss->bad, bad, __ATOMIC_RELAXED);
+
+    if (!c->buf_tx && alloc_and_reg(c, &c->buf_tx, &c->mr_tx, sizeof(struct bulk_ack), IBV_ACCESS_LOCAL_WRITE))
+        return -1;
+    struct bulk_ack *ack = c->buf_tx;
+    ack->iter = htonl(ss->iters);
+    ack->bad = htonl(bad);
+    if (post_recv(c->qp, c->mr_rx, c->buf_rx, bulk_trailer_max(total), 1))
+        return err_errno("ibv_post_recv");
+    if (post_send(c->qp, c->mr_tx, ack, sizeof(*ack), 0, 1))
+        return err_errno("post ack");
+    return 0;
+}
+
+// Serve trailers until the client disconnects. An unflagged trailer is a one-shot run and is left in
+// buf_rx for main(); a BULK_TRAILER_ACK trailer ends one session iteration.
+static int receive_trailers(rdma_ctx *c, struct imm_stream *st, struct session *ss, uint64_t total)
+{
+    if (fcntl(c->ec->fd, F_SETFL, fcntl(c->ec->fd, F_GETFL) | O_NONBLOCK))
+        return err_errno("fcntl O_NONBLOCK");
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    ss->last_ack = (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+    int disconnected = 0;
+    uint64_t empty = 0; // polls that found nothing, for RDMA_STATS
+    for (;;)
+    {
+        struct ibv_wc wcs[8];
+        int n = ibv_poll_cq(c->cq, 8, wcs);
+        if (n < 0)
+        {
+            LOG_ERR("ibv_poll_cq failed");
+            return -1;
+        }
+        if (n == 0)
+            empty++;
+        else
+        {
+            rdma_stats_on_cqes(c->cq, wcs, n, empty);
+            empty = 0;
+        }
+        for (int k = 0; k < n; k++)
+        {
+            if (wcs[k].status == IBV_WC_WR_FLUSH_ERR)
+                return 0; // reposted RECV flushed by the disconnect
+            if (wcs[k].status != IBV_WC_SUCCESS)
+            {
+                LOG_ERR("WC status=%s", ibv_wc_status_str(wcs[k].status));
+                return -1;
+            }
+            if (wcs[k].opcode != IBV_WC_RECV)
+                continue; // ack SEND completions
+            const struct bulk_trailer *trailer = c->buf_rx;
+            if (wcs[k].byte_len >= sizeof(*trailer) && (ntohl(trailer->flags) & BULK_TRAILER_ACK))
+            {
+                if (finish_iteration(c, ss, wcs[k].byte_len, total))
+                    return -1;
+            }
+            else
+                st->trailer_bytes = wcs[k].byte_len;
+        }
+        if (n == 0 && disconnected)
+            break;
+        struct rdma_cm_event *ev = NULL;
+        if (!disconnected && rdma_get_cm_event(c->ec, &ev) == 0)
+        {
+            disconnected = ev->event == RDMA_CM_EVENT_DISCONNECTED;
+            rdma_ack_cm_event(ev);
+        }
+        else if (!disconnected && errno != EAGAIN)
+            return err_errno("rdma_get_cm_event");
+    }
+    return 0;
+}
+
+static int write_out(const char *path, const char *buf, uint64_t len)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return err_errno("open output");
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(fd, buf + done, (size_t)(len - done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            err_errno("write output");
+            close(fd);
+            return -1;
+        }
+        done += (uint64_t)n;
+    }
+    if (fsync(fd))
+        err_errno("fsync output");
+    close(fd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = elapsed_sec(&t0, &t1);
+    printf("Wrote %" PRIu64 " bytes to %s in %.3f s (%.2f MiB/s incl. fsync)\n", len, path, secs,
+           (double)len / (1024.0 * 1024.0) / secs);
+    return 0;
+}
+
+// Prometheus section (RDMA_METRICS_PORT). Runs on the exporter thread, so it only reads.
+struct bulk_metrics
+{
+    int connected;
+    uint64_t exposed;
+    const struct session *ss;
+    const struct imm_stream *st;
+};
+
+static void bulk_metrics(FILE *out, void *arg)
+{
+    const struct bulk_metrics *m = arg;
+    metrics_family(out, "rdma_bulk_connections", "gauge", "Clients connected (one at a time).");
+    fprintf(out, "rdma_bulk_connections %d\n", __atomic_load_n(&m->connected, __ATOMIC_RELAXED));
+    metrics_family(out, "rdma_bulk_exposed_bytes", "gauge", "Size of the registered target buffer.");
+    fprintf(out, "rdma_bulk_exposed_bytes %" PRIu64 "\n", m->exposed);
+    metrics_family(out, "rdma_bulk_session_iterations_total", "counter", "Session passes checked and acknowledged.");
+    fprintf(out, "rdma_bulk_session_iterations_total %u\n", __atomic_load_n(&m->ss->iters, __ATOMIC_RELAXED));
+    metrics_family(out, "rdma_bulk_received_bytes_total", "counter", "Bytes acknowledged over all session passes.");
+    fprintf(out, "rdma_bulk_received_bytes_total %" PRIu64 "\n", metrics_u64(&m->ss->received));
+    metrics_family(out, "rdma_bulk_bad_chunks_total", "counter", "Chunks whose CRC32C did not match the client's.");
+    fprintf(out, "rdma_bulk_bad_chunks_total %u\n", __atomic_load_n(&m->ss->bad, __ATOMIC_RELAXED));
+    metrics_family(out, "rdma_bulk_imm_chunks_total", "counter", "Sequenced chunks by outcome.");
+    fprintf(out, "rdma_bulk_imm_chunks_total{outcome=\"arrived\"} %" PRIu64 "\n", metrics_u64(&m->st->chunks));
+    fprintf(out, "rdma_bulk_imm_chunks_total{outcome=\"lost\"} %" PRIu64 "\n", metrics_u64(&m->st->lost));
+    fprintf(out, "rdma_bulk_imm_chunks_total{outcome=\"reordered\"} %" PRIu64 "\n", metrics_u64(&m->st->reordered));
+}
+
 int main(int argc, char **argv)
 {
     int err = 0;
     const char *port = (argc >= 2) ? argv[1] : DEFAULT_PORT;
     const char *size_str = (argc >= 3) ? argv[2] : "1G";
+    const char *out_path = (argc >= 4) ? argv[3] : NULL;
     uint64_t total = parse_size_bytes(size_str);
     if (total == 0)
     {
-        fprintf(stderr, "Usage: %s <port> <bytes|K|M|G>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <port> <bytes|K|M|G> [out-file]\n", argv[0]);
+        return 1;
+    }
+    enum ibv_qp_type qpt;
+    int imm = 0;
+    if (bulk_qp_from_env(&qpt, &imm))
+    {
+        fprintf(stderr, "RDMA_BULK_QP must be rc or uc\n");
         return 1;
     }
+    struct imm_stream st = {0};
+    struct session ss = {0};
+    struct bulk_metrics bm = {.exposed = total, .ss = &ss, .st = &st};
+    static struct ib_counters ctr_before, ctr_after;
+    if (metrics_http_start(NULL) || metrics_http_add(bulk_metrics, &bm))
+        return 1;
 
     rdma_ctx c = {0};
     if (cm_create_channel_and_id(&c))
@@ -70,11 +477,12 @@ int main(int argc, char **argv)
     c.id = ev->id;
     rdma_ack_cm_event(ev);
 
-    if (build_pd_cq_qp(&c, IBV_QPT_RC, 256, 128, 128, 1))
+    if (build_pd_cq_qp(&c, qpt, 2 * BULK_IMM_RECVS, 128, BULK_IMM_RECVS, 1))
     {
         err = 1;
         goto cleanup;
     }
+    rdma_stats_label(c.qp, "bulk-server");
 
     if (alloc_and_reg(&c, &c.buf_remote, &c.mr_remote, total,
                       IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE))
@@ -83,9 +491,27 @@ int main(int argc, char **argv)
         goto cleanup;
     }
     memset(c.buf_remote, 0, (size_t)total);
+    // The client ends with a SEND carrying the byte count it wrote (and optional digests).
+    // A sequenced stream also consumes one RECV per chunk, so keep a ring posted on the same buffer.
+    size_t trailer_cap = bulk_trailer_max(total);
+    if (alloc_and_reg(&c, &c.buf_rx, &c.mr_rx, trailer_cap, IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < (imm ? BULK_IMM_RECVS : 1); i++)
+    {
+        if (post_recv(c.qp, c.mr_rx, c.buf_rx, trailer_cap, (uint64_t)i + 1))
+        {
+            err_errno("ibv_post_recv");
+            err = 1;
+            goto cleanup;
+        }
+    }
 
     struct bulk_info info = pack_bulk_info((uintptr_t)c.buf_remote, c.mr_remote->rkey, total);
-    if (cm_server_accept_with_priv(&c, &info, sizeof(info)))
+    if (qpt == IBV_QPT_UC ? cm_server_accept_uc(&c, &info, sizeof(info))
+                          : cm_server_accept_with_priv(&c, &info, sizeof(info)))
     {
         err = 1;
         goto cleanup;
@@ -97,35 +523,82 @@ int main(int argc, char **argv)
         goto cleanup;
     }
     rdma_ack_cm_event(ev);
+    __atomic_store_n(&bm.connected, 1, __ATOMIC_RELAXED);
+    ib_counters_read_verbs(&ctr_before, c.id->verbs, c.id->port_num);
 
-    printf("RDMA bulk server exposed %" PRIu64 " bytes\n", total);
+    printf("RDMA bulk server exposed %" PRIu64 " bytes over %s%s\n", total, qpt == IBV_QPT_UC ? "UC" : "RC",
+           imm ? " (sequenced WRITE_WITH_IMM)" : "");
     struct timespec t0, t1;
+    struct cpu_cost cpu;
+    cpu_cost_start(&cpu);
     clock_gettime(CLOCK_MONOTONIC, &t0);
 
-    // Wait for disconnect to mark completion.
-    while (rdma_get_cm_event(c.ec, &ev) == 0)
+    if (imm && receive_imm_stream(&c, &st, trailer_cap))
     {
-        if (ev->event == RDMA_CM_EVENT_DISCONNECTED)
-        {
-            rdma_ack_cm_event(ev);
-            break;
-        }
-        rdma_ack_cm_event(ev);
+        err = 1;
+        goto cleanup;
+    }
+    // Otherwise the disconnect marks completion; session iterations are acknowledged on the way.
+    if (!imm && receive_trailers(&c, &st, &ss, total))
+    {
+        err = 1;
+        goto cleanup;
     }
 
     clock_gettime(CLOCK_MONOTONIC, &t1);
+    cpu_cost_stop(&cpu);
+    __atomic_store_n(&bm.connected, 0, __ATOMIC_RELAXED);
     double secs = elapsed_sec(&t0, &t1);
     double mib = (double)total / (1024.0 * 1024.0);
     printf("RDMA bulk server finished in %.3f s (%.2f MiB/s)\n", secs, mib / secs);
 
+    uint64_t received = total;
+    uint64_t chunk = 0;
+    uint32_t ndigests = 0;
+    const struct bulk_trailer *trailer = c.buf_rx;
+    if (ss.iters)
+    {
+        // Every iteration was checked when it was acknowledged.
+        received = ss.last_received;
+        printf("Session: %u iterations on one connection, %u bad chunks\n", ss.iters, ss.bad);
+        if (ss.bad)
+            err = 3;
+    }
+    else if (st.trailer_bytes >= sizeof(*trailer))
+    {
+        received = ntohll_u64(trailer->len);
+        chunk = ntohll_u64(trailer->chunk);
+        ndigests = ntohl(trailer->ndigests);
+        if (st.trailer_bytes < sizeof(*trailer) + sizeof(uint32_t) * (uint64_t)ndigests)
+            ndigests = 0;
+    }
+    if (received > total)
+        received = total;
+    if (imm)
+        report_imm_stream(&st, chunk ? (received + chunk - 1) / chunk : 0);
+    if (received != total)
+        printf("Client wrote %" PRIu64 " of %" PRIu64 " bytes\n", received, total);
+    // WRITEs cost this side no WQE; a sequenced stream consumes one RECV per chunk.
+    cpu_cost_report("server", &cpu, ss.iters ? ss.received : received, imm ? st.chunks : 0, "wqe");
+    if (ctr_before.n)
+    {
+        ib_counters_read(&ctr_after, ctr_before.dev, ctr_before.port);
+        ib_counters_report("server", &ctr_before, &ctr_after, ss.iters ? ss.received : received);
+    }
+    if (ndigests && chunk && (received + chunk - 1) / chunk == ndigests &&
+        verify_chunks(c.buf_remote, received, chunk, (const uint32_t *)(trailer + 1), ndigests))
+        err = 3;
+    if (out_path && write_out(out_path, c.buf_remote, received))
+        err = 1;
+
 cleanup:
-    if (c.mr_remote)
-        ibv_dereg_mr(c.mr_remote);
+    metrics_http_stop();
+    free(st.gap_us);
+    mem_free_all(&c);
     free(c.buf_remote);
-    if (c.qp)
-        rdma_destroy_qp(c.id);
+    destroy_qp(&c);
     if (c.cq)
-        ibv_destroy_cq(c.cq);
+        cq_ts_destroy(c.cq);
     if (c.pd)
         ibv_dealloc_pd(c.pd);
     if (c.id)
@@ -0,0 +1,228 @@
+/**
+ * Live view of the per-QP counters a process publishes with RDMA_STATS (src/rdma_stats.h).
+ *
+ *   rdma_stat                              list the segments in /dev/shm
+ *   rdma_stat <pid|/name> [ms] [count]     sample every ms (default 1000), count times (default until it exits)
+ *
+ * The segment is mapped read-only; the process being watched does not notice. Each sample prints one line per
+ * live QP with rates over the interval and the current in-flight depth; a slot handed to a new QP since the last
+ * sample (its gen moved) starts its rates from zero.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rdma_stats.h"
+
+static uint64_t rd(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+// Private copy of one slot's counters.
+static void snap(const struct rdma_stats_qp *s, struct rdma_stats_qp *out)
+{
+    out->in_use = __atomic_load_n(&s->in_use, __ATOMIC_ACQUIRE);
+    out->gen = s->gen;
+    out->qp_num = s->qp_num;
+    memcpy(out->dev, s->dev, sizeof(out->dev));
+    out->dev[RDMA_STATS_LABEL - 1] = '\0';
+    memcpy(out->label, s->label, sizeof(out->label));
+    out->label[RDMA_STATS_LABEL - 1] = '\0';
+    out->bytes_posted = rd(&s->bytes_posted);
+    out->bytes_recv = rd(&s->bytes_recv);
+    out->signaled = rd(&s->signaled);
+    out->unsignaled = rd(&s->unsignaled);
+    out->cqes = rd(&s->cqes);
+    out->error_cqes = rd(&s->error_cqes);
+    out->empty_polls = rd(&s->empty_polls);
+    out->inflight = rd(&s->inflight);
+    out->max_inflight = rd(&s->max_inflight);
+    for (int op = 0; op < RDMA_STATS_NOPS; op++)
+        out->posted[op] = rd(&s->posted[op]);
+    out->lat_sum_ns = rd(&s->lat_sum_ns);
+    out->nic_lat_sum_ns = rd(&s->nic_lat_sum_ns);
+    out->poll_lat_sum_ns = rd(&s->poll_lat_sum_ns);
+    for (int b = 0; b < RDMA_STATS_LAT_BUCKETS; b++)
+    {
+        out->lat_hist[b] = rd(&s->lat_hist[b]);
+        out->nic_lat_hist[b] = rd(&s->nic_lat_hist[b]);
+        out->poll_lat_hist[b] = rd(&s->poll_lat_hist[b]);
+    }
+}
+
+// Upper bound, in us, of the bucket holding quantile q of the latencies a histogram gained from a to b; -1 if none.
+static double lat_quantile_us(const uint64_t *a, const uint64_t *b, double q)
+{
+    uint64_t n = 0, seen = 0;
+    for (int i = 0; i < RDMA_STATS_LAT_BUCKETS; i++)
+        n += b[i] - a[i];
+    if (!n)
+        return -1.0;
+    for (int i = 0; i < RDMA_STATS_LAT_BUCKETS; i++)
+    {
+        seen += b[i] - a[i];
+        if ((double)seen >= q * (double)n)
+            return rdma_stats_lat_bound_ns(i) ? (double)rdma_stats_lat_bound_ns(i) / 1e3 : INFINITY;
+    }
+    return INFINITY;
+}
+
+static int list_segments(void)
+{
+    DIR *d = opendir("/dev/shm");
+    if (!d)
+    {
+        perror("opendir /dev/shm");
+        return 1;
+    }
+    int found = 0;
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        if (strncmp(e->d_name, "rdma_stats", 10) != 0)
+            continue;
+        printf("/%s\n", e->d_name);
+        found++;
+    }
+    closedir(d);
+    if (!found)
+        printf("no segments (start a program with RDMA_STATS=1)\n");
+    return 0;
+}
+
+static const struct rdma_stats_seg *map_segment(const char *arg)
+{
+    char name[64];
+    if (arg[0] == '/')
+        snprintf(name, sizeof(name), "%s", arg);
+    else
+        snprintf(name, sizeof(name), "/rdma_stats.%s", arg);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "shm_open %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct rdma_stats_seg))
+        p = mmap(NULL, sizeof(struct rdma_stats_seg), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    const struct rdma_stats_seg *seg = p;
+    if (p == MAP_FAILED || __atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != RDMA_STATS_MAGIC ||
+        seg->version != RDMA_STATS_VERSION || seg->slot_size != sizeof(struct rdma_stats_qp))
+    {
+        fprintf(stderr, "%s is not an rdma_stats v%d segment of this build\n", name, RDMA_STATS_VERSION);
+        if (p != MAP_FAILED)
+            munmap(p, sizeof(struct rdma_stats_seg));
+        return NULL;
+    }
+    return seg;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void print_qp(const struct rdma_stats_qp *a, const struct rdma_stats_qp *b, double dt)
+{
+    uint64_t wrs = 0;
+    for (int op = 0; op < RDMA_STATS_OP_RECV; op++)
+        wrs += b->posted[op] - a->posted[op];
+    uint64_t sig = b->signaled - a->signaled, cqes = b->cqes - a->cqes;
+    uint64_t empty = b->empty_polls - a->empty_polls;
+    printf("  %s qp=%u %-12s wr/s=%.0f MiB/s=%.1f sig=%.1f%% cqe/s=%.0f empty/cqe=%.1f err=%llu inflight=%llu "
+           "max=%llu",
+           b->dev, b->qp_num, b->label, (double)wrs / dt, (double)(b->bytes_posted - a->bytes_posted) / dt / (1024.0 * 1024.0),
+           wrs ? 100.0 * (double)sig / (double)wrs : 0.0, (double)cqes / dt,
+           cqes ? (double)empty / (double)cqes : 0.0, (unsigned long long)b->error_cqes,
+           (unsigned long long)b->inflight, (unsigned long long)b->max_inflight);
+    if (b->bytes_recv != a->bytes_recv)
+        printf(" rx_MiB/s=%.1f", (double)(b->bytes_recv - a->bytes_recv) / dt / (1024.0 * 1024.0));
+    double p50 = lat_quantile_us(a->lat_hist, b->lat_hist, 0.5);
+    if (p50 >= 0)
+        printf(" lat_p50_us<=%.1f lat_p99_us<=%.1f", p50, lat_quantile_us(a->lat_hist, b->lat_hist, 0.99));
+    p50 = lat_quantile_us(a->nic_lat_hist, b->nic_lat_hist, 0.5);
+    if (p50 >= 0)
+        printf(" nic_p50_us<=%.1f nic_p99_us<=%.1f poll_p99_us<=%.1f", p50,
+               lat_quantile_us(a->nic_lat_hist, b->nic_lat_hist, 0.99),
+               lat_quantile_us(a->poll_lat_hist, b->poll_lat_hist, 0.99));
+    for (int op = 0; op < RDMA_STATS_NOPS; op++)
+    {
+        if (b->posted[op] != a->posted[op])
+            printf(" %s=%llu", rdma_stats_op_str(op), (unsigned long long)(b->posted[op] - a->posted[op]));
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        return list_segments();
+    const struct rdma_stats_seg *seg = map_segment(argv[1]);
+    if (!seg)
+        return 1;
+    long interval_ms = argc > 2 ? strtol(argv[2], NULL, 10) : 1000;
+    long count = argc > 3 ? strtol(argv[3], NULL, 10) : 0;
+    if (interval_ms <= 0)
+    {
+        fprintf(stderr, "Usage: %s [<pid|/name> [interval_ms] [count]]\n", argv[0]);
+        return 1;
+    }
+
+    static struct rdma_stats_qp prev[RDMA_STATS_MAX_QPS], cur[RDMA_STATS_MAX_QPS];
+    uint32_t nprev = __atomic_load_n(&seg->nslots, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < nprev; i++)
+        snap(&seg->qp[i], &prev[i]);
+    double t_prev = now_s(), t_start = t_prev;
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < nprev; i++)
+        live += prev[i].in_use != 0;
+    printf("rdma_stat prog=%s pid=%d qps=%u\n", seg->prog, seg->pid, live);
+
+    for (long n = 0; count == 0 || n < count; n++)
+    {
+        struct timespec ts = {.tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000L};
+        nanosleep(&ts, NULL);
+        double t = now_s();
+        uint32_t ncur = __atomic_load_n(&seg->nslots, __ATOMIC_ACQUIRE);
+        live = 0;
+        for (uint32_t i = 0; i < ncur; i++)
+        {
+            snap(&seg->qp[i], &cur[i]);
+            if (i >= nprev || cur[i].gen != prev[i].gen)
+                memset(&prev[i], 0, sizeof(prev[i])); // new QP: rates from zero
+            live += cur[i].in_use != 0;
+        }
+        printf("t=%.1fs qps=%u dropped=%llu\n", t - t_start, live, (unsigned long long)seg->dropped);
+        for (uint32_t i = 0; i < ncur; i++)
+        {
+            if (cur[i].in_use)
+                print_qp(&prev[i], &cur[i], t - t_prev);
+        }
+        fflush(stdout);
+        memcpy(prev, cur, sizeof(cur[0]) * ncur);
+        nprev = ncur;
+        t_prev = t;
+        if (kill(seg->pid, 0) != 0 && errno == ESRCH)
+        {
+            printf("pid %d exited\n", seg->pid);
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * Region directory client: fetch the server's region table with one READ right after ESTABLISHED,
+ * then follow its WRITE_WITH_IMM pushes. Every region that appears (initially or later) is READ
+ * and its "rdir slot <n>" tag checked, all on the one connection.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+#include "region_dir.h"
+
+#define DEFAULT_PORT "7479"
+#define WRID_FETCH 1
+#define WRID_VERIFY_BASE 1000
+#define TAG_BYTES 32
+
+struct client
+{
+    rdma_ctx c;
+    struct rdir_view v;
+    int outstanding;
+    uint64_t verified, mismatched;
+};
+
+static int verify_region(struct client *cl, uint32_t slot)
+{
+    const struct rdir_region *r = &cl->v.regions[slot];
+    if (post_read(cl->c.qp, cl->c.mr_rx, (char *)cl->c.buf_rx + (size_t)slot * TAG_BYTES, r->addr, r->rkey, TAG_BYTES,
+                  WRID_VERIFY_BASE + slot, 1))
+        return err_errno("post_read verify");
+    cl->outstanding++;
+    return 0;
+}
+
+static void check_tag(struct client *cl, uint32_t slot)
+{
+    char want[TAG_BYTES];
+    const char *got = (const char *)cl->c.buf_rx + (size_t)slot * TAG_BYTES;
+    snprintf(want, sizeof(want), "rdir slot %u", slot);
+    if (strncmp(got, want, sizeof(want)) == 0)
+        cl->verified++;
+    else
+    {
+        cl->mismatched++;
+        LOG_ERR("slot %u: read '%.*s', expected '%s'", slot, TAG_BYTES, got, want);
+    }
+}
+
+static void print_region(const struct rdir_view *v, uint32_t slot, const char *why)
+{
+    const struct rdir_region *r = &v->regions[slot];
+    if (r->len)
+        printf("%s slot %u gen %u: addr=%#" PRIx64 " len=%" PRIu64 " rkey=0x%x\n", why, slot, r->gen, r->addr,
+               r->len, r->rkey);
+    else
+        printf("%s slot %u gen %u: retracted\n", why, slot, r->gen);
+}
+
+// One loop for the fetch READ, pushes and verification READs, until the server's end marker.
+static int run(struct client *cl)
+{
+    int fetched = 0, ended = 0;
+    while (!(fetched && ended && cl->outstanding == 0))
+    {
+        struct ibv_wc wc[16];
+        int n = ibv_poll_cq(cl->c.cq, 16, wc);
+        if (n < 0)
+            return err_errno("ibv_poll_cq");
+        for (int i = 0; i < n; i++)
+        {
+            if (wc[i].status != IBV_WC_SUCCESS)
+                ERRF("wr_id %" PRIu64 ": %s", (uint64_t)wc[i].wr_id, ibv_wc_status_str(wc[i].status));
+            if (wc[i].opcode == IBV_WC_RECV_RDMA_WITH_IMM)
+            {
+                uint32_t imm = ntohl(wc[i].imm_data), slot = 0;
+                if (imm == RDIR_IMM_END)
+                {
+                    ended = 1;
+                    continue;
+                }
+                int rc = rdir_view_apply(&cl->v, cl->c.qp, imm, &slot);
+                if (rc < 0)
+                    return -1;
+                if (rc == 1)
+                {
+                    print_region(&cl->v, slot, "push ");
+                    if (cl->v.regions[slot].len && verify_region(cl, slot))
+                        return -1;
+                }
+            }
+            else if (wc[i].wr_id == WRID_FETCH)
+            {
+                int changed = rdir_view_load(&cl->v);
+                if (changed < 0)
+                    return -1;
+                fetched = 1;
+                printf("fetched table: %u slots, %d regions\n", cl->v.capacity, changed);
+                for (uint32_t s = 0; s < cl->v.capacity; s++)
+                {
+                    if (!cl->v.regions[s].len)
+                        continue;
+                    print_region(&cl->v, s, "table");
+                    if (verify_region(cl, s))
+                        return -1;
+                }
+            }
+            else if (wc[i].wr_id >= WRID_VERIFY_BASE)
+            {
+                cl->outstanding--;
+                check_tag(cl, (uint32_t)(wc[i].wr_id - WRID_VERIFY_BASE));
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <server_ip> [port] [inbox-slots]\n", argv[0]);
+        return 1;
+    }
+    const char *ip = argv[1];
+    const char *port = (argc >= 3) ? argv[2] : DEFAULT_PORT;
+    uint32_t inbox_slots = (argc >= 4) ? (uint32_t)atoi(argv[3]) : 32;
+    if (inbox_slots < 1 || inbox_slots > 1024)
+    {
+        fprintf(stderr, "inbox-slots must be in 1..1024\n");
+        return 1;
+    }
+    int err = 0;
+    struct client cl = {0};
+    rdma_ctx *c = &cl.c;
+
+    if (cm_create_channel_and_id(c) || cm_client_resolve(c, ip, port, getenv("RDMA_SRC_IP")) ||
+        build_pd_cq_qp(c, IBV_QPT_RC, 256 + (int)inbox_slots, 128, (int)inbox_slots, 1) ||
+        rdir_view_init(&cl.v, c->pd, inbox_slots) || rdir_view_post_recvs(&cl.v, c->qp))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    struct rdir_locator inbox = rdir_view_inbox_locator(&cl.v);
+    struct rdma_conn_param connp = {0};
+    if (cm_client_connect_with_priv(c, &inbox, sizeof(inbox)) || cm_wait_connected(c, &connp) ||
+        rdir_view_attach(&cl.v, c->pd, connp.private_data, connp.private_data_len))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (alloc_and_reg(c, &c->buf_rx, &c->mr_rx, (size_t)cl.v.capacity * TAG_BYTES + TAG_BYTES,
+                      IBV_ACCESS_LOCAL_WRITE) ||
+        rdir_view_post_fetch(&cl.v, c->qp, WRID_FETCH) || run(&cl))
+    {
+        err = 1;
+        goto cleanup;
+    }
+
+    uint32_t live = 0;
+    for (uint32_t s = 0; s < cl.v.capacity; s++)
+        live += cl.v.regions[s].len != 0;
+    printf("done on one connection: live regions=%u applied=%" PRIu64 " stale=%" PRIu64 " torn=%" PRIu64
+           " verified=%" PRIu64 " mismatched=%" PRIu64 "\n",
+           live, cl.v.applied, cl.v.stale, cl.v.torn, cl.verified, cl.mismatched);
+    if (cl.mismatched)
+        err = 1;
+    rdma_disconnect(c->id);
+
+cleanup:
+    mem_free_all(c);
+    destroy_qp(c);
+    rdir_view_destroy(&cl.v);
+    if (c->cq)
+        cq_ts_destroy(c->cq);
+    if (c->pd)
+        ibv_dealloc_pd(c->pd);
+    if (c->id)
+        rdma_destroy_id(c->id);
+    if (c->ec)
+        rdma_destroy_event_channel(c->ec);
+    return err;
+}
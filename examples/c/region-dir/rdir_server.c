@@ -0,0 +1,187 @@
+/**
+ * Region directory server: publish a table of exposed buffers, then keep exposing new buffers and
+ * retracting old ones on the live connection. Each change is pushed to the client with
+ * WRITE_WITH_IMM (src/region_dir.h); the client never reconnects.
+ *
+ * Every region starts with the string "rdir slot <n>" so the client can check what it READs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_ops.h"
+#include "region_dir.h"
+
+#define DEFAULT_PORT "7479"
+#define WRID_PUSH 1
+
+struct exposed
+{
+    void *buf;
+    struct ibv_mr *mr;
+};
+
+static int expose(struct ibv_pd *pd, struct rdir_table *t, struct exposed *x, uint32_t slot, size_t size)
+{
+    int rc = posix_memalign(&x->buf, 4096, size);
+    if (rc)
+    {
+        x->buf = NULL;
+        errno = rc;
+        return err_errno("posix_memalign");
+    }
+    memset(x->buf, 0, size);
+    snprintf(x->buf, size, "rdir slot %u", slot);
+    x->mr = ibv_reg_mr(pd, x->buf, size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+    if (!x->mr)
+        return err_errno("ibv_reg_mr");
+    return rdir_table_set(t, slot, (uintptr_t)x->buf, size, x->mr->rkey);
+}
+
+static int push_and_wait(rdma_ctx *c, struct rdir_table *t, uint32_t slot, struct rdir_sub *sub)
+{
+    if (rdir_push(c->qp, t, slot, sub, WRID_PUSH) || poll_one(c->cq, NULL))
+        ERRF("push of slot %u failed", slot);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *port = (argc >= 2) ? argv[1] : DEFAULT_PORT;
+    uint32_t initial = (argc >= 3) ? (uint32_t)atoi(argv[2]) : 8;
+    uint32_t updates = (argc >= 4) ? (uint32_t)atoi(argv[3]) : 16;
+    size_t region_size = (argc >= 5) ? (size_t)strtoull(argv[4], NULL, 0) : 64 * 1024;
+    int interval_ms = (argc >= 6) ? atoi(argv[5]) : 100;
+    if (region_size < 64)
+    {
+        fprintf(stderr, "region-size must be >= 64\n");
+        return 1;
+    }
+    // Every update either exposes a new slot or retracts one, so this never runs out.
+    uint32_t capacity = initial + updates;
+    int err = 0;
+    rdma_ctx c = {0};
+    struct rdir_table t = {0};
+    struct rdir_sub sub = {0};
+    struct exposed *x = calloc(capacity ? capacity : 1, sizeof(*x));
+    if (!x)
+        return 1;
+
+    if (cm_create_channel_and_id(&c) || cm_server_listen(&c, getenv("RDMA_BIND_IP"), port))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    printf("rdir server on %s: %u regions, %u updates, capacity %u\n", port, initial, updates, capacity);
+    fflush(stdout);
+
+    struct rdma_cm_event *ev = NULL;
+    if (cm_wait_event(&c, RDMA_CM_EVENT_CONNECT_REQUEST, &ev))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    c.id = ev->id;
+    int sub_rc = rdir_sub_init(&sub, ev->param.conn.private_data, ev->param.conn.private_data_len); // before ack
+    rdma_ack_cm_event(ev);
+    if (sub_rc)
+    {
+        rdma_reject(c.id, NULL, 0);
+        err = 1;
+        goto cleanup;
+    }
+
+    if (build_pd_cq_qp(&c, IBV_QPT_RC, 64, 32, 1, 1) || rdir_table_init(&t, c.pd, capacity))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    for (uint32_t i = 0; i < initial; i++)
+    {
+        if (expose(c.pd, &t, &x[i], i, region_size))
+        {
+            err = 1;
+            goto cleanup;
+        }
+    }
+    struct rdir_locator loc = rdir_table_locator(&t);
+    if (cm_server_accept_with_priv(&c, &loc, sizeof(loc)) || cm_wait_event(&c, RDMA_CM_EVENT_ESTABLISHED, &ev))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    rdma_ack_cm_event(ev);
+    printf("client connected: inbox of %u slots\n", sub.slots);
+
+    uint32_t next_slot = initial, oldest = 0;
+    struct timespec pause = {.tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000L};
+    for (uint32_t u = 0; u < updates; u++)
+    {
+        nanosleep(&pause, NULL);
+        uint32_t slot;
+        if (u % 4 == 3 && oldest < next_slot)
+        {
+            // Retract: the MR stays registered until teardown, since the client may still be reading it.
+            slot = oldest++;
+            if (rdir_table_set(&t, slot, 0, 0, 0))
+            {
+                err = 1;
+                break;
+            }
+            printf("update %u: retract slot %u (gen %u)\n", u, slot, ntohl(t.entries[slot].gen));
+        }
+        else
+        {
+            slot = next_slot++;
+            if (expose(c.pd, &t, &x[slot], slot, region_size))
+            {
+                err = 1;
+                break;
+            }
+            printf("update %u: expose slot %u (gen %u)\n", u, slot, ntohl(t.entries[slot].gen));
+        }
+        if (push_and_wait(&c, &t, slot, &sub))
+        {
+            err = 1;
+            break;
+        }
+    }
+    if (!err && (rdir_push_end(c.qp, &sub, WRID_PUSH) || poll_one(c.cq, NULL)))
+        err = 1;
+    printf("table gen %u, waiting for disconnect\n", t.gen);
+    fflush(stdout);
+
+    while (!err && rdma_get_cm_event(c.ec, &ev) == 0)
+    {
+        int done = ev->event == RDMA_CM_EVENT_DISCONNECTED;
+        rdma_ack_cm_event(ev);
+        if (done)
+            break;
+    }
+
+cleanup:
+    destroy_qp(&c);
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        if (x[i].mr)
+            ibv_dereg_mr(x[i].mr);
+        free(x[i].buf);
+    }
+    free(x);
+    rdir_table_destroy(&t);
+    if (c.cq)
+        cq_ts_destroy(c.cq);
+    if (c.pd)
+        ibv_dealloc_pd(c.pd);
+    if (c.id)
+        rdma_destroy_id(c.id);
+    if (c.ec)
+        rdma_destroy_event_channel(c.ec);
+    return err;
+}
@@ -1,11 +1,19 @@
 /**
  * TCP bulk sender for throughput comparison.
+ *
+ * Splits the payload over TCP_BULK_STREAMS connections, one sending thread each. With TCP_BULK_ZEROCOPY=1 every
+ * send() carries MSG_ZEROCOPY: the kernel pins the buffer instead of copying it and reports on the socket error
+ * queue when it is done with each call. At most TCP_ZC_WINDOW calls are left unreported before the thread reaps.
+ * TCP_BULK_ENGINE=uring hands each stream to the io_uring engine in tcp_uring.c instead.
  */
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,7 +21,27 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "cpu_cost.h"
 #include "tcp_common.h"
+#include "tcp_uring.h"
+
+#define TCP_ZC_WINDOW 8
+
+struct stream
+{
+    int fd;
+    uint64_t bytes, sent;
+    uint64_t calls; // send() calls that moved data
+    char *buf;
+    size_t buf_sz;
+    int zerocopy;
+    uint32_t zc_calls, zc_done; // MSG_ZEROCOPY send() calls made / reported complete
+    uint64_t zc_copied;         // reported, but the kernel copied after all (e.g. loopback)
+    uint64_t zc_fallback;       // sent without MSG_ZEROCOPY because pinning more memory failed
+    const struct tcp_uring_opts *uring;
+    struct tcp_uring_stats ust;
+    int err;
+};
 
 static double elapsed_sec(const struct timespec *start, const struct timespec *end)
 {
@@ -22,6 +50,113 @@ static double elapsed_sec(const struct timespec *start, const struct timespec *e
     return s + ns;
 }
 
+// Drain zerocopy notifications; each one covers the send() calls numbered [ee_info, ee_data].
+// With block set, first wait until at least one is queued (the error queue raises POLLERR).
+static int zc_reap(struct stream *s, int block)
+{
+    if (block)
+    {
+        struct pollfd p = {.fd = s->fd};
+        if (poll(&p, 1, -1) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            return -1;
+        }
+    }
+    for (;;)
+    {
+        char control[128];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            perror("recvmsg(MSG_ERRQUEUE)");
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+                continue;
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0)
+                continue;
+            uint32_t n = ee->ee_data - ee->ee_info + 1;
+            s->zc_done += n;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                s->zc_copied += n;
+        }
+    }
+}
+
+static void *send_stream(void *arg)
+{
+    struct stream *s = arg;
+    if (s->uring)
+    {
+        s->err = tcp_uring_send(s->fd, s->buf, s->buf_sz, s->bytes, s->uring, &s->ust) != 0;
+        s->sent = s->ust.bytes;
+        return NULL;
+    }
+    while (s->sent < s->bytes)
+    {
+        size_t chunk = s->buf_sz;
+        if (s->bytes - s->sent < chunk)
+            chunk = (size_t)(s->bytes - s->sent);
+        int flags = 0;
+        if (s->zerocopy)
+        {
+            // The buffer may not change until the kernel reports it unpinned; bound what it holds.
+            while (s->zc_calls - s->zc_done >= TCP_ZC_WINDOW)
+            {
+                if (zc_reap(s, 1))
+                    goto fail;
+            }
+            flags = MSG_ZEROCOPY;
+        }
+        ssize_t n = send(s->fd, s->buf, chunk, flags);
+        if (n < 0 && errno == ENOBUFS && flags)
+        {
+            // Pinned pages count against RLIMIT_MEMLOCK: wait for some back, or copy this one.
+            if (s->zc_calls != s->zc_done)
+            {
+                if (zc_reap(s, 1))
+                    goto fail;
+                continue;
+            }
+            s->zc_fallback++;
+            n = send(s->fd, s->buf, chunk, 0);
+            flags = 0;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (n < 0)
+                perror("send");
+            goto fail;
+        }
+        if (flags)
+        {
+            s->zc_calls++;
+            if (zc_reap(s, 0))
+                goto fail;
+        }
+        s->sent += (uint64_t)n;
+        s->calls++;
+    }
+    while (s->zc_calls != s->zc_done)
+    {
+        if (zc_reap(s, 1))
+            goto fail;
+    }
+    return NULL;
+fail:
+    s->err = 1;
+    return NULL;
+}
+
 int main(int argc, char **argv)
 {
     int err = 0;
@@ -39,69 +174,133 @@ int main(int argc, char **argv)
         fprintf(stderr, "Invalid size '%s'\n", size_str);
         return 1;
     }
-
-    int port = atoi(port_str);
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
-    char *buf = NULL;
-    if (fd < 0)
-    {
-        perror("socket");
+    struct tcp_tuning tune;
+    if (tcp_tuning_from_env(&tune))
         return 1;
-    }
-    int one = 1;
-    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct tcp_uring_opts uopts = {.depth = tune.uring_depth, .sqpoll = tune.sqpoll, .zerocopy = tune.zerocopy};
 
+    int port = atoi(port_str);
     struct sockaddr_in addr = {0};
     addr.sin_family = AF_INET;
     addr.sin_port = htons((uint16_t)port);
     if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)
     {
-        perror("inet_pton");
-        err = 1;
-        goto cleanup;
-    }
-    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-    {
-        perror("connect");
-        err = 1;
-        goto cleanup;
+        fprintf(stderr, "inet_pton: invalid address '%s'\n", ip);
+        return 1;
     }
 
+    struct stream streams[TCP_BULK_MAX_STREAMS];
+    pthread_t threads[TCP_BULK_MAX_STREAMS];
+    int started = 0;
+    memset(streams, 0, sizeof(streams));
+    for (int i = 0; i < tune.streams; i++)
+        streams[i].fd = -1;
+
     const size_t buf_sz = 4 * 1024 * 1024;
-    buf = malloc(buf_sz);
-    if (!buf)
+    for (int i = 0; i < tune.streams; i++)
     {
-        perror("malloc");
-        err = 1;
-        goto cleanup;
+        struct stream *s = &streams[i];
+        s->bytes = tcp_stream_share(total, tune.streams, i);
+        s->buf_sz = buf_sz;
+        s->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (s->fd < 0)
+        {
+            perror("socket");
+            err = 1;
+            goto cleanup;
+        }
+        int one = 1;
+        setsockopt(s->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        tcp_apply_tuning(s->fd, &tune);
+        if (tune.uring)
+            s->uring = &uopts;
+        else if (tune.zerocopy)
+        {
+            s->zerocopy = setsockopt(s->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+            if (!s->zerocopy)
+                perror("setsockopt(SO_ZEROCOPY), sending with copies");
+        }
+        if (connect(s->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            perror("connect");
+            err = 1;
+            goto cleanup;
+        }
+        struct tcp_stream_hello hello = {.magic = htonl(TCP_BULK_MAGIC),
+                                         .streams = htonl((uint32_t)tune.streams),
+                                         .index = htonl((uint32_t)i),
+                                         .bytes_hi = htonl((uint32_t)(s->bytes >> 32)),
+                                         .bytes_lo = htonl((uint32_t)s->bytes)};
+        if (tcp_io_full(s->fd, &hello, sizeof(hello), 1))
+        {
+            perror("send(hello)");
+            err = 1;
+            goto cleanup;
+        }
+        // Own buffer per stream: zerocopy pins it, and shared pages would serialize the streams' faults.
+        s->buf = malloc(buf_sz);
+        if (!s->buf)
+        {
+            perror("malloc");
+            err = 1;
+            goto cleanup;
+        }
+        memset(s->buf, 0x5a, buf_sz);
     }
-    memset(buf, 0x5a, buf_sz);
+    tcp_print_tuning("TCP client", streams[0].fd, &tune);
 
-    uint64_t sent = 0;
     struct timespec t0, t1;
+    struct cpu_cost cpu;
+    cpu_cost_start(&cpu);
     clock_gettime(CLOCK_MONOTONIC, &t0);
-    while (sent < total)
+    for (; started < tune.streams; started++)
     {
-        size_t chunk = buf_sz;
-        if (total - sent < chunk)
-            chunk = (size_t)(total - sent);
-        ssize_t n = send(fd, buf, chunk, 0);
-        if (n <= 0)
+        if (pthread_create(&threads[started], NULL, send_stream, &streams[started]))
         {
-            if (n < 0)
-                perror("send");
+            fprintf(stderr, "pthread_create failed\n");
+            err = 1;
             break;
         }
-        sent += (uint64_t)n;
     }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
     clock_gettime(CLOCK_MONOTONIC, &t1);
+    cpu_cost_stop(&cpu);
 
+    uint64_t sent = 0, zc_calls = 0, zc_copied = 0, zc_fallback = 0, cqes = 0, short_sends = 0, calls = 0;
+    for (int i = 0; i < tune.streams; i++)
+    {
+        sent += streams[i].sent;
+        calls += streams[i].calls;
+        cqes += streams[i].ust.cqes;
+        short_sends += streams[i].ust.short_sends;
+        zc_copied += streams[i].ust.zc_copied;
+        zc_calls += streams[i].zc_calls;
+        zc_copied += streams[i].zc_copied;
+        zc_fallback += streams[i].zc_fallback;
+        err |= streams[i].err;
+    }
     double secs = elapsed_sec(&t0, &t1);
     double mib = (double)sent / (1024.0 * 1024.0);
     printf("TCP client sent %llu bytes in %.3f s (%.2f MiB/s)\n", (unsigned long long)sent, secs, mib / secs);
+    // One op per send() call, or per io_uring completion.
+    if (tune.uring)
+        cpu_cost_report("TCP client", &cpu, sent, cqes, "cqe");
+    else
+        cpu_cost_report("TCP client", &cpu, sent, calls, "call");
+    if (tune.uring)
+        printf("TCP client uring cqes=%llu short_sends=%llu zc_copied=%llu\n", (unsigned long long)cqes,
+               (unsigned long long)short_sends, (unsigned long long)zc_copied);
+    else if (tune.zerocopy)
+        printf("TCP client zerocopy sends=%llu copied=%llu fallback=%llu\n", (unsigned long long)zc_calls,
+               (unsigned long long)zc_copied, (unsigned long long)zc_fallback);
 
 cleanup:
-    free(buf);
-    close(fd);
+    for (int i = 0; i < tune.streams; i++)
+    {
+        free(streams[i].buf);
+        if (streams[i].fd >= 0)
+            close(streams[i].fd);
+    }
     return err;
 }
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <arpa/inet.h>
 #include <ctype.h>
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 static inline uint64_t parse_size_bytes(const char *s)
 {
@@ -30,3 +33,127 @@ static inline uint64_t parse_size_bytes(const char *s)
     }
     return val;
 }
+
+/*
+ * Tuning, from the environment on either side (see README.md):
+ *   TCP_BULK_STREAMS    parallel connections, client only; the server learns the count from the first hello
+ *   TCP_BULK_SNDBUF     SO_SNDBUF bytes (K/M/G), 0 = kernel autotuning
+ *   TCP_BULK_RCVBUF     SO_RCVBUF bytes (K/M/G), 0 = kernel autotuning
+ *   TCP_BULK_BUSY_POLL  SO_BUSY_POLL microseconds for blocking receives
+ *   TCP_BULK_ZEROCOPY=1 MSG_ZEROCOPY sends, client only (SEND_ZC under io_uring)
+ *   TCP_BULK_ENGINE     sync (blocking send/recv, default) or uring (tcp_uring.h)
+ *   TCP_BULK_URING_DEPTH sends in flight / receive buffers per stream (default 16)
+ *   TCP_BULK_SQPOLL=1   io_uring submission thread in the kernel
+ */
+#define TCP_BULK_MAX_STREAMS 64
+
+struct tcp_tuning
+{
+    int streams;
+    int sndbuf, rcvbuf;
+    int busy_poll_us;
+    int zerocopy;
+    int uring;
+    unsigned uring_depth;
+    int sqpoll;
+};
+
+static inline int tcp_tuning_from_env(struct tcp_tuning *t)
+{
+    const char *streams = getenv("TCP_BULK_STREAMS");
+    const char *sndbuf = getenv("TCP_BULK_SNDBUF");
+    const char *rcvbuf = getenv("TCP_BULK_RCVBUF");
+    const char *busy = getenv("TCP_BULK_BUSY_POLL");
+    const char *zc = getenv("TCP_BULK_ZEROCOPY");
+    const char *engine = getenv("TCP_BULK_ENGINE");
+    const char *depth = getenv("TCP_BULK_URING_DEPTH");
+    const char *sqpoll = getenv("TCP_BULK_SQPOLL");
+    memset(t, 0, sizeof(*t));
+    t->streams = streams && *streams ? atoi(streams) : 1;
+    t->sndbuf = (int)parse_size_bytes(sndbuf);
+    t->rcvbuf = (int)parse_size_bytes(rcvbuf);
+    t->busy_poll_us = busy && *busy ? atoi(busy) : 0;
+    t->zerocopy = zc && *zc && strcmp(zc, "0") != 0;
+    t->uring = engine && strcmp(engine, "uring") == 0;
+    t->uring_depth = depth && *depth ? (unsigned)atoi(depth) : 16;
+    t->sqpoll = sqpoll && *sqpoll && strcmp(sqpoll, "0") != 0;
+    if (engine && *engine && !t->uring && strcmp(engine, "sync") != 0)
+    {
+        fprintf(stderr, "TCP_BULK_ENGINE must be sync or uring\n");
+        return -1;
+    }
+    if (t->uring_depth < 1 || t->uring_depth > 4096)
+    {
+        fprintf(stderr, "TCP_BULK_URING_DEPTH must be 1..4096\n");
+        return -1;
+    }
+    if (t->streams < 1 || t->streams > TCP_BULK_MAX_STREAMS)
+    {
+        fprintf(stderr, "TCP_BULK_STREAMS must be 1..%d\n", TCP_BULK_MAX_STREAMS);
+        return -1;
+    }
+    return 0;
+}
+
+// Socket buffers must be set before connect()/listen() for the window scale to cover them; accepted sockets
+// inherit the listener's. Failures only warn: the run goes on with the kernel's values.
+static inline void tcp_apply_tuning(int fd, const struct tcp_tuning *t)
+{
+    if (t->sndbuf && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &t->sndbuf, sizeof(t->sndbuf)))
+        perror("setsockopt(SO_SNDBUF)");
+    if (t->rcvbuf && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &t->rcvbuf, sizeof(t->rcvbuf)))
+        perror("setsockopt(SO_RCVBUF)");
+    // Values above net.core.busy_read need CAP_NET_ADMIN.
+    if (t->busy_poll_us && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &t->busy_poll_us, sizeof(t->busy_poll_us)))
+        perror("setsockopt(SO_BUSY_POLL)");
+}
+
+// What the kernel actually granted (it doubles requested buffer sizes for bookkeeping).
+static inline void tcp_print_tuning(const char *who, int fd, const struct tcp_tuning *t)
+{
+    int snd = 0, rcv = 0;
+    socklen_t len = sizeof(snd);
+    getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &snd, &len);
+    len = sizeof(rcv);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcv, &len);
+    printf("%s engine=%s streams=%d zerocopy=%d sndbuf=%d%s rcvbuf=%d%s busy_poll_us=%d", who,
+           t->uring ? "uring" : "sync", t->streams, t->zerocopy, snd, t->sndbuf ? "" : "(auto)", rcv,
+           t->rcvbuf ? "" : "(auto)", t->busy_poll_us);
+    if (t->uring)
+        printf(" uring_depth=%u sqpoll=%d", t->uring_depth, t->sqpoll);
+    printf("\n");
+}
+
+// First bytes on every connection, all fields in network byte order.
+#define TCP_BULK_MAGIC 0x54435042u // "TCPB"
+
+struct tcp_stream_hello
+{
+    uint32_t magic;
+    uint32_t streams; // connections in this run
+    uint32_t index;   // this connection's slot, 0..streams-1
+    uint32_t bytes_hi, bytes_lo;
+};
+
+static inline int tcp_io_full(int fd, void *buf, size_t len, int is_send)
+{
+    char *p = buf;
+    while (len)
+    {
+        ssize_t n = is_send ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Bytes stream `index` of `streams` carries: equal shares, the remainder on the last one.
+static inline uint64_t tcp_stream_share(uint64_t total, int streams, int index)
+{
+    uint64_t share = total / (uint64_t)streams;
+    return index == streams - 1 ? total - share * (uint64_t)(streams - 1) : share;
+}
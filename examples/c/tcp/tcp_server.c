@@ -1,11 +1,16 @@
 /**
  * TCP bulk receiver for throughput comparison.
+ *
+ * Every connection opens with a tcp_stream_hello. The first one tells the server how many streams the client
+ * runs; it accepts the rest and receives each on its own thread, with recv() or, under TCP_BULK_ENGINE=uring,
+ * a multishot io_uring RECV (tcp_uring.c).
  */
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,7 +18,21 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "cpu_cost.h"
 #include "tcp_common.h"
+#include "tcp_uring.h"
+
+struct stream
+{
+    int fd;
+    uint64_t bytes, received;
+    uint64_t calls; // recv() calls that returned data
+    char *buf;
+    size_t buf_sz;
+    const struct tcp_uring_opts *uring;
+    struct tcp_uring_stats ust;
+    int err;
+};
 
 static double elapsed_sec(const struct timespec *start, const struct timespec *end)
 {
@@ -22,6 +41,62 @@ static double elapsed_sec(const struct timespec *start, const struct timespec *e
     return s + ns;
 }
 
+static void *recv_stream(void *arg)
+{
+    struct stream *s = arg;
+    if (s->uring)
+    {
+        s->err = tcp_uring_recv(s->fd, s->buf_sz, s->bytes, s->uring, &s->ust) != 0;
+        s->received = s->ust.bytes;
+        return NULL;
+    }
+    while (s->received < s->bytes)
+    {
+        size_t want = s->buf_sz;
+        if (s->bytes - s->received < want)
+            want = (size_t)(s->bytes - s->received);
+        ssize_t n = recv(s->fd, s->buf, want, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (n < 0)
+                perror("recv");
+            s->err = 1;
+            break;
+        }
+        s->received += (uint64_t)n;
+        s->calls++;
+    }
+    return NULL;
+}
+
+// Accept one connection and read its hello. Returns the slot index, or -1.
+static int accept_stream(int fd, struct tcp_stream_hello *h)
+{
+    int cfd = accept(fd, NULL, NULL);
+    if (cfd < 0)
+    {
+        perror("accept");
+        return -1;
+    }
+    if (tcp_io_full(cfd, h, sizeof(*h), 0) || ntohl(h->magic) != TCP_BULK_MAGIC)
+    {
+        fprintf(stderr, "bad stream hello\n");
+        close(cfd);
+        return -1;
+    }
+    h->streams = ntohl(h->streams);
+    h->index = ntohl(h->index);
+    if (h->streams < 1 || h->streams > TCP_BULK_MAX_STREAMS || h->index >= h->streams)
+    {
+        fprintf(stderr, "bad stream hello (streams=%u index=%u)\n", h->streams, h->index);
+        close(cfd);
+        return -1;
+    }
+    return cfd;
+}
+
 int main(int argc, char **argv)
 {
     int err = 0;
@@ -33,10 +108,18 @@ int main(int argc, char **argv)
         fprintf(stderr, "Usage: %s <port> <bytes|K|M|G>\n", argv[0]);
         return 1;
     }
+    struct tcp_tuning tune;
+    if (tcp_tuning_from_env(&tune))
+        return 1;
+    struct tcp_uring_opts uopts = {.depth = tune.uring_depth, .sqpoll = tune.sqpoll};
 
     int port = atoi(port_str);
-    int cfd = -1;
-    char *buf = NULL;
+    struct stream streams[TCP_BULK_MAX_STREAMS];
+    pthread_t threads[TCP_BULK_MAX_STREAMS];
+    int nstreams = 0, started = 0;
+    memset(streams, 0, sizeof(streams));
+    for (int i = 0; i < TCP_BULK_MAX_STREAMS; i++)
+        streams[i].fd = -1;
     int fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0)
     {
@@ -46,6 +129,7 @@ int main(int argc, char **argv)
     int one = 1;
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
     setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    tcp_apply_tuning(fd, &tune);
 
     struct sockaddr_in addr = {0};
     addr.sin_family = AF_INET;
@@ -57,7 +141,7 @@ int main(int argc, char **argv)
         err = 1;
         goto cleanup;
     }
-    if (listen(fd, 1) < 0)
+    if (listen(fd, TCP_BULK_MAX_STREAMS) < 0)
     {
         perror("listen");
         err = 1;
@@ -65,51 +149,95 @@ int main(int argc, char **argv)
     }
 
     printf("TCP server listening on port %d, expecting %llu bytes\n", port, (unsigned long long)total);
-    cfd = accept(fd, NULL, NULL);
-    if (cfd < 0)
-    {
-        perror("accept");
-        err = 1;
-        goto cleanup;
-    }
-
-    const size_t buf_sz = 4 * 1024 * 1024;
-    buf = malloc(buf_sz);
-    if (!buf)
+    uint64_t announced = 0;
+    for (int i = 0; i == 0 || i < nstreams; i++)
     {
-        perror("malloc");
-        err = 1;
-        goto cleanup;
+        struct tcp_stream_hello h;
+        int cfd = accept_stream(fd, &h);
+        if (cfd < 0)
+        {
+            err = 1;
+            goto cleanup;
+        }
+        if (i == 0)
+            nstreams = (int)h.streams;
+        if ((int)h.streams != nstreams || streams[h.index].fd >= 0)
+        {
+            fprintf(stderr, "stream hello does not match the first one\n");
+            close(cfd);
+            err = 1;
+            goto cleanup;
+        }
+        struct stream *s = &streams[h.index];
+        s->fd = cfd;
+        s->bytes = (uint64_t)ntohl(h.bytes_hi) << 32 | ntohl(h.bytes_lo);
+        s->buf_sz = 4 * 1024 * 1024;
+        if (tune.uring)
+        {
+            s->uring = &uopts; // receives into its own provided-buffer ring of buf_sz bytes
+            announced += s->bytes;
+            continue;
+        }
+        s->buf = malloc(s->buf_sz);
+        if (!s->buf)
+        {
+            perror("malloc");
+            err = 1;
+            goto cleanup;
+        }
+        announced += s->bytes;
     }
+    if (announced != total)
+        fprintf(stderr, "client announced %llu bytes, expected %llu\n", (unsigned long long)announced,
+                (unsigned long long)total);
+    tune.streams = nstreams;
+    tcp_print_tuning("TCP server", streams[0].fd, &tune);
 
-    uint64_t received = 0;
     struct timespec t0, t1;
+    struct cpu_cost cpu;
+    cpu_cost_start(&cpu);
     clock_gettime(CLOCK_MONOTONIC, &t0);
-    while (received < total)
+    for (; started < nstreams; started++)
     {
-        size_t want = buf_sz;
-        if (total - received < want)
-            want = (size_t)(total - received);
-        ssize_t n = recv(cfd, buf, want, 0);
-        if (n <= 0)
+        if (pthread_create(&threads[started], NULL, recv_stream, &streams[started]))
         {
-            if (n < 0)
-                perror("recv");
+            fprintf(stderr, "pthread_create failed\n");
+            err = 1;
             break;
         }
-        received += (uint64_t)n;
     }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
     clock_gettime(CLOCK_MONOTONIC, &t1);
+    cpu_cost_stop(&cpu);
 
+    uint64_t received = 0, cqes = 0, rearms = 0, calls = 0;
+    for (int i = 0; i < nstreams; i++)
+    {
+        received += streams[i].received;
+        calls += streams[i].calls;
+        cqes += streams[i].ust.cqes;
+        rearms += streams[i].ust.rearms;
+        err |= streams[i].err;
+    }
     double secs = elapsed_sec(&t0, &t1);
     double mib = (double)received / (1024.0 * 1024.0);
     printf("TCP server received %llu bytes in %.3f s (%.2f MiB/s)\n", (unsigned long long)received, secs, mib / secs);
+    if (tune.uring)
+        cpu_cost_report("TCP server", &cpu, received, cqes, "cqe");
+    else
+        cpu_cost_report("TCP server", &cpu, received, calls, "call");
+    if (tune.uring)
+        printf("TCP server uring cqes=%llu bytes_per_cqe=%.0f rearms=%llu\n", (unsigned long long)cqes,
+               cqes ? (double)received / (double)cqes : 0.0, (unsigned long long)rearms);
 
 cleanup:
-    if (buf)
-        free(buf);
-    if (cfd >= 0)
-        close(cfd);
+    for (int i = 0; i < TCP_BULK_MAX_STREAMS; i++)
+    {
+        free(streams[i].buf);
+        if (streams[i].fd >= 0)
+            close(streams[i].fd);
+    }
     close(fd);
     return err;
 }
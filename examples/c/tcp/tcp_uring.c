@@ -0,0 +1,176 @@
+/**
+ * io_uring send/receive loops for the TCP bulk tools (see tcp_uring.h).
+ *
+ * Several sends in flight on one TCP socket may go out in any order. The payload is one repeated byte,
+ * so the benchmark doesn't care. A real protocol would link the SQEs (IOSQE_IO_LINK) or frame its records.
+ */
+
+#include "tcp_uring.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "uring_io.h"
+
+#define TCP_URING_MIN_SLOT (64 * 1024)
+#define TCP_URING_BGID 1
+
+static int ring_open(struct uring *r, unsigned entries, const struct tcp_uring_opts *o)
+{
+    int rc = uring_init(r, entries, o->sqpoll ? IORING_SETUP_SQPOLL : 0, 100);
+    if (rc)
+        fprintf(stderr, "uring_init(%s): %s\n", o->sqpoll ? "SQPOLL" : "", strerror(-rc));
+    return rc;
+}
+
+int tcp_uring_send(int fd, char *buf, size_t buf_sz, uint64_t bytes, const struct tcp_uring_opts *o,
+                   struct tcp_uring_stats *st)
+{
+    struct uring r;
+    unsigned depth = o->depth ? o->depth : 1;
+    if (buf_sz / depth < TCP_URING_MIN_SLOT)
+        depth = buf_sz / TCP_URING_MIN_SLOT ? (unsigned)(buf_sz / TCP_URING_MIN_SLOT) : 1;
+    size_t slot = buf_sz / depth;
+    uint64_t queued = 0;
+    unsigned inflight = 0, notifs = 0, next_slot = 0;
+    int err = -1;
+    if (ring_open(&r, depth, o))
+        return -1;
+    struct iovec iov = {.iov_base = buf, .iov_len = buf_sz};
+    int rc = uring_register_buffers(&r, &iov, 1);
+    if (rc)
+    {
+        fprintf(stderr, "uring_register_buffers: %s\n", strerror(-rc));
+        goto out;
+    }
+    while (st->bytes < bytes || notifs)
+    {
+        while (inflight < depth && queued < bytes)
+        {
+            struct io_uring_sqe *sqe = uring_get_sqe(&r);
+            if (!sqe)
+                break;
+            unsigned len = (unsigned)(bytes - queued < slot ? bytes - queued : slot);
+            char *p = buf + (size_t)next_slot * slot;
+            next_slot = (next_slot + 1) % depth;
+            if (o->zerocopy)
+                uring_prep_send_zc_fixed(sqe, fd, p, len, 0, len);
+            else
+                uring_prep_write_fixed(sqe, fd, p, len, 0, 0, len); // offset is ignored on a socket
+            queued += len;
+            inflight++;
+        }
+        rc = uring_submit(&r, 1);
+        if (rc < 0)
+        {
+            fprintf(stderr, "uring_submit: %s\n", strerror(-rc));
+            goto out;
+        }
+        struct io_uring_cqe *cqe;
+        while (uring_peek_cqe(&r, &cqe) == 0)
+        {
+            st->cqes++;
+            if (cqe->flags & IORING_CQE_F_NOTIF)
+            {
+                notifs--;
+                if ((uint32_t)cqe->res & IORING_NOTIF_USAGE_ZC_COPIED)
+                    st->zc_copied++;
+                uring_cqe_seen(&r);
+                continue;
+            }
+            int res = cqe->res;
+            unsigned len = (unsigned)cqe->user_data;
+            if (cqe->flags & IORING_CQE_F_MORE)
+                notifs++; // a SEND_ZC: its buffer notification follows
+            uring_cqe_seen(&r);
+            inflight--;
+            if (res <= 0)
+            {
+                fprintf(stderr, "%s: %s\n", o->zerocopy ? "send_zc" : "write_fixed", res ? strerror(-res) : "EOF");
+                goto out;
+            }
+            st->bytes += (uint64_t)res;
+            if ((unsigned)res < len)
+            {
+                st->short_sends++;
+                queued -= len - (unsigned)res;
+            }
+        }
+    }
+    err = 0;
+out:
+    uring_exit(&r);
+    return err;
+}
+
+int tcp_uring_recv(int fd, size_t buf_sz, uint64_t bytes, const struct tcp_uring_opts *o, struct tcp_uring_stats *st)
+{
+    struct uring r;
+    struct uring_buf_ring b;
+    unsigned entries = 8;
+    while (entries < o->depth && entries < 32768)
+        entries <<= 1;
+    int armed = 0, err = -1;
+    // A completion per segment: the CQ (twice the SQ) must hold a full buffer ring without overflowing.
+    if (ring_open(&r, entries, o))
+        return -1;
+    int rc = uring_buf_ring_init(&r, &b, TCP_URING_BGID, entries, buf_sz / entries);
+    if (rc)
+    {
+        fprintf(stderr, "uring_buf_ring_init: %s\n", strerror(-rc));
+        uring_exit(&r);
+        return -1;
+    }
+    while (st->bytes < bytes)
+    {
+        if (!armed)
+        {
+            uring_prep_recv_multishot(uring_get_sqe(&r), fd, TCP_URING_BGID, 0);
+            rc = uring_submit(&r, 0);
+            if (rc < 0)
+            {
+                fprintf(stderr, "uring_submit: %s\n", strerror(-rc));
+                goto out;
+            }
+            armed = 1;
+        }
+        struct io_uring_cqe *cqe;
+        rc = uring_wait_cqe(&r, &cqe);
+        if (rc)
+        {
+            fprintf(stderr, "uring_wait_cqe: %s\n", strerror(-rc));
+            goto out;
+        }
+        do
+        {
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(&r);
+            st->cqes++;
+            if (!(flags & IORING_CQE_F_MORE))
+            {
+                armed = 0;
+                if (st->bytes + (res > 0 ? (uint64_t)res : 0) < bytes)
+                    st->rearms++;
+            }
+            if (res == -ENOBUFS)
+                continue; // every buffer was full; the ones counted below go back before re-arming
+            if (res <= 0)
+            {
+                fprintf(stderr, "recv multishot: %s\n", res ? strerror(-res) : "EOF");
+                goto out;
+            }
+            st->bytes += (uint64_t)res;
+            if (flags & IORING_CQE_F_BUFFER)
+                uring_buf_ring_recycle(&b, flags >> IORING_CQE_BUFFER_SHIFT);
+        } while (uring_peek_cqe(&r, &cqe) == 0);
+    }
+    err = 0;
+out:
+    // Closing the ring cancels the still-armed RECV.
+    uring_buf_ring_exit(&r, &b);
+    uring_exit(&r);
+    return err;
+}
@@ -0,0 +1,32 @@
+#pragma once
+/**
+ * io_uring engine for tcp_client/tcp_server (TCP_BULK_ENGINE=uring).
+ *
+ * Sender: the 4 MiB stream buffer is registered once and cut into `depth` slots. Up to `depth` sends are
+ * in flight on the socket, each WRITE_FIXED from its slot, or SEND_ZC from the registered buffer with
+ * TCP_BULK_ZEROCOPY=1. Receiver: one multishot RECV fills a provided-buffer ring. Each buffer goes back to
+ * the ring as soon as its completion is counted. With TCP_BULK_SQPOLL=1 a kernel thread takes the submissions.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+struct tcp_uring_opts
+{
+    unsigned depth; // sends in flight / receive buffers, per stream
+    int sqpoll;
+    int zerocopy;
+};
+
+struct tcp_uring_stats
+{
+    uint64_t bytes;
+    uint64_t cqes;
+    uint64_t short_sends; // partial sends whose remainder was queued again
+    uint64_t zc_copied;   // SEND_ZC notifications reporting a copy
+    uint64_t rearms;      // multishot RECVs that ended before the stream did
+};
+
+// Both return 0 once `bytes` have been moved, -1 (with a message) otherwise.
+int tcp_uring_send(int fd, char *buf, size_t buf_sz, uint64_t bytes, const struct tcp_uring_opts *o,
+                   struct tcp_uring_stats *st);
+int tcp_uring_recv(int fd, size_t buf_sz, uint64_t bytes, const struct tcp_uring_opts *o, struct tcp_uring_stats *st);
@@ -0,0 +1,64 @@
+/**
+ * Address handle cache for UD senders (see ah_cache.h).
+ */
+
+#include "ah_cache.h"
+
+#include <string.h>
+
+#include "common.h"
+
+// Compare only the fields that select a route; the struct has padding and reserved members.
+static int same_dest(const struct ibv_ah_attr *a, const struct ibv_ah_attr *b)
+{
+    if (a->is_global != b->is_global || a->dlid != b->dlid || a->sl != b->sl || a->port_num != b->port_num ||
+        a->src_path_bits != b->src_path_bits)
+        return 0;
+    if (!a->is_global)
+        return 1;
+    return memcmp(&a->grh.dgid, &b->grh.dgid, sizeof(a->grh.dgid)) == 0 &&
+           a->grh.sgid_index == b->grh.sgid_index && a->grh.traffic_class == b->grh.traffic_class &&
+           a->grh.hop_limit == b->grh.hop_limit && a->grh.flow_label == b->grh.flow_label;
+}
+
+void ah_cache_init(struct ah_cache *c, struct ibv_pd *pd)
+{
+    memset(c, 0, sizeof(*c));
+    c->pd = pd;
+}
+
+struct ibv_ah *ah_cache_get(struct ah_cache *c, const struct ibv_ah_attr *attr)
+{
+    for (int i = 0; i < c->n; i++)
+    {
+        if (same_dest(&c->entries[i].attr, attr))
+        {
+            c->hits++;
+            return c->entries[i].ah;
+        }
+    }
+    if (c->n == AH_CACHE_MAX)
+    {
+        LOG_ERR("AH cache full (%d entries)", AH_CACHE_MAX);
+        return NULL;
+    }
+    struct ibv_ah_attr copy = *attr;
+    struct ibv_ah *ah = ibv_create_ah(c->pd, &copy);
+    if (!ah)
+    {
+        err_errno("ibv_create_ah");
+        return NULL;
+    }
+    c->entries[c->n].attr = *attr;
+    c->entries[c->n].ah = ah;
+    c->n++;
+    c->misses++;
+    return ah;
+}
+
+void ah_cache_destroy(struct ah_cache *c)
+{
+    for (int i = 0; i < c->n; i++)
+        ibv_destroy_ah(c->entries[i].ah);
+    c->n = 0;
+}
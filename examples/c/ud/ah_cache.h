@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ * Address handle cache: one ibv_ah per distinct destination (GID/LID, SL, port, source GID index).
+ * Many peers (QPs) behind the same address share an AH; creating one per send would dominate the
+ * data path. Lookup is a linear scan, which is fine for the few hundred peers of the labs.
+ */
+
+#include <infiniband/verbs.h>
+#include <stdint.h>
+
+#define AH_CACHE_MAX 256
+
+struct ah_cache_entry
+{
+    struct ibv_ah_attr attr;
+    struct ibv_ah *ah;
+};
+
+struct ah_cache
+{
+    struct ibv_pd *pd;
+    struct ah_cache_entry entries[AH_CACHE_MAX];
+    int n;
+    uint64_t hits, misses;
+};
+
+void ah_cache_init(struct ah_cache *c, struct ibv_pd *pd);
+struct ibv_ah *ah_cache_get(struct ah_cache *c, const struct ibv_ah_attr *attr);
+void ah_cache_destroy(struct ah_cache *c);
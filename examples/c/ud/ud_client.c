@@ -0,0 +1,247 @@
+/**
+ * UD message-rate client: one UD QP sends small datagrams round-robin to 1, 2, 4 .. N peers.
+ *
+ * Every server port is a separate peer (its own QPN). Each is resolved with SIDR on a throwaway
+ * UDP id; the resulting AH attributes go through the AH cache, so peers behind the same address
+ * share one ibv_ah. The data path is a single QP and CQ regardless of the peer count, where RC
+ * would need a connected QP (and its NIC context) per peer.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../rdma-bulk/rdma_bulk_common.h"
+#include "ah_cache.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+#include "ud_common.h"
+
+#define DEFAULT_PORT "7477"
+#define MAX_PEERS 64
+#define TX_SLOTS 256
+#define SIGNAL_EVERY 16
+#define MAX_OUTSTANDING 128
+
+struct peer
+{
+    struct ud_peer addr;
+    struct ibv_ah *ah;
+    uint64_t sent;
+};
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// Wait until at most `limit` WRs are outstanding; every signaled completion retires SIGNAL_EVERY.
+static int reap(struct ibv_cq *cq, int *outstanding, int limit)
+{
+    while (*outstanding > limit)
+    {
+        struct ibv_wc wcs[16];
+        int n = ibv_poll_cq(cq, 16, wcs);
+        if (n < 0)
+        {
+            LOG_ERR("ibv_poll_cq failed");
+            return -1;
+        }
+        for (int k = 0; k < n; k++)
+        {
+            if (wcs[k].status != IBV_WC_SUCCESS)
+            {
+                LOG_ERR("send WC status=%s wr_id=%" PRIu64, ibv_wc_status_str(wcs[k].status), wcs[k].wr_id);
+                return -1;
+            }
+            *outstanding -= SIGNAL_EVERY;
+        }
+    }
+    return 0;
+}
+
+static int resolve_peer(rdma_ctx *c, const char *ip, int port, const char *src_ip, struct ud_peer *out)
+{
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    rdma_ctx t = {.ec = c->ec};
+    if (rdma_create_id(c->ec, &t.id, NULL, RDMA_PS_UDP))
+        return err_errno("rdma_create_id");
+    int rc = cm_client_resolve(&t, ip, port_str, src_ip) || cm_ud_connect(&t, out) ? -1 : 0;
+    rdma_destroy_id(t.id);
+    return rc;
+}
+
+static int send_msg(rdma_ctx *c, struct peer *p, uint64_t seq, uint32_t kind, uint32_t round, uint64_t value,
+                    size_t msg_size, int *outstanding)
+{
+    if (reap(c->cq, outstanding, MAX_OUTSTANDING - 1))
+        return -1;
+    char *buf = (char *)c->buf_tx + (seq % TX_SLOTS) * msg_size;
+    struct ud_msg m = {.kind = kind, .round = round, .value = value};
+    memcpy(buf, &m, sizeof(m));
+    int signaled = (seq + 1) % SIGNAL_EVERY == 0;
+    if (post_send_ud(c->qp, c->mr_tx, buf, msg_size, p->ah, p->addr.qp_num, p->addr.qkey, seq, signaled))
+        return err_errno("ibv_post_send(UD)");
+    (*outstanding)++;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <server_ip> [port] [peers] [msgs-per-round] [msg-size]\n", argv[0]);
+        return 1;
+    }
+    int err = 0;
+    const char *ip = argv[1];
+    const char *port = (argc >= 3) ? argv[2] : DEFAULT_PORT;
+    int npeers = (argc >= 4) ? atoi(argv[3]) : 1;
+    uint64_t msgs = (argc >= 5) ? parse_size_bytes(argv[4]) : 100000;
+    uint64_t msg_size = (argc >= 6) ? parse_size_bytes(argv[5]) : 64;
+    const char *src_ip = getenv("RDMA_SRC_IP");
+    rdma_ctx c = {0};
+    struct ah_cache cache;
+    struct peer *peers = NULL;
+    int outstanding = 0;
+    int have_cache = 0;
+    if (npeers < 1 || npeers > MAX_PEERS || msgs == 0 || msg_size < sizeof(struct ud_msg))
+    {
+        fprintf(stderr, "peers must be 1..%d, msgs > 0, msg-size >= %zu\n", MAX_PEERS, sizeof(struct ud_msg));
+        return 1;
+    }
+    peers = calloc((size_t)npeers, sizeof(*peers));
+    if (!peers)
+        return 1;
+
+    // c.id carries the data-path QP; it also resolves peer 0.
+    if (cm_create_channel_and_id_ps(&c, RDMA_PS_UDP) || cm_client_resolve(&c, ip, port, src_ip))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    if (build_pd_cq_qp(&c, IBV_QPT_UD, 2 * TX_SLOTS, TX_SLOTS, 1, 1))
+    {
+        err = 1;
+        goto cleanup;
+    }
+    // A UD message must fit in one packet: cap it at the active path MTU.
+    struct ibv_port_attr pa;
+    if (ibv_query_port(c.id->verbs, c.id->port_num, &pa))
+    {
+        err_errno("ibv_query_port");
+        err = 1;
+        goto cleanup;
+    }
+    uint64_t mtu = 128ULL << pa.active_mtu;
+    if (msg_size > mtu)
+    {
+        LOG("msg-size %" PRIu64 " exceeds the active MTU; using %" PRIu64, msg_size, mtu);
+        msg_size = mtu;
+    }
+    if (alloc_and_reg(&c, &c.buf_tx, &c.mr_tx, TX_SLOTS * msg_size, IBV_ACCESS_LOCAL_WRITE))
+    {
+        err = 1;
+        goto cleanup;
+    }
+
+    ah_cache_init(&cache, c.pd);
+    have_cache = 1;
+    for (int i = 0; i < npeers; i++)
+    {
+        struct ud_peer *a = &peers[i].addr;
+        if ((i == 0 ? cm_ud_connect(&c, a) : resolve_peer(&c, ip, atoi(port) + i, src_ip, a)) ||
+            !(peers[i].ah = ah_cache_get(&cache, &a->ah_attr)))
+        {
+            LOG_ERR("peer %d (port %d): resolution failed", i, atoi(port) + i);
+            err = 1;
+            goto cleanup;
+        }
+    }
+    printf("UD client: %d peers resolved, %d address handle(s), 1 QP (RC would need %d), msg-size=%" PRIu64
+           " mtu=%" PRIu64 "\n",
+           npeers, cache.n, npeers, msg_size, mtu);
+    printf("   peers        msgs/s       MB/s     avg_ns\n");
+    fflush(stdout);
+
+    uint64_t seq = 0;
+    uint32_t round = 0;
+    for (int active = 1;; active = active * 2 > npeers ? npeers : active * 2, round++)
+    {
+        for (int i = 0; i < active; i++)
+            peers[i].sent = 0;
+        double t0 = now_sec();
+        for (uint64_t i = 0; i < msgs; i++)
+        {
+            struct peer *p = &peers[i % (uint64_t)active];
+            if (send_msg(&c, p, seq, UD_MSG_DATA, round, p->sent, msg_size, &outstanding))
+            {
+                err = 1;
+                goto cleanup;
+            }
+            p->sent++;
+            seq++;
+        }
+        double secs = now_sec() - t0;
+        printf("%8d %13.0f %10.2f %10.1f\n", active, (double)msgs / secs, (double)(msgs * msg_size) / secs / 1e6,
+               secs * 1e9 / (double)msgs);
+        fflush(stdout);
+
+        // Let the server drain its CQ, then report per-peer counts (repeated: UD may drop them too).
+        usleep(50000);
+        for (int rep = 0; rep < 3; rep++)
+        {
+            for (int i = 0; i < active; i++)
+            {
+                if (send_msg(&c, &peers[i], seq, UD_MSG_ROUND_END, round, peers[i].sent, msg_size, &outstanding))
+                {
+                    err = 1;
+                    goto cleanup;
+                }
+                seq++;
+            }
+        }
+        if (active == npeers || round + 1 == UD_MAX_ROUNDS)
+            break;
+        usleep(50000);
+    }
+    // Pad to a signaled WR (kind 0 is ignored by the server) so every send completes before teardown.
+    while (seq % SIGNAL_EVERY)
+    {
+        if (send_msg(&c, &peers[0], seq, 0, round, 0, msg_size, &outstanding))
+        {
+            err = 1;
+            goto cleanup;
+        }
+        seq++;
+    }
+    if (reap(c.cq, &outstanding, 0))
+        err = 1;
+    printf("UD client: ah_cache hits=%" PRIu64 " misses=%" PRIu64 "\n", cache.hits, cache.misses);
+
+cleanup:
+    if (have_cache)
+        ah_cache_destroy(&cache);
+    mem_free_all(&c);
+    destroy_qp(&c);
+    if (c.cq)
+        cq_ts_destroy(c.cq);
+    if (c.pd)
+        ibv_dealloc_pd(c.pd);
+    if (c.id)
+        rdma_destroy_id(c.id);
+    if (c.ec)
+        rdma_destroy_event_channel(c.ec);
+    free(peers);
+    return err;
+}
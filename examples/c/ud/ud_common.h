@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * UD message-rate benchmark.
+ *
+ * The server listens on `ports` consecutive CM ports with RDMA_PS_UDP. Each port owns one UD QP,
+ * shared by every client that resolves it. The client resolves each port as a separate peer
+ * (SIDR), keeps one UD QP of its own and addresses every datagram with an AH from its cache.
+ *
+ * Receive buffers reserve UD_GRH_BYTES in front of the payload: the HCA writes the Global Route
+ * Header there (on RoCE always present, carrying the IP header) before the message body.
+ */
+
+#define UD_GRH_BYTES 40
+#define UD_MAX_ROUNDS 32
+
+#define UD_MSG_DATA 1
+#define UD_MSG_ROUND_END 2 // value = datagrams sent to this peer in the round
+
+struct ud_msg
+{
+    uint32_t kind;
+    uint32_t round;
+    uint64_t value; // sequence number for DATA
+};
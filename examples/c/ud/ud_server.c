@@ -0,0 +1,266 @@
+/**
+ * UD message-rate server: one UD QP per CM port, shared by every client that resolves it.
+ *
+ * A UDP-port-space CONNECT_REQUEST is only a service-ID resolution (SIDR): the reply carries the
+ * QPN and QKey, and no per-client state is created. The first request on a port creates that
+ * port's QP on the request id (which binds it to the right device and port); later requests are
+ * answered with the same QPN and their ids destroyed right away.
+ *
+ * Received datagrams are counted per round; when the client's ROUND_END arrives the server
+ * prints how many of the datagrams sent to this port were dropped (UD has no retransmission, and
+ * a datagram that finds no RECV posted is silently discarded).
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../rdma-bulk/rdma_bulk_common.h"
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_mem.h"
+#include "rdma_ops.h"
+#include "ud_common.h"
+
+#define DEFAULT_PORT "7477"
+#define MAX_PORTS 64
+#define RECV_DEPTH 1024
+#define DEFAULT_MSG_SIZE 64
+
+struct ud_port
+{
+    int port;
+    struct rdma_cm_id *listen;
+    rdma_ctx c; // c.id is the request id that owns the QP
+    size_t slot;
+    int saw_grh;
+    uint64_t requests;
+    uint64_t rx[UD_MAX_ROUNDS];
+    int ended[UD_MAX_ROUNDS];
+};
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static int port_setup_qp(struct ud_port *p, struct rdma_event_channel *ec, struct rdma_cm_id *id)
+{
+    p->c.ec = ec;
+    p->c.id = id;
+    if (build_pd_cq_qp(&p->c, IBV_QPT_UD, RECV_DEPTH + 16, 16, RECV_DEPTH, 1))
+        return -1;
+    if (alloc_and_reg(&p->c, &p->c.buf_rx, &p->c.mr_rx, (size_t)RECV_DEPTH * p->slot, IBV_ACCESS_LOCAL_WRITE))
+        return -1;
+    // Each RECV covers GRH + payload: the HCA always writes the first 40 bytes as a GRH slot.
+    for (int i = 0; i < RECV_DEPTH; i++)
+    {
+        if (post_recv(p->c.qp, p->c.mr_rx, (char *)p->c.buf_rx + (size_t)i * p->slot, p->slot, (uint64_t)i))
+            return err_errno("ibv_post_recv");
+    }
+    printf("UD server: port %d qpn=%u (%d RECVs of %zu bytes)\n", p->port, p->c.qp->qp_num, RECV_DEPTH, p->slot);
+    fflush(stdout);
+    return 0;
+}
+
+static void port_destroy(struct ud_port *p)
+{
+    mem_free_all(&p->c);
+    destroy_qp(&p->c);
+    if (p->c.cq)
+        cq_ts_destroy(p->c.cq);
+    if (p->c.pd)
+        ibv_dealloc_pd(p->c.pd);
+    if (p->c.id)
+        rdma_destroy_id(p->c.id);
+    if (p->listen)
+        rdma_destroy_id(p->listen);
+    memset(p, 0, sizeof(*p));
+}
+
+static void handle_request(struct ud_port *p, struct rdma_event_channel *ec, struct rdma_cm_id *id)
+{
+    p->requests++;
+    if (!p->c.qp)
+    {
+        if (port_setup_qp(p, ec, id) || cm_ud_accept(id, p->c.qp->qp_num))
+        {
+            LOG_ERR("port %d: UD QP setup failed; rejecting", p->port);
+            rdma_reject(id, NULL, 0);
+            mem_free_all(&p->c);
+            destroy_qp(&p->c);
+            if (p->c.cq)
+                cq_ts_destroy(p->c.cq);
+            if (p->c.pd)
+                ibv_dealloc_pd(p->c.pd);
+            rdma_destroy_id(id);
+            memset(&p->c, 0, sizeof(p->c));
+        }
+        return;
+    }
+    if (cm_ud_accept(id, p->c.qp->qp_num))
+        rdma_reject(id, NULL, 0);
+    rdma_destroy_id(id);
+}
+
+static void handle_recv(struct ud_port *p, const struct ibv_wc *wc)
+{
+    char *slot = (char *)p->c.buf_rx + wc->wr_id * p->slot;
+    if ((wc->wc_flags & IBV_WC_GRH) && !p->saw_grh)
+    {
+        p->saw_grh = 1;
+        LOG("port %d: first datagram from qpn=%u carries a GRH (%u bytes incl. header)", p->port, wc->src_qp,
+            wc->byte_len);
+    }
+    if (wc->byte_len >= UD_GRH_BYTES + sizeof(struct ud_msg))
+    {
+        struct ud_msg m;
+        memcpy(&m, slot + UD_GRH_BYTES, sizeof(m));
+        uint32_t r = m.round % UD_MAX_ROUNDS;
+        if (m.kind == UD_MSG_DATA)
+        {
+            if (p->ended[r]) // a new run reuses round numbers
+            {
+                p->ended[r] = 0;
+                p->rx[r] = 0;
+            }
+            p->rx[r]++;
+        }
+        else if (m.kind == UD_MSG_ROUND_END && !p->ended[r]) // ROUND_END is sent several times
+        {
+            p->ended[r] = 1;
+            uint64_t lost = m.value > p->rx[r] ? m.value - p->rx[r] : 0;
+            printf("UD server: port %d round %u sent=%" PRIu64 " received=%" PRIu64 " lost=%" PRIu64 " (%.3f%%)\n",
+                   p->port, m.round, m.value, p->rx[r], lost, m.value ? 100.0 * (double)lost / (double)m.value : 0.0);
+            fflush(stdout);
+        }
+    }
+    if (post_recv(p->c.qp, p->c.mr_rx, slot, p->slot, wc->wr_id))
+        LOG_ERR("port %d: RECV repost failed: %s", p->port, strerror(errno));
+}
+
+int main(int argc, char **argv)
+{
+    int err = 0;
+    const char *port = (argc >= 2) ? argv[1] : DEFAULT_PORT;
+    int nports = (argc >= 3) ? atoi(argv[2]) : 1;
+    uint64_t msg_size = (argc >= 4) ? parse_size_bytes(argv[3]) : DEFAULT_MSG_SIZE;
+    const char *bind_ip = getenv("RDMA_BIND_IP");
+    struct rdma_event_channel *ec = NULL;
+    struct ud_port *ports = NULL;
+    if (nports < 1 || nports > MAX_PORTS || msg_size < sizeof(struct ud_msg))
+    {
+        fprintf(stderr, "Usage: %s [port] [ports<=%d] [msg-size>=%zu]\n", argv[0], MAX_PORTS, sizeof(struct ud_msg));
+        return 1;
+    }
+    ports = calloc((size_t)nports, sizeof(*ports));
+    if (!ports)
+        return 1;
+    signal(SIGINT, on_sigint);
+
+    ec = rdma_create_event_channel();
+    if (!ec)
+    {
+        err_errno("rdma_create_event_channel");
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < nports; i++)
+    {
+        struct ud_port *p = &ports[i];
+        char port_str[16];
+        p->port = atoi(port) + i;
+        p->slot = UD_GRH_BYTES + msg_size;
+        snprintf(port_str, sizeof(port_str), "%d", p->port);
+        rdma_ctx l = {.ec = ec};
+        if (rdma_create_id(ec, &l.id, NULL, RDMA_PS_UDP))
+        {
+            err_errno("rdma_create_id");
+            err = 1;
+            goto cleanup;
+        }
+        p->listen = l.id;
+        if (cm_server_listen_backlog(&l, bind_ip, port_str, 128))
+        {
+            err = 1;
+            goto cleanup;
+        }
+    }
+    if (fcntl(ec->fd, F_SETFL, fcntl(ec->fd, F_GETFL) | O_NONBLOCK))
+    {
+        err_errno("fcntl O_NONBLOCK");
+        err = 1;
+        goto cleanup;
+    }
+    printf("UD server listening on %d..%d, msg-size=%" PRIu64 " (Ctrl-C to stop)\n", ports[0].port,
+           ports[nports - 1].port, msg_size);
+    fflush(stdout);
+
+    while (!g_stop)
+    {
+        struct rdma_cm_event *ev = NULL;
+        if (rdma_get_cm_event(ec, &ev) == 0)
+        {
+            struct rdma_cm_id *id = ev->id;
+            struct rdma_cm_id *listen_id = ev->listen_id;
+            enum rdma_cm_event_type type = ev->event;
+            rdma_ack_cm_event(ev);
+            if (type == RDMA_CM_EVENT_CONNECT_REQUEST)
+            {
+                struct ud_port *p = NULL;
+                for (int i = 0; i < nports && !p; i++)
+                {
+                    if (ports[i].listen == listen_id)
+                        p = &ports[i];
+                }
+                if (p)
+                    handle_request(p, ec, id);
+                else
+                    rdma_reject(id, NULL, 0);
+            }
+        }
+        else if (errno != EAGAIN)
+        {
+            err_errno("rdma_get_cm_event");
+            err = 1;
+            goto cleanup;
+        }
+
+        for (int i = 0; i < nports; i++)
+        {
+            struct ud_port *p = &ports[i];
+            if (!p->c.qp)
+                continue;
+            struct ibv_wc wcs[32];
+            int n = ibv_poll_cq(p->c.cq, 32, wcs);
+            for (int k = 0; k < n; k++)
+            {
+                if (wcs[k].status != IBV_WC_SUCCESS)
+                {
+                    LOG_ERR("port %d: WC status=%s", p->port, ibv_wc_status_str(wcs[k].status));
+                    continue;
+                }
+                if (wcs[k].opcode == IBV_WC_RECV)
+                    handle_recv(p, &wcs[k]);
+            }
+        }
+    }
+    for (int i = 0; i < nports; i++)
+        printf("UD server: port %d resolved by %" PRIu64 " requests\n", ports[i].port, ports[i].requests);
+
+cleanup:
+    for (int i = 0; ports && i < nports; i++)
+        port_destroy(&ports[i]);
+    if (ec)
+        rdma_destroy_event_channel(ec);
+    free(ports);
+    return err;
+}
@@ -0,0 +1,424 @@
+/**
+ * Transport comparison benchmark: one set of workloads run through the xport interface, so RDMA,
+ * TCP and in-process memory are measured by the same code and print the same line.
+ *
+ *   write     client WRITEs chunks into the server's region (offsets wrap), BENCH_DEPTH in flight,
+ *             one completion every BENCH_SIGNAL WRs
+ *   read      client READs chunks out of the server's region, BENCH_DEPTH in flight
+ *   pingpong  client SENDs chunk bytes and the server echoes them back, one at a time
+ *
+ * Timing stops only when the server has answered the final DONE message. Every backend has
+ * therefore placed all data when the clock stops, including TCP, whose WRITEs complete as soon
+ * as they are queued in the socket.
+ *
+ * Modes:
+ *   server <backend> <port> [region]                       serve one client, then exit
+ *   client <backend> <ip> <port> <workload> [bytes] [chunk]
+ *   local  <backend> <workload> [bytes] [chunk]            server on a thread, client on 127.0.0.1
+ *
+ * The shm backend only works in local mode, because both ends must be in one process.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../rdma-bulk/rdma_bulk_common.h"
+#include "common.h"
+#include "xport.h"
+
+#define BENCH_DEPTH 64
+#define BENCH_SIGNAL 16
+#define BENCH_MSG_MAX (64u * 1024u) // largest pingpong message
+#define BENCH_REGION_DEFAULT (64ull << 20)
+#define BENCH_LOCAL_PORT "7490"
+#define BENCH_MAGIC 0x58424e43u // "XBNC"
+
+#define WR_MSG 1
+
+enum workload
+{
+    WL_WRITE,
+    WL_READ,
+    WL_PINGPONG
+};
+
+enum ctrl_type
+{
+    CTRL_START = 1,
+    CTRL_DONE = 2
+};
+
+// Client <-> server control message. Big-endian on the wire.
+struct bench_ctrl
+{
+    uint32_t magic;
+    uint32_t type;
+    uint32_t workload;
+    uint32_t reserved;
+    uint64_t bytes;
+    uint64_t chunk;
+} __attribute__((packed));
+
+struct server_args
+{
+    const char *backend, *port;
+    uint64_t region;
+    int rc;
+};
+
+static const char *workload_names[] = {"write", "read", "pingpong"};
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int parse_workload(const char *s)
+{
+    for (int i = 0; i < (int)(sizeof(workload_names) / sizeof(workload_names[0])); i++)
+    {
+        if (strcmp(s, workload_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void ctrl_pack(struct bench_ctrl *m, uint32_t type, uint32_t workload, uint64_t bytes, uint64_t chunk)
+{
+    m->magic = htonl(BENCH_MAGIC);
+    m->type = htonl(type);
+    m->workload = htonl(workload);
+    m->reserved = 0;
+    m->bytes = htonll_u64(bytes);
+    m->chunk = htonll_u64(chunk);
+}
+
+// Wait for the next RECV completion, retiring the SEND completions that come first.
+static int wait_recv(struct xport *x, struct xport_wc *wc)
+{
+    do
+    {
+        if (xport_wait(x, wc))
+            return -1;
+    } while (wc->op != XPORT_OP_RECV);
+    return 0;
+}
+
+static int wait_ctrl(struct xport *x, const void *rx, uint32_t want, struct bench_ctrl *out)
+{
+    struct xport_wc wc;
+    if (wait_recv(x, &wc))
+        return -1;
+    memcpy(out, rx, sizeof(*out));
+    if (wc.byte_len != sizeof(*out) || ntohl(out->magic) != BENCH_MAGIC || ntohl(out->type) != want)
+        ERRF("unexpected control message (%u bytes)", wc.byte_len);
+    return 0;
+}
+
+// Send a message and wait for its own completion, so tx may be rewritten afterwards.
+static int send_sync(struct xport *x, struct xport_mr *mr, void *tx, size_t len)
+{
+    struct xport_wc wc;
+    if (xport_send(x, mr, tx, len, WR_MSG, 1))
+        return -1;
+    do
+    {
+        if (xport_wait(x, &wc))
+            return -1;
+    } while (wc.op != XPORT_OP_SEND);
+    return 0;
+}
+
+static int run_server(const char *backend, const char *port, uint64_t region)
+{
+    struct xport x = {0};
+    struct xport_mr region_mr = {0}, msg_mr = {0};
+    char *buf = NULL, *msg = NULL;
+    struct bench_ctrl start, done;
+    int rc = -1;
+
+    if (xport_open(&x, backend) || xport_listen(&x, getenv("RDMA_BIND_IP"), port))
+        goto cleanup;
+    if (posix_memalign((void **)&buf, 4096, region) || posix_memalign((void **)&msg, 4096, 2 * BENCH_MSG_MAX))
+    {
+        LOG_ERR("no memory for a %" PRIu64 "-byte region", region);
+        goto cleanup;
+    }
+    memset(buf, 0, region);
+    char *rx = msg, *tx = msg + BENCH_MSG_MAX;
+    // The START RECV goes in after xport_expose, or it would catch the client's region descriptor.
+    if (xport_reg(&x, buf, region, &region_mr) || xport_reg(&x, msg, 2 * BENCH_MSG_MAX, &msg_mr) ||
+        xport_expose(&x, &region_mr) || xport_recv(&x, &msg_mr, rx, BENCH_MSG_MAX, WR_MSG))
+        goto cleanup;
+    if (wait_ctrl(&x, rx, CTRL_START, &start))
+        goto cleanup;
+    uint32_t wl = ntohl(start.workload);
+    uint64_t chunk = ntohll_u64(start.chunk);
+    uint64_t iters = chunk ? ntohll_u64(start.bytes) / chunk : 0;
+    if (xport_recv(&x, &msg_mr, rx, BENCH_MSG_MAX, WR_MSG))
+        goto cleanup;
+    LOG("%s: %s from client", backend, wl < 3 ? workload_names[wl] : "?");
+
+    if (wl == WL_PINGPONG)
+    {
+        for (uint64_t i = 0; i < iters; i++)
+        {
+            struct xport_wc wc;
+            if (wait_recv(&x, &wc))
+                goto cleanup;
+            // Copy out before the next RECV reuses rx; it has to be posted before the echo.
+            memcpy(tx, rx, wc.byte_len);
+            if (xport_recv(&x, &msg_mr, rx, BENCH_MSG_MAX, WR_MSG) || send_sync(&x, &msg_mr, tx, wc.byte_len))
+                goto cleanup;
+        }
+    }
+    // write/read need nothing from the server until DONE.
+    if (wait_ctrl(&x, rx, CTRL_DONE, &done))
+        goto cleanup;
+    ctrl_pack((struct bench_ctrl *)tx, CTRL_DONE, wl, 0, 0);
+    if (send_sync(&x, &msg_mr, tx, sizeof(struct bench_ctrl)))
+        goto cleanup;
+    rc = 0;
+
+cleanup:
+    if (region_mr.addr)
+        xport_dereg(&x, &region_mr);
+    if (msg_mr.addr)
+        xport_dereg(&x, &msg_mr);
+    xport_close(&x);
+    free(buf);
+    free(msg);
+    return rc;
+}
+
+static int run_onesided(struct xport *x, int wl, char *data, struct xport_mr *data_mr, uint64_t bytes,
+                        uint64_t chunk)
+{
+    uint64_t span = x->remote_len - x->remote_len % chunk;
+    uint64_t n = (bytes + chunk - 1) / chunk;
+    uint64_t posted = 0, inflight = 0, unsignaled = 0;
+    if (span == 0)
+        ERRF("chunk %" PRIu64 " exceeds the server's %" PRIu64 "-byte region", chunk, x->remote_len);
+    while (posted < n || inflight > 0)
+    {
+        while (posted < n && inflight < BENCH_DEPTH)
+        {
+            size_t len = posted + 1 == n ? bytes - posted * chunk : chunk;
+            char *slot = data + (posted % BENCH_DEPTH) * chunk;
+            uint64_t off = (posted * chunk) % span;
+            int rc;
+            if (wl == WL_WRITE)
+            {
+                // A completion retires itself and the unsignaled WRs before it: wr_id says how many.
+                int sig = ++unsignaled == BENCH_SIGNAL || posted + 1 == n;
+                rc = xport_write(x, data_mr, slot, off, len, sig ? unsignaled : 0, sig);
+                if (sig)
+                    unsignaled = 0;
+            }
+            else
+                rc = xport_read(x, data_mr, slot, off, len, 1);
+            if (rc)
+                return -1;
+            posted++;
+            inflight++;
+        }
+        struct xport_wc wc[16];
+        int got = xport_poll(x, wc, 16);
+        if (got < 0)
+            ERRF("%s: connection failed", x->ops->name);
+        for (int i = 0; i < got; i++)
+        {
+            if (wc[i].status)
+                ERRF("%s: completion failed (status %d)", x->ops->name, wc[i].status);
+            inflight -= wc[i].wr_id;
+        }
+    }
+    return 0;
+}
+
+static int run_pingpong(struct xport *x, struct xport_mr *msg_mr, char *rx, char *tx, uint64_t iters,
+                        uint64_t chunk, double *rtt_us)
+{
+    memset(tx, 0x5a, chunk);
+    for (uint64_t i = 0; i < iters; i++)
+    {
+        struct xport_wc wc;
+        double t0 = now_sec();
+        if (xport_recv(x, msg_mr, rx, BENCH_MSG_MAX, WR_MSG) || xport_send(x, msg_mr, tx, chunk, WR_MSG, 1))
+            return -1;
+        // SEND and RECV completions may arrive in either order; both must be seen.
+        for (int seen = 0; seen < 2; seen++)
+        {
+            if (xport_wait(x, &wc))
+                return -1;
+            if (wc.op == XPORT_OP_RECV && wc.byte_len != chunk)
+                ERRF("echo of %u bytes, sent %" PRIu64, wc.byte_len, chunk);
+        }
+        rtt_us[i] = (now_sec() - t0) * 1e6;
+    }
+    return 0;
+}
+
+static int run_client(const char *backend, const char *ip, const char *port, int wl, uint64_t bytes, uint64_t chunk,
+                      int retry)
+{
+    struct xport x = {0};
+    struct xport_mr data_mr = {0}, msg_mr = {0};
+    char *data = NULL, *msg = NULL;
+    double *rtt = NULL;
+    uint64_t iters = bytes / chunk;
+    int rc = -1;
+
+    // In local mode the server thread may not be listening yet.
+    for (int attempt = 0;; attempt++)
+    {
+        if (xport_open(&x, backend))
+            return -1;
+        if (xport_connect(&x, ip, port) == 0)
+            break;
+        xport_close(&x);
+        if (attempt >= retry)
+            return -1;
+        usleep(100 * 1000);
+    }
+    size_t data_len = wl == WL_PINGPONG ? 4096 : BENCH_DEPTH * chunk;
+    if (posix_memalign((void **)&data, 4096, data_len) || posix_memalign((void **)&msg, 4096, 2 * BENCH_MSG_MAX) ||
+        (wl == WL_PINGPONG && !(rtt = calloc(iters, sizeof(*rtt)))))
+    {
+        LOG_ERR("out of memory");
+        goto cleanup;
+    }
+    memset(data, 0xa5, data_len);
+    char *rx = msg, *tx = msg + BENCH_MSG_MAX;
+    if (xport_reg(&x, data, data_len, &data_mr) || xport_reg(&x, msg, 2 * BENCH_MSG_MAX, &msg_mr) ||
+        xport_expose(&x, NULL))
+        goto cleanup;
+    ctrl_pack((struct bench_ctrl *)tx, CTRL_START, (uint32_t)wl, bytes, chunk);
+    if (send_sync(&x, &msg_mr, tx, sizeof(struct bench_ctrl)))
+        goto cleanup;
+
+    double t0 = now_sec();
+    if (wl == WL_PINGPONG ? run_pingpong(&x, &msg_mr, rx, tx, iters, chunk, rtt)
+                          : run_onesided(&x, wl, data, &data_mr, bytes, chunk))
+        goto cleanup;
+    struct bench_ctrl done;
+    ctrl_pack((struct bench_ctrl *)tx, CTRL_DONE, (uint32_t)wl, 0, 0);
+    if (xport_recv(&x, &msg_mr, rx, BENCH_MSG_MAX, WR_MSG) || send_sync(&x, &msg_mr, tx, sizeof(done)) ||
+        wait_ctrl(&x, rx, CTRL_DONE, &done))
+        goto cleanup;
+    double secs = now_sec() - t0;
+
+    uint64_t moved = wl == WL_PINGPONG ? 2 * iters * chunk : bytes;
+    printf("xport=%s workload=%s bytes=%" PRIu64 " chunk=%" PRIu64 " secs=%.6f MiB/s=%.1f", backend,
+           workload_names[wl], moved, chunk, secs, secs > 0 ? (double)moved / (1024.0 * 1024.0) / secs : 0.0);
+    if (wl == WL_PINGPONG && iters > 0)
+    {
+        qsort(rtt, iters, sizeof(*rtt), cmp_double);
+        printf(" iters=%" PRIu64 " rtt_p50_us=%.2f rtt_p99_us=%.2f rtt_max_us=%.2f", iters, rtt[iters / 2],
+               rtt[(iters * 99) / 100], rtt[iters - 1]);
+    }
+    printf("\n");
+    rc = 0;
+
+cleanup:
+    if (data_mr.addr)
+        xport_dereg(&x, &data_mr);
+    if (msg_mr.addr)
+        xport_dereg(&x, &msg_mr);
+    xport_close(&x);
+    free(data);
+    free(msg);
+    free(rtt);
+    return rc;
+}
+
+static void *server_thread(void *arg)
+{
+    struct server_args *a = arg;
+    a->rc = run_server(a->backend, a->port, a->region);
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s server <rdma|tcp> <port> [region]\n"
+            "  %s client <rdma|tcp> <server_ip> <port> <write|read|pingpong> [bytes] [chunk]\n"
+            "  %s local  <rdma|tcp|shm> <write|read|pingpong> [bytes] [chunk]\n"
+            "Defaults: bytes 1G, chunk 1M (pingpong: 100000 x 64 bytes), region 64M.\n",
+            prog, prog, prog);
+}
+
+// Fill in bytes/chunk defaults and check the limits of the workload.
+static int workload_sizes(int wl, const char *bytes_s, const char *chunk_s, uint64_t *bytes, uint64_t *chunk)
+{
+    *chunk = chunk_s ? parse_size_bytes(chunk_s) : (wl == WL_PINGPONG ? 64 : 1ull << 20);
+    *bytes = bytes_s ? parse_size_bytes(bytes_s) : (wl == WL_PINGPONG ? *chunk * 100000 : 1ull << 30);
+    if (*chunk == 0 || *bytes < *chunk)
+        ERRF("need 0 < chunk <= bytes");
+    if (wl == WL_PINGPONG && *chunk > BENCH_MSG_MAX)
+        ERRF("pingpong messages are at most %u bytes", BENCH_MSG_MAX);
+    if (wl != WL_PINGPONG && *chunk > UINT32_MAX)
+        ERRF("chunk must fit in 32 bits");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t bytes, chunk;
+    int wl;
+    if (argc >= 4 && strcmp(argv[1], "server") == 0)
+    {
+        uint64_t region = argc > 4 ? parse_size_bytes(argv[4]) : BENCH_REGION_DEFAULT;
+        if (region == 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        return run_server(argv[2], argv[3], region) ? 1 : 0;
+    }
+    if (argc >= 6 && strcmp(argv[1], "client") == 0)
+    {
+        if ((wl = parse_workload(argv[5])) < 0 ||
+            workload_sizes(wl, argc > 6 ? argv[6] : NULL, argc > 7 ? argv[7] : NULL, &bytes, &chunk))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        return run_client(argv[2], argv[3], argv[4], wl, bytes, chunk, 0) ? 1 : 0;
+    }
+    if (argc >= 4 && strcmp(argv[1], "local") == 0)
+    {
+        if ((wl = parse_workload(argv[3])) < 0 ||
+            workload_sizes(wl, argc > 4 ? argv[4] : NULL, argc > 5 ? argv[5] : NULL, &bytes, &chunk))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        struct server_args sa = {.backend = argv[2], .port = BENCH_LOCAL_PORT, .region = BENCH_REGION_DEFAULT};
+        pthread_t th;
+        if (pthread_create(&th, NULL, server_thread, &sa))
+        {
+            perror("pthread_create");
+            return 1;
+        }
+        int rc = run_client(argv[2], "127.0.0.1", BENCH_LOCAL_PORT, wl, bytes, chunk, 50);
+        pthread_join(th, NULL);
+        return rc || sa.rc ? 1 : 0;
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -27,6 +27,8 @@ def main():
     sent_mib = [float(r["sent_mib"]) for r in rows]
     inflight = [int(r["inflight"]) for r in rows]
     cqe_gap = [float(r["cqe_gap_s"]) for r in rows]
+    # Per-interval rate, written by the client's progress sampler.
+    mib_s = [float(r["mib_s"]) for r in rows] if "mib_s" in rows[0] else None
 
     fig, ax = plt.subplots(2, 1, figsize=(8, 6), sharex=True)
 
@@ -34,6 +36,11 @@ def main():
     ax[0].set_ylabel("MiB sent")
     ax[0].grid(True, alpha=0.2)
     ax[0].legend(loc="upper left")
+    if mib_s:
+        rate = ax[0].twinx()
+        rate.plot(t, mib_s, color="#3ddc84", label="MiB/s (interval)")
+        rate.set_ylabel("MiB/s")
+        rate.legend(loc="lower right")
 
     ax[1].plot(t, inflight, color="#ffb020", label="Inflight")
     ax[1].plot(t, cqe_gap, color="#ff5c5c", label="CQE gap (s)")
@@ -0,0 +1,364 @@
+/**
+ * File: cm_dispatch.c
+ * Purpose: Event-driven rdma_cm dispatcher (see cm_dispatch.h).
+ */
+
+#include "cm_dispatch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_mem.h"
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+const char *cm_conn_state_str(enum cm_conn_state s)
+{
+    switch (s)
+    {
+    case CM_ST_IDLE:
+        return "IDLE";
+    case CM_ST_ADDR_RESOLVING:
+        return "ADDR_RESOLVING";
+    case CM_ST_ROUTE_RESOLVING:
+        return "ROUTE_RESOLVING";
+    case CM_ST_CONNECTING:
+        return "CONNECTING";
+    case CM_ST_LISTENING:
+        return "LISTENING";
+    case CM_ST_ACCEPTING:
+        return "ACCEPTING";
+    case CM_ST_ESTABLISHED:
+        return "ESTABLISHED";
+    case CM_ST_DISCONNECTED:
+        return "DISCONNECTED";
+    case CM_ST_ERROR:
+        return "ERROR";
+    }
+    return "?";
+}
+
+int cm_dispatch_init(struct cm_dispatcher *d, const struct cm_callbacks *cb)
+{
+    memset(d, 0, sizeof(*d));
+    d->epfd = -1;
+    if (cb)
+        d->cb = *cb;
+    d->ec = rdma_create_event_channel();
+    if (!d->ec)
+        return err_errno("rdma_create_event_channel");
+    if (fcntl(d->ec->fd, F_SETFL, fcntl(d->ec->fd, F_GETFL) | O_NONBLOCK))
+        return err_errno("fcntl O_NONBLOCK");
+    d->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (d->epfd < 0)
+        return err_errno("epoll_create1");
+    struct epoll_event ee = {.events = EPOLLIN, .data.ptr = d};
+    if (epoll_ctl(d->epfd, EPOLL_CTL_ADD, d->ec->fd, &ee))
+        return err_errno("epoll_ctl");
+    return 0;
+}
+
+void cm_dispatch_destroy(struct cm_dispatcher *d)
+{
+    if (d->live)
+        LOG("cm_dispatch: destroying %d live connections", d->live);
+    while (d->conns)
+        cm_conn_destroy(d->conns);
+    if (d->epfd >= 0)
+        close(d->epfd);
+    if (d->ec)
+        rdma_destroy_event_channel(d->ec);
+    d->epfd = -1;
+    d->ec = NULL;
+}
+
+static struct cm_conn *conn_new(struct cm_dispatcher *d, void *user)
+{
+    struct cm_conn *c = calloc(1, sizeof(*c));
+    if (!c)
+    {
+        err_errno("calloc cm_conn");
+        return NULL;
+    }
+    c->d = d;
+    c->user = user;
+    c->t_start = now_sec();
+    c->ctx.ec = d->ec;
+    c->next = d->conns;
+    if (d->conns)
+        d->conns->prev = c;
+    d->conns = c;
+    __atomic_fetch_add(&d->live, 1, __ATOMIC_RELAXED);
+    return c;
+}
+
+void cm_conn_destroy(struct cm_conn *c)
+{
+    if (!c)
+        return;
+    rdma_ctx *x = &c->ctx;
+    mem_free_all(x);
+    destroy_qp(x);
+    if (x->cq)
+        cq_ts_destroy(x->cq);
+    if (x->pd)
+        ibv_dealloc_pd(x->pd);
+    if (x->id)
+        rdma_destroy_id(x->id);
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        c->d->conns = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    __atomic_fetch_sub(&c->d->live, 1, __ATOMIC_RELAXED);
+    free(c);
+}
+
+struct cm_conn *cm_dispatch_connect(struct cm_dispatcher *d, const char *ip, const char *port, const char *src_ip,
+                                    void *user)
+{
+    struct sockaddr_storage dst, src;
+    int has_src = 0;
+    struct cm_conn *c = conn_new(d, user);
+    if (!c)
+        return NULL;
+    cm_rcache_key_set(&c->key, ip, port, src_ip);
+    if (cm_rcache_addrs(&c->key, &dst, &src, &has_src))
+        goto fail;
+    if (rdma_create_id(d->ec, &c->ctx.id, c, RDMA_PS_TCP))
+    {
+        err_errno("rdma_create_id");
+        goto fail;
+    }
+    if (rdma_resolve_addr(c->ctx.id, has_src ? (struct sockaddr *)&src : NULL, (struct sockaddr *)&dst,
+                          cm_resolve_cfg()->addr_timeout_ms))
+    {
+        err_errno("rdma_resolve_addr");
+        goto fail;
+    }
+    c->state = CM_ST_ADDR_RESOLVING;
+    return c;
+
+fail:
+    cm_conn_destroy(c);
+    return NULL;
+}
+
+struct cm_conn *cm_dispatch_listen(struct cm_dispatcher *d, const char *ip, const char *port, int backlog,
+                                   void *user)
+{
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_flags = (ip && *ip) ? 0 : AI_PASSIVE}, *res = NULL;
+    struct cm_conn *c = conn_new(d, user);
+    if (!c)
+        return NULL;
+    int rc = getaddrinfo((ip && *ip) ? ip : NULL, port, &hints, &res);
+    if (rc)
+    {
+        LOG_ERR("getaddrinfo(%s): %s", port, gai_strerror(rc));
+        cm_conn_destroy(c);
+        return NULL;
+    }
+    if (rdma_create_id(d->ec, &c->ctx.id, c, RDMA_PS_TCP) || rdma_bind_addr(c->ctx.id, res->ai_addr) ||
+        rdma_listen(c->ctx.id, backlog))
+    {
+        err_errno("rdma listen");
+        freeaddrinfo(res);
+        cm_conn_destroy(c);
+        return NULL;
+    }
+    freeaddrinfo(res);
+    c->state = CM_ST_LISTENING;
+    return c;
+}
+
+// QP built by the callback without rdma_create_qp (UC, rdma_pool): its transitions are ours.
+static int user_qp(const struct cm_conn *c)
+{
+    return c->ctx.qp && !c->ctx.id->qp;
+}
+
+static void fail_conn(struct cm_conn *c, const struct cm_event_info *ev)
+{
+    c->state = CM_ST_ERROR;
+    if (c->d->cb.on_error)
+        c->d->cb.on_error(c, ev);
+}
+
+static void on_connect_request(struct cm_dispatcher *d, struct cm_conn *l, struct rdma_cm_id *id,
+                               const struct cm_event_info *ev)
+{
+    struct cm_conn *c = conn_new(d, l->user);
+    if (!c)
+    {
+        rdma_reject(id, NULL, 0);
+        rdma_destroy_id(id);
+        return;
+    }
+    c->ctx.id = id;
+    c->listener = l;
+    c->state = CM_ST_ACCEPTING;
+    id->context = c;
+    struct rdma_conn_param p = {.retry_count = 7, .rnr_retry_count = 7};
+    cm_rd_atomic_defaults(&c->ctx, &p.initiator_depth, &p.responder_resources);
+    int rc = !d->cb.on_connect_request || d->cb.on_connect_request(c, ev, &p);
+    if (!rc && user_qp(c))
+    {
+        rc = modify_qp_from_cm(&c->ctx, IBV_QPS_RTR) || modify_qp_from_cm(&c->ctx, IBV_QPS_RTS);
+        p.qp_num = c->ctx.qp->qp_num;
+    }
+    c->t_connect = now_sec();
+    if (rc || rdma_accept(id, &p))
+    {
+        LOG("cm_dispatch: rejecting connection request");
+        rdma_reject(id, NULL, 0);
+        cm_conn_destroy(c);
+    }
+}
+
+// Advance c's state machine for one event; returns 0 when the event does not fit the current state.
+static int dispatch_one(struct cm_dispatcher *d, struct rdma_cm_id *id, struct cm_event_info *ev)
+{
+    struct cm_conn *c = id->context;
+    switch (ev->event)
+    {
+    case RDMA_CM_EVENT_ADDR_RESOLVED:
+        if (c->state != CM_ST_ADDR_RESOLVING)
+            return 0;
+        c->state = CM_ST_ROUTE_RESOLVING;
+        c->t_addr_resolved = now_sec();
+        if (cm_rcache_resolve_route(&c->key, id) < 0)
+        {
+            cm_rcache_invalidate(&c->key);
+            fail_conn(c, ev);
+        }
+        return 1;
+    case RDMA_CM_EVENT_ROUTE_RESOLVED:
+    {
+        if (c->state != CM_ST_ROUTE_RESOLVING)
+            return 0;
+        struct rdma_conn_param p = {.retry_count = 7, .rnr_retry_count = 7};
+        cm_rd_atomic_defaults(&c->ctx, &p.initiator_depth, &p.responder_resources);
+        c->t_route_resolved = now_sec();
+        cm_rcache_store(&c->key, id);
+        if (d->cb.on_route_resolved && d->cb.on_route_resolved(c, &p))
+        {
+            fail_conn(c, ev);
+            return 1;
+        }
+        if (user_qp(c))
+            p.qp_num = c->ctx.qp->qp_num;
+        c->state = CM_ST_CONNECTING;
+        c->t_connect = now_sec();
+        if (rdma_connect(id, &p))
+        {
+            err_errno("rdma_connect");
+            fail_conn(c, ev);
+        }
+        return 1;
+    }
+    case RDMA_CM_EVENT_CONNECT_REQUEST:
+        if (c->state != CM_ST_LISTENING)
+            return 0;
+        on_connect_request(d, c, id, ev);
+        return 1;
+    case RDMA_CM_EVENT_CONNECT_RESPONSE: // user QP: we move it to RTS, then the RTU completes the handshake
+        if (c->state != CM_ST_CONNECTING || !user_qp(c))
+            return 0;
+        if (modify_qp_from_cm(&c->ctx, IBV_QPS_RTR) || modify_qp_from_cm(&c->ctx, IBV_QPS_RTS) ||
+            rdma_establish(id))
+        {
+            LOG_ERR("cm_dispatch: cannot complete user-QP handshake");
+            rdma_reject(id, NULL, 0);
+            fail_conn(c, ev);
+            return 1;
+        }
+        // rdma_establish() produces no further event on the active side
+        // fall through
+    case RDMA_CM_EVENT_ESTABLISHED:
+        if (c->state != CM_ST_CONNECTING && c->state != CM_ST_ACCEPTING)
+            return 0;
+        c->state = CM_ST_ESTABLISHED;
+        c->t_established = now_sec();
+        if (d->cb.on_established)
+            d->cb.on_established(c, ev);
+        return 1;
+    case RDMA_CM_EVENT_DISCONNECTED: // also reported for a peer that gave up mid-handshake
+        if (c->state == CM_ST_LISTENING || c->state == CM_ST_DISCONNECTED)
+            return 0;
+        c->state = CM_ST_DISCONNECTED;
+        c->t_disconnected = now_sec();
+        if (d->cb.on_disconnected)
+            d->cb.on_disconnected(c);
+        return 1;
+    case RDMA_CM_EVENT_ADDR_ERROR:
+    case RDMA_CM_EVENT_ROUTE_ERROR:
+    case RDMA_CM_EVENT_CONNECT_ERROR:
+    case RDMA_CM_EVENT_UNREACHABLE:
+    case RDMA_CM_EVENT_REJECTED:
+        LOG("cm_dispatch: %s in state %s (status=%d)", rdma_event_str(ev->event), cm_conn_state_str(c->state),
+            ev->status);
+        // REJECTED means the peer answered, so the resolution was fine.
+        if (c->key.ip[0] && ev->event != RDMA_CM_EVENT_REJECTED)
+            cm_rcache_invalidate(&c->key);
+        fail_conn(c, ev);
+        return 1;
+    default: // TIMEWAIT_EXIT, ADDR_CHANGE, ...
+        return 0;
+    }
+}
+
+int cm_dispatch_run(struct cm_dispatcher *d, int timeout_ms)
+{
+    struct epoll_event ee;
+    int n = epoll_wait(d->epfd, &ee, 1, timeout_ms);
+    if (n < 0 && errno != EINTR)
+        return err_errno("epoll_wait");
+    int handled = 0;
+    for (;;)
+    {
+        struct rdma_cm_event *ev = NULL;
+        if (rdma_get_cm_event(d->ec, &ev))
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return err_errno("rdma_get_cm_event");
+        }
+        // Copy out and ack first: callbacks may destroy the id, which waits for its events to be acked.
+        struct cm_event_info info = {.event = ev->event, .status = ev->status};
+        struct rdma_cm_id *id = ev->id;
+        if (ev->event == RDMA_CM_EVENT_CONNECT_REQUEST && ev->listen_id)
+            ev->id->context = ev->listen_id->context;
+        info.param = ev->param.conn;
+        size_t plen = ev->param.conn.private_data ? ev->param.conn.private_data_len : 0;
+        if (plen > sizeof(info.priv))
+            plen = sizeof(info.priv);
+        if (plen)
+            memcpy(info.priv, ev->param.conn.private_data, plen);
+        info.param.private_data = plen ? info.priv : NULL;
+        info.param.private_data_len = (uint8_t)plen;
+        rdma_ack_cm_event(ev);
+        d->events++;
+        handled++;
+        struct cm_conn *c = id->context;
+        if (c && !dispatch_one(d, id, &info))
+        {
+            d->ignored++;
+            LOG("cm_dispatch: ignoring %s in state %s", rdma_event_str(info.event), cm_conn_state_str(c->state));
+        }
+    }
+    return handled;
+}
@@ -0,0 +1,114 @@
+/**
+ * File: cm_dispatch.h
+ * Purpose: Event-driven rdma_cm dispatcher for bringing up many connections at once.
+ *
+ * Overview:
+ * cm_wait_event() blocks for one specific event, so the sample clients connect strictly one at a
+ * time. The dispatcher instead owns one non-blocking event channel watched by epoll. Every
+ * rdma_cm_id on it points (id->context) at a struct cm_conn with its own state machine, and each
+ * event advances that connection and runs the matching callback. Hundreds of connections can be
+ * resolving, connecting and accepting concurrently from one thread.
+ *
+ *   client: IDLE -> ADDR_RESOLVING -> ROUTE_RESOLVING -> CONNECTING -> ESTABLISHED -> DISCONNECTED
+ *   server: LISTENING spawns ACCEPTING children -> ESTABLISHED -> DISCONNECTED
+ *   any error event (ADDR/ROUTE/CONNECT_ERROR, UNREACHABLE, REJECTED) -> ERROR
+ *
+ * Notes:
+ *  - Events are copied (including private data) and acked before callbacks run, so a callback may
+ *    call cm_conn_destroy() on its connection.
+ *  - Events that do not fit the connection's state are logged and ignored, not treated as fatal.
+ *  - A callback may set ctx.qp to a QP it created itself (UC, or one taken from rdma_pool) instead of
+ *    calling rdma_create_qp. The dispatcher then passes its qp_num to connect/accept, moves it to
+ *    RTR/RTS, and on the active side turns CONNECT_RESPONSE into ESTABLISHED with rdma_establish().
+ *  - Active connections resolve through cm_resolve_cache: a recently seen peer skips getaddrinfo
+ *    and gets its cached path injected instead of a route query. Resolve timeouts come from
+ *    cm_resolve_cfg(). ADDR/ROUTE_ERROR, UNREACHABLE and CONNECT_ERROR drop the peer's entry.
+ *  - Not thread-safe: run one dispatcher per thread.
+ */
+
+#pragma once
+#include <rdma/rdma_cma.h>
+
+#include "cm_resolve_cache.h"
+#include "common.h"
+#include "rdma_ctx.h"
+
+enum cm_conn_state
+{
+    CM_ST_IDLE,
+    CM_ST_ADDR_RESOLVING,
+    CM_ST_ROUTE_RESOLVING,
+    CM_ST_CONNECTING,
+    CM_ST_LISTENING,
+    CM_ST_ACCEPTING,
+    CM_ST_ESTABLISHED,
+    CM_ST_DISCONNECTED,
+    CM_ST_ERROR
+};
+
+struct cm_dispatcher;
+
+struct cm_conn
+{
+    rdma_ctx ctx; // ctx.ec is the dispatcher's channel; ctx.id->context points back here
+    enum cm_conn_state state;
+    struct cm_dispatcher *d;
+    struct cm_conn *listener; // set on accepted connections
+    struct cm_rcache_key key;  // active side: the (ip, port, src) it resolves through cm_resolve_cache
+    void *user;
+    struct cm_conn *prev, *next; // dispatcher's list of live connections
+    // CLOCK_MONOTONIC seconds at each transition (0 until reached), for setup-latency breakdowns.
+    // t_connect is taken after on_route_resolved/on_connect_request returns, right before connect/accept.
+    double t_start, t_addr_resolved, t_route_resolved, t_connect, t_established, t_disconnected;
+};
+
+// Private data of the event that triggered a callback (copied; valid during the callback).
+struct cm_event_info
+{
+    enum rdma_cm_event_type event;
+    int status;
+    struct rdma_conn_param param; // param.private_data points at priv
+    uint8_t priv[256];
+};
+
+struct cm_callbacks
+{
+    // Route known: build the QP (build_pd_cq_qp on c->ctx) and adjust the connect parameters. param arrives
+    // with cm_rd_atomic_defaults() for the device already in initiator_depth/responder_resources; lower them freely.
+    int (*on_route_resolved)(struct cm_conn *c, struct rdma_conn_param *param);
+    // New child of a listener: build its QP and adjust the accept parameters (prefilled the same way), or return
+    // nonzero to reject.
+    int (*on_connect_request)(struct cm_conn *c, const struct cm_event_info *ev, struct rdma_conn_param *param);
+    void (*on_established)(struct cm_conn *c, const struct cm_event_info *ev);
+    void (*on_disconnected)(struct cm_conn *c);
+    // The connection is in CM_ST_ERROR; typically destroy it or retry.
+    void (*on_error)(struct cm_conn *c, const struct cm_event_info *ev);
+};
+
+struct cm_dispatcher
+{
+    struct rdma_event_channel *ec;
+    int epfd;
+    struct cm_callbacks cb;
+    int live;       // cm_conn objects not yet destroyed; relaxed atomic adds, so other threads may load it
+    struct cm_conn *conns;
+    uint64_t events, ignored;
+};
+
+int cm_dispatch_init(struct cm_dispatcher *d, const struct cm_callbacks *cb);
+// Destroys every connection still alive (without callbacks), then the channel.
+void cm_dispatch_destroy(struct cm_dispatcher *d);
+
+// Start an active connection: resolve addr -> route -> callbacks -> connect. NULL on immediate failure.
+struct cm_conn *cm_dispatch_connect(struct cm_dispatcher *d, const char *ip, const char *port, const char *src_ip,
+                                    void *user);
+struct cm_conn *cm_dispatch_listen(struct cm_dispatcher *d, const char *ip, const char *port, int backlog,
+                                   void *user);
+
+// Wait up to timeout_ms for the channel, then handle every queued event. Returns events handled or -1.
+int cm_dispatch_run(struct cm_dispatcher *d, int timeout_ms);
+
+// Tear down the connection's QP/CQ/PD, rdma_ctx buffers and id, then free it. Release pooled
+// resources first (rdma_pool_release clears ctx.pd/cq/qp) so they are not destroyed here.
+void cm_conn_destroy(struct cm_conn *c);
+const char *cm_conn_state_str(enum cm_conn_state s);
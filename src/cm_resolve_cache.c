@@ -0,0 +1,293 @@
+/**
+ * File: cm_resolve_cache.c
+ * Purpose: Address/route resolution cache and resolve timeouts (see cm_resolve_cache.h).
+ */
+
+#include "cm_resolve_cache.h"
+
+#include <infiniband/sa.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+#define CM_RCACHE_SLOTS 64
+
+struct rcache_entry
+{
+    int used;
+    struct cm_rcache_key key;
+    double expires, last_use;
+    struct sockaddr_storage dst, src;
+    int has_src;
+    // Filled by cm_rcache_store once a route resolved.
+    int has_route;
+    char dev[64];
+    uint8_t port_num;
+    union ibv_gid sgid, dgid;
+    struct ibv_path_data path;
+};
+
+static struct rcache_entry g_cache[CM_RCACHE_SLOTS];
+static struct cm_rcache_stats g_stats;
+static struct cm_resolve_cfg g_cfg;
+static int g_cfg_loaded;
+
+static double now_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int env_ms(const char *name, int def)
+{
+    const char *v = getenv(name);
+    return (v && *v) ? atoi(v) : def;
+}
+
+const struct cm_resolve_cfg *cm_resolve_cfg(void)
+{
+    if (!g_cfg_loaded)
+    {
+        g_cfg.addr_timeout_ms = env_ms("RDMA_ADDR_TIMEOUT_MS", 5000);
+        g_cfg.route_timeout_ms = env_ms("RDMA_ROUTE_TIMEOUT_MS", 5000);
+        g_cfg.ttl_ms = env_ms("RDMA_RESOLVE_CACHE_TTL_MS", 60000);
+        g_cfg_loaded = 1;
+    }
+    return &g_cfg;
+}
+
+void cm_resolve_set_cfg(const struct cm_resolve_cfg *cfg)
+{
+    g_cfg = *cfg;
+    g_cfg_loaded = 1;
+    if (g_cfg.ttl_ms <= 0)
+        cm_rcache_flush();
+}
+
+const struct cm_rcache_stats *cm_rcache_stats(void)
+{
+    return &g_stats;
+}
+
+void cm_rcache_key_set(struct cm_rcache_key *k, const char *ip, const char *port, const char *src_ip)
+{
+    memset(k, 0, sizeof(*k));
+    snprintf(k->ip, sizeof(k->ip), "%s", ip ? ip : "");
+    snprintf(k->port, sizeof(k->port), "%s", port ? port : "");
+    snprintf(k->src_ip, sizeof(k->src_ip), "%s", src_ip ? src_ip : "");
+}
+
+static int key_eq(const struct cm_rcache_key *a, const struct cm_rcache_key *b)
+{
+    return !strcmp(a->ip, b->ip) && !strcmp(a->port, b->port) && !strcmp(a->src_ip, b->src_ip);
+}
+
+// Live entry for k, or NULL. Expired entries are dropped on the way.
+static struct rcache_entry *find(const struct cm_rcache_key *k)
+{
+    double now = now_sec();
+    for (int i = 0; i < CM_RCACHE_SLOTS; i++)
+    {
+        struct rcache_entry *e = &g_cache[i];
+        if (!e->used || !key_eq(&e->key, k))
+            continue;
+        if (now >= e->expires)
+        {
+            e->used = 0;
+            __atomic_fetch_add(&g_stats.expired, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        e->last_use = now;
+        return e;
+    }
+    return NULL;
+}
+
+// A free slot, else the least recently used one.
+static struct rcache_entry *slot_for(const struct cm_rcache_key *k)
+{
+    struct rcache_entry *victim = &g_cache[0];
+    for (int i = 0; i < CM_RCACHE_SLOTS; i++)
+    {
+        struct rcache_entry *e = &g_cache[i];
+        if (!e->used || key_eq(&e->key, k))
+        {
+            victim = e;
+            break;
+        }
+        if (e->last_use < victim->last_use)
+            victim = e;
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->used = 1;
+    victim->key = *k;
+    victim->last_use = now_sec();
+    victim->expires = victim->last_use + cm_resolve_cfg()->ttl_ms / 1e3;
+    return victim;
+}
+
+static int lookup_addrs(const struct cm_rcache_key *k, struct sockaddr_storage *dst, struct sockaddr_storage *src,
+                        int *has_src)
+{
+    struct addrinfo hints = {.ai_family = AF_INET}, *res = NULL;
+    int rc = getaddrinfo(k->ip, k->port, &hints, &res);
+    if (rc)
+    {
+        LOG_ERR("getaddrinfo(%s:%s): %s", k->ip, k->port, gai_strerror(rc));
+        return -1;
+    }
+    memset(dst, 0, sizeof(*dst));
+    memcpy(dst, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    *has_src = 0;
+    if (k->src_ip[0])
+    {
+        rc = getaddrinfo(k->src_ip, NULL, &hints, &res);
+        if (rc)
+        {
+            LOG_ERR("getaddrinfo(src=%s): %s", k->src_ip, gai_strerror(rc));
+            return -1;
+        }
+        memset(src, 0, sizeof(*src));
+        memcpy(src, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+        *has_src = 1;
+    }
+    return 0;
+}
+
+int cm_rcache_addrs(const struct cm_rcache_key *k, struct sockaddr_storage *dst, struct sockaddr_storage *src,
+                    int *has_src)
+{
+    if (cm_resolve_cfg()->ttl_ms <= 0)
+        return lookup_addrs(k, dst, src, has_src);
+    struct rcache_entry *e = find(k);
+    if (e)
+    {
+        __atomic_fetch_add(&g_stats.hits, 1, __ATOMIC_RELAXED);
+        *dst = e->dst;
+        *src = e->src;
+        *has_src = e->has_src;
+        return 0;
+    }
+    __atomic_fetch_add(&g_stats.misses, 1, __ATOMIC_RELAXED);
+    if (lookup_addrs(k, dst, src, has_src))
+        return -1;
+    e = slot_for(k);
+    e->dst = *dst;
+    e->src = *src;
+    e->has_src = *has_src;
+    return 0;
+}
+
+// struct ibv_sa_path_rec (what librdmacm reports) -> wire-format ibv_path_record (what it accepts).
+static void pack_path(const struct ibv_sa_path_rec *p, struct ibv_path_data *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->flags = IBV_PATH_FLAG_GMP | IBV_PATH_FLAG_PRIMARY | IBV_PATH_FLAG_BIDIRECTIONAL;
+    struct ibv_path_record *r = &out->path;
+    r->dgid = p->dgid;
+    r->sgid = p->sgid;
+    r->dlid = p->dlid;
+    r->slid = p->slid;
+    r->flowlabel_hoplimit = htonl((ntohl(p->flow_label) << 8) | p->hop_limit);
+    r->tclass = p->traffic_class;
+    r->reversible_numpath = (uint8_t)((p->reversible ? 0x80 : 0) | (p->numb_path & 0x7f));
+    r->pkey = p->pkey;
+    r->qosclass_sl = htons(p->sl & 0xf);
+    r->mtu = (uint8_t)((p->mtu_selector << 6) | (p->mtu & 0x3f));
+    r->rate = (uint8_t)((p->rate_selector << 6) | (p->rate & 0x3f));
+    r->packetlifetime = (uint8_t)((p->packet_life_time_selector << 6) | (p->packet_life_time & 0x3f));
+    r->preference = p->preference;
+}
+
+int cm_rcache_resolve_route(const struct cm_rcache_key *k, struct rdma_cm_id *id)
+{
+    const struct cm_resolve_cfg *cfg = cm_resolve_cfg();
+    struct rcache_entry *e = cfg->ttl_ms > 0 ? find(k) : NULL;
+    if (e && e->has_route)
+    {
+        // The cached path is only valid on the device and port it was resolved through.
+        if (id->verbs && !strcmp(e->dev, ibv_get_device_name(id->verbs->device)) && id->port_num == e->port_num &&
+            !rdma_set_option(id, RDMA_OPTION_IB, RDMA_OPTION_IB_PATH, &e->path, sizeof(e->path)))
+        {
+            __atomic_fetch_add(&g_stats.paths_injected, 1, __ATOMIC_RELAXED);
+            LOG("rcache: injected cached path to %s:%s via %s/%u", k->ip, k->port, e->dev, e->port_num);
+            return 1;
+        }
+        LOG("rcache: cached path to %s:%s not usable (%s); resolving", k->ip, k->port, strerror(errno));
+        __atomic_fetch_add(&g_stats.path_fallbacks, 1, __ATOMIC_RELAXED);
+        e->has_route = 0;
+    }
+    if (rdma_resolve_route(id, cfg->route_timeout_ms))
+        return err_errno("rdma_resolve_route");
+    return 0;
+}
+
+void cm_rcache_store(const struct cm_rcache_key *k, struct rdma_cm_id *id)
+{
+    if (cm_resolve_cfg()->ttl_ms <= 0 || !id->verbs)
+        return;
+    struct rcache_entry *e = find(k);
+    if (!e)
+    {
+        e = slot_for(k);
+        e->dst = id->route.addr.dst_storage;
+    }
+    // Pin the source address the CM picked, without the ephemeral port of this id.
+    struct sockaddr *local = rdma_get_local_addr(id);
+    if (!e->has_src && local->sa_family == AF_INET)
+    {
+        memset(&e->src, 0, sizeof(e->src));
+        memcpy(&e->src, local, sizeof(struct sockaddr_in));
+        ((struct sockaddr_in *)&e->src)->sin_port = 0;
+        e->has_src = 1;
+    }
+    snprintf(e->dev, sizeof(e->dev), "%s", ibv_get_device_name(id->verbs->device));
+    e->port_num = id->port_num;
+    e->sgid = id->route.addr.addr.ibaddr.sgid;
+    e->dgid = id->route.addr.addr.ibaddr.dgid;
+    if (id->route.num_paths > 0 && id->route.path_rec)
+    {
+        pack_path(id->route.path_rec, &e->path);
+        e->has_route = 1;
+    }
+}
+
+void cm_rcache_invalidate(const struct cm_rcache_key *k)
+{
+    for (int i = 0; i < CM_RCACHE_SLOTS; i++)
+    {
+        if (g_cache[i].used && key_eq(&g_cache[i].key, k))
+        {
+            g_cache[i].used = 0;
+            __atomic_fetch_add(&g_stats.invalidations, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void cm_rcache_invalidate_dst(const struct sockaddr *dst)
+{
+    if (!dst || dst->sa_family != AF_INET)
+        return;
+    const struct sockaddr_in *d = (const struct sockaddr_in *)dst;
+    for (int i = 0; i < CM_RCACHE_SLOTS; i++)
+    {
+        const struct sockaddr_in *e = (const struct sockaddr_in *)&g_cache[i].dst;
+        if (g_cache[i].used && e->sin_addr.s_addr == d->sin_addr.s_addr)
+        {
+            g_cache[i].used = 0;
+            __atomic_fetch_add(&g_stats.invalidations, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void cm_rcache_flush(void)
+{
+    memset(g_cache, 0, sizeof(g_cache));
+}
@@ -0,0 +1,78 @@
+/**
+ * File: cm_resolve_cache.h
+ * Purpose: Per-process cache of address/route resolution results, plus the resolve timeouts.
+ *
+ * Overview:
+ * Every active connect runs getaddrinfo, rdma_resolve_addr and rdma_resolve_route. Clients that
+ * reconnect to the same few servers repeat identical work each time. This cache remembers, per
+ * (dest ip, port, src ip):
+ *  - the destination and source sockaddrs, so later connects skip getaddrinfo and bind to the
+ *    source address the first resolve picked;
+ *  - the device, port and GIDs the route went through;
+ *  - the path record. It is injected into later ids with rdma_set_option(RDMA_OPTION_IB_PATH),
+ *    which moves the id straight to ROUTE_RESOLVED. On InfiniBand that skips the SA PathRecord
+ *    query; on RoCE, route resolution is local and the saving is small.
+ *
+ * rdma_resolve_addr itself is not skipped: an rdma_cm_id only becomes usable through it. It runs
+ * with the cached source address, so it is a neighbour-table lookup.
+ *
+ * Entries expire after ttl_ms and are dropped on ADDR/ROUTE_ERROR, UNREACHABLE and CONNECT_ERROR.
+ * If the path cannot be injected, or the id resolved to another device or port, the caller falls
+ * back to rdma_resolve_route.
+ *
+ * Configuration (read from the environment on first use, overridable with cm_resolve_set_cfg):
+ *   RDMA_ADDR_TIMEOUT_MS        rdma_resolve_addr timeout (default 5000)
+ *   RDMA_ROUTE_TIMEOUT_MS       rdma_resolve_route timeout (default 5000)
+ *   RDMA_RESOLVE_CACHE_TTL_MS   entry lifetime, 0 disables the cache (default 60000)
+ *
+ * Notes:
+ *  - Not thread-safe, like the rest of the CM helpers.
+ */
+
+#pragma once
+#include <rdma/rdma_cma.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+struct cm_resolve_cfg
+{
+    int addr_timeout_ms;
+    int route_timeout_ms;
+    int ttl_ms;
+};
+
+struct cm_rcache_key
+{
+    char ip[64];
+    char port[16];
+    char src_ip[64]; // "" = let the CM pick
+};
+
+// Bumped with relaxed atomic adds; the metrics exporter reads them from its own thread.
+struct cm_rcache_stats
+{
+    uint64_t hits, misses, expired, invalidations;
+    uint64_t paths_injected, path_fallbacks;
+};
+
+const struct cm_resolve_cfg *cm_resolve_cfg(void);
+void cm_resolve_set_cfg(const struct cm_resolve_cfg *cfg);
+const struct cm_rcache_stats *cm_rcache_stats(void);
+
+void cm_rcache_key_set(struct cm_rcache_key *k, const char *ip, const char *port, const char *src_ip);
+
+// Destination and (optional) source sockaddrs for k: from the cache, else getaddrinfo. 0 or -1.
+int cm_rcache_addrs(const struct cm_rcache_key *k, struct sockaddr_storage *dst, struct sockaddr_storage *src,
+                    int *has_src);
+
+// Call after ADDR_RESOLVED. Either injects the cached path or calls rdma_resolve_route; both end in
+// ROUTE_RESOLVED on the id's channel. Returns 1 if the path was injected, 0 if resolved normally, -1 on error.
+int cm_rcache_resolve_route(const struct cm_rcache_key *k, struct rdma_cm_id *id);
+
+// Call after ROUTE_RESOLVED: remember the source address, device/port, GIDs and path for ttl_ms.
+void cm_rcache_store(const struct cm_rcache_key *k, struct rdma_cm_id *id);
+
+void cm_rcache_invalidate(const struct cm_rcache_key *k);
+// Drop every entry resolving to dst (for callers that only hold the id, e.g. after UNREACHABLE).
+void cm_rcache_invalidate_dst(const struct sockaddr *dst);
+void cm_rcache_flush(void);
@@ -182,6 +182,10 @@ static inline const char *wc_opcode_str(enum ibv_wc_opcode op)
         return "RECV";
     case IBV_WC_RECV_RDMA_WITH_IMM:
         return "RECV_RDMA_IMM";
+    case IBV_WC_FETCH_ADD:
+        return "FETCH_ADD";
+    case IBV_WC_COMP_SWAP:
+        return "CMP_SWAP";
     default:
         return "?";
     }
@@ -211,3 +215,14 @@ static inline void dump_wr_rdma(const struct ibv_send_wr *wr)
         (unsigned long)wr->wr_id, op, !!(wr->send_flags & IBV_SEND_SIGNALED), wr->num_sge,
         (unsigned long long)wr->wr.rdma.remote_addr, wr->wr.rdma.rkey);
 }
+
+static inline void dump_wr_atomic(const struct ibv_send_wr *wr)
+{
+    const char *op = (wr->opcode == IBV_WR_ATOMIC_FETCH_AND_ADD) ? "ATOMIC_FETCH_ADD"
+                     : (wr->opcode == IBV_WR_ATOMIC_CMP_AND_SWP) ? "ATOMIC_CMP_SWAP"
+                                                                 : "?";
+    LOG("WR: wr_id=%lu opcode=%s signaled=%d remote_addr=%#llx rkey=0x%x compare_add=%llu swap=%llu",
+        (unsigned long)wr->wr_id, op, !!(wr->send_flags & IBV_SEND_SIGNALED),
+        (unsigned long long)wr->wr.atomic.remote_addr, wr->wr.atomic.rkey,
+        (unsigned long long)wr->wr.atomic.compare_add, (unsigned long long)wr->wr.atomic.swap);
+}
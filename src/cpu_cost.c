@@ -0,0 +1,129 @@
+/**
+ * File: cpu_cost.c
+ * Purpose: rusage and perf_event_open accounting for benchmark runs (see cpu_cost.h).
+ */
+
+#include "cpu_cost.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static const uint64_t k_config[CPU_COST_NEV] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                PERF_COUNT_HW_CACHE_MISSES};
+
+static void rusage_now(double *user_s, double *sys_s)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    *user_s = (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6;
+    *sys_s = (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+}
+
+static double wall_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static int perf_open(uint64_t config, int exclude_kernel)
+{
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = config;
+    a.disabled = 1;
+    a.inherit = 1; // threads started later (TCP streams, producers) add their counts when they exit
+    a.exclude_kernel = (uint64_t)exclude_kernel;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+void cpu_cost_start(struct cpu_cost *c)
+{
+    memset(c, 0, sizeof(*c));
+    for (int i = 0; i < CPU_COST_NEV; i++)
+        c->fd[i] = -1;
+    const char *env = getenv("BENCH_PERF");
+    if (env && *env && strcmp(env, "0") != 0)
+    {
+        for (int i = 0; i < CPU_COST_NEV; i++)
+        {
+            c->fd[i] = perf_open(k_config[i], c->user_only);
+            if (c->fd[i] < 0 && (errno == EACCES || errno == EPERM) && !c->user_only)
+            {
+                c->user_only = 1; // perf_event_paranoid >= 2: count what we may
+                c->fd[i] = perf_open(k_config[i], 1);
+            }
+        }
+        if (c->fd[CPU_COST_CYCLES] < 0)
+            fprintf(stderr, "BENCH_PERF: perf_event_open(cycles): %s; rusage only\n", strerror(errno));
+        for (int i = 0; i < CPU_COST_NEV; i++)
+        {
+            if (c->fd[i] >= 0)
+            {
+                ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+    rusage_now(&c->user_s, &c->sys_s);
+    c->wall_s = wall_now();
+}
+
+void cpu_cost_stop(struct cpu_cost *c)
+{
+    for (int i = 0; i < CPU_COST_NEV; i++)
+    {
+        if (c->fd[i] < 0)
+            continue;
+        ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t v[3]; // value, time enabled, time running
+        if (read(c->fd[i], v, sizeof(v)) == (ssize_t)sizeof(v) && v[2] > 0)
+        {
+            c->val[i] = v[2] < v[1] ? (uint64_t)((double)v[0] * (double)v[1] / (double)v[2]) : v[0];
+            c->counted[i] = 1;
+        }
+        close(c->fd[i]);
+        c->fd[i] = -1;
+    }
+    double user, sys;
+    rusage_now(&user, &sys);
+    c->user_s = user - c->user_s;
+    c->sys_s = sys - c->sys_s;
+    c->wall_s = wall_now() - c->wall_s;
+}
+
+void cpu_cost_report(const char *who, const struct cpu_cost *c, uint64_t bytes, uint64_t ops, const char *op_name)
+{
+    double cpu = c->user_s + c->sys_s;
+    double gib = (double)bytes / (1024.0 * 1024.0 * 1024.0);
+    printf("%s cpu user=%.3fs sys=%.3fs cpu_s_per_GiB=%.3f cpu_util=%.0f%%", who, c->user_s, c->sys_s,
+           gib > 0 ? cpu / gib : 0.0, c->wall_s > 0 ? 100.0 * cpu / c->wall_s : 0.0);
+    if (ops)
+        printf(" %ss=%llu cpu_ns_per_%s=%.0f", op_name, (unsigned long long)ops, op_name, cpu * 1e9 / (double)ops);
+    printf("\n");
+    if (!c->counted[CPU_COST_CYCLES])
+        return;
+    uint64_t cyc = c->val[CPU_COST_CYCLES], ins = c->val[CPU_COST_INSTRUCTIONS];
+    printf("%s perf cycles=%llu", who, (unsigned long long)cyc);
+    if (c->counted[CPU_COST_INSTRUCTIONS])
+        printf(" instructions=%llu ipc=%.2f", (unsigned long long)ins, cyc ? (double)ins / (double)cyc : 0.0);
+    if (c->counted[CPU_COST_CACHE_MISSES])
+        printf(" cache_misses=%llu", (unsigned long long)c->val[CPU_COST_CACHE_MISSES]);
+    if (bytes)
+        printf(" cycles_per_byte=%.3f", (double)cyc / (double)bytes);
+    if (ops)
+        printf(" cycles_per_%s=%.0f", op_name, (double)cyc / (double)ops);
+    printf(" scope=%s\n", c->user_only ? "user" : "user+kernel");
+}
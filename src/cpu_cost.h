@@ -0,0 +1,49 @@
+/**
+ * File: cpu_cost.h
+ * Purpose: CPU cost of a benchmark run: getrusage times and optional hardware counters, per byte and per op.
+ *
+ * Overview:
+ * cpu_cost_start() and cpu_cost_stop() bracket the transfer. The report prints
+ *  - always: user and system CPU seconds of the whole process, CPU seconds per GiB, utilization, and CPU ns
+ *    per op;
+ *  - with BENCH_PERF=1: cycles, instructions, IPC and last-level cache misses counted by perf_event_open
+ *    on the calling thread and the threads it starts after cpu_cost_start(). They are normalized as cycles
+ *    per byte and per op.
+ * An "op" is whatever the tool hands the NIC or kernel one at a time: a WQE for RDMA, a send()/recv() call
+ * or io_uring completion for TCP. The same lines from both let the two be compared on efficiency, not just
+ * MiB/s.
+ *
+ * Notes:
+ *  - Kernel cycles are included when perf_event_paranoid allows it (<= 1, or CAP_PERFMON). Otherwise the
+ *    counters fall back to user space only and the report says scope=user. For TCP that hides most of the
+ *    cost, so compare like with like.
+ *  - Threads started before cpu_cost_start() (an exporter, say) are in the rusage times but not the counters.
+ *  - Counters a PMU lacks (common in VMs) are left out; if none open, only the rusage line is printed.
+ */
+
+#pragma once
+#include <stdint.h>
+
+enum
+{
+    CPU_COST_CYCLES,
+    CPU_COST_INSTRUCTIONS,
+    CPU_COST_CACHE_MISSES,
+    CPU_COST_NEV
+};
+
+struct cpu_cost
+{
+    double user_s, sys_s, wall_s;  // deltas after cpu_cost_stop()
+    int fd[CPU_COST_NEV];          // -1 if not counting
+    uint64_t val[CPU_COST_NEV];    // scaled for multiplexing
+    uint8_t counted[CPU_COST_NEV]; // val is valid
+    int user_only;                 // kernel counting was refused
+};
+
+/* Snapshot rusage and, if BENCH_PERF is set, open and enable the hardware counters. */
+void cpu_cost_start(struct cpu_cost *c);
+/* Turn the snapshots into deltas and close the counters. */
+void cpu_cost_stop(struct cpu_cost *c);
+/* "<who> cpu ..." and, when counters ran, "<who> perf ..."; ops 0 leaves the per-op figures out. */
+void cpu_cost_report(const char *who, const struct cpu_cost *c, uint64_t bytes, uint64_t ops, const char *op_name);
@@ -0,0 +1,216 @@
+/**
+ * File: cq_ts.c
+ * Purpose: Extended CQs with NIC completion timestamps, and the NIC-to-host clock conversion (see cq_ts.h).
+ */
+
+#include "cq_ts.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+#define CQ_TS_MAX 256
+#define CQ_TS_RECAL_NS 100000000ull // move the base point (and re-measure the rate) every 100 ms of NIC time
+
+struct cq_ts
+{
+    struct ibv_cq *cq; // NULL while the entry is free
+    struct ibv_cq_ex *cq_ex;
+    struct ibv_context *verbs;
+    uint64_t mask;       // completion_timestamp_mask: the counter's valid bits
+    double ns_per_tick;  // nominal from hca_core_clock, then measured
+    uint64_t recal_ticks;
+    uint64_t raw_base, host_base;     // last calibration
+    uint64_t raw_anchor, host_anchor; // first calibration, for the measured rate
+};
+
+static struct cq_ts g_ts[CQ_TS_MAX];
+static pthread_mutex_t g_ts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static struct cq_ts *cq_ts_of(struct ibv_cq *cq)
+{
+    struct cq_ts *t = cq->cq_context;
+    if ((uintptr_t)t - (uintptr_t)g_ts >= sizeof(g_ts))
+        return NULL;
+    return __atomic_load_n(&t->cq, __ATOMIC_ACQUIRE) == cq ? t : NULL;
+}
+
+// Pair the NIC clock with the host clock read around it.
+static int calibrate(struct cq_ts *t)
+{
+    struct ibv_values_ex v = {.comp_mask = IBV_VALUES_MASK_RAW_CLOCK};
+    uint64_t t0 = now_ns();
+    if (ibv_query_rt_values_ex(t->verbs, &v) || !(v.comp_mask & IBV_VALUES_MASK_RAW_CLOCK))
+        return -1;
+    uint64_t t1 = now_ns();
+    uint64_t raw = ((uint64_t)v.raw_clock.tv_sec * 1000000000ull + (uint64_t)v.raw_clock.tv_nsec) & t->mask;
+    uint64_t host = t0 + (t1 - t0) / 2;
+    if (!t->host_anchor)
+    {
+        t->raw_anchor = raw;
+        t->host_anchor = host;
+    }
+    else if (host - t->host_anchor >= CQ_TS_RECAL_NS)
+    {
+        // The longer the baseline, the less the read jitter matters; restart it if the counter could have wrapped.
+        uint64_t ticks = (raw - t->raw_anchor) & t->mask;
+        if (ticks && ticks < t->mask / 2)
+            t->ns_per_tick = (double)(host - t->host_anchor) / (double)ticks;
+        else
+        {
+            t->raw_anchor = raw;
+            t->host_anchor = host;
+        }
+    }
+    t->raw_base = raw;
+    t->host_base = host;
+    return 0;
+}
+
+static uint64_t to_host_ns(struct cq_ts *t, uint64_t raw)
+{
+    uint64_t ticks = (raw - t->raw_base) & t->mask;
+    if (ticks > t->recal_ticks && ticks <= t->mask / 2 && calibrate(t) == 0)
+        ticks = (raw - t->raw_base) & t->mask;
+    if (ticks <= t->mask / 2)
+        return t->host_base + (uint64_t)((double)ticks * t->ns_per_tick);
+    // Stamped before the base point (a CQE the NIC wrote just before a recalibration).
+    return t->host_base - (uint64_t)((double)((t->raw_base - raw) & t->mask) * t->ns_per_tick);
+}
+
+struct ibv_cq *cq_ts_create(struct ibv_context *verbs, int depth)
+{
+    const char *env = getenv("RDMA_CQ_TS");
+    struct ibv_device_attr_ex da;
+    struct cq_ts *t = NULL;
+    if (env && strcmp(env, "0") == 0)
+        goto plain;
+    memset(&da, 0, sizeof(da));
+    if (ibv_query_device_ex(verbs, NULL, &da) || !da.completion_timestamp_mask || !da.hca_core_clock)
+        goto plain;
+
+    pthread_mutex_lock(&g_ts_lock);
+    for (int i = 0; i < CQ_TS_MAX && !t; i++)
+    {
+        if (!g_ts[i].cq)
+            t = &g_ts[i];
+    }
+    if (!t)
+    {
+        pthread_mutex_unlock(&g_ts_lock);
+        LOG("cq_ts: %d timestamped CQs in use; this one gets software timestamps", CQ_TS_MAX);
+        goto plain;
+    }
+    memset(t, 0, sizeof(*t));
+    t->verbs = verbs;
+    t->mask = da.completion_timestamp_mask;
+    t->ns_per_tick = 1e6 / (double)da.hca_core_clock; // hca_core_clock is in kHz
+    t->recal_ticks = (uint64_t)((double)CQ_TS_RECAL_NS / t->ns_per_tick);
+    if (calibrate(t))
+    {
+        pthread_mutex_unlock(&g_ts_lock);
+        LOG("cq_ts: ibv_query_rt_values_ex failed; software timestamps");
+        goto plain;
+    }
+    struct ibv_cq_init_attr_ex ca = {.cqe = (uint32_t)depth,
+                                     .cq_context = t,
+                                     .wc_flags = IBV_WC_STANDARD_FLAGS | IBV_WC_EX_WITH_COMPLETION_TIMESTAMP};
+    t->cq_ex = ibv_create_cq_ex(verbs, &ca);
+    if (!t->cq_ex)
+    {
+        pthread_mutex_unlock(&g_ts_lock);
+        LOG("cq_ts: ibv_create_cq_ex(COMPLETION_TIMESTAMP): %s; software timestamps", strerror(errno));
+        goto plain;
+    }
+    __atomic_store_n(&t->cq, ibv_cq_ex_to_cq(t->cq_ex), __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_ts_lock);
+    LOG("cq_ts: NIC completion timestamps on (core clock %llu kHz, mask 0x%llx)",
+        (unsigned long long)da.hca_core_clock, (unsigned long long)da.completion_timestamp_mask);
+    return t->cq;
+
+plain:
+    return ibv_create_cq(verbs, depth, NULL, NULL, 0);
+}
+
+int cq_ts_destroy(struct ibv_cq *cq)
+{
+    struct cq_ts *t = cq_ts_of(cq);
+    int rc = ibv_destroy_cq(cq);
+    if (t && rc == 0)
+    {
+        pthread_mutex_lock(&g_ts_lock);
+        __atomic_store_n(&t->cq, NULL, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&g_ts_lock);
+    }
+    return rc;
+}
+
+int cq_ts_enabled(struct ibv_cq *cq)
+{
+    return cq_ts_of(cq) != NULL;
+}
+
+// The ibv_wc fields the rest of the repo reads. Only wr_id, status, vendor_err and qp_num are defined on errors.
+static void read_wc(struct ibv_cq_ex *cq, struct ibv_wc *wc)
+{
+    memset(wc, 0, sizeof(*wc));
+    wc->wr_id = cq->wr_id;
+    wc->status = cq->status;
+    wc->vendor_err = ibv_wc_read_vendor_err(cq);
+    wc->qp_num = ibv_wc_read_qp_num(cq);
+    if (wc->status != IBV_WC_SUCCESS)
+        return;
+    wc->opcode = ibv_wc_read_opcode(cq);
+    wc->byte_len = ibv_wc_read_byte_len(cq);
+    wc->wc_flags = ibv_wc_read_wc_flags(cq);
+    if (wc->wc_flags & IBV_WC_WITH_IMM)
+        wc->imm_data = ibv_wc_read_imm_data(cq);
+    wc->src_qp = ibv_wc_read_src_qp(cq);
+    wc->slid = ibv_wc_read_slid(cq);
+    wc->sl = ibv_wc_read_sl(cq);
+    wc->dlid_path_bits = ibv_wc_read_dlid_path_bits(cq);
+}
+
+int cq_ts_poll(struct ibv_cq *cq, int n, struct ibv_wc *wc, uint64_t *ts_ns)
+{
+    struct cq_ts *t = cq_ts_of(cq);
+    if (!t)
+    {
+        int got = ibv_poll_cq(cq, n, wc);
+        for (int k = 0; k < got; k++)
+            ts_ns[k] = 0;
+        return got;
+    }
+    if (n <= 0)
+        return 0;
+    struct ibv_poll_cq_attr pa = {.comp_mask = 0};
+    int rc = ibv_start_poll(t->cq_ex, &pa);
+    if (rc == ENOENT)
+        return 0;
+    if (rc)
+        return -1;
+    int got = 0;
+    for (;;)
+    {
+        read_wc(t->cq_ex, &wc[got]);
+        ts_ns[got] = wc[got].status == IBV_WC_SUCCESS ? to_host_ns(t, ibv_wc_read_completion_ts(t->cq_ex)) : 0;
+        if (++got == n)
+            break;
+        rc = ibv_next_poll(t->cq_ex);
+        if (rc)
+            break;
+    }
+    ibv_end_poll(t->cq_ex);
+    return got; // an error after the first CQE shows up again on the next call
+}
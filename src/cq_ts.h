@@ -0,0 +1,39 @@
+/**
+ * File: cq_ts.h
+ * Purpose: Completion queues that stamp each CQE with the NIC's clock, converted to host time.
+ *
+ * Overview:
+ * cq_ts_create() asks the device for an extended CQ with IBV_WC_EX_WITH_COMPLETION_TIMESTAMP when it reports a
+ * completion timestamp mask and a core clock frequency (ibv_query_device_ex). The raw counter is tied to host
+ * CLOCK_MONOTONIC, the clock rdma_stats stamps posts with, through ibv_query_rt_values_ex: each calibration reads
+ * the NIC clock between two host clock reads. Conversions start from the nominal hca_core_clock rate; once the
+ * first calibration is 100 ms old, the rate measured since then replaces it, and the base point moves forward
+ * every 100 ms of NIC time so drift stays bounded.
+ *
+ * cq_ts_poll() reaps like ibv_poll_cq and adds one host timestamp per CQE: when the NIC wrote it, or 0 when the
+ * CQ has none. With those, rdma_stats splits a signaled WR's post-to-reap time into the part spent in the NIC and
+ * fabric (post to CQE timestamp) and the part spent waiting for the host to poll (CQE timestamp to reap).
+ *
+ * Notes:
+ *  - Without device support (SoftRoCE, the test mock), with RDMA_CQ_TS=0, or if the extended CQ cannot be
+ *    created, cq_ts_create() returns a plain ibv_create_cq CQ and cq_ts_poll() is ibv_poll_cq with zeroed
+ *    timestamps: latency is then measured in software only, post to reap.
+ *  - Timestamped CQs are found through cq_context, which cq_ts owns for them. Destroy them with cq_ts_destroy()
+ *    so the entry is reused; it takes plain CQs too.
+ *  - ibv_poll_cq still works on a timestamped CQ (the bulk server's batch loops use it); those CQEs just carry
+ *    no timestamp.
+ *  - A CQ is polled by one thread at a time, as everywhere in this repo; calibration state is per CQ.
+ */
+
+#pragma once
+#include <infiniband/verbs.h>
+#include <stdint.h>
+
+/* A CQ of depth entries, with NIC completion timestamps where the device has them. NULL + errno on failure. */
+struct ibv_cq *cq_ts_create(struct ibv_context *verbs, int depth);
+/* ibv_destroy_cq, releasing the timestamp state of a CQ from cq_ts_create(). */
+int cq_ts_destroy(struct ibv_cq *cq);
+/* 1 if CQEs reaped with cq_ts_poll() carry NIC timestamps. */
+int cq_ts_enabled(struct ibv_cq *cq);
+/* Up to n CQEs into wc, as ibv_poll_cq; ts_ns[k] is wc[k]'s completion time in CLOCK_MONOTONIC ns, or 0. */
+int cq_ts_poll(struct ibv_cq *cq, int n, struct ibv_wc *wc, uint64_t *ts_ns);
@@ -0,0 +1,242 @@
+/**
+ * File: crc32c.c
+ * Purpose: CRC32C with hardware acceleration (see crc32c.h).
+ *
+ * Overview:
+ * The hardware path follows the well-known three-lane scheme: a crc32 instruction has a latency
+ * of about three cycles but a throughput of one per cycle, so the buffer is split into three
+ * blocks whose CRCs are computed in parallel and then combined. Combining needs "CRC of the
+ * first block followed by N zero bytes", which is a linear operator over GF(2); it is built once
+ * per block size as four byte-indexed tables.
+ */
+
+#include "crc32c.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HW_TARGET __attribute__((target("sse4.2")))
+#define CRC32C_HW_U8(c, v) _mm_crc32_u8((uint32_t)(c), (v))
+#define CRC32C_HW_U64(c, v) _mm_crc32_u64((c), (v))
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#define CRC32C_HW_TARGET __attribute__((target("+crc")))
+#define CRC32C_HW_U8(c, v) __crc32cb((uint32_t)(c), (v))
+#define CRC32C_HW_U64(c, v) __crc32cd((uint32_t)(c), (v))
+#endif
+
+#define POLY 0x82f63b78u // reflected Castagnoli polynomial
+#define LONG_BLOCK 8192
+#define SHORT_BLOCK 256
+
+static uint32_t sw_table[8][256];
+static uint32_t shift_long[4][256];
+static uint32_t shift_short[4][256];
+static int have_hw;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; n++)
+        square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+// Operator that appends len zero bytes to a CRC (len must be a power of two).
+static void zeros_op(uint32_t *even, size_t len)
+{
+    uint32_t odd[32];
+    uint32_t row = 1;
+    odd[0] = POLY;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2_matrix_square(even, odd); // 2 zero bits
+    gf2_matrix_square(odd, even); // 4 zero bits
+    do
+    {
+        gf2_matrix_square(even, odd);
+        len >>= 1;
+        if (len == 0)
+            return;
+        gf2_matrix_square(odd, even);
+        len >>= 1;
+    } while (len);
+    memcpy(even, odd, sizeof(odd));
+}
+
+static void build_shift_table(uint32_t table[4][256], size_t len)
+{
+    uint32_t op[32];
+    zeros_op(op, len);
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        table[0][n] = gf2_matrix_times(op, n);
+        table[1][n] = gf2_matrix_times(op, n << 8);
+        table[2][n] = gf2_matrix_times(op, n << 16);
+        table[3][n] = gf2_matrix_times(op, n << 24);
+    }
+}
+
+static inline uint32_t shift_crc(uint32_t table[4][256], uint32_t crc)
+{
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+static void crc32c_init(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+        sw_table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t crc = sw_table[0][n];
+        for (int k = 1; k < 8; k++)
+        {
+            crc = sw_table[0][crc & 0xff] ^ (crc >> 8);
+            sw_table[k][n] = crc;
+        }
+    }
+    build_shift_table(shift_long, LONG_BLOCK);
+    build_shift_table(shift_short, SHORT_BLOCK);
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    have_hw = __builtin_cpu_supports("sse4.2");
+#elif defined(__aarch64__)
+    have_hw = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+
+static inline uint64_t load_u64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&init_once, crc32c_init);
+    const unsigned char *next = buf;
+    uint64_t c = crc ^ 0xffffffffu;
+    while (len && ((uintptr_t)next & 7))
+    {
+        c = sw_table[0][(c ^ *next++) & 0xff] ^ (c >> 8);
+        len--;
+    }
+    while (len >= 8)
+    {
+        c ^= load_u64(next); // little-endian hosts only, like the rest of the labs
+        c = sw_table[7][c & 0xff] ^ sw_table[6][(c >> 8) & 0xff] ^ sw_table[5][(c >> 16) & 0xff] ^
+            sw_table[4][(c >> 24) & 0xff] ^ sw_table[3][(c >> 32) & 0xff] ^ sw_table[2][(c >> 40) & 0xff] ^
+            sw_table[1][(c >> 48) & 0xff] ^ sw_table[0][c >> 56];
+        next += 8;
+        len -= 8;
+    }
+    while (len--)
+        c = sw_table[0][(c ^ *next++) & 0xff] ^ (c >> 8);
+    return (uint32_t)c ^ 0xffffffffu;
+}
+
+#ifdef CRC32C_HW_TARGET
+CRC32C_HW_TARGET static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+    const unsigned char *next = buf;
+    uint64_t crc0 = crc ^ 0xffffffffu;
+    while (len && ((uintptr_t)next & 7))
+    {
+        crc0 = CRC32C_HW_U8(crc0, *next++);
+        len--;
+    }
+    // Three lanes over consecutive blocks, then shift lane 0 past lanes 1 and 2.
+    while (len >= 3 * LONG_BLOCK)
+    {
+        uint64_t crc1 = 0, crc2 = 0;
+        const unsigned char *end = next + LONG_BLOCK;
+        do
+        {
+            crc0 = CRC32C_HW_U64(crc0, load_u64(next));
+            crc1 = CRC32C_HW_U64(crc1, load_u64(next + LONG_BLOCK));
+            crc2 = CRC32C_HW_U64(crc2, load_u64(next + 2 * LONG_BLOCK));
+            next += 8;
+        } while (next < end);
+        crc0 = shift_crc(shift_long, (uint32_t)crc0) ^ crc1;
+        crc0 = shift_crc(shift_long, (uint32_t)crc0) ^ crc2;
+        next += 2 * LONG_BLOCK;
+        len -= 3 * LONG_BLOCK;
+    }
+    while (len >= 3 * SHORT_BLOCK)
+    {
+        uint64_t crc1 = 0, crc2 = 0;
+        const unsigned char *end = next + SHORT_BLOCK;
+        do
+        {
+            crc0 = CRC32C_HW_U64(crc0, load_u64(next));
+            crc1 = CRC32C_HW_U64(crc1, load_u64(next + SHORT_BLOCK));
+            crc2 = CRC32C_HW_U64(crc2, load_u64(next + 2 * SHORT_BLOCK));
+            next += 8;
+        } while (next < end);
+        crc0 = shift_crc(shift_short, (uint32_t)crc0) ^ crc1;
+        crc0 = shift_crc(shift_short, (uint32_t)crc0) ^ crc2;
+        next += 2 * SHORT_BLOCK;
+        len -= 3 * SHORT_BLOCK;
+    }
+    const unsigned char *end = next + (len - (len & 7));
+    while (next < end)
+    {
+        crc0 = CRC32C_HW_U64(crc0, load_u64(next));
+        next += 8;
+    }
+    len &= 7;
+    while (len--)
+        crc0 = CRC32C_HW_U8(crc0, *next++);
+    return (uint32_t)crc0 ^ 0xffffffffu;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&init_once, crc32c_init);
+#ifdef CRC32C_HW_TARGET
+    if (have_hw)
+        return crc32c_hw(crc, buf, len);
+#endif
+    return crc32c_sw(crc, buf, len);
+}
+
+const char *crc32c_impl(void)
+{
+    pthread_once(&init_once, crc32c_init);
+#if defined(__x86_64__)
+    if (have_hw)
+        return "sse4.2";
+#elif defined(__aarch64__)
+    if (have_hw)
+        return "armv8-crc";
+#endif
+    return "table";
+}
@@ -0,0 +1,21 @@
+/**
+ * File: crc32c.h
+ * Purpose: CRC32C (Castagnoli) for payload integrity checks.
+ *
+ * Overview:
+ * crc32c() dispatches once to the fastest implementation the CPU has: the SSE4.2 crc32
+ * instruction on x86-64 or the ARMv8 CRC32 extension on aarch64, each running three interleaved
+ * streams that are merged with precomputed shift tables, and a slicing-by-8 table otherwise.
+ *
+ * Notes:
+ *  - crc32c(0, buf, len) starts a new checksum; pass a previous result to extend it.
+ *  - Thread-safe after the first call (initialisation is idempotent).
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+const char *crc32c_impl(void);
@@ -0,0 +1,137 @@
+/**
+ * File: ib_counters.c
+ * Purpose: sysfs port counter snapshots and per-GiB deltas (see ib_counters.h).
+ */
+
+#include "ib_counters.h"
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// hw_counters names differ by driver (mlx5, rxe, irdma, bnxt_re, ...); each group sums whichever exist.
+static const char *const k_retrans[] = {"completer_retry_err", "roce_adp_retrans", "retry_exceeded_err", NULL};
+static const char *const k_oos[] = {"out_of_sequence",  "out_of_seq_request",  "rcvd_seq_err",
+                                    "packet_seq_err",   "implied_nak_seq_err", NULL};
+static const char *const k_rnr[] = {"rcvd_rnr_err", "send_rnr_err", "rnr_nak_retry_err", "retry_rnr_exceeded_err",
+                                    NULL};
+static const char *const k_timeout[] = {"local_ack_timeout_err", NULL};
+static const char *const k_dup[] = {"duplicate_request", NULL};
+
+static int read_one(const char *path, uint64_t *out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    unsigned long long v;
+    int ok = fscanf(f, "%llu", &v) == 1;
+    fclose(f);
+    if (!ok)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static void read_group(struct ib_counters *s, const char *port_dir, const char *sub, uint8_t hw)
+{
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/%s", port_dir, sub);
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *e;
+    while ((e = readdir(d)) && s->n < IB_COUNTERS_MAX)
+    {
+        if (e->d_name[0] == '.' || strlen(e->d_name) >= sizeof(s->c[0].name))
+            continue;
+        char path[768];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        struct ib_counter *c = &s->c[s->n];
+        // Some drivers expose write-only or erroring entries (e.g. lifespan); skip what does not parse.
+        if (read_one(path, &c->value))
+            continue;
+        snprintf(c->name, sizeof(c->name), "%s", e->d_name);
+        c->hw = hw;
+        s->n++;
+    }
+    closedir(d);
+}
+
+int ib_counters_read_dir(struct ib_counters *s, const char *port_dir)
+{
+    s->n = 0;
+    read_group(s, port_dir, "counters", 0);
+    read_group(s, port_dir, "hw_counters", 1);
+    return s->n ? s->n : -1;
+}
+
+int ib_counters_read(struct ib_counters *s, const char *dev, int port)
+{
+    char dir[256];
+    snprintf(s->dev, sizeof(s->dev), "%s", dev ? dev : "");
+    s->port = port;
+    if (!dev || !*dev)
+    {
+        s->n = 0;
+        return -1;
+    }
+    snprintf(dir, sizeof(dir), "/sys/class/infiniband/%s/ports/%d", dev, port);
+    return ib_counters_read_dir(s, dir);
+}
+
+static const struct ib_counter *find(const struct ib_counters *s, const char *name)
+{
+    for (int i = 0; i < s->n; i++)
+    {
+        if (strcmp(s->c[i].name, name) == 0)
+            return &s->c[i];
+    }
+    return NULL;
+}
+
+uint64_t ib_counters_delta(const struct ib_counters *a, const struct ib_counters *b, const char *name)
+{
+    const struct ib_counter *x = find(a, name), *y = find(b, name);
+    if (!x || !y || y->value < x->value) // missing, or reset in between
+        return 0;
+    return y->value - x->value;
+}
+
+static uint64_t group_delta(const struct ib_counters *a, const struct ib_counters *b, const char *const *names)
+{
+    uint64_t sum = 0;
+    for (; *names; names++)
+        sum += ib_counters_delta(a, b, *names);
+    return sum;
+}
+
+void ib_counters_report(const char *who, const struct ib_counters *a, const struct ib_counters *b, uint64_t bytes)
+{
+    if (!a->n || !b->n)
+    {
+        printf("%s port counters: unavailable for %s port %d\n", who, a->dev[0] ? a->dev : "?", a->port);
+        return;
+    }
+    double gib = (double)bytes / (1024.0 * 1024.0 * 1024.0);
+    double per = gib > 0 ? 1.0 / gib : 0.0;
+    // port_xmit_data/port_rcv_data count 4-byte words, headers and retransmissions included.
+    uint64_t wire = 4 * (ib_counters_delta(a, b, "port_xmit_data") + ib_counters_delta(a, b, "port_rcv_data"));
+    uint64_t retrans = group_delta(a, b, k_retrans), oos = group_delta(a, b, k_oos);
+    uint64_t rnr = group_delta(a, b, k_rnr), tmo = group_delta(a, b, k_timeout), dup = group_delta(a, b, k_dup);
+
+    printf("%s port counters %s/%d: payload=%.3fGiB wire/payload=%.3f", who, a->dev, a->port, gib,
+           bytes ? (double)wire / (double)bytes : 0.0);
+    printf(" retransmit=%" PRIu64 " (%.1f/GiB) out_of_sequence=%" PRIu64 " (%.1f/GiB) rnr_nak=%" PRIu64
+           " (%.1f/GiB) timeout=%" PRIu64 " (%.1f/GiB) duplicate=%" PRIu64 " (%.1f/GiB)\n",
+           retrans, (double)retrans * per, oos, (double)oos * per, rnr, (double)rnr * per, tmo, (double)tmo * per, dup,
+           (double)dup * per);
+    for (int i = 0; i < b->n; i++)
+    {
+        uint64_t d = ib_counters_delta(a, b, b->c[i].name);
+        if (d)
+            printf("  %s%-32s %12" PRIu64 " %14.1f/GiB\n", b->c[i].hw ? "hw:" : "", b->c[i].name, d,
+                   (double)d * per);
+    }
+}
@@ -0,0 +1,61 @@
+/**
+ * File: ib_counters.h
+ * Purpose: Before/after snapshots of an RDMA port's sysfs counters, reported as deltas per GiB moved.
+ *
+ * Overview:
+ * /sys/class/infiniband/<dev>/ports/<port>/counters holds the IB port counters (port_xmit_data, port_rcv_data, ...
+ * in 4-byte words). hw_counters holds the driver's own: retransmissions, out-of-sequence and duplicate packets,
+ * RNR NAKs, ACK timeouts. A tool snapshots both before and after a run, and ib_counters_report() prints:
+ *  - one summary line: wire bytes over payload bytes (amplification), and the retransmission-related counters
+ *    grouped by cause, each per GiB of payload;
+ *  - one line per counter that changed.
+ * That is what tells a throughput collapse under netem caused by go-back-N retransmits from one caused by, say,
+ * RNR NAKs from a receiver that ran out of buffers.
+ *
+ * Notes:
+ *  - Counters are port-wide: other traffic on the port during the run shows up too.
+ *  - Devices without a readable sysfs directory (or a counter that refuses reads) are skipped silently;
+ *    the report then says the counters were unavailable.
+ */
+
+#pragma once
+#include <infiniband/verbs.h>
+#include <stdint.h>
+
+#define IB_COUNTERS_MAX 192
+
+struct ib_counter
+{
+    char name[48];
+    uint8_t hw; // from hw_counters/ rather than counters/
+    uint64_t value;
+};
+
+struct ib_counters
+{
+    char dev[64];
+    int port;
+    int n; // 0 = not taken or unavailable
+    struct ib_counter c[IB_COUNTERS_MAX];
+};
+
+/* Read <port_dir>/counters and <port_dir>/hw_counters. Returns the number of counters read, -1 if none. */
+int ib_counters_read_dir(struct ib_counters *s, const char *port_dir);
+/* Same, for /sys/class/infiniband/<dev>/ports/<port>. */
+int ib_counters_read(struct ib_counters *s, const char *dev, int port);
+
+/* The device and port a connected cm_id uses: ib_counters_read_verbs(&s, id->verbs, id->port_num). */
+static inline int ib_counters_read_verbs(struct ib_counters *s, struct ibv_context *verbs, uint8_t port)
+{
+    if (!verbs)
+    {
+        s->n = 0;
+        return -1;
+    }
+    return ib_counters_read(s, ibv_get_device_name(verbs->device), port);
+}
+
+/* Delta of one counter by name between two snapshots; 0 if either lacks it. */
+uint64_t ib_counters_delta(const struct ib_counters *a, const struct ib_counters *b, const char *name);
+/* Print the summary and per-counter lines, prefixed with who, normalized by payload bytes. */
+void ib_counters_report(const char *who, const struct ib_counters *a, const struct ib_counters *b, uint64_t bytes);
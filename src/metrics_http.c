@@ -0,0 +1,365 @@
+/**
+ * File: metrics_http.c
+ * Purpose: Prometheus exporter thread (see metrics_http.h).
+ */
+
+#include "metrics_http.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cm_resolve_cache.h"
+#include "common.h"
+#include "rdma_stats.h"
+
+#define METRICS_MAX_SOURCES 16
+
+static struct
+{
+    int fd;
+    int running;
+    volatile int stop;
+    pthread_t thread;
+    pthread_mutex_t lock; // sources; held by the exporter while it renders, never by the data path
+    struct
+    {
+        metrics_source_fn fn;
+        void *arg;
+    } src[METRICS_MAX_SOURCES];
+    int nsrc;
+} g = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+void metrics_family(FILE *out, const char *name, const char *type, const char *help)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// The labels naming a QP slot, or NULL for a free one: QP numbers are only unique per device.
+static const char *qp_labels(const struct rdma_stats_qp *q, char *buf, size_t len)
+{
+    if (!__atomic_load_n(&q->in_use, __ATOMIC_ACQUIRE))
+        return NULL;
+    snprintf(buf, len, "dev=\"%.*s\",qp=\"%u\",label=\"%.*s\"", RDMA_STATS_LABEL, q->dev, q->qp_num,
+             RDMA_STATS_LABEL, q->label);
+    return buf;
+}
+
+// One counter or gauge sample per QP slot; `off` is the field's byte offset in struct rdma_stats_qp.
+static void qp_family(FILE *out, const struct rdma_stats_seg *seg, uint32_t n, const char *name, const char *type,
+                      const char *help, size_t off)
+{
+    char lb[80];
+    metrics_family(out, name, type, help);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const struct rdma_stats_qp *q = &seg->qp[i];
+        if (qp_labels(q, lb, sizeof(lb)))
+            fprintf(out, "%s{%s} %llu\n", name, lb,
+                    (unsigned long long)metrics_u64((const uint64_t *)((const char *)q + off)));
+    }
+}
+
+// One log2 latency histogram per QP slot; `hist_off` and `sum_off` locate its buckets and ns sum.
+static void qp_histogram(FILE *out, const struct rdma_stats_seg *seg, uint32_t n, const char *name, const char *help,
+                         size_t hist_off, size_t sum_off)
+{
+    char lb[80];
+    metrics_family(out, name, "histogram", help);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const struct rdma_stats_qp *q = &seg->qp[i];
+        if (!qp_labels(q, lb, sizeof(lb)))
+            continue;
+        const uint64_t *hist = (const uint64_t *)((const char *)q + hist_off);
+        uint64_t cum = 0;
+        for (int b = 0; b < RDMA_STATS_LAT_BUCKETS; b++)
+        {
+            cum += metrics_u64(&hist[b]);
+            uint64_t bound = rdma_stats_lat_bound_ns(b);
+            if (!bound)
+                break;
+            fprintf(out, "%s_bucket{%s,le=\"%.9g\"} %llu\n", name, lb, (double)bound / 1e9, (unsigned long long)cum);
+        }
+        fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, lb, (unsigned long long)cum);
+        fprintf(out, "%s_sum{%s} %.9f\n", name, lb,
+                (double)metrics_u64((const uint64_t *)((const char *)q + sum_off)) / 1e9);
+        fprintf(out, "%s_count{%s} %llu\n", name, lb, (unsigned long long)cum);
+    }
+}
+
+// One CQ as the QP slots see it: a CQ shared by several QPs (or by one QP's send and recv side) is one row.
+struct cq_row
+{
+    const char *dev;
+    uint32_t handle, size;
+    uint64_t owed;
+};
+
+static struct cq_row *cq_row(struct cq_row *rows, uint32_t *nrows, const char *dev, uint32_t handle, uint32_t size)
+{
+    for (uint32_t i = 0; i < *nrows; i++)
+    {
+        if (rows[i].handle == handle && strncmp(rows[i].dev, dev, RDMA_STATS_LABEL) == 0)
+            return &rows[i];
+    }
+    rows[*nrows] = (struct cq_row){.dev = dev, .handle = handle, .size = size};
+    return &rows[(*nrows)++];
+}
+
+static void render_cqs(FILE *out, const struct rdma_stats_seg *seg, uint32_t n)
+{
+    struct cq_row rows[2 * RDMA_STATS_MAX_QPS];
+    uint32_t nrows = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const struct rdma_stats_qp *q = &seg->qp[i];
+        if (!__atomic_load_n(&q->in_use, __ATOMIC_ACQUIRE))
+            continue;
+        uint32_t ssize = __atomic_load_n(&q->send_cq_size, __ATOMIC_ACQUIRE);
+        uint32_t rsize = __atomic_load_n(&q->recv_cq_size, __ATOMIC_ACQUIRE);
+        if (!ssize || !rsize)
+            continue;
+        cq_row(rows, &nrows, q->dev, __atomic_load_n(&q->send_cq, __ATOMIC_RELAXED), ssize)->owed +=
+            metrics_u64(&q->send_cqes_owed);
+        cq_row(rows, &nrows, q->dev, __atomic_load_n(&q->recv_cq, __ATOMIC_RELAXED), rsize)->owed +=
+            metrics_u64(&q->recv_cqes_owed);
+    }
+    metrics_family(out, "rdma_cq_size", "gauge", "CQ capacity in entries (ibv_cq.cqe).");
+    for (uint32_t i = 0; i < nrows; i++)
+        fprintf(out, "rdma_cq_size{dev=\"%.*s\",cq=\"%u\"} %u\n", RDMA_STATS_LABEL, rows[i].dev, rows[i].handle,
+                rows[i].size);
+    metrics_family(out, "rdma_cq_owed_cqes", "gauge",
+                   "Signaled sends and RECVs posted to the CQ's QPs and not yet reaped: an upper bound on its fill.");
+    for (uint32_t i = 0; i < nrows; i++)
+        fprintf(out, "rdma_cq_owed_cqes{dev=\"%.*s\",cq=\"%u\"} %llu\n", RDMA_STATS_LABEL, rows[i].dev,
+                rows[i].handle, (unsigned long long)rows[i].owed);
+}
+
+static void render_qps(FILE *out)
+{
+    const struct rdma_stats_seg *seg = rdma_stats_segment();
+    if (!seg)
+        return;
+    uint32_t n = __atomic_load_n(&seg->nslots, __ATOMIC_ACQUIRE), live = 0;
+    for (uint32_t i = 0; i < n; i++)
+        live += __atomic_load_n(&seg->qp[i].in_use, __ATOMIC_RELAXED) != 0;
+    metrics_family(out, "rdma_qps", "gauge", "QPs with a counter slot (freed when the QP is destroyed).");
+    fprintf(out, "rdma_qps %u\n", live);
+    metrics_family(out, "rdma_qps_untracked_total", "counter", "QPs seen after every counter slot was taken.");
+    fprintf(out, "rdma_qps_untracked_total %llu\n", (unsigned long long)metrics_u64(&seg->dropped));
+
+    char lb[80];
+    metrics_family(out, "rdma_qp_wrs_posted_total", "counter", "Work requests posted, by opcode.");
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const struct rdma_stats_qp *q = &seg->qp[i];
+        if (!qp_labels(q, lb, sizeof(lb)))
+            continue;
+        for (int op = 0; op < RDMA_STATS_NOPS; op++)
+            fprintf(out, "rdma_qp_wrs_posted_total{%s,op=\"%s\"} %llu\n", lb, rdma_stats_op_str(op),
+                    (unsigned long long)metrics_u64(&q->posted[op]));
+    }
+#define QP_FIELD(name, type, help, field) qp_family(out, seg, n, name, type, help, offsetof(struct rdma_stats_qp, field))
+    QP_FIELD("rdma_qp_bytes_posted_total", "counter", "Bytes in posted send work requests.", bytes_posted);
+    QP_FIELD("rdma_qp_bytes_received_total", "counter", "Bytes delivered by successful RECV completions.",
+             bytes_recv);
+    QP_FIELD("rdma_qp_signaled_wrs_total", "counter", "Send work requests posted with IBV_SEND_SIGNALED.", signaled);
+    QP_FIELD("rdma_qp_unsignaled_wrs_total", "counter", "Send work requests posted without a completion.",
+             unsignaled);
+    QP_FIELD("rdma_qp_cqes_total", "counter", "Completions reaped.", cqes);
+    QP_FIELD("rdma_qp_error_cqes_total", "counter", "Completions with a non-success status.", error_cqes);
+    QP_FIELD("rdma_qp_empty_polls_total", "counter", "CQ polls that returned nothing.", empty_polls);
+    QP_FIELD("rdma_qp_inflight_wrs", "gauge", "Send work requests posted and not yet completed.", inflight);
+    QP_FIELD("rdma_qp_inflight_wrs_max", "gauge", "Peak of rdma_qp_inflight_wrs.", max_inflight);
+#undef QP_FIELD
+
+#define QP_HIST(name, help, hist, sum) \
+    qp_histogram(out, seg, n, name, help, offsetof(struct rdma_stats_qp, hist), offsetof(struct rdma_stats_qp, sum))
+    QP_HIST("rdma_qp_completion_latency_seconds", "Post to CQE time of signaled send work requests.", lat_hist,
+            lat_sum_ns);
+    QP_HIST("rdma_qp_nic_latency_seconds",
+            "Post to NIC completion timestamp of signaled send work requests (CQs with timestamps only).",
+            nic_lat_hist, nic_lat_sum_ns);
+    QP_HIST("rdma_qp_poll_delay_seconds", "NIC completion timestamp to the poll that reaped the CQE.", poll_lat_hist,
+            poll_lat_sum_ns);
+#undef QP_HIST
+    render_cqs(out, seg, n);
+}
+
+static void render_resolve_cache(FILE *out)
+{
+    const struct cm_rcache_stats *st = cm_rcache_stats();
+    metrics_family(out, "rdma_resolve_cache_lookups_total", "counter", "Address/route cache lookups, by result.");
+    fprintf(out, "rdma_resolve_cache_lookups_total{result=\"hit\"} %llu\n", (unsigned long long)metrics_u64(&st->hits));
+    fprintf(out, "rdma_resolve_cache_lookups_total{result=\"miss\"} %llu\n",
+            (unsigned long long)metrics_u64(&st->misses));
+    fprintf(out, "rdma_resolve_cache_lookups_total{result=\"expired\"} %llu\n",
+            (unsigned long long)metrics_u64(&st->expired));
+}
+
+static void render(FILE *out)
+{
+    render_qps(out);
+    render_resolve_cache(out);
+    pthread_mutex_lock(&g.lock);
+    for (int i = 0; i < g.nsrc; i++)
+        g.src[i].fn(out, g.src[i].arg);
+    pthread_mutex_unlock(&g.lock);
+}
+
+static int write_all(int fd, const char *p, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void serve(int cfd)
+{
+    char req[2048];
+    size_t got = 0;
+    struct timeval tv = {.tv_sec = 2};
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    // Only the request line matters, but read the whole header so the client sees a clean close.
+    while (got < sizeof(req) - 1)
+    {
+        ssize_t n = recv(cfd, req + got, sizeof(req) - 1 - got, 0);
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+            break;
+    }
+    req[got] = '\0';
+
+    char *body = NULL;
+    size_t body_len = 0;
+    const char *status = "404 Not Found";
+    if (strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET /metrics?", 13) == 0)
+    {
+        FILE *out = open_memstream(&body, &body_len);
+        if (!out)
+            status = "500 Internal Server Error";
+        else
+        {
+            render(out);
+            fclose(out);
+            status = "200 OK";
+        }
+    }
+    char head[256];
+    int hl = snprintf(head, sizeof(head),
+                      "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+                      "Connection: close\r\n\r\n",
+                      status, body ? body_len : 0);
+    if (write_all(cfd, head, (size_t)hl) == 0 && body)
+        write_all(cfd, body, body_len);
+    free(body);
+}
+
+static void *exporter(void *arg)
+{
+    (void)arg;
+    while (!g.stop)
+    {
+        struct pollfd p = {.fd = g.fd, .events = POLLIN};
+        if (poll(&p, 1, 200) <= 0)
+            continue;
+        int cfd = accept(g.fd, NULL, NULL);
+        if (cfd < 0)
+            continue;
+        serve(cfd);
+        close(cfd);
+    }
+    return NULL;
+}
+
+int metrics_http_start(const char *port)
+{
+    if (!port)
+        port = getenv("RDMA_METRICS_PORT");
+    if (!port || !*port)
+        return 0;
+    if (g.running)
+        return 0;
+    int p = atoi(port);
+    if (p <= 0 || p > 65535)
+    {
+        LOG_ERR("RDMA_METRICS_PORT must be 1..65535, got '%s'", port);
+        return -1;
+    }
+    if (rdma_stats_enable())
+        LOG_ERR("metrics: QP counters were already off (a WR was posted first); exporting the rest");
+
+    g.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (g.fd < 0)
+        return err_errno("metrics socket");
+    int one = 1;
+    setsockopt(g.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in a = {.sin_family = AF_INET, .sin_port = htons((uint16_t)p),
+                            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (bind(g.fd, (struct sockaddr *)&a, sizeof(a)) || listen(g.fd, 8))
+    {
+        err_errno("metrics bind/listen");
+        goto fail;
+    }
+    g.stop = 0;
+    if (pthread_create(&g.thread, NULL, exporter, NULL))
+    {
+        LOG_ERR("metrics: pthread_create failed");
+        goto fail;
+    }
+    g.running = 1;
+    LOG("metrics: http://127.0.0.1:%d/metrics", p);
+    return 0;
+fail:
+    close(g.fd);
+    g.fd = -1;
+    return -1;
+}
+
+int metrics_http_add(metrics_source_fn fn, void *arg)
+{
+    int rc = -1;
+    pthread_mutex_lock(&g.lock);
+    if (g.nsrc < METRICS_MAX_SOURCES)
+    {
+        g.src[g.nsrc].fn = fn;
+        g.src[g.nsrc].arg = arg;
+        g.nsrc++;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&g.lock);
+    return rc;
+}
+
+void metrics_http_stop(void)
+{
+    if (g.running)
+    {
+        g.stop = 1;
+        pthread_join(g.thread, NULL);
+        g.running = 0;
+    }
+    if (g.fd >= 0)
+        close(g.fd);
+    g.fd = -1;
+    pthread_mutex_lock(&g.lock);
+    g.nsrc = 0;
+    pthread_mutex_unlock(&g.lock);
+}
@@ -0,0 +1,44 @@
+/**
+ * File: metrics_http.h
+ * Purpose: Prometheus text-format exporter on a localhost HTTP port, served from its own thread.
+ *
+ * Overview:
+ * metrics_http_start() binds 127.0.0.1:<port> and answers GET /metrics with
+ *  - the per-QP counters of rdma_stats.h: WRs by opcode, bytes, CQEs, empty polls, errors, WRs in flight and the
+ *    post-to-CQE latency histogram (counting is turned on here if RDMA_STATS did not already do it),
+ *  - per CQ, its size and the completions its QPs still owe it. The host cannot see a CQ's fill without polling
+ *    it, so the owed count (signaled sends and RECVs posted, not reaped) stands in as its upper bound,
+ *  - the address-resolution cache counters of cm_resolve_cache.h,
+ *  - whatever each source registered with metrics_http_add() writes: connection counts, pool and MR cache
+ *    statistics, anything the program already keeps.
+ * A scrape only reads memory the data path writes anyway. The post and poll paths make no extra calls and take
+ * no lock for it; the exporter's own lock guards the source list and is never held by a data-path thread.
+ *
+ * Notes:
+ *  - Sources run on the exporter thread. They must only read their counters, with metrics_u64() or another
+ *    relaxed atomic load, never call into the objects that own them. The owners write those counters with
+ *    relaxed atomics too (__atomic_fetch_add, or __atomic_store_n from a single writer), or the two sides race.
+ *  - One request at a time, HTTP/1.0 with Connection: close. Meant for a scraper every few seconds.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+typedef void (*metrics_source_fn)(FILE *out, void *arg);
+
+/* Start serving on 127.0.0.1:port; port NULL means RDMA_METRICS_PORT, and if that is unset too nothing starts.
+ * Returns 0 on success or when disabled, -1 on error. */
+int metrics_http_start(const char *port);
+/* Add a section to every scrape. Up to 16 sources; callable before or after start. */
+int metrics_http_add(metrics_source_fn fn, void *arg);
+/* Stop the thread and close the socket. Safe to call when never started. */
+void metrics_http_stop(void);
+
+/* # HELP and # TYPE lines for one metric family; type is "counter", "gauge" or "histogram". */
+void metrics_family(FILE *out, const char *name, const char *type, const char *help);
+
+static inline uint64_t metrics_u64(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
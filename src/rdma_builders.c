@@ -6,7 +6,8 @@
  * Overview:
  * Creates PD, CQ, and QP bound to an rdma_cm_id; associates CQ with both
  * send/recv; prints useful attributes like QP number, state, and caps to ease
- * troubleshooting.
+ * troubleshooting. UC QPs are created beside the id and moved through their
+ * states with the CM's negotiated attributes (modify_qp_from_cm).
  *
  * Notes:
  *  - This file is part of an educational RDMA sample showing connection setup,
@@ -19,6 +20,9 @@
  */
 
 #include "rdma_builders.h"
+
+#include "rdma_stats.h"
+
 /**
  * build_pd_cq_qp(rdma_ctx *c, enum ibv_qp_type qpt, int cq_depth,int
  * max_send_wr, int max_recv_wr, int max_sge) Creates or configures a verbs
@@ -46,7 +50,8 @@ int build_pd_cq_qp(rdma_ctx *c, enum ibv_qp_type qpt, int cq_depth, int max_send
     c->pd = ibv_alloc_pd(c->id->verbs);
     if (!c->pd)
         return err_errno("ibv_alloc_pd");
-    c->cq = ibv_create_cq(c->id->verbs, cq_depth, NULL, NULL, 0);
+    // Extended CQ with NIC completion timestamps where the device has them, for rdma_stats' latency split.
+    c->cq = cq_ts_create(c->id->verbs, cq_depth);
     if (!c->cq)
         return err_errno("ibv_create_cq");
     struct ibv_qp_init_attr qa = {.send_cq = c->cq,
@@ -56,6 +61,17 @@ int build_pd_cq_qp(rdma_ctx *c, enum ibv_qp_type qpt, int cq_depth, int max_send
                                           .max_send_sge = max_sge,
                                           .max_recv_sge = max_sge},
                                   .qp_type = qpt};
+    if (qpt == IBV_QPT_UC)
+    {
+        // The kernel CM only drives RC/UD QPs: keep a UC QP off the id and walk its states ourselves.
+        c->qp = ibv_create_qp(c->pd, &qa);
+        if (!c->qp)
+            return err_errno("ibv_create_qp(UC)");
+        if (modify_qp_from_cm(c, IBV_QPS_INIT))
+            return -1;
+        dump_qp(c->qp);
+        return 0;
+    }
     err = rdma_create_qp(c->id, c->pd, &qa);
     if (err)
         return err_errno("rdma_create_qp");
@@ -63,3 +79,51 @@ int build_pd_cq_qp(rdma_ctx *c, enum ibv_qp_type qpt, int cq_depth, int max_send
     dump_qp(c->qp);
     return 0;
 }
+
+/**
+ * modify_qp_from_cm(rdma_ctx *c, enum ibv_qp_state state)
+ * Moves a QP that is not attached to c->id (UC, or a pooled RC QP from rdma_pool) to INIT, RTR or
+ * RTS using the attributes the CM negotiated (port, P_Key, path, remote QPN, PSNs). The CM returns
+ * RC attribute masks, so for UC the READ/atomic and retry fields it does not have are dropped
+ * before ibv_modify_qp.
+ *
+ * Returns:
+ *   int (0 on success, -1 on error).
+ */
+
+int modify_qp_from_cm(rdma_ctx *c, enum ibv_qp_state state)
+{
+    struct ibv_qp_attr attr = {.qp_state = state};
+    int mask = 0;
+    if (rdma_init_qp_attr(c->id, &attr, &mask))
+        return err_errno("rdma_init_qp_attr");
+    if (c->qp->qp_type == IBV_QPT_UC)
+    {
+        mask &= ~(IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT |
+                  IBV_QP_RNR_RETRY | IBV_QP_MAX_QP_RD_ATOMIC);
+        if (state == IBV_QPS_INIT)
+            attr.qp_access_flags &= ~(IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC);
+    }
+    if (ibv_modify_qp(c->qp, &attr, mask))
+        return err_errno("ibv_modify_qp");
+    return 0;
+}
+
+/**
+ * destroy_qp(rdma_ctx *c)
+ * Destroys c->qp, if any: rdma_destroy_qp when it hangs off c->id (RC/UD from build_pd_cq_qp),
+ * ibv_destroy_qp when it does not (UC). Its rdma_stats slot is freed first, so the next QP that
+ * gets the same number on this device starts with fresh counters.
+ */
+
+void destroy_qp(rdma_ctx *c)
+{
+    if (!c->qp)
+        return;
+    rdma_stats_release(c->qp);
+    if (c->id && c->id->qp == c->qp)
+        rdma_destroy_qp(c->id);
+    else if (ibv_destroy_qp(c->qp))
+        err_errno("ibv_destroy_qp");
+    c->qp = NULL;
+}
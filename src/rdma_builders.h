@@ -1,6 +1,14 @@
 
 #pragma once
 #include "common.h"
+#include "cq_ts.h"
 #include "rdma_ctx.h"
 
+// c->cq comes from cq_ts_create(): destroy it with cq_ts_destroy().
 int build_pd_cq_qp(rdma_ctx *c, enum ibv_qp_type qpt, int cq_depth, int max_send_wr, int max_recv_wr, int max_sge);
+
+// UC QPs (IBV_QPT_UC) and pooled QPs are not attached to c->id; move them through INIT/RTR/RTS with this.
+int modify_qp_from_cm(rdma_ctx *c, enum ibv_qp_state state);
+
+// Frees c->qp's rdma_stats slot and destroys it, through c->id when the QP is attached there. NULLs c->qp.
+void destroy_qp(rdma_ctx *c);
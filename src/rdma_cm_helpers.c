@@ -1,5 +1,8 @@
 #include "rdma_cm_helpers.h"
 
+#include "cm_resolve_cache.h"
+#include "rdma_builders.h"
+
 #include <netdb.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,16 +14,28 @@ static int err_gai(const char *ctx, int rc)
 }
 
 int cm_create_channel_and_id(rdma_ctx *c)
+{
+    return cm_create_channel_and_id_ps(c, RDMA_PS_TCP);
+}
+
+// RDMA_PS_TCP gives RC ids; RDMA_PS_UDP gives UD ids whose "connect" only resolves the peer QP.
+int cm_create_channel_and_id_ps(rdma_ctx *c, enum rdma_port_space ps)
 {
     c->ec = rdma_create_event_channel();
     if (!c->ec)
         return err_errno("rdma_create_event_channel");
-    if (rdma_create_id(c->ec, &c->id, NULL, RDMA_PS_TCP))
+    if (rdma_create_id(c->ec, &c->id, NULL, ps))
         return err_errno("rdma_create_id");
     return 0;
 }
 
 int cm_server_listen(rdma_ctx *c, const char *ip, const char *port)
+{
+    return cm_server_listen_backlog(c, ip, port, 1);
+}
+
+// Same as cm_server_listen, but lets multi-client servers queue more than one CONNECT_REQUEST.
+int cm_server_listen_backlog(rdma_ctx *c, const char *ip, const char *port, int backlog)
 {
     struct addrinfo hints = {0}, *res = NULL;
     int rc = 0;
@@ -38,7 +53,7 @@ int cm_server_listen(rdma_ctx *c, const char *ip, const char *port)
         return err_errno("rdma_bind_addr");
     }
     freeaddrinfo(res);
-    if (rdma_listen(c->id, 1))
+    if (rdma_listen(c->id, backlog))
         return err_errno("rdma_listen");
     return 0;
 }
@@ -90,6 +105,10 @@ int cm_wait_connected(rdma_ctx *c, struct rdma_conn_param *out_conn_param)
             }
         }
 
+        // A cached address/path may be what sent us to an unreachable peer: resolve afresh next time.
+        if (got == RDMA_CM_EVENT_UNREACHABLE || got == RDMA_CM_EVENT_CONNECT_ERROR)
+            cm_rcache_invalidate_dst(rdma_get_peer_addr(c->id));
+
         // Unexpected sequence
         LOG("Unexpected CM event while waiting for ESTABLISHED: got=%s(%d) status=%d (%s)", rdma_event_str(got), got,
             status, strerror(status));
@@ -99,16 +118,39 @@ int cm_wait_connected(rdma_ctx *c, struct rdma_conn_param *out_conn_param)
     return -1;
 }
 
-int cm_server_accept_with_priv(rdma_ctx *c, const void *priv, size_t len)
+// The CM field is 8 bits wide; devices commonly report 16..128 outstanding READs/atomics per QP.
+static uint8_t clamp_rd_atomic(int v)
 {
-    uint8_t responder_resources = 1;
-    uint8_t initiator_depth = 1;
+    if (v < 1)
+        return 1;
+    return v > 255 ? 255 : (uint8_t)v;
+}
+
+void cm_rd_atomic_defaults(rdma_ctx *c, uint8_t *initiator_depth, uint8_t *responder_resources)
+{
+    *initiator_depth = 1;
+    *responder_resources = 1;
+    struct ibv_device_attr attr;
+    if (c->id && c->id->verbs && ibv_query_device(c->id->verbs, &attr) == 0)
+    {
+        *initiator_depth = clamp_rd_atomic(attr.max_qp_init_rd_atom);
+        *responder_resources = clamp_rd_atomic(attr.max_qp_rd_atom);
+    }
     const char *resp_env = getenv("RDMA_RESPONDER_RESOURCES");
     const char *init_env = getenv("RDMA_INITIATOR_DEPTH");
     if (resp_env && *resp_env)
-        responder_resources = (uint8_t)strtoul(resp_env, NULL, 10);
+        *responder_resources = (uint8_t)strtoul(resp_env, NULL, 10);
     if (init_env && *init_env)
-        initiator_depth = (uint8_t)strtoul(init_env, NULL, 10);
+        *initiator_depth = (uint8_t)strtoul(init_env, NULL, 10);
+}
+
+int cm_server_accept_with_priv(rdma_ctx *c, const void *priv, size_t len)
+{
+    // librdmacm lowers these to what the peer asked for in its CONNECT_REQUEST.
+    uint8_t responder_resources = 1;
+    uint8_t initiator_depth = 1;
+    cm_rd_atomic_defaults(c, &initiator_depth, &responder_resources);
+    LOG("cm: rdma_accept(responder_resources<=%u, initiator_depth<=%u)", responder_resources, initiator_depth);
     struct rdma_conn_param p = {.private_data = priv,
                                 .private_data_len = (uint8_t)len,
                                 // for READ/WRITE example
@@ -126,53 +168,130 @@ int cm_server_accept_with_priv(rdma_ctx *c, const void *priv, size_t len)
 
 int cm_client_resolve(rdma_ctx *c, const char *ip, const char *port, const char *src_ip)
 {
-    struct addrinfo hints = {0}, *res = NULL, *src_res = NULL;
-    int rc = 0;
-    hints.ai_family = AF_INET;
+    const struct cm_resolve_cfg *cfg = cm_resolve_cfg();
+    struct cm_rcache_key key;
+    struct sockaddr_storage dst, src;
+    int has_src = 0;
+    cm_rcache_key_set(&key, ip, port, src_ip);
 
-    LOG("cm: getaddrinfo(%s:%s)", ip, port);
-    rc = getaddrinfo(ip, port, &hints, &res);
-    if (rc)
-        return err_gai("getaddrinfo", rc);
+    LOG("cm: addresses for %s:%s (cached getaddrinfo)", ip, port);
+    if (cm_rcache_addrs(&key, &dst, &src, &has_src))
+        return -1;
 
-    LOG("cm: rdma_resolve_addr(timeout=5000ms)");
-    if (src_ip && *src_ip)
-    {
-        LOG("cm: getaddrinfo(src=%s)", src_ip);
-        rc = getaddrinfo(src_ip, NULL, &hints, &src_res);
-        if (rc)
-        {
-            freeaddrinfo(res);
-            return err_gai("getaddrinfo src", rc);
-        }
-    }
-    if (rdma_resolve_addr(c->id, src_res ? src_res->ai_addr : NULL, res->ai_addr, 5000))
-    {
-        if (src_res)
-            freeaddrinfo(src_res);
-        freeaddrinfo(res);
+    LOG("cm: rdma_resolve_addr(timeout=%dms)", cfg->addr_timeout_ms);
+    if (rdma_resolve_addr(c->id, has_src ? (struct sockaddr *)&src : NULL, (struct sockaddr *)&dst,
+                          cfg->addr_timeout_ms))
         return err_errno("rdma_resolve_addr");
-    }
-    if (src_res)
-        freeaddrinfo(src_res);
-    freeaddrinfo(res);
 
     struct rdma_cm_event *ev = NULL;
 
     LOG("cm: waiting ADDR_RESOLVED");
     if (cm_wait_event(c, RDMA_CM_EVENT_ADDR_RESOLVED, &ev))
-        return -1;
+        goto invalidate;
     rdma_ack_cm_event(ev);
 
-    LOG("cm: rdma_resolve_route(timeout=5000ms)");
-    if (rdma_resolve_route(c->id, 5000))
-        return err_errno("rdma_resolve_route");
+    LOG("cm: route (cached path or rdma_resolve_route timeout=%dms)", cfg->route_timeout_ms);
+    if (cm_rcache_resolve_route(&key, c->id) < 0)
+        goto invalidate;
 
     LOG("cm: waiting ROUTE_RESOLVED");
     if (cm_wait_event(c, RDMA_CM_EVENT_ROUTE_RESOLVED, &ev))
+        goto invalidate;
+    rdma_ack_cm_event(ev);
+    cm_rcache_store(&key, c->id);
+
+    return 0;
+
+invalidate:
+    cm_rcache_invalidate(&key);
+    return -1;
+}
+
+// After cm_client_resolve on a UDP id: SIDR request, then read the peer's AH attributes, QPN and QKey.
+int cm_ud_connect(rdma_ctx *c, struct ud_peer *out)
+{
+    struct rdma_conn_param p = {0};
+    LOG("cm: rdma_connect(UD)");
+    if (rdma_connect(c->id, &p))
+        return err_errno("rdma_connect");
+    struct rdma_cm_event *ev = NULL;
+    if (cm_wait_event(c, RDMA_CM_EVENT_ESTABLISHED, &ev))
+        return -1;
+    out->ah_attr = ev->param.ud.ah_attr;
+    out->qp_num = ev->param.ud.qp_num;
+    out->qkey = ev->param.ud.qkey;
+    rdma_ack_cm_event(ev);
+    LOG("cm: UD peer qpn=%u qkey=0x%x", out->qp_num, out->qkey);
+    return 0;
+}
+
+// Answer a UD CONNECT_REQUEST with qp_num, which may be a QP shared by many requesters.
+int cm_ud_accept(struct rdma_cm_id *id, uint32_t qp_num)
+{
+    struct rdma_conn_param p = {.qp_num = qp_num};
+    if (rdma_accept(id, &p))
+        return err_errno("rdma_accept(UD)");
+    return 0;
+}
+
+// c->qp is not attached to the id, so the CM reports CONNECT_RESPONSE and leaves RTR/RTS and the RTU to us.
+int cm_client_connect_user_qp(rdma_ctx *c, struct rdma_conn_param *p, void *priv, size_t len)
+{
+    p->qp_num = c->qp->qp_num;
+    LOG("cm: rdma_connect(user QP qpn=%u)", c->qp->qp_num);
+    if (rdma_connect(c->id, p))
+        return err_errno("rdma_connect");
+    struct rdma_cm_event *ev = NULL;
+    if (cm_wait_event(c, RDMA_CM_EVENT_CONNECT_RESPONSE, &ev))
         return -1;
+    int short_priv = ev->param.conn.private_data_len < len;
+    if (!short_priv && len)
+        memcpy(priv, ev->param.conn.private_data, len); // copy before ack
     rdma_ack_cm_event(ev);
+    if (short_priv)
+    {
+        LOG_ERR("cm: short private_data in CONNECT_RESPONSE");
+        return -1;
+    }
+    if (modify_qp_from_cm(c, IBV_QPS_RTR) || modify_qp_from_cm(c, IBV_QPS_RTS))
+        return -1;
+    if (rdma_establish(c->id))
+        return err_errno("rdma_establish");
+    return 0;
+}
+
+// Bring the QP to RTS from the CONNECT_REQUEST's path before the REP lets the client send.
+int cm_server_accept_user_qp(rdma_ctx *c, struct rdma_conn_param *p)
+{
+    if (modify_qp_from_cm(c, IBV_QPS_RTR) || modify_qp_from_cm(c, IBV_QPS_RTS))
+        return -1;
+    p->qp_num = c->qp->qp_num;
+    if (rdma_accept(c->id, p))
+        return err_errno("rdma_accept(user QP)");
+    return 0;
+}
 
+int cm_client_connect_uc(rdma_ctx *c, void *priv, size_t len)
+{
+    struct rdma_conn_param p = {0};
+    return cm_client_connect_user_qp(c, &p, priv, len);
+}
+
+int cm_server_accept_uc(rdma_ctx *c, const void *priv, size_t len)
+{
+    struct rdma_conn_param p = {.private_data = priv, .private_data_len = (uint8_t)len};
+    return cm_server_accept_user_qp(c, &p);
+}
+
+// Like cm_client_connect_only with device-default depths, but carrying priv in the CONNECT_REQUEST.
+int cm_client_connect_with_priv(rdma_ctx *c, const void *priv, size_t len)
+{
+    struct rdma_conn_param p = {.private_data = priv, .private_data_len = (uint8_t)len, .retry_count = 7,
+                                .rnr_retry_count = 7};
+    cm_rd_atomic_defaults(c, &p.initiator_depth, &p.responder_resources);
+    LOG("cm: rdma_connect(private_data %zu bytes)", len);
+    if (rdma_connect(c->id, &p))
+        return err_errno("rdma_connect");
     return 0;
 }
 
@@ -5,16 +5,41 @@
 #include "rdma_ctx.h"
 
 int cm_create_channel_and_id(rdma_ctx *c);
+int cm_create_channel_and_id_ps(rdma_ctx *c, enum rdma_port_space ps);
 int cm_server_listen(rdma_ctx *c, const char *ip, const char *port);
+int cm_server_listen_backlog(rdma_ctx *c, const char *ip, const char *port, int backlog);
 int cm_wait_event(rdma_ctx *c, enum rdma_cm_event_type want, struct rdma_cm_event **out);
 
 /* NEW: make sure this line exists */
 int cm_wait_connected(rdma_ctx *c, struct rdma_conn_param *out_conn_param);
 
+// UD (RDMA_PS_UDP): connect/accept only exchange addressing (SIDR); no connection state is kept.
+struct ud_peer
+{
+    struct ibv_ah_attr ah_attr;
+    uint32_t qp_num;
+    uint32_t qkey;
+};
+int cm_ud_connect(rdma_ctx *c, struct ud_peer *out);
+int cm_ud_accept(struct rdma_cm_id *id, uint32_t qp_num);
+
 int cm_server_accept_with_priv(rdma_ctx *c, const void *priv, size_t len);
+
+// READ/atomic depths to offer: RDMA_INITIATOR_DEPTH / RDMA_RESPONDER_RESOURCES if set, else the device maxima.
+void cm_rd_atomic_defaults(rdma_ctx *c, uint8_t *initiator_depth, uint8_t *responder_resources);
 int cm_client_connect(rdma_ctx *c, const char *ip, const char *port);
 
 // Fixes the connect issue
+// Addresses and the path come from cm_resolve_cache when this peer was resolved recently.
 int cm_client_resolve(rdma_ctx *c, const char *ip, const char *port, const char *src_ip);
 int cm_client_connect_only(rdma_ctx *c, uint8_t initiator_depth, uint8_t responder_resources);
+int cm_client_connect_with_priv(rdma_ctx *c, const void *priv, size_t len);
+
+// QPs not attached to c->id (UC from build_pd_cq_qp, pooled RC from rdma_pool): the CM carries QPNs,
+// PSNs and private data; QP states are ours. p supplies depths/retries (qp_num is filled in).
+// The client call returns with the QP in RTS and len bytes of the server's private data in priv.
+int cm_client_connect_user_qp(rdma_ctx *c, struct rdma_conn_param *p, void *priv, size_t len);
+int cm_server_accept_user_qp(rdma_ctx *c, struct rdma_conn_param *p);
+int cm_client_connect_uc(rdma_ctx *c, void *priv, size_t len);
+int cm_server_accept_uc(rdma_ctx *c, const void *priv, size_t len);
 int cm_wait_connected(rdma_ctx *c, struct rdma_conn_param *out_conn_param);
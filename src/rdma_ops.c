@@ -3,8 +3,8 @@
  * Purpose: Implementation of RDMA post operations (WRITE/READ/RECV) and CQ polling.
  *
  * Overview:
- * Wraps verbs calls to post WRITE/READ/SEND/RECV and a CQ polling helper that prints WC fields. Keeps data-path logic
- * tidy in main programs.
+ * Wraps verbs calls to post WRITE/READ/SEND/RECV, WRITE_WITH_IMM, 8-byte atomics (FETCH_ADD/CMP_SWAP) and UD
+ * datagram SENDs, plus a CQ polling helper that prints WC fields. Keeps data-path logic tidy in main programs.
  *
  * Notes:
  *  - This file is part of an educational RDMA sample showing connection setup,
@@ -16,6 +16,9 @@
  */
 
 #include "rdma_ops.h"
+
+#include "cq_ts.h"
+#include "rdma_stats.h"
 /**
  * post_write(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src,                uint64_t remote_addr, uint32_t rkey,
  * size_t len, uint64_t wr_id, int signaled) Auto-comment: Posts an RDMA work request (WQE) to the QP's send/recv queue.
@@ -46,7 +49,10 @@ int post_write(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, uint64_t rem
                        *bad = NULL;
     dump_sge(&s, "WRITE");
     dump_wr_rdma(&wr);
-    return /* Post a SEND/WRITE/READ WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    int rc = /* Post a SEND/WRITE/READ WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
 }
 /**
  * post_read(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst,               uint64_t remote_addr, uint32_t rkey,
@@ -78,7 +84,174 @@ int post_read(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst, uint64_t remo
                        *bad = NULL;
     dump_sge(&s, "READ");
     dump_wr_rdma(&wr);
-    return /* Post a SEND/WRITE/READ WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    int rc = /* Post a SEND/WRITE/READ WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
+}
+/**
+ * post_write_imm(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, uint64_t remote_addr, uint32_t rkey,
+ * size_t len, uint32_t imm_host, uint64_t wr_id, int signaled)
+ * Posts an RDMA_WRITE_WITH_IMM: the payload lands like a plain WRITE and the peer consumes one RECV whose
+ * completion carries imm_data. len may be 0 for a pure notification.
+ *
+ * Parameters:
+ *   struct ibv_qp *qp - connected RC/UC QP.
+ *   struct ibv_mr *mr_src, void *src, size_t len - local source (ignored when len == 0).
+ *   uint64_t remote_addr, uint32_t rkey - remote destination.
+ *   uint32_t imm_host - immediate value in host order; converted to network order here.
+ *   uint64_t wr_id - echoed in the local CQE.
+ *   int signaled - request a local CQE.
+ * Returns:
+ *   int (0 or ibv_post_send error).
+ */
+
+int post_write_imm(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, uint64_t remote_addr, uint32_t rkey, size_t len,
+                   uint32_t imm_host, uint64_t wr_id, int signaled)
+{
+    struct ibv_sge s = {.addr = (uintptr_t)src, .length = (uint32_t)len, .lkey = mr_src ? mr_src->lkey : 0};
+    struct ibv_send_wr wr = {.wr_id = wr_id,
+                             .sg_list = len ? &s : NULL,
+                             .num_sge = len ? 1 : 0,
+                             .opcode = IBV_WR_RDMA_WRITE_WITH_IMM,
+                             .send_flags = signaled ? IBV_SEND_SIGNALED : 0,
+                             .wr.rdma = {.remote_addr = remote_addr, .rkey = rkey},
+                             .imm_data = htonl(imm_host)},
+                       *bad = NULL;
+    if (len)
+        dump_sge(&s, "WRITE_WITH_IMM");
+    dump_wr_rdma(&wr);
+    int rc = /* Post a SEND/WRITE/READ WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
+}
+/**
+ * post_fetch_add(struct ibv_qp *qp, struct ibv_mr *mr_dst, uint64_t *dst, uint64_t remote_addr, uint32_t rkey,
+ * uint64_t add, uint64_t wr_id, int signaled)
+ * Posts an ATOMIC_FETCH_AND_ADD on one remote 8-byte word. The responder adds `add` atomically and returns the
+ * value it held *before* the add into *dst once the CQE arrives.
+ *
+ * Parameters:
+ *   struct ibv_qp *qp - connected RC QP (atomics are RC-only; need initiator_depth >= 1).
+ *   struct ibv_mr *mr_dst, uint64_t *dst - local 8-byte landing slot for the old value.
+ *   uint64_t remote_addr - 8-byte aligned; the remote MR needs IBV_ACCESS_REMOTE_ATOMIC.
+ *   uint32_t rkey - remote key.
+ *   uint64_t add - addend.
+ *   uint64_t wr_id, int signaled - as for post_write.
+ * Returns:
+ *   int (0 or ibv_post_send error).
+ */
+
+int post_fetch_add(struct ibv_qp *qp, struct ibv_mr *mr_dst, uint64_t *dst, uint64_t remote_addr, uint32_t rkey,
+                   uint64_t add, uint64_t wr_id, int signaled)
+{
+    struct ibv_sge s = {.addr = (uintptr_t)dst, .length = sizeof(uint64_t), .lkey = mr_dst->lkey};
+    struct ibv_send_wr wr = {.wr_id = wr_id,
+                             .sg_list = &s,
+                             .num_sge = 1,
+                             .opcode = IBV_WR_ATOMIC_FETCH_AND_ADD,
+                             .send_flags = signaled ? IBV_SEND_SIGNALED : 0,
+                             .wr.atomic = {.remote_addr = remote_addr, .compare_add = add, .rkey = rkey}},
+                       *bad = NULL;
+    dump_sge(&s, "FETCH_ADD");
+    dump_wr_atomic(&wr);
+    int rc = /* Post an ATOMIC WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
+}
+/**
+ * post_cmp_swap(struct ibv_qp *qp, struct ibv_mr *mr_dst, uint64_t *dst, uint64_t remote_addr, uint32_t rkey,
+ * uint64_t compare, uint64_t swap, uint64_t wr_id, int signaled)
+ * Posts an ATOMIC_CMP_AND_SWP: if the remote word equals `compare` it becomes `swap`. The old remote value is
+ * always returned into *dst, so success is (*dst == compare) after the CQE.
+ *
+ * Parameters:
+ *   same as post_fetch_add, with compare/swap instead of add.
+ * Returns:
+ *   int (0 or ibv_post_send error).
+ */
+
+int post_cmp_swap(struct ibv_qp *qp, struct ibv_mr *mr_dst, uint64_t *dst, uint64_t remote_addr, uint32_t rkey,
+                  uint64_t compare, uint64_t swap, uint64_t wr_id, int signaled)
+{
+    struct ibv_sge s = {.addr = (uintptr_t)dst, .length = sizeof(uint64_t), .lkey = mr_dst->lkey};
+    struct ibv_send_wr wr = {.wr_id = wr_id,
+                             .sg_list = &s,
+                             .num_sge = 1,
+                             .opcode = IBV_WR_ATOMIC_CMP_AND_SWP,
+                             .send_flags = signaled ? IBV_SEND_SIGNALED : 0,
+                             .wr.atomic = {.remote_addr = remote_addr,
+                                           .compare_add = compare,
+                                           .swap = swap,
+                                           .rkey = rkey}},
+                       *bad = NULL;
+    dump_sge(&s, "CMP_SWAP");
+    dump_wr_atomic(&wr);
+    int rc = /* Post an ATOMIC WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
+}
+/**
+ * post_send(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, size_t len, uint64_t wr_id, int signaled)
+ * Posts a two-sided SEND; the peer must have a RECV posted or the QP sees RNR NAKs.
+ *
+ * Parameters:
+ *   struct ibv_qp *qp - connected QP.
+ *   struct ibv_mr *mr_src, void *src, size_t len - local payload.
+ *   uint64_t wr_id, int signaled - as for post_write.
+ * Returns:
+ *   int (0 or ibv_post_send error).
+ */
+
+int post_send(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, size_t len, uint64_t wr_id, int signaled)
+{
+    struct ibv_sge s = {.addr = (uintptr_t)src, .length = (uint32_t)len, .lkey = mr_src->lkey};
+    struct ibv_send_wr wr = {.wr_id = wr_id,
+                             .sg_list = &s,
+                             .num_sge = 1,
+                             .opcode = IBV_WR_SEND,
+                             .send_flags = signaled ? IBV_SEND_SIGNALED : 0},
+                       *bad = NULL;
+    dump_sge(&s, "SEND");
+    int rc = /* Post a SEND/WRITE/READ WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
+}
+/**
+ * post_send_ud(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, size_t len, struct ibv_ah *ah,
+ * uint32_t remote_qpn, uint32_t remote_qkey, uint64_t wr_id, int signaled)
+ * Posts a datagram SEND on a UD QP. Every WR names its destination (AH + QPN + QKey), so one QP can
+ * reach any number of peers. len must fit in the path MTU; a peer without a RECV posted drops it.
+ *
+ * Parameters:
+ *   struct ibv_qp *qp - UD QP in RTS.
+ *   struct ibv_mr *mr_src, void *src, size_t len - local payload (no GRH on the send side).
+ *   struct ibv_ah *ah, uint32_t remote_qpn, uint32_t remote_qkey - destination.
+ *   uint64_t wr_id, int signaled - as for post_write.
+ * Returns:
+ *   int (0 or ibv_post_send error).
+ */
+
+int post_send_ud(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, size_t len, struct ibv_ah *ah, uint32_t remote_qpn,
+                 uint32_t remote_qkey, uint64_t wr_id, int signaled)
+{
+    struct ibv_sge s = {.addr = (uintptr_t)src, .length = (uint32_t)len, .lkey = mr_src->lkey};
+    struct ibv_send_wr wr = {.wr_id = wr_id,
+                             .sg_list = &s,
+                             .num_sge = 1,
+                             .opcode = IBV_WR_SEND,
+                             .send_flags = signaled ? IBV_SEND_SIGNALED : 0,
+                             .wr.ud = {.ah = ah, .remote_qpn = remote_qpn, .remote_qkey = remote_qkey}},
+                       *bad = NULL;
+    dump_sge(&s, "SEND_UD");
+    int rc = /* Post a datagram SEND WQE to SQ */ ibv_post_send(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_send(qp, &wr);
+    return rc;
 }
 /**
  * post_recv(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst, size_t len, uint64_t wr_id)
@@ -99,7 +272,10 @@ int post_recv(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst, size_t len, u
     struct ibv_sge s = {.addr = (uintptr_t)dst, .length = (uint32_t)len, .lkey = mr_dst->lkey};
     struct ibv_recv_wr wr = {.wr_id = wr_id, .sg_list = &s, .num_sge = 1}, *bad = NULL;
     dump_sge(&s, "RECV");
-    return /* Post a RECV WQE to RQ */ ibv_post_recv(qp, &wr, &bad);
+    int rc = /* Post a RECV WQE to RQ */ ibv_post_recv(qp, &wr, &bad);
+    if (rc == 0)
+        rdma_stats_on_recv(qp, &wr);
+    return rc;
 }
 /**
  * poll_one(struct ibv_cq *cq, struct ibv_wc *wc_out)
@@ -115,11 +291,13 @@ int post_recv(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst, size_t len, u
 int poll_one(struct ibv_cq *cq, struct ibv_wc *wc_out)
 {
     struct ibv_wc wc;
+    uint64_t empty = 0, ts = 0;
     int n;
-    do
-    {
-        n = /* Poll CQ for completions */ ibv_poll_cq(cq, 1, &wc);
-    } while (n == 0);
+    // Poll CQ for completions; ts is the NIC's completion time when the CQ was built with timestamps (cq_ts.h).
+    while ((n = cq_ts_poll(cq, 1, &wc, &ts)) == 0)
+        empty++;
+    if (n > 0)
+        rdma_stats_on_cqes_ts(cq, &wc, n, empty, &ts);
     if (n < 0 || wc.status != IBV_WC_SUCCESS)
         return -1;
     dump_wc(&wc);
@@ -3,8 +3,8 @@
  * Purpose: Prototypes for posting RDMA operations and CQ polling.
  *
  * Overview:
- * Wraps verbs calls to post WRITE/READ/SEND/RECV and a CQ polling helper that prints WC fields. Keeps data-path logic
- * tidy in main programs.
+ * Wraps verbs calls to post WRITE/READ/SEND/RECV, WRITE_WITH_IMM and 8-byte atomics (FETCH_ADD/CMP_SWAP), plus a CQ
+ * polling helper that prints WC fields. Keeps data-path logic tidy in main programs.
  *
  * Notes:
  *  - This file is part of an educational RDMA sample showing connection setup,
@@ -26,6 +26,20 @@ int post_write(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, uint64_t rem
 int post_read(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst, uint64_t remote_addr, uint32_t rkey, size_t len,
               uint64_t wr_id, int signaled);
 /* prototype */
+int post_write_imm(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, uint64_t remote_addr, uint32_t rkey, size_t len,
+                   uint32_t imm_host, uint64_t wr_id, int signaled);
+/* prototype */
+int post_fetch_add(struct ibv_qp *qp, struct ibv_mr *mr_dst, uint64_t *dst, uint64_t remote_addr, uint32_t rkey,
+                   uint64_t add, uint64_t wr_id, int signaled);
+/* prototype */
+int post_cmp_swap(struct ibv_qp *qp, struct ibv_mr *mr_dst, uint64_t *dst, uint64_t remote_addr, uint32_t rkey,
+                  uint64_t compare, uint64_t swap, uint64_t wr_id, int signaled);
+/* prototype */
+int post_send(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, size_t len, uint64_t wr_id, int signaled);
+/* prototype */
+int post_send_ud(struct ibv_qp *qp, struct ibv_mr *mr_src, void *src, size_t len, struct ibv_ah *ah, uint32_t remote_qpn,
+                 uint32_t remote_qkey, uint64_t wr_id, int signaled);
+/* prototype */
 int post_recv(struct ibv_qp *qp, struct ibv_mr *mr_dst, void *dst, size_t len, uint64_t wr_id);
 /* prototype */
 int poll_one(struct ibv_cq *cq, struct ibv_wc *wc_out);
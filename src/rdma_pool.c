@@ -0,0 +1,140 @@
+/**
+ * File: rdma_pool.c
+ * Purpose: Pre-warmed PD/CQ/QP/MR pool (see rdma_pool.h).
+ */
+
+#include "rdma_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_stats.h"
+
+int rdma_pool_init(struct rdma_pool *p, struct ibv_context *verbs, int n, int cq_depth, int max_send_wr,
+                   int max_recv_wr, size_t buf_size, int access)
+{
+    memset(p, 0, sizeof(*p));
+    p->verbs = verbs;
+    p->buf_size = buf_size;
+    p->pd = ibv_alloc_pd(verbs);
+    if (!p->pd)
+        return err_errno("ibv_alloc_pd");
+    p->entries = calloc((size_t)n, sizeof(*p->entries));
+    if (!p->entries)
+        return err_errno("calloc pool");
+    for (int i = 0; i < n; i++)
+    {
+        struct rdma_pool_entry *e = &p->entries[i];
+        p->n = i + 1; // destroy cleans up a partially built entry
+        e->cq = cq_ts_create(verbs, cq_depth); // NIC completion timestamps where the device has them, as built CQs
+        if (!e->cq)
+            return err_errno("ibv_create_cq");
+        struct ibv_qp_init_attr qa = {.send_cq = e->cq,
+                                      .recv_cq = e->cq,
+                                      .cap = {.max_send_wr = max_send_wr,
+                                              .max_recv_wr = max_recv_wr,
+                                              .max_send_sge = 1,
+                                              .max_recv_sge = 1},
+                                      .qp_type = IBV_QPT_RC};
+        e->qp = ibv_create_qp(p->pd, &qa);
+        if (!e->qp)
+            return err_errno("ibv_create_qp");
+        if (buf_size)
+        {
+            int rc = posix_memalign(&e->buf, 4096, buf_size);
+            if (rc)
+            {
+                e->buf = NULL;
+                errno = rc;
+                return err_errno("posix_memalign");
+            }
+            memset(e->buf, 0, buf_size);
+            e->mr = ibv_reg_mr(p->pd, e->buf, buf_size, access);
+            if (!e->mr)
+                return err_errno("ibv_reg_mr");
+        }
+    }
+    LOG("pool: %d QPs + %zu-byte buffers pre-registered", n, buf_size);
+    return 0;
+}
+
+struct rdma_pool_entry *rdma_pool_acquire(struct rdma_pool *p, rdma_ctx *c)
+{
+    if (c->id->verbs != p->verbs)
+    {
+        LOG_ERR("pool: connection resolved to another device");
+        return NULL;
+    }
+    for (int i = 0; i < p->n; i++)
+    {
+        struct rdma_pool_entry *e = &p->entries[i];
+        if (e->in_use)
+            continue;
+        c->pd = p->pd;
+        c->cq = e->cq;
+        c->qp = e->qp;
+        if (modify_qp_from_cm(c, IBV_QPS_INIT))
+        {
+            c->pd = NULL;
+            c->cq = NULL;
+            c->qp = NULL;
+            return NULL;
+        }
+        e->in_use = 1;
+        __atomic_fetch_add(&p->acquired, 1, __ATOMIC_RELAXED);
+        return e;
+    }
+    __atomic_fetch_add(&p->exhausted, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+void rdma_pool_release(struct rdma_pool *p, rdma_ctx *c)
+{
+    if (!c->pd || c->pd != p->pd)
+        return; // built by build_pd_cq_qp after the pool ran dry: normal cleanup owns it
+    for (int i = 0; i < p->n; i++)
+    {
+        struct rdma_pool_entry *e = &p->entries[i];
+        if (!e->in_use || e->qp != c->qp)
+            continue;
+        // RESET discards outstanding WRs; drop any completions left behind for the next owner, whose counters
+        // start over in a fresh rdma_stats slot.
+        rdma_stats_release(e->qp);
+        struct ibv_qp_attr attr = {.qp_state = IBV_QPS_RESET};
+        if (ibv_modify_qp(e->qp, &attr, IBV_QP_STATE))
+            err_errno("ibv_modify_qp(RESET)");
+        struct ibv_wc wc[16];
+        while (ibv_poll_cq(e->cq, 16, wc) > 0)
+            ;
+        e->in_use = 0;
+        __atomic_fetch_add(&p->released, 1, __ATOMIC_RELAXED);
+        break;
+    }
+    c->pd = NULL;
+    c->cq = NULL;
+    c->qp = NULL;
+}
+
+void rdma_pool_destroy(struct rdma_pool *p)
+{
+    for (int i = 0; i < p->n; i++)
+    {
+        struct rdma_pool_entry *e = &p->entries[i];
+        if (e->mr)
+            ibv_dereg_mr(e->mr);
+        free(e->buf);
+        if (e->qp)
+        {
+            rdma_stats_release(e->qp);
+            ibv_destroy_qp(e->qp);
+        }
+        if (e->cq)
+            cq_ts_destroy(e->cq);
+    }
+    free(p->entries);
+    if (p->pd)
+        ibv_dealloc_pd(p->pd);
+    memset(p, 0, sizeof(*p));
+}
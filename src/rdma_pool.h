@@ -0,0 +1,60 @@
+/**
+ * File: rdma_pool.h
+ * Purpose: Pre-warmed verbs resources (PD, CQ+QP pairs, registered buffers) for fast connection bring-up.
+ *
+ * Overview:
+ * build_pd_cq_qp() and alloc_and_reg() run inside every connect path, and QP creation and memory
+ * pinning dominate setup latency once address and route resolution are overlapped. A pool
+ * creates one PD and N entries of {CQ, RC QP, registered buffer} on a device ahead of time.
+ * rdma_pool_acquire() hands an entry to a new cm_id by moving its QP to INIT with the id's
+ * attributes. rdma_pool_release() resets the QP and returns the entry instead of destroying it.
+ *
+ * Notes:
+ *  - Pooled QPs are not attached to the cm_id (id->qp stays NULL): the CM reports
+ *    CONNECT_RESPONSE and the QP is moved to RTR/RTS with modify_qp_from_cm(). cm_dispatch does
+ *    this automatically, and cm_client_connect_user_qp / cm_server_accept_user_qp cover blocking code.
+ *  - The pool's PD must be on the same device as the ids that use it; acquire checks this.
+ *  - Entry CQs come from cq_ts_create() like those of build_pd_cq_qp(), so pooled connections get the
+ *    rdma_stats NIC-time / poll-delay split too where the device stamps completions.
+ *  - Not thread-safe. Only the acquired/released/exhausted counters may be read from another thread (a
+ *    metrics exporter, with relaxed atomic loads): they are bumped with relaxed atomic adds.
+ */
+
+#pragma once
+#include <infiniband/verbs.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rdma_ctx.h"
+
+struct rdma_pool_entry
+{
+    struct ibv_cq *cq;
+    struct ibv_qp *qp;
+    void *buf;
+    struct ibv_mr *mr;
+    int in_use;
+};
+
+struct rdma_pool
+{
+    struct ibv_context *verbs;
+    struct ibv_pd *pd;
+    struct rdma_pool_entry *entries;
+    int n;
+    size_t buf_size;
+    uint64_t acquired, released, exhausted;
+};
+
+// Create the PD and n {CQ, RC QP, buf_size registered buffer} entries on verbs.
+int rdma_pool_init(struct rdma_pool *p, struct ibv_context *verbs, int n, int cq_depth, int max_send_wr,
+                   int max_recv_wr, size_t buf_size, int access);
+
+// Bind a free entry to c->id: sets c->pd/cq/qp (QP in INIT). NULL when the pool is empty or on error.
+struct rdma_pool_entry *rdma_pool_acquire(struct rdma_pool *p, rdma_ctx *c);
+
+// Reset the QP, drain its CQ and return the entry; clears c->pd/cq/qp so normal cleanup skips them.
+// No-op for a ctx whose resources did not come from p, so callers may release unconditionally.
+void rdma_pool_release(struct rdma_pool *p, rdma_ctx *c);
+
+void rdma_pool_destroy(struct rdma_pool *p);
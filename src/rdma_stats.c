@@ -0,0 +1,361 @@
+/**
+ * File: rdma_stats.c
+ * Purpose: Per-QP counters in shared memory (see rdma_stats.h).
+ */
+
+#include "rdma_stats.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+// Signaled send WRs remembered per QP for in-flight accounting; more outstanding than this folds the oldest
+// into the next one, which only delays when their unsignaled predecessors count as retired.
+#define RDMA_STATS_MARKS 1024
+
+// Process-private half of a slot: what a completion needs to work out how many WRs it retired.
+struct qp_track
+{
+    struct ibv_context *verbs; // with qpn, the slot's key; NULL while the slot is free
+    uint32_t qpn;
+    uint64_t sends;                   // send WRs posted
+    uint64_t retired;                 // of those, known complete
+    struct
+    {
+        uint64_t sends; // `sends` right after this signaled WR
+        uint64_t t_ns;  // when it was posted
+    } marks[RDMA_STATS_MARKS]; // oldest at tail
+    uint32_t head, tail;
+};
+
+int rdma_stats_state = RDMA_STATS_UNCHECKED;
+
+static struct rdma_stats_seg *g_seg;
+static struct qp_track g_track[RDMA_STATS_MAX_QPS];
+static char g_name[64];
+static int g_force; // rdma_stats_enable() was called
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The slot this thread used last: one thread drives one QP in every sample, so this nearly always hits.
+static __thread int t_last_slot = -1;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // vDSO: no system call
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void stats_unlink(void)
+{
+    shm_unlink(g_name);
+}
+
+static void stats_open(void)
+{
+    const char *env = getenv("RDMA_STATS");
+    int fd = -1;
+    if ((!env || !*env || strcmp(env, "0") == 0) && !g_force)
+        goto off;
+    if (env && env[0] == '/')
+        snprintf(g_name, sizeof(g_name), "%s", env);
+    else
+        snprintf(g_name, sizeof(g_name), "/rdma_stats.%d", (int)getpid());
+
+    shm_unlink(g_name); // a leftover from a crashed run with the same name
+    fd = shm_open(g_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        err_errno("shm_open(RDMA_STATS)");
+        goto off;
+    }
+    if (ftruncate(fd, sizeof(*g_seg)))
+    {
+        err_errno("ftruncate(RDMA_STATS)");
+        goto off_unlink;
+    }
+    void *p = mmap(NULL, sizeof(*g_seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        err_errno("mmap(RDMA_STATS)");
+        goto off_unlink;
+    }
+    close(fd);
+    g_seg = p;
+    g_seg->version = RDMA_STATS_VERSION;
+    g_seg->max_qps = RDMA_STATS_MAX_QPS;
+    g_seg->slot_size = sizeof(struct rdma_stats_qp);
+    g_seg->pid = (int32_t)getpid();
+    FILE *f = fopen("/proc/self/comm", "r");
+    if (f)
+    {
+        if (fgets(g_seg->prog, sizeof(g_seg->prog), f))
+            g_seg->prog[strcspn(g_seg->prog, "\n")] = '\0';
+        fclose(f);
+    }
+    __atomic_store_n(&g_seg->magic, RDMA_STATS_MAGIC, __ATOMIC_RELEASE);
+    atexit(stats_unlink);
+    LOG("RDMA_STATS: per-QP counters in /dev/shm%s", g_name);
+    __atomic_store_n(&rdma_stats_state, RDMA_STATS_ON, __ATOMIC_RELEASE);
+    return;
+
+off_unlink:
+    shm_unlink(g_name);
+off:
+    if (fd >= 0)
+        close(fd);
+    g_name[0] = '\0';
+    __atomic_store_n(&rdma_stats_state, RDMA_STATS_OFF, __ATOMIC_RELEASE);
+}
+
+// The key is written under g_alloc_lock (qpn first, verbs last) and read without it.
+static int slot_is(int idx, struct ibv_context *verbs, uint32_t qpn)
+{
+    struct ibv_context *v = __atomic_load_n(&g_track[idx].verbs, __ATOMIC_ACQUIRE);
+    return v && v == verbs && __atomic_load_n(&g_track[idx].qpn, __ATOMIC_RELAXED) == qpn;
+}
+
+static int find_slot(struct ibv_context *verbs, uint32_t qpn, uint32_t nslots)
+{
+    for (uint32_t i = 0; i < nslots; i++)
+    {
+        if (slot_is((int)i, verbs, qpn))
+            return (int)i;
+    }
+    return -1;
+}
+
+// Called with g_alloc_lock held. Takes the first free slot, or the next unused one.
+static int new_slot(struct ibv_context *verbs, uint32_t qpn)
+{
+    uint32_t n = g_seg->nslots;
+    int idx = -1;
+    for (uint32_t i = 0; i < n && idx < 0; i++)
+    {
+        if (!g_track[i].verbs)
+            idx = (int)i;
+    }
+    if (idx < 0 && n == RDMA_STATS_MAX_QPS)
+    {
+        g_seg->dropped++;
+        return -1;
+    }
+    if (idx < 0)
+        idx = (int)n;
+    struct rdma_stats_qp *s = &g_seg->qp[idx];
+    uint32_t gen = s->gen + 1;
+    memset(s, 0, sizeof(*s)); // in_use is already 0: readers skip it until it is filled in again
+    s->gen = gen;
+    s->qp_num = qpn;
+    snprintf(s->dev, sizeof(s->dev), "%.*s", RDMA_STATS_LABEL - 1, verbs->device ? verbs->device->name : "?");
+    snprintf(s->label, sizeof(s->label), "qp");
+    struct qp_track *t = &g_track[idx];
+    t->sends = t->retired = 0;
+    t->head = t->tail = 0;
+    __atomic_store_n(&t->qpn, qpn, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->verbs, verbs, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->in_use, 1, __ATOMIC_RELEASE);
+    if ((uint32_t)idx == n)
+        __atomic_store_n(&g_seg->nslots, n + 1, __ATOMIC_RELEASE);
+    return idx;
+}
+
+// Slot index for (verbs, qp_num), taking a free one on first sight; -1 if counting is off or every slot is taken.
+static int slot_for(struct ibv_context *verbs, uint32_t qpn)
+{
+    if (t_last_slot >= 0 && slot_is(t_last_slot, verbs, qpn))
+        return t_last_slot;
+    if (__atomic_load_n(&rdma_stats_state, __ATOMIC_ACQUIRE) == RDMA_STATS_UNCHECKED)
+        pthread_once(&g_once, stats_open);
+    if (!g_seg)
+        return -1;
+
+    // Lock-free scan for a QP already counted; taking (or reusing) a slot needs the lock.
+    int idx = find_slot(verbs, qpn, __atomic_load_n(&g_seg->nslots, __ATOMIC_ACQUIRE));
+    if (idx < 0)
+    {
+        pthread_mutex_lock(&g_alloc_lock);
+        idx = find_slot(verbs, qpn, g_seg->nslots);
+        if (idx < 0)
+            idx = new_slot(verbs, qpn);
+        pthread_mutex_unlock(&g_alloc_lock);
+    }
+    if (idx >= 0)
+        t_last_slot = idx;
+    return idx;
+}
+
+// Record qp's CQs in its slot once. The sizes go last: a reader that sees them nonzero sees the handles too.
+static void note_cqs(struct rdma_stats_qp *s, const struct ibv_qp *qp)
+{
+    if (s->send_cq_size || !qp->send_cq || !qp->recv_cq)
+        return;
+    __atomic_store_n(&s->send_cq, qp->send_cq->handle, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->recv_cq, qp->recv_cq->handle, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->recv_cq_size, (uint32_t)qp->recv_cq->cqe, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->send_cq_size, (uint32_t)qp->send_cq->cqe, __ATOMIC_RELEASE);
+}
+
+void rdma_stats_count_send(struct ibv_qp *qp, const struct ibv_send_wr *wr)
+{
+    int idx = slot_for(qp->context, qp->qp_num);
+    if (idx < 0)
+        return;
+    struct rdma_stats_qp *s = &g_seg->qp[idx];
+    note_cqs(s, qp);
+    struct qp_track *t = &g_track[idx];
+    uint64_t t_ns = 0;
+    for (; wr; wr = wr->next)
+    {
+        if ((unsigned)wr->opcode < RDMA_STATS_OP_RECV)
+            s->posted[wr->opcode]++;
+        for (int i = 0; i < wr->num_sge; i++)
+            s->bytes_posted += wr->sg_list[i].length;
+        t->sends++;
+        if (wr->send_flags & IBV_SEND_SIGNALED)
+        {
+            s->signaled++;
+            s->send_cqes_owed++;
+            if (t->head - t->tail == RDMA_STATS_MARKS)
+                t->tail++;
+            if (!t_ns)
+                t_ns = now_ns();
+            uint32_t m = t->head++ % RDMA_STATS_MARKS;
+            t->marks[m].sends = t->sends;
+            t->marks[m].t_ns = t_ns;
+        }
+        else
+            s->unsignaled++;
+    }
+    s->inflight = t->sends - t->retired;
+    if (s->inflight > s->max_inflight)
+        s->max_inflight = s->inflight;
+}
+
+void rdma_stats_count_recv(struct ibv_qp *qp, const struct ibv_recv_wr *wr)
+{
+    int idx = slot_for(qp->context, qp->qp_num);
+    if (idx < 0)
+        return;
+    struct rdma_stats_qp *s = &g_seg->qp[idx];
+    note_cqs(s, qp);
+    for (; wr; wr = wr->next)
+    {
+        s->posted[RDMA_STATS_OP_RECV]++;
+        s->recv_cqes_owed++;
+    }
+}
+
+static int lat_bucket(uint64_t ns)
+{
+    int b = 64 - __builtin_clzll(ns | 255) - 8;
+    return b < RDMA_STATS_LAT_BUCKETS ? b : RDMA_STATS_LAT_BUCKETS - 1;
+}
+
+void rdma_stats_count_cqes(struct ibv_cq *cq, const struct ibv_wc *wc, int n, uint64_t empty_polls,
+                           const uint64_t *ts_ns)
+{
+    uint64_t t_ns = 0;
+    for (int k = 0; k < n; k++)
+    {
+        int idx = slot_for(cq->context, wc[k].qp_num);
+        if (idx < 0)
+            continue;
+        struct rdma_stats_qp *s = &g_seg->qp[idx];
+        struct qp_track *t = &g_track[idx];
+        s->cqes++;
+        if (k == 0)
+            s->empty_polls += empty_polls;
+        if (wc[k].status != IBV_WC_SUCCESS)
+        {
+            // opcode is undefined on errors; the QP is in ERR and flushes everything it holds anyway.
+            // Which queue this CQE came from is unknown too, so stop counting what the QP still owes.
+            s->error_cqes++;
+            s->send_cqes_owed = s->recv_cqes_owed = 0;
+            t->retired = t->sends;
+            t->tail = t->head;
+        }
+        else if (wc[k].opcode & IBV_WC_RECV)
+        {
+            s->bytes_recv += wc[k].byte_len;
+            if (s->recv_cqes_owed)
+                s->recv_cqes_owed--;
+        }
+        else
+        {
+            if (s->send_cqes_owed)
+                s->send_cqes_owed--;
+            if (t->tail != t->head)
+            {
+                // RC completes in order: a signaled WR's CQE retires it and every unsignaled WR before it.
+                uint32_t m = t->tail++ % RDMA_STATS_MARKS;
+                t->retired = t->marks[m].sends;
+                if (!t_ns)
+                    t_ns = now_ns();
+                uint64_t lat = t_ns - t->marks[m].t_ns;
+                s->lat_sum_ns += lat;
+                s->lat_hist[lat_bucket(lat)]++;
+                if (ts_ns && ts_ns[k])
+                {
+                    // Clamp: the NIC-to-host clock mapping is good to a few hundred ns, not to zero.
+                    uint64_t c = ts_ns[k] < t->marks[m].t_ns ? t->marks[m].t_ns : ts_ns[k] > t_ns ? t_ns : ts_ns[k];
+                    uint64_t nic = c - t->marks[m].t_ns, poll = t_ns - c;
+                    s->nic_lat_sum_ns += nic;
+                    s->nic_lat_hist[lat_bucket(nic)]++;
+                    s->poll_lat_sum_ns += poll;
+                    s->poll_lat_hist[lat_bucket(poll)]++;
+                }
+            }
+        }
+        s->inflight = t->sends - t->retired;
+    }
+}
+
+void rdma_stats_label(struct ibv_qp *qp, const char *label)
+{
+    int idx = slot_for(qp->context, qp->qp_num);
+    if (idx < 0)
+        return;
+    note_cqs(&g_seg->qp[idx], qp);
+    snprintf(g_seg->qp[idx].label, sizeof(g_seg->qp[idx].label), "%s", label);
+}
+
+void rdma_stats_release(struct ibv_qp *qp)
+{
+    if (!qp || __atomic_load_n(&rdma_stats_state, __ATOMIC_ACQUIRE) != RDMA_STATS_ON)
+        return;
+    pthread_mutex_lock(&g_alloc_lock);
+    int idx = find_slot(qp->context, qp->qp_num, g_seg->nslots);
+    if (idx >= 0)
+    {
+        // A thread that still caches idx misses on the key and scans again.
+        __atomic_store_n(&g_seg->qp[idx].in_use, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_track[idx].verbs, NULL, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_alloc_lock);
+}
+
+int rdma_stats_enable(void)
+{
+    g_force = 1;
+    pthread_once(&g_once, stats_open);
+    return g_seg ? 0 : -1;
+}
+
+const struct rdma_stats_seg *rdma_stats_segment(void)
+{
+    return g_seg;
+}
+
+const char *rdma_stats_name(void)
+{
+    return g_seg ? g_name : NULL;
+}
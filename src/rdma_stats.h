@@ -0,0 +1,158 @@
+/**
+ * File: rdma_stats.h
+ * Purpose: Per-QP data-path counters published in a named shared-memory segment.
+ *
+ * Overview:
+ * The posting and polling helpers in rdma_ops.c count, per QP: WRs posted per opcode, bytes posted and received,
+ * signaled vs unsignaled sends, CQEs reaped, empty polls, error CQEs, and send WRs in flight (current and peak).
+ * Each slot also names the QP's send and recv CQ (handle and size) and counts the CQEs it still owes each one:
+ * signaled sends and RECVs posted and not yet reaped. Summed over the QPs sharing a CQ, that bounds the CQ's
+ * occupancy from above; the true fill is only known to whoever polls it.
+ * Signaled sends are also timed from post to CQE into a log2 histogram. When the CQ carries NIC completion
+ * timestamps (cq_ts.h), that time is also split in two: post to the NIC's timestamp (NIC and fabric), and the
+ * timestamp to the poll that reaped it (host polling delay). Counting is off until RDMA_STATS is set
+ * in the environment (checked on the first post or poll) or the metrics exporter asks for it:
+ *   RDMA_STATS=1       segment "/rdma_stats.<pid>"
+ *   RDMA_STATS=/name   that segment name instead
+ * The segment lives in /dev/shm until the process exits. The rdma_stat tool (examples/c/rdma-stat) maps it
+ * read-only and prints rates while the process runs; metrics_http.h serves the same counters to Prometheus.
+ *
+ * Notes:
+ *  - Each QP slot is written only by the thread that posts and polls that QP, with plain loads and stores, so
+ *    counting costs no lock-prefixed instructions. Slots are cache-line aligned so two QPs driven by two threads
+ *    never share a line. A QP posted from one thread and polled from another may lose counts; the samples here
+ *    keep both on one thread.
+ *  - Readers see each aligned 64-bit counter whole, but not a consistent snapshot across counters.
+ *  - Code that posts or polls without rdma_ops (a direct ibv_poll_cq batch, say) reports through
+ *    rdma_stats_on_cqes(), or rdma_stats_on_cqes_ts() with the timestamps from cq_ts_poll().
+ *  - A slot belongs to one (device, QP number): QPNs are only unique per device, and a destroyed QP's number
+ *    comes back. rdma_stats_release() frees the slot when the QP is destroyed (destroy_qp() in rdma_builders
+ *    does it) or reset for another owner (rdma_pool); the next QP to take it starts from zero with a new gen.
+ *    Readers skip slots whose in_use is 0.
+ */
+
+#pragma once
+#include <infiniband/verbs.h>
+#include <stdalign.h>
+#include <stdint.h>
+
+#define RDMA_STATS_MAGIC 0x52535431u // "RST1"
+#define RDMA_STATS_VERSION 5
+#define RDMA_STATS_MAX_QPS 64
+#define RDMA_STATS_LABEL 16
+
+// posted[] index: enum ibv_wr_opcode for sends (WRITE 0 .. FETCH_ADD 6), then RECV.
+#define RDMA_STATS_OP_RECV 7
+#define RDMA_STATS_NOPS 8
+
+// lat_hist[i] counts post-to-CQE times under 2^(i+8) ns (256 ns .. ~1.07 s); the last bucket takes the rest.
+// nic_lat_hist and poll_lat_hist use the same buckets.
+#define RDMA_STATS_LAT_BUCKETS 24
+
+struct rdma_stats_qp
+{
+    alignas(64) uint32_t in_use; // set last, with release ordering, once the slot is filled in; 0 while free
+    uint32_t qp_num;
+    uint32_t gen;                // bumped each time the slot is handed to a QP, so a reader can tell them apart
+    char dev[RDMA_STATS_LABEL];  // ibv device name
+    char label[RDMA_STATS_LABEL];
+    uint64_t bytes_posted; // sum of SGE lengths over posted send WRs
+    uint64_t signaled, unsignaled;
+    uint64_t cqes, error_cqes;
+    uint64_t empty_polls; // polls of the CQ that returned nothing before this QP's CQE
+    uint64_t inflight;     // send WRs posted and not yet retired by a completion
+    uint64_t max_inflight;
+    uint64_t bytes_recv; // byte_len over successful RECV completions
+    // CQ handles (unique per device) and ibv_cq.cqe; the sizes stay 0 until the QP is labeled or first posts.
+    uint32_t send_cq, recv_cq;
+    uint32_t send_cq_size, recv_cq_size;
+    uint64_t send_cqes_owed; // signaled sends not yet reaped
+    uint64_t recv_cqes_owed; // RECVs not yet reaped; both drop to 0 at the QP's first error CQE
+    uint64_t posted[RDMA_STATS_NOPS];
+    // Signaled send WRs only, timed from the post call returning to the poll that reaped the CQE.
+    uint64_t lat_sum_ns;
+    uint64_t lat_hist[RDMA_STATS_LAT_BUCKETS];
+    // The same WRs when their CQE carried a NIC timestamp: post to timestamp, and timestamp to reap.
+    uint64_t nic_lat_sum_ns;
+    uint64_t nic_lat_hist[RDMA_STATS_LAT_BUCKETS];
+    uint64_t poll_lat_sum_ns;
+    uint64_t poll_lat_hist[RDMA_STATS_LAT_BUCKETS];
+};
+
+struct rdma_stats_seg
+{
+    alignas(64) uint32_t magic;
+    uint32_t version;
+    uint32_t max_qps, slot_size;
+    int32_t pid;
+    uint32_t nslots;  // slots ever used; readers scan [0, nslots) and skip the free ones
+    uint64_t dropped; // QPs seen while every slot was taken
+    char prog[32];
+    struct rdma_stats_qp qp[RDMA_STATS_MAX_QPS];
+};
+
+// Open state, read on every hook: 0 = RDMA_STATS not checked yet, 1 = off, 2 = on.
+enum
+{
+    RDMA_STATS_UNCHECKED,
+    RDMA_STATS_OFF,
+    RDMA_STATS_ON
+};
+extern int rdma_stats_state;
+
+/* Counting entry points; rdma_ops.c calls these after each successful post and poll. */
+void rdma_stats_count_send(struct ibv_qp *qp, const struct ibv_send_wr *wr);
+void rdma_stats_count_recv(struct ibv_qp *qp, const struct ibv_recv_wr *wr);
+// cq: the CQ wc came from (its device keys the slots). ts_ns: NULL, or wc[k]'s NIC completion time in
+// CLOCK_MONOTONIC ns (0 for none), as cq_ts_poll() fills it.
+void rdma_stats_count_cqes(struct ibv_cq *cq, const struct ibv_wc *wc, int n, uint64_t empty_polls,
+                           const uint64_t *ts_ns);
+
+static inline void rdma_stats_on_send(struct ibv_qp *qp, const struct ibv_send_wr *wr)
+{
+    if (__atomic_load_n(&rdma_stats_state, __ATOMIC_RELAXED) != RDMA_STATS_OFF)
+        rdma_stats_count_send(qp, wr);
+}
+
+static inline void rdma_stats_on_recv(struct ibv_qp *qp, const struct ibv_recv_wr *wr)
+{
+    if (__atomic_load_n(&rdma_stats_state, __ATOMIC_RELAXED) != RDMA_STATS_OFF)
+        rdma_stats_count_recv(qp, wr);
+}
+
+static inline void rdma_stats_on_cqes(struct ibv_cq *cq, const struct ibv_wc *wc, int n, uint64_t empty_polls)
+{
+    if (__atomic_load_n(&rdma_stats_state, __ATOMIC_RELAXED) != RDMA_STATS_OFF)
+        rdma_stats_count_cqes(cq, wc, n, empty_polls, NULL);
+}
+
+static inline void rdma_stats_on_cqes_ts(struct ibv_cq *cq, const struct ibv_wc *wc, int n, uint64_t empty_polls,
+                                         const uint64_t *ts_ns)
+{
+    if (__atomic_load_n(&rdma_stats_state, __ATOMIC_RELAXED) != RDMA_STATS_OFF)
+        rdma_stats_count_cqes(cq, wc, n, empty_polls, ts_ns);
+}
+
+/* Name a QP's slot in the rdma_stat output (default "qp"). Allocates the slot if counting is on. */
+void rdma_stats_label(struct ibv_qp *qp, const char *label);
+/* Free qp's slot before the QP is destroyed or reset for reuse; a later QP with its number gets a fresh one. */
+void rdma_stats_release(struct ibv_qp *qp);
+/* Turn counting on without RDMA_STATS (the metrics exporter does). 0 on success; -1 if it already started off. */
+int rdma_stats_enable(void);
+/* The segment name in use, or NULL while counting is off. */
+const char *rdma_stats_name(void);
+/* This process's segment, or NULL while counting is off. */
+const struct rdma_stats_seg *rdma_stats_segment(void);
+/* Upper bound of lat_hist[i] (and the other latency histograms) in ns; the last bucket has none (returns 0). */
+static inline uint64_t rdma_stats_lat_bound_ns(int i)
+{
+    return i < RDMA_STATS_LAT_BUCKETS - 1 ? 1ull << (i + 8) : 0;
+}
+
+/* Opcode name for a posted[] index. */
+static inline const char *rdma_stats_op_str(int op)
+{
+    static const char *const names[RDMA_STATS_NOPS] = {"write", "write_imm", "send",      "send_imm",
+                                                       "read",  "cmp_swap",  "fetch_add", "recv"};
+    return op >= 0 && op < RDMA_STATS_NOPS ? names[op] : "?";
+}
@@ -0,0 +1,232 @@
+/**
+ * File: region_dir.c
+ * Purpose: Region directory table, pushes and client view (see region_dir.h).
+ */
+
+#include "region_dir.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "crc32c.h"
+#include "rdma_ops.h"
+
+static int alloc_reg(struct ibv_pd *pd, size_t len, int access, void **buf, struct ibv_mr **mr)
+{
+    int rc = posix_memalign(buf, 4096, len);
+    if (rc)
+    {
+        *buf = NULL;
+        errno = rc;
+        return err_errno("posix_memalign");
+    }
+    memset(*buf, 0, len);
+    *mr = ibv_reg_mr(pd, *buf, len, access);
+    if (!*mr)
+        return err_errno("ibv_reg_mr");
+    return 0;
+}
+
+static void free_reg(void **buf, struct ibv_mr **mr)
+{
+    if (*mr)
+        ibv_dereg_mr(*mr);
+    free(*buf);
+    *mr = NULL;
+    *buf = NULL;
+}
+
+static uint32_t entry_crc(const struct rdir_entry *e)
+{
+    return crc32c(0, e, offsetof(struct rdir_entry, crc));
+}
+
+static size_t table_bytes(uint32_t capacity)
+{
+    return sizeof(struct rdir_header) + (size_t)capacity * sizeof(struct rdir_entry);
+}
+
+int rdir_table_init(struct rdir_table *t, struct ibv_pd *pd, uint32_t capacity)
+{
+    memset(t, 0, sizeof(*t));
+    if (alloc_reg(pd, table_bytes(capacity), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ, &t->buf, &t->mr))
+        return -1;
+    t->capacity = capacity;
+    t->hdr = t->buf;
+    t->entries = (struct rdir_entry *)(t->hdr + 1);
+    t->hdr->magic = htonl(RDIR_MAGIC);
+    t->hdr->capacity = htonl(capacity);
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        t->entries[i].slot = htonl(i);
+        t->entries[i].crc = htonl(entry_crc(&t->entries[i]));
+    }
+    return 0;
+}
+
+void rdir_table_destroy(struct rdir_table *t)
+{
+    free_reg(&t->buf, &t->mr);
+}
+
+struct rdir_locator rdir_table_locator(const struct rdir_table *t)
+{
+    struct rdir_locator l = {.addr = htonll_u64((uintptr_t)t->buf),
+                             .rkey = htonl(t->mr->rkey),
+                             .bytes = htonl((uint32_t)table_bytes(t->capacity))};
+    return l;
+}
+
+int rdir_table_set(struct rdir_table *t, uint32_t slot, uint64_t addr, uint64_t len, uint32_t rkey)
+{
+    if (slot >= t->capacity)
+        ERRF("rdir: slot %u out of range (capacity %u)", slot, t->capacity);
+    struct rdir_entry *e = &t->entries[slot];
+    // CRC last: a reader that overlaps this sees fields that do not match it.
+    e->gen = htonl(ntohl(e->gen) + 1);
+    e->addr = htonll_u64(addr);
+    e->len = htonll_u64(len);
+    e->rkey = htonl(rkey);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->crc = htonl(entry_crc(e));
+    t->hdr->gen = htonl(++t->gen);
+    return 0;
+}
+
+int rdir_sub_init(struct rdir_sub *s, const void *priv, size_t priv_len)
+{
+    struct rdir_locator l;
+    if (!priv || priv_len < sizeof(l))
+        ERRF("rdir: no inbox locator in private_data");
+    memcpy(&l, priv, sizeof(l));
+    s->addr = ntohll_u64(l.addr);
+    s->rkey = ntohl(l.rkey);
+    s->slots = ntohl(l.bytes) / sizeof(struct rdir_entry);
+    s->next = 0;
+    if (!s->slots)
+        ERRF("rdir: empty inbox");
+    return 0;
+}
+
+int rdir_push(struct ibv_qp *qp, const struct rdir_table *t, uint32_t slot, struct rdir_sub *s, uint64_t wr_id)
+{
+    uint32_t pos = s->next++ % s->slots;
+    if (post_write_imm(qp, t->mr, &t->entries[slot], s->addr + (uint64_t)pos * sizeof(struct rdir_entry), s->rkey,
+                       sizeof(struct rdir_entry), pos, wr_id, 1))
+        return err_errno("rdir push");
+    return 0;
+}
+
+int rdir_push_end(struct ibv_qp *qp, const struct rdir_sub *s, uint64_t wr_id)
+{
+    if (post_write_imm(qp, NULL, NULL, s->addr, s->rkey, 0, RDIR_IMM_END, wr_id, 1))
+        return err_errno("rdir push end");
+    return 0;
+}
+
+int rdir_view_init(struct rdir_view *v, struct ibv_pd *pd, uint32_t inbox_slots)
+{
+    memset(v, 0, sizeof(*v));
+    v->inbox_slots = inbox_slots;
+    return alloc_reg(pd, (size_t)inbox_slots * sizeof(struct rdir_entry),
+                     IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE, (void **)&v->inbox, &v->inbox_mr);
+}
+
+struct rdir_locator rdir_view_inbox_locator(const struct rdir_view *v)
+{
+    struct rdir_locator l = {.addr = htonll_u64((uintptr_t)v->inbox),
+                             .rkey = htonl(v->inbox_mr->rkey),
+                             .bytes = htonl(v->inbox_slots * (uint32_t)sizeof(struct rdir_entry))};
+    return l;
+}
+
+int rdir_view_post_recvs(struct rdir_view *v, struct ibv_qp *qp)
+{
+    // WRITE_WITH_IMM lands in the inbox, not in the RECV buffer: zero-length RECVs suffice.
+    for (uint32_t i = 0; i < v->inbox_slots; i++)
+        if (post_recv(qp, v->inbox_mr, v->inbox, 0, RDIR_WR_RECV))
+            return err_errno("rdir post_recv");
+    return 0;
+}
+
+int rdir_view_attach(struct rdir_view *v, struct ibv_pd *pd, const void *priv, size_t priv_len)
+{
+    if (!priv || priv_len < sizeof(v->table))
+        ERRF("rdir: no table locator in private_data");
+    memcpy(&v->table, priv, sizeof(v->table));
+    uint32_t bytes = ntohl(v->table.bytes);
+    if (bytes < sizeof(struct rdir_header))
+        ERRF("rdir: table of %u bytes", bytes);
+    v->capacity = (uint32_t)((bytes - sizeof(struct rdir_header)) / sizeof(struct rdir_entry));
+    v->regions = calloc(v->capacity ? v->capacity : 1, sizeof(*v->regions));
+    if (!v->regions)
+        return err_errno("calloc regions");
+    return alloc_reg(pd, bytes, IBV_ACCESS_LOCAL_WRITE, &v->mirror, &v->mirror_mr);
+}
+
+int rdir_view_post_fetch(struct rdir_view *v, struct ibv_qp *qp, uint64_t wr_id)
+{
+    if (post_read(qp, v->mirror_mr, v->mirror, ntohll_u64(v->table.addr), ntohl(v->table.rkey),
+                  ntohl(v->table.bytes), wr_id, 1))
+        return err_errno("rdir fetch");
+    return 0;
+}
+
+// Keep the newest consistent version of a slot. 1 if it changed the region.
+static int merge(struct rdir_view *v, const struct rdir_entry *e, uint32_t *slot_out)
+{
+    if (entry_crc(e) != ntohl(e->crc))
+    {
+        v->torn++;
+        return 0;
+    }
+    uint32_t gen = ntohl(e->gen), slot = ntohl(e->slot);
+    if (slot >= v->capacity || gen == 0)
+        return 0;
+    struct rdir_region *r = &v->regions[slot];
+    if (gen <= r->gen)
+    {
+        v->stale++;
+        return 0;
+    }
+    r->addr = ntohll_u64(e->addr);
+    r->len = ntohll_u64(e->len);
+    r->rkey = ntohl(e->rkey);
+    r->gen = gen;
+    v->applied++;
+    if (slot_out)
+        *slot_out = slot;
+    return 1;
+}
+
+int rdir_view_load(struct rdir_view *v)
+{
+    const struct rdir_header *h = v->mirror;
+    if (ntohl(h->magic) != RDIR_MAGIC || ntohl(h->capacity) != v->capacity)
+        ERRF("rdir: bad table header (magic=%#x capacity=%u)", ntohl(h->magic), ntohl(h->capacity));
+    const struct rdir_entry *e = (const struct rdir_entry *)(h + 1);
+    int changed = 0;
+    for (uint32_t i = 0; i < v->capacity; i++)
+        changed += merge(v, &e[i], NULL);
+    return changed;
+}
+
+int rdir_view_apply(struct rdir_view *v, struct ibv_qp *qp, uint32_t imm, uint32_t *slot)
+{
+    if (imm >= v->inbox_slots)
+        ERRF("rdir: inbox position %u out of range", imm);
+    struct rdir_entry e = v->inbox[imm]; // copy before the RECV is reposted
+    if (post_recv(qp, v->inbox_mr, v->inbox, 0, RDIR_WR_RECV))
+        return err_errno("rdir repost");
+    return merge(v, &e, slot);
+}
+
+void rdir_view_destroy(struct rdir_view *v)
+{
+    free_reg((void **)&v->inbox, &v->inbox_mr);
+    free_reg(&v->mirror, &v->mirror_mr);
+    free(v->regions);
+    v->regions = NULL;
+}
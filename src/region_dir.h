@@ -0,0 +1,126 @@
+/**
+ * File: region_dir.h
+ * Purpose: Region directory: expose many remote buffers over one connection and update them live.
+ *
+ * Overview:
+ * struct remote_buf_info in the CM private_data describes exactly one buffer, and private_data is
+ * only a few hundred bytes. Exposing another buffer therefore meant reconnecting. With a region
+ * directory the private_data only carries locators:
+ *
+ *   server -> client (accept):  rdir_locator of the server's table {header, capacity x rdir_entry}
+ *   client -> server (connect): rdir_locator of the client's inbox ring (inbox_slots x rdir_entry)
+ *
+ * Right after ESTABLISHED the client fetches the whole table with one RDMA READ. Each later change
+ * of a slot is pushed as a WRITE_WITH_IMM of that 32-byte entry into the next inbox slot, with
+ * imm = inbox position. The client copies it out at the RECV completion and reposts the RECV.
+ *
+ * Consistency: every entry ends in a CRC32C over its other 28 bytes, and rdir_table_set() rewrites
+ * it last. The order in which the NIC reads the bytes of an entry is unspecified, so a READ or push
+ * that raced a change can carry any mix of old and new fields. Such a mix fails the CRC and is
+ * dropped, except with probability ~2^-32. The change that caused it is always followed by its own
+ * push. The client keeps the highest gen per slot, so a push that completes before the initial
+ * READ is not undone by it.
+ *
+ * Notes:
+ *  - All wire fields are big-endian.
+ *  - A retracted region (len 0) may still be in use by a client that has not seen the push yet.
+ *    Deregister its MR only after a grace period or an application-level ack.
+ *  - The inbox holds inbox_slots entries and the client keeps one RECV posted per slot. A push
+ *    cannot lap a slot the client has not copied yet: without a RECV it is RNR-retried.
+ */
+
+#pragma once
+#include <infiniband/verbs.h>
+#include <stdint.h>
+
+#define RDIR_MAGIC 0x52444952u   // "RDIR"
+#define RDIR_IMM_END 0xffffffffu // zero-length WRITE_WITH_IMM: server is done publishing
+#define RDIR_WR_RECV 0x52445200u // wr_id of inbox RECVs
+
+struct rdir_header
+{
+    uint32_t magic;
+    uint32_t capacity; // entries that follow
+    uint32_t gen;      // bumped on every change
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct rdir_entry
+{
+    uint64_t addr;
+    uint64_t len; // 0 = empty or retracted
+    uint32_t rkey;
+    uint32_t slot;
+    uint32_t gen;
+    uint32_t crc; // CRC32C of the wire bytes before it
+} __attribute__((packed));
+
+struct rdir_locator
+{
+    uint64_t addr;
+    uint32_t rkey;
+    uint32_t bytes;
+} __attribute__((packed));
+
+// ---- server side ----
+struct rdir_table
+{
+    void *buf;
+    struct ibv_mr *mr;
+    struct rdir_header *hdr;
+    struct rdir_entry *entries;
+    uint32_t capacity, gen;
+};
+
+// A client's inbox ring, from the locator in its CONNECT_REQUEST.
+struct rdir_sub
+{
+    uint64_t addr;
+    uint32_t rkey;
+    uint32_t slots, next;
+};
+
+int rdir_table_init(struct rdir_table *t, struct ibv_pd *pd, uint32_t capacity);
+void rdir_table_destroy(struct rdir_table *t);
+struct rdir_locator rdir_table_locator(const struct rdir_table *t);
+// Publish (len > 0) or retract (len == 0) slot.
+int rdir_table_set(struct rdir_table *t, uint32_t slot, uint64_t addr, uint64_t len, uint32_t rkey);
+
+int rdir_sub_init(struct rdir_sub *s, const void *priv, size_t priv_len);
+// WRITE_WITH_IMM of the slot's entry into the subscriber's next inbox slot (signaled).
+int rdir_push(struct ibv_qp *qp, const struct rdir_table *t, uint32_t slot, struct rdir_sub *s, uint64_t wr_id);
+int rdir_push_end(struct ibv_qp *qp, const struct rdir_sub *s, uint64_t wr_id);
+
+// ---- client side ----
+struct rdir_region
+{
+    uint64_t addr, len; // len 0 = no region in this slot
+    uint32_t rkey, gen;
+};
+
+struct rdir_view
+{
+    struct rdir_entry *inbox;
+    struct ibv_mr *inbox_mr;
+    uint32_t inbox_slots;
+    struct rdir_locator table; // server's table
+    uint32_t capacity;
+    void *mirror; // READ target for the table
+    struct ibv_mr *mirror_mr;
+    struct rdir_region *regions;
+    uint64_t applied, stale, torn;
+};
+
+int rdir_view_init(struct rdir_view *v, struct ibv_pd *pd, uint32_t inbox_slots);
+struct rdir_locator rdir_view_inbox_locator(const struct rdir_view *v);
+// One RECV per inbox slot; call before connecting.
+int rdir_view_post_recvs(struct rdir_view *v, struct ibv_qp *qp);
+// Size the mirror and region array from the server's locator (accept private_data).
+int rdir_view_attach(struct rdir_view *v, struct ibv_pd *pd, const void *priv, size_t priv_len);
+int rdir_view_post_fetch(struct rdir_view *v, struct ibv_qp *qp, uint64_t wr_id);
+// After the fetch READ completed: merge the mirror into regions. Returns slots that changed, -1 if malformed.
+int rdir_view_load(struct rdir_view *v);
+// RECV completion with imm (not RDIR_IMM_END): merge that inbox entry and repost the RECV.
+// Returns 1 and sets *slot if a region changed, 0 for a stale or torn entry, -1 on error.
+int rdir_view_apply(struct rdir_view *v, struct ibv_qp *qp, uint32_t imm, uint32_t *slot);
+void rdir_view_destroy(struct rdir_view *v);
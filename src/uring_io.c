@@ -0,0 +1,229 @@
+/**
+ * File: uring_io.c
+ * Purpose: Minimal io_uring wrapper over the raw syscalls (see uring_io.h).
+ *
+ * Overview:
+ * uring_init maps the SQ ring, CQ ring and SQE array; uring_get_sqe hands out SQEs locally;
+ * uring_submit publishes them with a release store on the SQ tail and calls io_uring_enter
+ * (skipped under SQPOLL unless the poller thread went idle); CQEs are consumed in place and
+ * retired with uring_cqe_seen. Provided-buffer rings live in anonymous memory we map and hand
+ * to the kernel with IORING_REGISTER_PBUF_RING.
+ */
+
+#include "uring_io.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+int uring_init(struct uring *r, unsigned entries, unsigned setup_flags, unsigned sq_thread_idle_ms)
+{
+    struct io_uring_params p;
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    p.flags = setup_flags;
+    if (setup_flags & IORING_SETUP_SQPOLL)
+        p.sq_thread_idle = sq_thread_idle_ms;
+    r->fd = sys_io_uring_setup(entries, &p);
+    if (r->fd < 0)
+        return -errno;
+    r->flags = setup_flags;
+    r->features = p.features;
+
+    r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (r->cq_ring_sz > r->sq_ring_sz)
+            r->sq_ring_sz = r->cq_ring_sz;
+        r->cq_ring_sz = r->sq_ring_sz;
+    }
+    r->sq_ring_ptr =
+        mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring_ptr == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_ring_ptr = r->sq_ring_ptr;
+    else
+    {
+        r->cq_ring_ptr =
+            mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring_ptr == MAP_FAILED)
+            goto fail;
+    }
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto fail;
+
+    char *sq = r->sq_ring_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_entries = (unsigned *)(sq + p.sq_off.ring_entries);
+    r->sq_flags = (unsigned *)(sq + p.sq_off.flags);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    char *cq = r->cq_ring_ptr;
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cq_entries = (unsigned *)(cq + p.cq_off.ring_entries);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+
+fail:
+{
+    int e = -errno;
+    uring_exit(r);
+    return e;
+}
+}
+
+void uring_exit(struct uring *r)
+{
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_sz);
+    if (r->cq_ring_ptr && r->cq_ring_ptr != MAP_FAILED && r->cq_ring_ptr != r->sq_ring_ptr)
+        munmap(r->cq_ring_ptr, r->cq_ring_sz);
+    if (r->sq_ring_ptr && r->sq_ring_ptr != MAP_FAILED)
+        munmap(r->sq_ring_ptr, r->sq_ring_sz);
+    if (r->fd > 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *r)
+{
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sqe_tail - head >= *r->sq_entries)
+        return NULL;
+    return &r->sqes[r->sqe_tail++ & *r->sq_mask];
+}
+
+int uring_submit(struct uring *r, unsigned wait_nr)
+{
+    unsigned mask = *r->sq_mask;
+    unsigned ktail = *r->sq_tail;
+    unsigned to_submit = r->sqe_tail - r->sqe_head;
+    while (r->sqe_head != r->sqe_tail)
+    {
+        r->sq_array[ktail & mask] = r->sqe_head & mask;
+        ktail++;
+        r->sqe_head++;
+    }
+    // The kernel (or the SQPOLL thread) may read the SQEs as soon as it sees the new tail.
+    __atomic_store_n(r->sq_tail, ktail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    if (r->flags & IORING_SETUP_SQPOLL)
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        else if (!wait_nr)
+            return (int)to_submit; // the poller picks them up without a syscall
+    }
+    int ret;
+    do
+    {
+        ret = sys_io_uring_enter(r->fd, to_submit, wait_nr, flags);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret;
+}
+
+int uring_peek_cqe(struct uring *r, struct io_uring_cqe **cqe)
+{
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return -EAGAIN;
+    *cqe = &r->cqes[head & *r->cq_mask];
+    return 0;
+}
+
+int uring_wait_cqe(struct uring *r, struct io_uring_cqe **cqe)
+{
+    for (;;)
+    {
+        if (uring_peek_cqe(r, cqe) == 0)
+            return 0;
+        if (sys_io_uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            return -errno;
+    }
+}
+
+void uring_cqe_seen(struct uring *r)
+{
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_register(struct uring *r, unsigned opcode, void *arg, unsigned nr_args)
+{
+    int ret = (int)syscall(__NR_io_uring_register, r->fd, opcode, arg, nr_args);
+    return ret < 0 ? -errno : ret;
+}
+
+int uring_register_buffers(struct uring *r, const struct iovec *iov, unsigned n)
+{
+    return uring_register(r, IORING_REGISTER_BUFFERS, (void *)iov, n);
+}
+
+int uring_buf_ring_init(struct uring *r, struct uring_buf_ring *b, uint16_t bgid, unsigned entries, size_t buf_sz)
+{
+    memset(b, 0, sizeof(*b));
+    if (!entries || (entries & (entries - 1)) || entries > 32768)
+        return -EINVAL;
+    b->entries = entries;
+    b->buf_sz = buf_sz;
+    b->bgid = bgid;
+    b->ring_sz = entries * sizeof(struct io_uring_buf);
+    b->br = mmap(NULL, b->ring_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->br == MAP_FAILED)
+    {
+        b->br = NULL;
+        return -errno;
+    }
+    b->bufs = mmap(NULL, entries * buf_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->bufs == MAP_FAILED)
+    {
+        int e = -errno;
+        b->bufs = NULL;
+        uring_buf_ring_exit(r, b);
+        return e;
+    }
+    struct io_uring_buf_reg reg = {.ring_addr = (uint64_t)(uintptr_t)b->br, .ring_entries = entries, .bgid = bgid};
+    int rc = uring_register(r, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (rc)
+    {
+        uring_buf_ring_exit(r, b);
+        return rc;
+    }
+    for (unsigned i = 0; i < entries; i++)
+        uring_buf_ring_recycle(b, i);
+    return 0;
+}
+
+void uring_buf_ring_exit(struct uring *r, struct uring_buf_ring *b)
+{
+    if (b->br && r->fd >= 0)
+    {
+        struct io_uring_buf_reg reg = {.bgid = b->bgid};
+        uring_register(r, IORING_UNREGISTER_PBUF_RING, &reg, 1); // fails harmlessly if never registered
+    }
+    if (b->bufs)
+        munmap(b->bufs, b->entries * b->buf_sz);
+    if (b->br)
+        munmap(b->br, b->ring_sz);
+    memset(b, 0, sizeof(*b));
+}
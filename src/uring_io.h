@@ -0,0 +1,158 @@
+/**
+ * File: uring_io.h
+ * Purpose: Minimal io_uring wrapper (setup, SQE/CQE ring access, buffer registration).
+ *
+ * Overview:
+ * Talks to the kernel through the raw io_uring_setup/io_uring_enter/io_uring_register syscalls and
+ * the mmap'd SQ/CQ rings, so samples need no liburing. It covers exactly what the labs use: plain
+ * and fixed-buffer read/write, fsync, socket send/recv (zero-copy send from a registered buffer,
+ * multishot receive into a provided-buffer ring), and optional SQPOLL. Prep helpers fill one SQE
+ * each; callers batch several and publish them with one uring_submit().
+ *
+ * Notes:
+ *  - Not thread-safe: one ring per thread, like the verbs CQs in these samples.
+ *  - Errors follow the kernel convention: negative errno in return values and cqe->res.
+ */
+
+#pragma once
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+struct uring
+{
+    int fd;
+    unsigned flags; // IORING_SETUP_* used at setup
+    unsigned features;
+
+    // Submission ring (shared with the kernel) + the SQE array it indexes.
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_entries, *sq_flags, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_head, sqe_tail; // SQEs handed out locally but not yet published
+
+    // Completion ring.
+    unsigned *cq_head, *cq_tail, *cq_mask, *cq_entries;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring_ptr, *cq_ring_ptr;
+    size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+};
+
+int uring_init(struct uring *r, unsigned entries, unsigned setup_flags, unsigned sq_thread_idle_ms);
+void uring_exit(struct uring *r);
+struct io_uring_sqe *uring_get_sqe(struct uring *r);
+int uring_submit(struct uring *r, unsigned wait_nr);
+int uring_peek_cqe(struct uring *r, struct io_uring_cqe **cqe);
+int uring_wait_cqe(struct uring *r, struct io_uring_cqe **cqe);
+void uring_cqe_seen(struct uring *r);
+int uring_register_buffers(struct uring *r, const struct iovec *iov, unsigned n);
+int uring_register(struct uring *r, unsigned opcode, void *arg, unsigned nr_args);
+
+static inline void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, const void *addr, unsigned len,
+                                 uint64_t off, uint64_t user_data)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = user_data;
+}
+
+static inline void uring_prep_write(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len, uint64_t off,
+                                    uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_WRITE, fd, buf, len, off, user_data);
+}
+
+static inline void uring_prep_read(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, uint64_t off,
+                                   uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_READ, fd, buf, len, off, user_data);
+}
+
+// Fixed variants use a buffer registered with uring_register_buffers (no per-I/O page pinning).
+static inline void uring_prep_write_fixed(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len,
+                                          uint64_t off, unsigned buf_index, uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, fd, buf, len, off, user_data);
+    sqe->buf_index = (uint16_t)buf_index;
+}
+
+static inline void uring_prep_read_fixed(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, uint64_t off,
+                                         unsigned buf_index, uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_READ_FIXED, fd, buf, len, off, user_data);
+    sqe->buf_index = (uint16_t)buf_index;
+}
+
+static inline void uring_prep_fsync(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_FSYNC, fd, NULL, 0, 0, user_data);
+}
+
+// Sockets (Linux 6.0+ for SEND_ZC and multishot RECV).
+static inline void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len, int msg_flags,
+                                   uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_SEND, fd, buf, len, 0, user_data);
+    sqe->msg_flags = (uint32_t)msg_flags;
+}
+
+// Zero-copy send from a registered buffer. Completes twice: the send result (IORING_CQE_F_MORE set), then a
+// IORING_CQE_F_NOTIF CQE once the kernel no longer needs the pages; its res has IORING_NOTIF_USAGE_ZC_COPIED
+// set if the data was copied after all.
+static inline void uring_prep_send_zc_fixed(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len,
+                                            unsigned buf_index, uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_SEND_ZC, fd, buf, len, 0, user_data);
+    sqe->ioprio = IORING_RECVSEND_FIXED_BUF | IORING_SEND_ZC_REPORT_USAGE;
+    sqe->buf_index = (uint16_t)buf_index;
+}
+
+// One SQE, one CQE per arriving segment, each in a buffer the kernel takes from group bgid (see uring_buf_ring).
+// IORING_CQE_F_MORE is clear on the last one (error, EOF, or -ENOBUFS when the group ran dry): re-arm then.
+static inline void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint16_t bgid, uint64_t user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_RECV, fd, NULL, 0, 0, user_data);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+}
+
+/*
+ * Provided-buffer ring: `entries` (a power of two) buffers of buf_sz bytes that the kernel picks from for
+ * IOSQE_BUFFER_SELECT receives. The chosen id is cqe->flags >> IORING_CQE_BUFFER_SHIFT; hand the buffer
+ * back with uring_buf_ring_recycle once its data has been consumed.
+ */
+struct uring_buf_ring
+{
+    struct io_uring_buf_ring *br;
+    size_t ring_sz;
+    char *bufs;
+    size_t buf_sz;
+    unsigned entries;
+    uint16_t bgid, tail;
+};
+
+int uring_buf_ring_init(struct uring *r, struct uring_buf_ring *b, uint16_t bgid, unsigned entries, size_t buf_sz);
+void uring_buf_ring_exit(struct uring *r, struct uring_buf_ring *b);
+
+static inline void *uring_buf_ring_addr(const struct uring_buf_ring *b, unsigned bid)
+{
+    return b->bufs + (size_t)bid * b->buf_sz;
+}
+
+static inline void uring_buf_ring_recycle(struct uring_buf_ring *b, unsigned bid)
+{
+    struct io_uring_buf *buf = &b->br->bufs[b->tail & (b->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf_ring_addr(b, bid);
+    buf->len = (uint32_t)b->buf_sz;
+    buf->bid = (uint16_t)bid;
+    b->tail++;
+    // The kernel may take the buffer as soon as it sees the new tail.
+    __atomic_store_n(&b->br->tail, b->tail, __ATOMIC_RELEASE);
+}
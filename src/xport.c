@@ -0,0 +1,104 @@
+/**
+ * File: xport.c
+ * Purpose: Backend lookup and the backend-independent parts of the transport interface (see xport.h).
+ */
+
+#include "xport.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#define XPORT_WR_EXPOSE 0x58505200ULL
+
+// Region descriptor swapped by xport_expose. Big-endian on the wire.
+struct xport_desc
+{
+    uint64_t addr;
+    uint64_t len;
+    uint32_t key;
+    uint32_t reserved;
+} __attribute__((packed));
+
+int xport_open_ops(struct xport *x, const struct xport_ops *ops)
+{
+    memset(x, 0, sizeof(*x));
+    x->ops = ops;
+    if (ops->open(x))
+    {
+        x->ops = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int xport_open(struct xport *x, const char *backend)
+{
+    static const struct xport_ops *const all[] = {&xport_rdma_ops, &xport_tcp_ops, &xport_shm_ops};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++)
+    {
+        if (backend && strcmp(backend, all[i]->name) == 0)
+            return xport_open_ops(x, all[i]);
+    }
+    ERRF("unknown transport '%s' (rdma, tcp or shm)", backend ? backend : "");
+}
+
+int xport_wait(struct xport *x, struct xport_wc *wc)
+{
+    int n;
+    while ((n = xport_poll(x, wc, 1)) == 0)
+        ;
+    if (n < 0)
+        ERRF("%s: connection failed", x->ops->name);
+    if (wc->status)
+        ERRF("%s: wr_id %llu failed (status %d)", x->ops->name, (unsigned long long)wc->wr_id, wc->status);
+    return 0;
+}
+
+int xport_expose(struct xport *x, struct xport_mr *mr)
+{
+    struct xport_desc *d = NULL;
+    struct xport_mr dmr = {0};
+    int rc = -1;
+    if (posix_memalign((void **)&d, 64, 2 * sizeof(*d)))
+        ERRF("xport: no memory for the descriptor");
+    memset(d, 0, 2 * sizeof(*d));
+    if (xport_reg(x, d, 2 * sizeof(*d), &dmr))
+        goto cleanup;
+    // Set before the descriptor leaves: the peer may WRITE as soon as it has it.
+    x->exposed = mr;
+    if (mr)
+    {
+        d[0].addr = htonll_u64((uintptr_t)mr->addr);
+        d[0].len = htonll_u64(mr->len);
+        d[0].key = htonl(mr->key);
+    }
+    if (xport_recv(x, &dmr, &d[1], sizeof(d[1]), XPORT_WR_EXPOSE) ||
+        xport_send(x, &dmr, &d[0], sizeof(d[0]), XPORT_WR_EXPOSE, 1))
+    {
+        LOG_ERR("%s: posting the region descriptor failed", x->ops->name);
+        goto cleanup;
+    }
+    for (int pending = 2; pending > 0; pending--)
+    {
+        struct xport_wc wc;
+        if (xport_wait(x, &wc))
+            goto cleanup;
+        if (wc.op == XPORT_OP_RECV && wc.byte_len < sizeof(d[1]))
+        {
+            LOG_ERR("%s: short region descriptor (%u bytes)", x->ops->name, wc.byte_len);
+            goto cleanup;
+        }
+    }
+    x->remote_addr = ntohll_u64(d[1].addr);
+    x->remote_len = ntohll_u64(d[1].len);
+    x->remote_key = ntohl(d[1].key);
+    rc = 0;
+
+cleanup:
+    if (dmr.priv || dmr.addr)
+        xport_dereg(x, &dmr);
+    free(d);
+    return rc;
+}
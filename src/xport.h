@@ -0,0 +1,149 @@
+/**
+ * File: xport.h
+ * Purpose: One transport interface (connect, register, write, read, send, poll) over RDMA, TCP or memory.
+ *
+ * Overview:
+ * The RDMA samples and the TCP baseline are separate programs, each with its own CLI and output,
+ * so a fair comparison has to be assembled by hand. A workload written against struct xport runs
+ * unchanged on every backend:
+ *
+ *   rdma  verbs RC QP set up through rdma_cm (src/xport_rdma.c)
+ *   tcp   one TCP socket. A receive thread on each side plays the NIC: it places incoming WRITEs,
+ *         answers READs and matches SENDs to posted RECVs (src/xport_tcp.c)
+ *   shm   both ends in one process. Operations are memcpy between the two endpoints
+ *         (src/xport_shm.c). This needs no device or network, for tests and CPU-side baselines
+ *
+ * Usage: xport_open() -> xport_listen() or xport_connect() -> xport_reg() -> xport_expose() on
+ * both sides -> post operations -> xport_poll() -> xport_close().
+ *
+ * Remote memory: each side exposes at most one registered region with xport_expose(), which swaps
+ * region descriptors with the peer via SEND/RECV. One-sided operations then address the peer's
+ * region by offset. Each backend bounds-checks the offset, or leaves it to the NIC.
+ *
+ * Completions follow RC rules where the backend can honour them. Operations on one endpoint complete
+ * in posting order, and an unsignaled WRITE/SEND produces no completion. A TCP WRITE/SEND completes
+ * when the bytes are queued in the socket: the source buffer is reusable, but the data has not
+ * been placed yet. TCP ordering still places it before any later SEND is delivered. If READs
+ * posted before it are still outstanding, its completion is held until theirs.
+ *
+ * Notes:
+ *  - One thread per endpoint posts and polls, as with the verbs samples.
+ *  - A SEND that finds no RECV posted waits for one (RNR retry on RDMA, queued on tcp/shm).
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+enum xport_op
+{
+    XPORT_OP_WRITE,
+    XPORT_OP_READ,
+    XPORT_OP_SEND,
+    XPORT_OP_RECV
+};
+
+struct xport_mr
+{
+    void *addr;
+    size_t len;
+    uint32_t key; // rkey on rdma, 0 elsewhere
+    void *priv;   // backend handle (struct ibv_mr * on rdma)
+};
+
+struct xport_wc
+{
+    uint64_t wr_id;
+    enum xport_op op;
+    uint32_t byte_len; // RECV only
+    int status;        // 0 = success
+};
+
+struct xport;
+
+struct xport_ops
+{
+    const char *name;
+    int (*open)(struct xport *x);
+    // Wait for exactly one peer on port (bind_ip may be NULL).
+    int (*listen)(struct xport *x, const char *bind_ip, const char *port);
+    int (*connect)(struct xport *x, const char *ip, const char *port);
+    int (*reg)(struct xport *x, void *buf, size_t len, struct xport_mr *mr);
+    void (*dereg)(struct xport *x, struct xport_mr *mr);
+    int (*write)(struct xport *x, struct xport_mr *mr, void *src, uint64_t roff, size_t len, uint64_t wr_id,
+                 int signaled);
+    int (*read)(struct xport *x, struct xport_mr *mr, void *dst, uint64_t roff, size_t len, uint64_t wr_id);
+    int (*send)(struct xport *x, struct xport_mr *mr, void *src, size_t len, uint64_t wr_id, int signaled);
+    int (*recv)(struct xport *x, struct xport_mr *mr, void *dst, size_t len, uint64_t wr_id);
+    // Up to max completions, 0 if none; -1 once the connection has failed.
+    int (*poll)(struct xport *x, struct xport_wc *wc, int max);
+    void (*close)(struct xport *x);
+};
+
+struct xport
+{
+    const struct xport_ops *ops;
+    void *impl;
+    struct xport_mr *exposed; // local region the peer may WRITE/READ (NULL: none)
+    uint64_t remote_addr;     // peer's region as sent by xport_expose
+    uint64_t remote_len;
+    uint32_t remote_key;
+};
+
+extern const struct xport_ops xport_rdma_ops;
+extern const struct xport_ops xport_tcp_ops;
+extern const struct xport_ops xport_shm_ops;
+
+// Pick a backend by name ("rdma", "tcp", "shm"). Returns -1 for an unknown name.
+int xport_open(struct xport *x, const char *backend);
+int xport_open_ops(struct xport *x, const struct xport_ops *ops);
+
+// Exchange region descriptors with the peer (both sides must call it). mr may be NULL.
+int xport_expose(struct xport *x, struct xport_mr *mr);
+
+// Poll until one completion arrives. Returns -1 on a failed completion or connection.
+int xport_wait(struct xport *x, struct xport_wc *wc);
+
+static inline int xport_listen(struct xport *x, const char *bind_ip, const char *port)
+{
+    return x->ops->listen(x, bind_ip, port);
+}
+static inline int xport_connect(struct xport *x, const char *ip, const char *port)
+{
+    return x->ops->connect(x, ip, port);
+}
+static inline int xport_reg(struct xport *x, void *buf, size_t len, struct xport_mr *mr)
+{
+    return x->ops->reg(x, buf, len, mr);
+}
+static inline void xport_dereg(struct xport *x, struct xport_mr *mr)
+{
+    x->ops->dereg(x, mr);
+}
+static inline int xport_write(struct xport *x, struct xport_mr *mr, void *src, uint64_t roff, size_t len,
+                              uint64_t wr_id, int signaled)
+{
+    return x->ops->write(x, mr, src, roff, len, wr_id, signaled);
+}
+static inline int xport_read(struct xport *x, struct xport_mr *mr, void *dst, uint64_t roff, size_t len,
+                             uint64_t wr_id)
+{
+    return x->ops->read(x, mr, dst, roff, len, wr_id);
+}
+static inline int xport_send(struct xport *x, struct xport_mr *mr, void *src, size_t len, uint64_t wr_id, int signaled)
+{
+    return x->ops->send(x, mr, src, len, wr_id, signaled);
+}
+static inline int xport_recv(struct xport *x, struct xport_mr *mr, void *dst, size_t len, uint64_t wr_id)
+{
+    return x->ops->recv(x, mr, dst, len, wr_id);
+}
+static inline int xport_poll(struct xport *x, struct xport_wc *wc, int max)
+{
+    return x->ops->poll(x, wc, max);
+}
+static inline void xport_close(struct xport *x)
+{
+    if (x->ops)
+        x->ops->close(x);
+}
@@ -0,0 +1,191 @@
+/**
+ * File: xport_rdma.c
+ * Purpose: RDMA verbs backend of the transport interface: one RC QP set up through rdma_cm.
+ *
+ * Notes:
+ *  - Every region is registered with remote READ/WRITE access, so any of them can be exposed.
+ *  - The send queue holds XPORT_RDMA_SQ WRs; workloads keep fewer than that in flight.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "rdma_builders.h"
+#include "rdma_cm_helpers.h"
+#include "rdma_ctx.h"
+#include "rdma_ops.h"
+#include "xport.h"
+
+#define XPORT_RDMA_SQ 512
+#define XPORT_RDMA_RQ 512
+
+struct rdma_impl
+{
+    rdma_ctx c;
+    struct rdma_cm_id *listen_id;
+};
+
+static rdma_ctx *ctx(struct xport *x)
+{
+    return &((struct rdma_impl *)x->impl)->c;
+}
+
+static int xr_open(struct xport *x)
+{
+    x->impl = calloc(1, sizeof(struct rdma_impl));
+    if (!x->impl)
+        return err_errno("calloc rdma xport");
+    return 0;
+}
+
+static int xr_listen(struct xport *x, const char *bind_ip, const char *port)
+{
+    struct rdma_impl *r = x->impl;
+    rdma_ctx *c = &r->c;
+    struct rdma_cm_event *ev = NULL;
+    if (cm_create_channel_and_id(c) || cm_server_listen(c, bind_ip, port))
+        return -1;
+    r->listen_id = c->id;
+    c->id = NULL;
+    if (cm_wait_event(c, RDMA_CM_EVENT_CONNECT_REQUEST, &ev))
+        return -1;
+    c->id = ev->id;
+    rdma_ack_cm_event(ev);
+    if (build_pd_cq_qp(c, IBV_QPT_RC, XPORT_RDMA_SQ + XPORT_RDMA_RQ, XPORT_RDMA_SQ, XPORT_RDMA_RQ, 1) ||
+        cm_server_accept_with_priv(c, NULL, 0) || cm_wait_event(c, RDMA_CM_EVENT_ESTABLISHED, &ev))
+        return -1;
+    rdma_ack_cm_event(ev);
+    return 0;
+}
+
+static int xr_connect(struct xport *x, const char *ip, const char *port)
+{
+    rdma_ctx *c = ctx(x);
+    uint8_t initiator_depth = 1;
+    uint8_t responder_resources = 1;
+    struct rdma_conn_param connp = {0};
+    if (cm_create_channel_and_id(c) || cm_client_resolve(c, ip, port, getenv("RDMA_SRC_IP")) ||
+        build_pd_cq_qp(c, IBV_QPT_RC, XPORT_RDMA_SQ + XPORT_RDMA_RQ, XPORT_RDMA_SQ, XPORT_RDMA_RQ, 1))
+        return -1;
+    cm_rd_atomic_defaults(c, &initiator_depth, &responder_resources);
+    if (cm_client_connect_only(c, initiator_depth, responder_resources) || cm_wait_connected(c, &connp))
+        return -1;
+    return 0;
+}
+
+static int xr_reg(struct xport *x, void *buf, size_t len, struct xport_mr *mr)
+{
+    struct ibv_mr *m =
+        ibv_reg_mr(ctx(x)->pd, buf, len, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+    if (!m)
+        return err_errno("ibv_reg_mr");
+    mr->addr = buf;
+    mr->len = len;
+    mr->key = m->rkey;
+    mr->priv = m;
+    return 0;
+}
+
+static void xr_dereg(struct xport *x, struct xport_mr *mr)
+{
+    (void)x;
+    if (mr->priv)
+        ibv_dereg_mr(mr->priv);
+    memset(mr, 0, sizeof(*mr));
+}
+
+static int xr_write(struct xport *x, struct xport_mr *mr, void *src, uint64_t roff, size_t len, uint64_t wr_id,
+                    int signaled)
+{
+    rdma_ctx *c = ctx(x);
+    return post_write(c->qp, mr->priv, src, x->remote_addr + roff, x->remote_key, len, wr_id, signaled);
+}
+
+static int xr_read(struct xport *x, struct xport_mr *mr, void *dst, uint64_t roff, size_t len, uint64_t wr_id)
+{
+    rdma_ctx *c = ctx(x);
+    return post_read(c->qp, mr->priv, dst, x->remote_addr + roff, x->remote_key, len, wr_id, 1);
+}
+
+static int xr_send(struct xport *x, struct xport_mr *mr, void *src, size_t len, uint64_t wr_id, int signaled)
+{
+    return post_send(ctx(x)->qp, mr->priv, src, len, wr_id, signaled);
+}
+
+static int xr_recv(struct xport *x, struct xport_mr *mr, void *dst, size_t len, uint64_t wr_id)
+{
+    return post_recv(ctx(x)->qp, mr->priv, dst, len, wr_id);
+}
+
+static int xr_poll(struct xport *x, struct xport_wc *wc, int max)
+{
+    struct ibv_wc wcs[32];
+    if (max > 32)
+        max = 32;
+    int n = ibv_poll_cq(ctx(x)->cq, max, wcs);
+    if (n < 0)
+        return err_errno("ibv_poll_cq");
+    for (int i = 0; i < n; i++)
+    {
+        wc[i].wr_id = wcs[i].wr_id;
+        wc[i].status = wcs[i].status == IBV_WC_SUCCESS ? 0 : (int)wcs[i].status;
+        wc[i].byte_len = wcs[i].byte_len;
+        switch (wcs[i].opcode)
+        {
+        case IBV_WC_RDMA_WRITE:
+            wc[i].op = XPORT_OP_WRITE;
+            break;
+        case IBV_WC_RDMA_READ:
+            wc[i].op = XPORT_OP_READ;
+            break;
+        case IBV_WC_SEND:
+            wc[i].op = XPORT_OP_SEND;
+            break;
+        default:
+            wc[i].op = XPORT_OP_RECV; // error CQEs carry no valid opcode either
+            break;
+        }
+        if (wc[i].status)
+            LOG_ERR("rdma xport: wr_id %llu: %s", (unsigned long long)wcs[i].wr_id, ibv_wc_status_str(wcs[i].status));
+    }
+    return n;
+}
+
+static void xr_close(struct xport *x)
+{
+    struct rdma_impl *r = x->impl;
+    if (!r)
+        return;
+    rdma_ctx *c = &r->c;
+    if (c->id && c->qp)
+        rdma_disconnect(c->id);
+    destroy_qp(c);
+    if (c->cq)
+        cq_ts_destroy(c->cq);
+    if (c->pd)
+        ibv_dealloc_pd(c->pd);
+    if (c->id)
+        rdma_destroy_id(c->id);
+    if (r->listen_id)
+        rdma_destroy_id(r->listen_id);
+    if (c->ec)
+        rdma_destroy_event_channel(c->ec);
+    free(r);
+    x->impl = NULL;
+}
+
+const struct xport_ops xport_rdma_ops = {
+    .name = "rdma",
+    .open = xr_open,
+    .listen = xr_listen,
+    .connect = xr_connect,
+    .reg = xr_reg,
+    .dereg = xr_dereg,
+    .write = xr_write,
+    .read = xr_read,
+    .send = xr_send,
+    .recv = xr_recv,
+    .poll = xr_poll,
+    .close = xr_close,
+};
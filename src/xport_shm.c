@@ -0,0 +1,393 @@
+/**
+ * File: xport_shm.c
+ * Purpose: In-process shared-memory backend of the transport interface.
+ *
+ * Overview:
+ * Both endpoints live in one process, usually on two threads. xport_listen() registers the port
+ * string as a name and blocks until xport_connect() with the same name pairs with it. Operations
+ * run at post time on the posting thread:
+ *  - WRITE/READ memcpy to or from the peer's exposed region and complete right away, already placed;
+ *  - SEND copies into the peer's oldest posted RECV, or queues a copy until a RECV is posted.
+ * No device and no network are involved. Rates therefore show the memory-copy ceiling and the
+ * CPU cost of the workload logic, and the backend runs transport tests on any machine.
+ *
+ * Notes:
+ *  - The two ends share a refcounted link and are freed when the second one closes, so a peer
+ *    that is still posting never touches freed state. Regions belong to the application: do not
+ *    free an exposed region while the peer may still access it.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "xport.h"
+
+#define SHM_CQ_DEPTH 4096
+#define SHM_RQ_DEPTH 1024
+#define SHM_MAX_LISTENERS 16
+#define SHM_CONNECT_TIMEOUT_S 5
+
+struct shm_msg
+{
+    struct shm_msg *next;
+    size_t len;
+    char data[];
+};
+
+struct shm_rbuf
+{
+    void *addr;
+    size_t len;
+    uint64_t wr_id;
+};
+
+struct shm_link;
+
+struct shm_end
+{
+    pthread_mutex_t lock; // everything below
+    struct xport *x;      // NULL once closed
+    struct shm_link *link;
+    int side;
+    struct xport_wc cq[SHM_CQ_DEPTH];
+    unsigned cq_head, cq_tail;
+    struct shm_rbuf rq[SHM_RQ_DEPTH];
+    unsigned rq_head, rq_tail;
+    struct shm_msg *inbox, *inbox_tail; // SENDs that arrived before a RECV
+    int peer_gone;
+    char name[64]; // while listening
+};
+
+struct shm_link
+{
+    struct shm_end *end[2];
+    int refs;
+};
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER; // listeners and link refcounts
+static pthread_cond_t g_paired = PTHREAD_COND_INITIALIZER;
+static struct shm_end *g_listeners[SHM_MAX_LISTENERS];
+
+static struct shm_end *peer_of(struct xport *x)
+{
+    struct shm_end *e = x->impl;
+    return e->link ? e->link->end[1 - e->side] : NULL;
+}
+
+// Caller holds e->lock.
+static int push_wc(struct shm_end *e, uint64_t wr_id, enum xport_op op, uint32_t byte_len)
+{
+    if (e->cq_tail - e->cq_head == SHM_CQ_DEPTH)
+        ERRF("shm xport: completion ring overrun");
+    e->cq[e->cq_tail++ % SHM_CQ_DEPTH] = (struct xport_wc){.wr_id = wr_id, .op = op, .byte_len = byte_len};
+    return 0;
+}
+
+static int complete(struct shm_end *e, uint64_t wr_id, enum xport_op op, uint32_t byte_len)
+{
+    pthread_mutex_lock(&e->lock);
+    int rc = push_wc(e, wr_id, op, byte_len);
+    pthread_mutex_unlock(&e->lock);
+    return rc;
+}
+
+// The peer's exposed region at [off, off + len), or NULL.
+static char *peer_region(struct xport *x, uint64_t off, size_t len)
+{
+    struct shm_end *p = peer_of(x);
+    char *at = NULL;
+    if (!p)
+        return NULL;
+    pthread_mutex_lock(&p->lock);
+    struct xport_mr *mr = p->x ? p->x->exposed : NULL;
+    if (mr && off <= mr->len && len <= mr->len - off)
+        at = (char *)mr->addr + off;
+    pthread_mutex_unlock(&p->lock);
+    if (!at)
+        LOG_ERR("shm xport: access [%llu, +%zu) outside the peer's region", (unsigned long long)off, len);
+    return at;
+}
+
+static int xs_open(struct xport *x)
+{
+    struct shm_end *e = calloc(1, sizeof(*e));
+    if (!e)
+        return err_errno("calloc shm xport");
+    pthread_mutex_init(&e->lock, NULL);
+    e->x = x;
+    x->impl = e;
+    return 0;
+}
+
+static int xs_listen(struct xport *x, const char *bind_ip, const char *port)
+{
+    (void)bind_ip;
+    struct shm_end *e = x->impl;
+    snprintf(e->name, sizeof(e->name), "%s", port);
+    pthread_mutex_lock(&g_lock);
+    int slot = -1;
+    for (int i = 0; i < SHM_MAX_LISTENERS; i++)
+    {
+        if (g_listeners[i] && strcmp(g_listeners[i]->name, e->name) == 0)
+        {
+            pthread_mutex_unlock(&g_lock);
+            ERRF("shm xport: '%s' already has a listener", e->name);
+        }
+        if (!g_listeners[i] && slot < 0)
+            slot = i;
+    }
+    if (slot < 0)
+    {
+        pthread_mutex_unlock(&g_lock);
+        ERRF("shm xport: more than %d listeners", SHM_MAX_LISTENERS);
+    }
+    g_listeners[slot] = e;
+    pthread_cond_broadcast(&g_paired);
+    while (!e->link)
+        pthread_cond_wait(&g_paired, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+    return 0;
+}
+
+static int xs_connect(struct xport *x, const char *ip, const char *port)
+{
+    (void)ip;
+    struct shm_end *e = x->impl;
+    struct shm_link *l = calloc(1, sizeof(*l));
+    if (!l)
+        return err_errno("calloc shm link");
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SHM_CONNECT_TIMEOUT_S;
+    pthread_mutex_lock(&g_lock);
+    for (;;)
+    {
+        // The listener may be a thread that has not reached xport_listen() yet.
+        for (int i = 0; i < SHM_MAX_LISTENERS; i++)
+        {
+            struct shm_end *s = g_listeners[i];
+            if (s && strcmp(s->name, port) == 0)
+            {
+                g_listeners[i] = NULL;
+                l->end[0] = s;
+                l->end[1] = e;
+                l->refs = 2;
+                s->side = 0;
+                e->side = 1;
+                s->link = l;
+                e->link = l;
+                pthread_cond_broadcast(&g_paired);
+                pthread_mutex_unlock(&g_lock);
+                return 0;
+            }
+        }
+        if (pthread_cond_timedwait(&g_paired, &g_lock, &deadline))
+            break;
+    }
+    pthread_mutex_unlock(&g_lock);
+    free(l);
+    ERRF("shm xport: nobody listening on '%s' in this process", port);
+}
+
+static int xs_reg(struct xport *x, void *buf, size_t len, struct xport_mr *mr)
+{
+    (void)x;
+    *mr = (struct xport_mr){.addr = buf, .len = len};
+    return 0;
+}
+
+static void xs_dereg(struct xport *x, struct xport_mr *mr)
+{
+    (void)x;
+    memset(mr, 0, sizeof(*mr));
+}
+
+static int xs_write(struct xport *x, struct xport_mr *mr, void *src, uint64_t roff, size_t len, uint64_t wr_id,
+                    int signaled)
+{
+    (void)mr;
+    char *dst = peer_region(x, roff, len);
+    if (!dst)
+        return -1;
+    memcpy(dst, src, len);
+    return signaled ? complete(x->impl, wr_id, XPORT_OP_WRITE, 0) : 0;
+}
+
+static int xs_read(struct xport *x, struct xport_mr *mr, void *dst, uint64_t roff, size_t len, uint64_t wr_id)
+{
+    (void)mr;
+    char *src = peer_region(x, roff, len);
+    if (!src)
+        return -1;
+    memcpy(dst, src, len);
+    return complete(x->impl, wr_id, XPORT_OP_READ, (uint32_t)len);
+}
+
+static int xs_send(struct xport *x, struct xport_mr *mr, void *src, size_t len, uint64_t wr_id, int signaled)
+{
+    (void)mr;
+    struct shm_end *p = peer_of(x);
+    if (!p)
+        ERRF("shm xport: not connected");
+    pthread_mutex_lock(&p->lock);
+    int rc = 0;
+    if (p->peer_gone || !p->x)
+    {
+        LOG_ERR("shm xport: peer closed");
+        rc = -1;
+    }
+    else if (p->rq_head != p->rq_tail)
+    {
+        struct shm_rbuf b = p->rq[p->rq_head++ % SHM_RQ_DEPTH];
+        if (len > b.len)
+        {
+            LOG_ERR("shm xport: %zu-byte SEND into a %zu-byte RECV", len, b.len);
+            rc = -1;
+        }
+        else
+        {
+            memcpy(b.addr, src, len);
+            rc = push_wc(p, b.wr_id, XPORT_OP_RECV, (uint32_t)len);
+        }
+    }
+    else
+    {
+        struct shm_msg *m = malloc(sizeof(*m) + len);
+        if (!m)
+            rc = err_errno("malloc shm message");
+        else
+        {
+            m->next = NULL;
+            m->len = len;
+            memcpy(m->data, src, len);
+            if (p->inbox_tail)
+                p->inbox_tail->next = m;
+            else
+                p->inbox = m;
+            p->inbox_tail = m;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (rc)
+        return rc;
+    return signaled ? complete(x->impl, wr_id, XPORT_OP_SEND, 0) : 0;
+}
+
+static int xs_recv(struct xport *x, struct xport_mr *mr, void *dst, size_t len, uint64_t wr_id)
+{
+    (void)mr;
+    struct shm_end *e = x->impl;
+    int rc = 0;
+    pthread_mutex_lock(&e->lock);
+    struct shm_msg *m = e->inbox;
+    if (m)
+    {
+        e->inbox = m->next;
+        if (!e->inbox)
+            e->inbox_tail = NULL;
+        if (m->len > len)
+        {
+            LOG_ERR("shm xport: %zu-byte SEND into a %zu-byte RECV", m->len, len);
+            rc = -1;
+        }
+        else
+        {
+            memcpy(dst, m->data, m->len);
+            rc = push_wc(e, wr_id, XPORT_OP_RECV, (uint32_t)m->len);
+        }
+        free(m);
+    }
+    else if (e->rq_tail - e->rq_head == SHM_RQ_DEPTH)
+    {
+        LOG_ERR("shm xport: receive queue full");
+        rc = -1;
+    }
+    else
+        e->rq[e->rq_tail++ % SHM_RQ_DEPTH] = (struct shm_rbuf){.addr = dst, .len = len, .wr_id = wr_id};
+    pthread_mutex_unlock(&e->lock);
+    return rc;
+}
+
+static int xs_poll(struct xport *x, struct xport_wc *wc, int max)
+{
+    struct shm_end *e = x->impl;
+    int n = 0;
+    pthread_mutex_lock(&e->lock);
+    while (n < max && e->cq_head != e->cq_tail)
+        wc[n++] = e->cq[e->cq_head++ % SHM_CQ_DEPTH];
+    // Like a flush on RDMA: posted RECVs can no longer complete.
+    if (n == 0 && e->peer_gone && e->rq_head != e->rq_tail)
+        n = -1;
+    pthread_mutex_unlock(&e->lock);
+    // Completions come from the peer's thread: let it run when a caller spins on an empty ring.
+    if (n == 0)
+        sched_yield();
+    return n;
+}
+
+static void free_end(struct shm_end *e)
+{
+    while (e->inbox)
+    {
+        struct shm_msg *m = e->inbox;
+        e->inbox = m->next;
+        free(m);
+    }
+    pthread_mutex_destroy(&e->lock);
+    free(e);
+}
+
+static void xs_close(struct xport *x)
+{
+    struct shm_end *e = x->impl;
+    if (!e)
+        return;
+    x->impl = NULL;
+    pthread_mutex_lock(&e->lock);
+    e->x = NULL;
+    pthread_mutex_unlock(&e->lock);
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < SHM_MAX_LISTENERS; i++)
+    {
+        if (g_listeners[i] == e)
+            g_listeners[i] = NULL;
+    }
+    struct shm_link *l = e->link;
+    if (!l)
+    {
+        pthread_mutex_unlock(&g_lock);
+        free_end(e);
+        return;
+    }
+    struct shm_end *p = l->end[1 - e->side];
+    pthread_mutex_lock(&p->lock);
+    p->peer_gone = 1;
+    pthread_mutex_unlock(&p->lock);
+    int last = --l->refs == 0;
+    pthread_mutex_unlock(&g_lock);
+    if (last)
+    {
+        free_end(l->end[0]);
+        free_end(l->end[1]);
+        free(l);
+    }
+}
+
+const struct xport_ops xport_shm_ops = {
+    .name = "shm",
+    .open = xs_open,
+    .listen = xs_listen,
+    .connect = xs_connect,
+    .reg = xs_reg,
+    .dereg = xs_dereg,
+    .write = xs_write,
+    .read = xs_read,
+    .send = xs_send,
+    .recv = xs_recv,
+    .poll = xs_poll,
+    .close = xs_close,
+};
@@ -0,0 +1,496 @@
+/**
+ * File: xport_tcp.c
+ * Purpose: TCP backend of the transport interface: RDMA-style operations framed over one socket.
+ *
+ * Overview:
+ * Every operation is a frame {op, len, off} followed by its payload. The poster sends WRITE, READ
+ * requests and SEND frames. A receive thread on each endpoint does what the NIC does for RDMA:
+ *  - places WRITE payloads straight into the exposed region (recv() into it, no bounce copy);
+ *  - answers READ requests with a READ_RESP frame read from the exposed region;
+ *  - receives READ_RESP payloads into the buffer of the oldest outstanding READ (TCP keeps order);
+ *  - matches SEND frames to posted RECVs and waits if none is posted (RNR).
+ * Completions go to a mutex-protected ring that xport_poll() drains.
+ *
+ * Notes:
+ *  - A WRITE/SEND completion means the bytes are queued in the socket, not placed (see xport.h).
+ *  - A signaled WRITE/SEND posted while READs are outstanding is held until those READs complete,
+ *    so completions still come out in posting order.
+ *  - The socket is shared by the poster and the receive thread (READ_RESP), so sends hold tx_lock.
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "common.h"
+#include "xport.h"
+
+#define TCP_CQ_DEPTH 4096
+#define TCP_RQ_DEPTH 1024
+
+enum tcp_frame_op
+{
+    TCP_F_WRITE = 1,
+    TCP_F_READ_REQ,
+    TCP_F_READ_RESP,
+    TCP_F_SEND
+};
+
+struct tcp_frame
+{
+    uint32_t op;
+    uint32_t len;
+    uint64_t off;
+} __attribute__((packed));
+
+struct tcp_buf
+{
+    void *addr;
+    size_t len;
+    uint64_t wr_id;
+};
+
+// A WRITE/SEND completion waiting for the READs posted before it.
+struct tcp_held
+{
+    uint64_t wr_id;
+    enum xport_op op;
+    unsigned after; // due once this many READs have completed (rd_tail when it was posted)
+};
+
+// Completions come from both the poster and the receive thread, so one mutex guards the rings.
+struct tcp_impl
+{
+    int fd;
+    pthread_t rx;
+    int rx_started;
+    pthread_mutex_t tx_lock;
+    pthread_mutex_t lock; // everything below
+    pthread_cond_t recv_posted;
+    struct xport_wc cq[TCP_CQ_DEPTH];
+    unsigned cq_head, cq_tail;
+    struct tcp_buf rq[TCP_RQ_DEPTH]; // posted RECVs
+    unsigned rq_head, rq_tail;
+    struct tcp_buf reads[TCP_RQ_DEPTH]; // outstanding READs, in request order
+    unsigned rd_head, rd_tail;
+    unsigned rd_done; // READs completed
+    struct tcp_held held[TCP_CQ_DEPTH];
+    unsigned held_head, held_tail;
+    int failed;
+    int closing;
+};
+
+static int send_all(int fd, const struct iovec *iov_in, int iovcnt)
+{
+    struct iovec iov[2];
+    memcpy(iov, iov_in, (size_t)iovcnt * sizeof(*iov));
+    struct iovec *v = iov;
+    while (iovcnt > 0)
+    {
+        struct msghdr msg = {.msg_iov = v, .msg_iovlen = (size_t)iovcnt};
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return err_errno("tcp xport send");
+        while (iovcnt > 0 && (size_t)n >= v->iov_len)
+        {
+            n -= (ssize_t)v->iov_len;
+            v++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            v->iov_base = (char *)v->iov_base + n;
+            v->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+// 1 on orderly EOF before the first byte, 0 when len bytes arrived, -1 on error.
+static int recv_all(int fd, void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = recv(fd, (char *)buf + done, len - done, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return err_errno("tcp xport recv");
+        if (n == 0)
+        {
+            if (done == 0)
+                return 1;
+            ERRF("tcp xport: peer closed mid-frame");
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+static int send_frame(struct tcp_impl *t, uint32_t op, uint64_t off, const void *payload, size_t len)
+{
+    struct tcp_frame f = {.op = htonl(op), .len = htonl((uint32_t)len), .off = htonll_u64(off)};
+    struct iovec iov[2] = {{.iov_base = &f, .iov_len = sizeof(f)}, {.iov_base = (void *)payload, .iov_len = len}};
+    pthread_mutex_lock(&t->tx_lock);
+    int rc = send_all(t->fd, iov, payload && len ? 2 : 1);
+    pthread_mutex_unlock(&t->tx_lock);
+    return rc;
+}
+
+// Caller holds t->lock.
+static int push_wc(struct tcp_impl *t, uint64_t wr_id, enum xport_op op, uint32_t byte_len)
+{
+    if (t->cq_tail - t->cq_head == TCP_CQ_DEPTH)
+        ERRF("tcp xport: completion ring overrun");
+    t->cq[t->cq_tail++ % TCP_CQ_DEPTH] = (struct xport_wc){.wr_id = wr_id, .op = op, .byte_len = byte_len};
+    return 0;
+}
+
+static int complete(struct tcp_impl *t, uint64_t wr_id, enum xport_op op, uint32_t byte_len)
+{
+    pthread_mutex_lock(&t->lock);
+    int rc = push_wc(t, wr_id, op, byte_len);
+    pthread_mutex_unlock(&t->lock);
+    return rc;
+}
+
+// A signaled WRITE/SEND is done once its bytes are queued, but an RC QP completes it only after the READs
+// posted before it: hold it behind them.
+static int complete_in_order(struct tcp_impl *t, uint64_t wr_id, enum xport_op op)
+{
+    pthread_mutex_lock(&t->lock);
+    int rc = 0;
+    if (t->rd_done == t->rd_tail && t->held_head == t->held_tail)
+        rc = push_wc(t, wr_id, op, 0);
+    else if (t->held_tail - t->held_head == TCP_CQ_DEPTH)
+    {
+        LOG_ERR("tcp xport: completion ring overrun");
+        rc = -1;
+    }
+    else
+        t->held[t->held_tail++ % TCP_CQ_DEPTH] = (struct tcp_held){.wr_id = wr_id, .op = op, .after = t->rd_tail};
+    pthread_mutex_unlock(&t->lock);
+    return rc;
+}
+
+// The oldest READ is done: complete it, then whatever was held only behind it.
+static int complete_read(struct tcp_impl *t, uint64_t wr_id, uint32_t len)
+{
+    pthread_mutex_lock(&t->lock);
+    int rc = push_wc(t, wr_id, XPORT_OP_READ, len);
+    t->rd_done++;
+    while (!rc && t->held_head != t->held_tail && (int)(t->rd_done - t->held[t->held_head % TCP_CQ_DEPTH].after) >= 0)
+    {
+        struct tcp_held h = t->held[t->held_head++ % TCP_CQ_DEPTH];
+        rc = push_wc(t, h.wr_id, h.op, 0);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return rc;
+}
+
+// Where an incoming WRITE or READ request may touch the exposed region; NULL if out of bounds.
+static char *exposed_at(struct xport *x, uint64_t off, uint32_t len)
+{
+    // xport_expose() set this before its descriptor went out, and the peer only accesses after receiving it.
+    struct xport_mr *mr = x->exposed;
+    if (!mr || off > mr->len || len > mr->len - off)
+    {
+        LOG_ERR("tcp xport: access [%llu, +%u) outside the exposed region", (unsigned long long)off, len);
+        return NULL;
+    }
+    return (char *)mr->addr + off;
+}
+
+static int rx_frame(struct xport *x, const struct tcp_frame *f)
+{
+    struct tcp_impl *t = x->impl;
+    uint32_t op = ntohl(f->op);
+    uint32_t len = ntohl(f->len);
+    uint64_t off = ntohll_u64(f->off);
+    char *p;
+    struct tcp_buf b;
+    switch (op)
+    {
+    case TCP_F_WRITE:
+        if (!(p = exposed_at(x, off, len)))
+            return -1;
+        return recv_all(t->fd, p, len) ? -1 : 0;
+    case TCP_F_READ_REQ:
+        if (!(p = exposed_at(x, off, len)))
+            return -1;
+        return send_frame(t, TCP_F_READ_RESP, off, p, len);
+    case TCP_F_READ_RESP:
+        pthread_mutex_lock(&t->lock);
+        if (t->rd_head == t->rd_tail)
+        {
+            pthread_mutex_unlock(&t->lock);
+            ERRF("tcp xport: READ response without a request");
+        }
+        b = t->reads[t->rd_head++ % TCP_RQ_DEPTH];
+        pthread_mutex_unlock(&t->lock);
+        if (len != b.len || recv_all(t->fd, b.addr, len))
+            return -1;
+        return complete_read(t, b.wr_id, len);
+    case TCP_F_SEND:
+        pthread_mutex_lock(&t->lock);
+        while (t->rq_head == t->rq_tail && !t->closing)
+            pthread_cond_wait(&t->recv_posted, &t->lock); // RNR: hold the stream until a RECV is posted
+        if (t->closing)
+        {
+            pthread_mutex_unlock(&t->lock);
+            return -1;
+        }
+        b = t->rq[t->rq_head++ % TCP_RQ_DEPTH];
+        pthread_mutex_unlock(&t->lock);
+        if (len > b.len)
+            ERRF("tcp xport: %u-byte SEND into a %zu-byte RECV", len, b.len);
+        if (recv_all(t->fd, b.addr, len))
+            return -1;
+        return complete(t, b.wr_id, XPORT_OP_RECV, len);
+    default:
+        ERRF("tcp xport: bad frame op %u", op);
+    }
+}
+
+static void *rx_thread(void *arg)
+{
+    struct xport *x = arg;
+    struct tcp_impl *t = x->impl;
+    for (;;)
+    {
+        struct tcp_frame f;
+        int rc = recv_all(t->fd, &f, sizeof(f));
+        if (rc == 1)
+            break; // peer closed
+        if (rc || rx_frame(x, &f))
+        {
+            pthread_mutex_lock(&t->lock);
+            if (!t->closing)
+                t->failed = 1;
+            pthread_mutex_unlock(&t->lock);
+            break;
+        }
+    }
+    pthread_mutex_lock(&t->lock);
+    // Like a flush on RDMA: nothing still posted can complete any more.
+    if (t->rd_head != t->rd_tail || t->rq_head != t->rq_tail)
+        t->failed = 1;
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static int tcp_open(struct xport *x)
+{
+    struct tcp_impl *t = calloc(1, sizeof(*t));
+    if (!t)
+        return err_errno("calloc tcp xport");
+    t->fd = -1;
+    pthread_mutex_init(&t->tx_lock, NULL);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->recv_posted, NULL);
+    x->impl = t;
+    return 0;
+}
+
+static int start(struct xport *x, int fd)
+{
+    struct tcp_impl *t = x->impl;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    t->fd = fd;
+    if (pthread_create(&t->rx, NULL, rx_thread, x))
+        ERRF("tcp xport: pthread_create failed");
+    t->rx_started = 1;
+    return 0;
+}
+
+static int tcp_listen(struct xport *x, const char *bind_ip, const char *port)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE};
+    struct addrinfo *res = NULL;
+    int rc = getaddrinfo(bind_ip, port, &hints, &res);
+    if (rc)
+        ERRF("getaddrinfo %s:%s: %s", bind_ip ? bind_ip : "*", port, gai_strerror(rc));
+    int lfd = socket(res->ai_family, SOCK_STREAM, 0);
+    int one = 1;
+    if (lfd < 0)
+    {
+        freeaddrinfo(res);
+        return err_errno("socket");
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lfd, res->ai_addr, res->ai_addrlen) || listen(lfd, 1))
+    {
+        err_errno("bind/listen");
+        freeaddrinfo(res);
+        close(lfd);
+        return -1;
+    }
+    freeaddrinfo(res);
+    int fd = accept(lfd, NULL, NULL);
+    close(lfd);
+    if (fd < 0)
+        return err_errno("accept");
+    return start(x, fd);
+}
+
+static int tcp_connect(struct xport *x, const char *ip, const char *port)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    int rc = getaddrinfo(ip, port, &hints, &res);
+    if (rc)
+        ERRF("getaddrinfo %s:%s: %s", ip, port, gai_strerror(rc));
+    int fd = -1;
+    for (struct addrinfo *a = res; a; a = a->ai_next)
+    {
+        fd = socket(a->ai_family, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+            break;
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        return err_errno("connect");
+    return start(x, fd);
+}
+
+static int tcp_reg(struct xport *x, void *buf, size_t len, struct xport_mr *mr)
+{
+    (void)x;
+    *mr = (struct xport_mr){.addr = buf, .len = len};
+    return 0;
+}
+
+static void tcp_dereg(struct xport *x, struct xport_mr *mr)
+{
+    (void)x;
+    memset(mr, 0, sizeof(*mr));
+}
+
+// Refuse at post time what the peer would reject, instead of losing the connection over it.
+static int remote_ok(struct xport *x, uint64_t off, size_t len)
+{
+    if (off > x->remote_len || len > x->remote_len - off)
+        ERRF("tcp xport: [%llu, +%zu) is outside the peer's region", (unsigned long long)off, len);
+    return 0;
+}
+
+static int tcp_write(struct xport *x, struct xport_mr *mr, void *src, uint64_t roff, size_t len, uint64_t wr_id,
+                     int signaled)
+{
+    (void)mr;
+    struct tcp_impl *t = x->impl;
+    if (remote_ok(x, roff, len))
+        return -1;
+    if (send_frame(t, TCP_F_WRITE, roff, src, len))
+        return -1;
+    return signaled ? complete_in_order(t, wr_id, XPORT_OP_WRITE) : 0;
+}
+
+static int tcp_read(struct xport *x, struct xport_mr *mr, void *dst, uint64_t roff, size_t len, uint64_t wr_id)
+{
+    (void)mr;
+    struct tcp_impl *t = x->impl;
+    if (remote_ok(x, roff, len))
+        return -1;
+    pthread_mutex_lock(&t->lock);
+    if (t->rd_tail - t->rd_head == TCP_RQ_DEPTH)
+    {
+        pthread_mutex_unlock(&t->lock);
+        ERRF("tcp xport: too many READs outstanding");
+    }
+    // Queued before the request leaves, so the response always finds it.
+    t->reads[t->rd_tail++ % TCP_RQ_DEPTH] = (struct tcp_buf){.addr = dst, .len = len, .wr_id = wr_id};
+    pthread_mutex_unlock(&t->lock);
+    return send_frame(t, TCP_F_READ_REQ, roff, NULL, len);
+}
+
+static int tcp_send(struct xport *x, struct xport_mr *mr, void *src, size_t len, uint64_t wr_id, int signaled)
+{
+    (void)mr;
+    struct tcp_impl *t = x->impl;
+    if (send_frame(t, TCP_F_SEND, 0, src, len))
+        return -1;
+    return signaled ? complete_in_order(t, wr_id, XPORT_OP_SEND) : 0;
+}
+
+static int tcp_recv(struct xport *x, struct xport_mr *mr, void *dst, size_t len, uint64_t wr_id)
+{
+    (void)mr;
+    struct tcp_impl *t = x->impl;
+    pthread_mutex_lock(&t->lock);
+    if (t->rq_tail - t->rq_head == TCP_RQ_DEPTH)
+    {
+        pthread_mutex_unlock(&t->lock);
+        ERRF("tcp xport: receive queue full");
+    }
+    t->rq[t->rq_tail++ % TCP_RQ_DEPTH] = (struct tcp_buf){.addr = dst, .len = len, .wr_id = wr_id};
+    pthread_cond_signal(&t->recv_posted);
+    pthread_mutex_unlock(&t->lock);
+    return 0;
+}
+
+static int tcp_poll(struct xport *x, struct xport_wc *wc, int max)
+{
+    struct tcp_impl *t = x->impl;
+    int n = 0;
+    pthread_mutex_lock(&t->lock);
+    while (n < max && t->cq_head != t->cq_tail)
+        wc[n++] = t->cq[t->cq_head++ % TCP_CQ_DEPTH];
+    if (n == 0 && t->failed)
+        n = -1;
+    pthread_mutex_unlock(&t->lock);
+    // Completions come from the rx thread: let it run when a caller spins on an empty ring.
+    if (n == 0)
+        sched_yield();
+    return n;
+}
+
+static void tcp_close(struct xport *x)
+{
+    struct tcp_impl *t = x->impl;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->closing = 1;
+    pthread_cond_broadcast(&t->recv_posted);
+    pthread_mutex_unlock(&t->lock);
+    if (t->fd >= 0)
+        shutdown(t->fd, SHUT_RDWR);
+    if (t->rx_started)
+        pthread_join(t->rx, NULL);
+    if (t->fd >= 0)
+        close(t->fd);
+    pthread_cond_destroy(&t->recv_posted);
+    pthread_mutex_destroy(&t->lock);
+    pthread_mutex_destroy(&t->tx_lock);
+    free(t);
+    x->impl = NULL;
+}
+
+const struct xport_ops xport_tcp_ops = {
+    .name = "tcp",
+    .open = tcp_open,
+    .listen = tcp_listen,
+    .connect = tcp_connect,
+    .reg = tcp_reg,
+    .dereg = tcp_dereg,
+    .write = tcp_write,
+    .read = tcp_read,
+    .send = tcp_send,
+    .recv = tcp_recv,
+    .poll = tcp_poll,
+    .close = tcp_close,
+};
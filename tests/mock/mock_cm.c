@@ -0,0 +1,516 @@
+/**
+ * File: mock_cm.c
+ * Purpose: rdma_cm half of the loopback mock (see mock_verbs.h): event channels and the connection handshake.
+ *
+ * Overview:
+ * Each event channel is a queue plus a pipe that carries one byte per queued event, so a blocking
+ * rdma_get_cm_event() sleeps in read() and an O_NONBLOCK channel reports EAGAIN as librdmacm does.
+ * Every address resolves to mock0. A listener is found by port alone. The requester's CM calls
+ * queue their events on the peer's channel at once, so both sides may run on a single thread as
+ * long as each side waits only after the other has acted.
+ *
+ *   rdma_connect   -> CONNECT_REQUEST on the listener (new child id carrying the private data)
+ *   rdma_accept    -> ESTABLISHED on both, or CONNECT_RESPONSE on the client if its QP is
+ *                     user-managed (ESTABLISHED on the server then waits for rdma_establish)
+ *   rdma_reject    -> REJECTED on the client (status 28, consumer reject)
+ *   rdma_disconnect-> both QPs to ERR (flushing posted WRs), DISCONNECTED on both
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rdma/rdma_cma.h>
+
+#include "mock_verbs.h"
+
+#define MOCK_MAX_LISTENERS 64
+
+struct mock_event
+{
+    struct rdma_cm_event ev; // first: the application gets &ev back in rdma_ack_cm_event
+    struct mock_event *next;
+    uint8_t priv[UINT8_MAX]; // private_data_len is a uint8_t
+};
+
+struct mock_channel
+{
+    struct rdma_event_channel ch;
+    int wfd;
+    struct mock_event *head, *tail;
+};
+
+struct mock_id
+{
+    struct rdma_cm_id id;
+    struct mock_id *peer;        // the other end once connecting
+    uint32_t peer_qpn;           // requester's QPN, as the child sees it
+    uint32_t user_qpn;           // QPN from conn_param when no QP is attached to the id
+    int listening, connected, disconnected, user_qp;
+};
+
+static struct mock_id *g_listeners[MOCK_MAX_LISTENERS];
+
+static struct mock_id *mid(struct rdma_cm_id *id)
+{
+    return (struct mock_id *)id;
+}
+
+static uint16_t port_of(const struct sockaddr *sa)
+{
+    return ntohs(((const struct sockaddr_in *)sa)->sin_port);
+}
+
+static uint32_t qpn_of(struct mock_id *m)
+{
+    return m->id.qp ? m->id.qp->qp_num : m->user_qpn;
+}
+
+// Caller holds mock_lock.
+static void push_event(struct mock_id *to, enum rdma_cm_event_type type, int status, struct rdma_cm_id *listen_id,
+                       const struct rdma_conn_param *conn)
+{
+    struct mock_channel *ch = (struct mock_channel *)to->id.channel;
+    struct mock_event *e = calloc(1, sizeof(*e));
+    if (!e)
+        return;
+    e->ev.id = &to->id;
+    e->ev.listen_id = listen_id;
+    e->ev.event = type;
+    e->ev.status = status;
+    if (conn)
+    {
+        e->ev.param.conn = *conn;
+        if (conn->private_data && conn->private_data_len)
+            memcpy(e->priv, conn->private_data, conn->private_data_len);
+        e->ev.param.conn.private_data = e->priv;
+    }
+    if (ch->tail)
+        ch->tail->next = e;
+    else
+        ch->head = e;
+    ch->tail = e;
+    // The pipe holds 64 Ki events; a full pipe means nobody reads this channel.
+    char b = 0;
+    (void)!write(ch->wfd, &b, 1);
+}
+
+struct rdma_event_channel *rdma_create_event_channel(void)
+{
+    int fds[2];
+    struct mock_channel *ch = calloc(1, sizeof(*ch));
+    if (!ch)
+        return NULL;
+    if (pipe(fds))
+    {
+        free(ch);
+        return NULL;
+    }
+    ch->ch.fd = fds[0];
+    ch->wfd = fds[1];
+    pthread_mutex_lock(&mock_lock);
+    mock_stats.channels++;
+    pthread_mutex_unlock(&mock_lock);
+    return &ch->ch;
+}
+
+void rdma_destroy_event_channel(struct rdma_event_channel *channel)
+{
+    struct mock_channel *ch = (struct mock_channel *)channel;
+    pthread_mutex_lock(&mock_lock);
+    while (ch->head)
+    {
+        struct mock_event *e = ch->head;
+        ch->head = e->next;
+        free(e);
+    }
+    mock_stats.channels--;
+    pthread_mutex_unlock(&mock_lock);
+    close(ch->ch.fd);
+    close(ch->wfd);
+    free(ch);
+}
+
+int rdma_get_cm_event(struct rdma_event_channel *channel, struct rdma_cm_event **event)
+{
+    struct mock_channel *ch = (struct mock_channel *)channel;
+    char b;
+    ssize_t n;
+    while ((n = read(ch->ch.fd, &b, 1)) < 0 && errno == EINTR)
+        ;
+    if (n != 1)
+        return -1; // errno from read(): EAGAIN on an O_NONBLOCK channel
+    pthread_mutex_lock(&mock_lock);
+    struct mock_event *e = ch->head;
+    ch->head = e->next;
+    if (!ch->head)
+        ch->tail = NULL;
+    pthread_mutex_unlock(&mock_lock);
+    *event = &e->ev;
+    return 0;
+}
+
+int rdma_ack_cm_event(struct rdma_cm_event *event)
+{
+    free(event); // ev is the first member of struct mock_event
+    return 0;
+}
+
+int rdma_create_id(struct rdma_event_channel *channel, struct rdma_cm_id **id, void *context, enum rdma_port_space ps)
+{
+    if (ps != RDMA_PS_TCP)
+    {
+        errno = EOPNOTSUPP; // UD ids (RDMA_PS_UDP) are not modelled
+        return -1;
+    }
+    struct mock_id *m = calloc(1, sizeof(*m));
+    if (!m)
+        return -1;
+    m->id.channel = channel;
+    m->id.context = context;
+    m->id.ps = ps;
+    m->id.qp_type = IBV_QPT_RC;
+    pthread_mutex_lock(&mock_lock);
+    mock_stats.ids++;
+    pthread_mutex_unlock(&mock_lock);
+    *id = &m->id;
+    return 0;
+}
+
+int rdma_destroy_id(struct rdma_cm_id *id)
+{
+    struct mock_id *m = mid(id);
+    pthread_mutex_lock(&mock_lock);
+    for (int i = 0; i < MOCK_MAX_LISTENERS; i++)
+    {
+        if (g_listeners[i] == m)
+            g_listeners[i] = NULL;
+    }
+    if (m->peer)
+        m->peer->peer = NULL;
+    // Queued events may still name this id; applications drain their channel before destroying ids.
+    mock_stats.ids--;
+    pthread_mutex_unlock(&mock_lock);
+    free(m);
+    return 0;
+}
+
+int rdma_migrate_id(struct rdma_cm_id *id, struct rdma_event_channel *channel)
+{
+    pthread_mutex_lock(&mock_lock);
+    id->channel = channel;
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_bind_addr(struct rdma_cm_id *id, struct sockaddr *addr)
+{
+    pthread_mutex_lock(&mock_lock);
+    memcpy(&id->route.addr.src_storage, addr, addr->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                                                          : sizeof(struct sockaddr_in));
+    id->verbs = &mock_ctx;
+    id->port_num = 1;
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_listen(struct rdma_cm_id *id, int backlog)
+{
+    (void)backlog;
+    struct mock_id *m = mid(id);
+    uint16_t port = port_of(&id->route.addr.src_addr);
+    int rc = -1;
+    pthread_mutex_lock(&mock_lock);
+    errno = EADDRINUSE;
+    for (int i = 0; i < MOCK_MAX_LISTENERS; i++)
+    {
+        if (g_listeners[i] && port_of(&g_listeners[i]->id.route.addr.src_addr) == port)
+            goto out;
+    }
+    errno = ENOMEM;
+    for (int i = 0; i < MOCK_MAX_LISTENERS; i++)
+    {
+        if (!g_listeners[i])
+        {
+            g_listeners[i] = m;
+            m->listening = 1;
+            rc = 0;
+            break;
+        }
+    }
+out:
+    pthread_mutex_unlock(&mock_lock);
+    return rc;
+}
+
+int rdma_resolve_addr(struct rdma_cm_id *id, struct sockaddr *src_addr, struct sockaddr *dst_addr, int timeout_ms)
+{
+    (void)timeout_ms;
+    pthread_mutex_lock(&mock_lock);
+    memcpy(&id->route.addr.dst_storage, dst_addr, sizeof(struct sockaddr_in));
+    if (src_addr)
+        memcpy(&id->route.addr.src_storage, src_addr, sizeof(struct sockaddr_in));
+    else
+    {
+        struct sockaddr_in *sin = &id->route.addr.src_sin;
+        sin->sin_family = AF_INET;
+        sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    id->verbs = &mock_ctx;
+    id->port_num = 1;
+    push_event(mid(id), RDMA_CM_EVENT_ADDR_RESOLVED, 0, NULL, NULL);
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_resolve_route(struct rdma_cm_id *id, int timeout_ms)
+{
+    (void)timeout_ms;
+    pthread_mutex_lock(&mock_lock);
+    push_event(mid(id), RDMA_CM_EVENT_ROUTE_RESOLVED, 0, NULL, NULL);
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_set_option(struct rdma_cm_id *id, int level, int optname, void *optval, size_t optlen)
+{
+    (void)optval;
+    (void)optlen;
+    // An injected path resolves the route just like rdma_resolve_route.
+    if (level == RDMA_OPTION_IB && optname == RDMA_OPTION_IB_PATH)
+        return rdma_resolve_route(id, 0);
+    return 0;
+}
+
+int rdma_create_qp(struct rdma_cm_id *id, struct ibv_pd *pd, struct ibv_qp_init_attr *qp_init_attr)
+{
+    struct ibv_qp *qp = ibv_create_qp(pd, qp_init_attr);
+    if (!qp)
+        return -1;
+    pthread_mutex_lock(&mock_lock);
+    mock_qp_set_state(qp, IBV_QPS_INIT);
+    id->qp = qp;
+    id->pd = pd;
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+void rdma_destroy_qp(struct rdma_cm_id *id)
+{
+    if (!id->qp)
+        return;
+    ibv_destroy_qp(id->qp);
+    id->qp = NULL;
+}
+
+int rdma_connect(struct rdma_cm_id *id, struct rdma_conn_param *conn_param)
+{
+    struct mock_id *m = mid(id), *l = NULL;
+    uint16_t port = port_of(&id->route.addr.dst_addr);
+    pthread_mutex_lock(&mock_lock);
+    for (int i = 0; i < MOCK_MAX_LISTENERS && !l; i++)
+    {
+        if (g_listeners[i] && port_of(&g_listeners[i]->id.route.addr.src_addr) == port)
+            l = g_listeners[i];
+    }
+    m->user_qp = !id->qp;
+    m->user_qpn = conn_param ? conn_param->qp_num : 0;
+    if (!l)
+    {
+        // RoCE reports a missing listener as a reject from the remote CM.
+        push_event(m, RDMA_CM_EVENT_REJECTED, 8, NULL, NULL);
+        pthread_mutex_unlock(&mock_lock);
+        return 0;
+    }
+    struct mock_id *child = calloc(1, sizeof(*child));
+    if (!child)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        errno = ENOMEM;
+        return -1;
+    }
+    child->id.channel = l->id.channel;
+    child->id.context = l->id.context;
+    child->id.verbs = &mock_ctx;
+    child->id.ps = l->id.ps;
+    child->id.qp_type = IBV_QPT_RC;
+    child->id.port_num = 1;
+    child->id.route.addr.src_storage = id->route.addr.dst_storage;
+    child->id.route.addr.dst_storage = id->route.addr.src_storage;
+    child->peer = m;
+    child->peer_qpn = qpn_of(m);
+    m->peer = child;
+    mock_stats.ids++;
+    struct rdma_conn_param req = conn_param ? *conn_param : (struct rdma_conn_param){0};
+    req.qp_num = child->peer_qpn;
+    push_event(child, RDMA_CM_EVENT_CONNECT_REQUEST, 0, &l->id, &req);
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_accept(struct rdma_cm_id *id, struct rdma_conn_param *conn_param)
+{
+    struct mock_id *m = mid(id), *c;
+    pthread_mutex_lock(&mock_lock);
+    c = m->peer;
+    if (!c)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        errno = ENOTCONN;
+        return -1;
+    }
+    m->user_qp = !id->qp;
+    m->user_qpn = conn_param ? conn_param->qp_num : 0;
+    struct ibv_qp *sqp = mock_qp_lookup(qpn_of(m)), *cqp = mock_qp_lookup(m->peer_qpn);
+    // QPs the CM owns are connected and moved to RTS here; user-managed ones go through ibv_modify_qp.
+    if (sqp && !m->user_qp)
+    {
+        mock_qp_connect(sqp, m->peer_qpn);
+        mock_qp_set_state(sqp, IBV_QPS_RTS);
+    }
+    if (cqp && !c->user_qp)
+    {
+        mock_qp_connect(cqp, qpn_of(m));
+        mock_qp_set_state(cqp, IBV_QPS_RTS);
+    }
+    struct rdma_conn_param rep = conn_param ? *conn_param : (struct rdma_conn_param){0};
+    rep.qp_num = qpn_of(m);
+    c->peer_qpn = qpn_of(m);
+    if (c->user_qp)
+        push_event(c, RDMA_CM_EVENT_CONNECT_RESPONSE, 0, NULL, &rep);
+    else
+    {
+        m->connected = c->connected = 1;
+        push_event(c, RDMA_CM_EVENT_ESTABLISHED, 0, NULL, &rep);
+        push_event(m, RDMA_CM_EVENT_ESTABLISHED, 0, NULL, NULL);
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_establish(struct rdma_cm_id *id)
+{
+    struct mock_id *m = mid(id);
+    pthread_mutex_lock(&mock_lock);
+    if (!m->peer)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        errno = ENOTCONN;
+        return -1;
+    }
+    m->connected = m->peer->connected = 1;
+    push_event(m->peer, RDMA_CM_EVENT_ESTABLISHED, 0, NULL, NULL);
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_init_qp_attr(struct rdma_cm_id *id, struct ibv_qp_attr *qp_attr, int *qp_attr_mask)
+{
+    struct mock_id *m = mid(id);
+    pthread_mutex_lock(&mock_lock);
+    // The requester learns the responder's QPN from the REP; the responder knows it from the REQ.
+    uint32_t dest = m->peer_qpn;
+    pthread_mutex_unlock(&mock_lock);
+    *qp_attr_mask = IBV_QP_STATE;
+    switch (qp_attr->qp_state)
+    {
+    case IBV_QPS_INIT:
+        qp_attr->port_num = 1;
+        qp_attr->pkey_index = 0;
+        qp_attr->qp_access_flags = IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC;
+        *qp_attr_mask |= IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS;
+        break;
+    case IBV_QPS_RTR:
+        qp_attr->path_mtu = IBV_MTU_4096;
+        qp_attr->dest_qp_num = dest;
+        qp_attr->rq_psn = 0;
+        qp_attr->max_dest_rd_atomic = 16;
+        qp_attr->min_rnr_timer = 12;
+        *qp_attr_mask |= IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN | IBV_QP_RQ_PSN | IBV_QP_MAX_DEST_RD_ATOMIC |
+                         IBV_QP_MIN_RNR_TIMER;
+        break;
+    case IBV_QPS_RTS:
+        qp_attr->timeout = 14;
+        qp_attr->retry_cnt = 7;
+        qp_attr->rnr_retry = 7;
+        qp_attr->sq_psn = 0;
+        qp_attr->max_rd_atomic = 16;
+        *qp_attr_mask |= IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT | IBV_QP_RNR_RETRY | IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+int rdma_reject(struct rdma_cm_id *id, const void *private_data, uint8_t private_data_len)
+{
+    struct mock_id *m = mid(id);
+    pthread_mutex_lock(&mock_lock);
+    if (m->peer)
+    {
+        struct rdma_conn_param p = {.private_data = private_data, .private_data_len = private_data_len};
+        push_event(m->peer, RDMA_CM_EVENT_REJECTED, 28, NULL, &p);
+        m->peer->peer = NULL;
+        m->peer = NULL;
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int rdma_disconnect(struct rdma_cm_id *id)
+{
+    struct mock_id *m = mid(id);
+    pthread_mutex_lock(&mock_lock);
+    struct mock_id *ends[2] = {m, m->peer};
+    for (int i = 0; i < 2; i++)
+    {
+        struct mock_id *e = ends[i];
+        if (!e || !e->connected || e->disconnected)
+            continue;
+        e->disconnected = 1;
+        struct ibv_qp *qp = mock_qp_lookup(qpn_of(e));
+        if (qp)
+            mock_qp_set_state(qp, IBV_QPS_ERR);
+        push_event(e, RDMA_CM_EVENT_DISCONNECTED, 0, NULL, NULL);
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+const char *rdma_event_str(enum rdma_cm_event_type event)
+{
+    static const char *const names[] = {
+        [RDMA_CM_EVENT_ADDR_RESOLVED] = "RDMA_CM_EVENT_ADDR_RESOLVED",
+        [RDMA_CM_EVENT_ADDR_ERROR] = "RDMA_CM_EVENT_ADDR_ERROR",
+        [RDMA_CM_EVENT_ROUTE_RESOLVED] = "RDMA_CM_EVENT_ROUTE_RESOLVED",
+        [RDMA_CM_EVENT_ROUTE_ERROR] = "RDMA_CM_EVENT_ROUTE_ERROR",
+        [RDMA_CM_EVENT_CONNECT_REQUEST] = "RDMA_CM_EVENT_CONNECT_REQUEST",
+        [RDMA_CM_EVENT_CONNECT_RESPONSE] = "RDMA_CM_EVENT_CONNECT_RESPONSE",
+        [RDMA_CM_EVENT_CONNECT_ERROR] = "RDMA_CM_EVENT_CONNECT_ERROR",
+        [RDMA_CM_EVENT_UNREACHABLE] = "RDMA_CM_EVENT_UNREACHABLE",
+        [RDMA_CM_EVENT_REJECTED] = "RDMA_CM_EVENT_REJECTED",
+        [RDMA_CM_EVENT_ESTABLISHED] = "RDMA_CM_EVENT_ESTABLISHED",
+        [RDMA_CM_EVENT_DISCONNECTED] = "RDMA_CM_EVENT_DISCONNECTED",
+        [RDMA_CM_EVENT_DEVICE_REMOVAL] = "RDMA_CM_EVENT_DEVICE_REMOVAL",
+        [RDMA_CM_EVENT_MULTICAST_JOIN] = "RDMA_CM_EVENT_MULTICAST_JOIN",
+        [RDMA_CM_EVENT_MULTICAST_ERROR] = "RDMA_CM_EVENT_MULTICAST_ERROR",
+        [RDMA_CM_EVENT_ADDR_CHANGE] = "RDMA_CM_EVENT_ADDR_CHANGE",
+        [RDMA_CM_EVENT_TIMEWAIT_EXIT] = "RDMA_CM_EVENT_TIMEWAIT_EXIT",
+    };
+    if ((unsigned)event < sizeof(names) / sizeof(names[0]) && names[event])
+        return names[event];
+    return "UNKNOWN EVENT";
+}
+
+__be16 rdma_get_src_port(struct rdma_cm_id *id)
+{
+    return id->route.addr.src_sin.sin_port;
+}
+
+__be16 rdma_get_dst_port(struct rdma_cm_id *id)
+{
+    return id->route.addr.dst_sin.sin_port;
+}
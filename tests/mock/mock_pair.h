@@ -0,0 +1,81 @@
+// Two connected RC endpoints in one process over the loopback mock (mock_verbs.h), set up with the src/ CM helpers.
+// Shared by tests/test_mock_verbs.c, tests/bench_mock_verbs.c, tests/test_rdma_stats.c and tests/test_metrics_http.c.
+#pragma once
+#include <stdio.h>
+#include <string.h>
+
+#include "../../src/rdma_builders.h"
+#include "../../src/rdma_cm_helpers.h"
+#include "../../src/rdma_mem.h"
+#include "mock_verbs.h"
+
+#define MOCK_PAIR_BUF 8192
+#define MOCK_PAIR_ACCESS                                                                                               \
+    (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC)
+
+// cli.buf_tx/mr_tx and srv.buf_remote/mr_remote are MOCK_PAIR_BUF bytes; cli.remote_addr/remote_rkey name the latter.
+struct mock_pair
+{
+    rdma_ctx srv, cli;
+    struct rdma_cm_id *listen_id;
+};
+
+static int mock_pair_fail(const char *what)
+{
+    fprintf(stderr, "mock_pair: %s\n", what);
+    return -1;
+}
+
+// Both sides run on this thread: every CM call queues its peer's event before the peer waits for it.
+static int mock_pair_up(struct mock_pair *p, const char *port)
+{
+    struct rdma_cm_event *ev = NULL;
+    struct rdma_conn_param conn;
+    char hello[] = "hello";
+    memset(p, 0, sizeof(*p));
+    if (cm_create_channel_and_id(&p->srv) || cm_server_listen(&p->srv, "127.0.0.1", port))
+        return mock_pair_fail("listen");
+    p->listen_id = p->srv.id;
+    if (cm_create_channel_and_id(&p->cli) || cm_client_resolve(&p->cli, "127.0.0.1", port, NULL) ||
+        build_pd_cq_qp(&p->cli, IBV_QPT_RC, 64, 16, 16, 1) || cm_client_connect_with_priv(&p->cli, hello, 5))
+        return mock_pair_fail("client connect");
+    if (cm_wait_event(&p->srv, RDMA_CM_EVENT_CONNECT_REQUEST, &ev))
+        return mock_pair_fail("CONNECT_REQUEST");
+    int priv_ok = ev->param.conn.private_data_len == 5 && !memcmp(ev->param.conn.private_data, "hello", 5);
+    p->srv.id = ev->id;
+    rdma_ack_cm_event(ev);
+    if (!priv_ok)
+        return mock_pair_fail("private data lost in CONNECT_REQUEST");
+    if (build_pd_cq_qp(&p->srv, IBV_QPT_RC, 64, 16, 16, 1) || cm_server_accept_with_priv(&p->srv, "ok", 2) ||
+        cm_wait_connected(&p->cli, &conn) || cm_wait_event(&p->srv, RDMA_CM_EVENT_ESTABLISHED, &ev))
+        return mock_pair_fail("accept");
+    rdma_ack_cm_event(ev);
+    if (conn.private_data_len != 2 || memcmp(conn.private_data, "ok", 2))
+        return mock_pair_fail("private data lost in ESTABLISHED");
+    if (alloc_and_reg(&p->srv, &p->srv.buf_remote, &p->srv.mr_remote, MOCK_PAIR_BUF, MOCK_PAIR_ACCESS) ||
+        alloc_and_reg(&p->cli, &p->cli.buf_tx, &p->cli.mr_tx, MOCK_PAIR_BUF, MOCK_PAIR_ACCESS))
+        return mock_pair_fail("alloc_and_reg");
+    p->cli.remote_addr = (uintptr_t)p->srv.buf_remote;
+    p->cli.remote_rkey = p->srv.mr_remote->rkey;
+    return 0;
+}
+
+static void mock_pair_down(struct mock_pair *p)
+{
+    rdma_ctx *sides[2] = {&p->cli, &p->srv};
+    for (int i = 0; i < 2; i++)
+    {
+        rdma_ctx *c = sides[i];
+        mem_free_all(c);
+        if (c == &p->srv)
+            free(c->buf_remote);
+        destroy_qp(c);
+        if (c->cq)
+            cq_ts_destroy(c->cq);
+        if (c->pd)
+            ibv_dealloc_pd(c->pd);
+        rdma_destroy_id(c->id);
+        rdma_destroy_event_channel(c->ec);
+    }
+    rdma_destroy_id(p->listen_id);
+}
@@ -0,0 +1,993 @@
+/**
+ * File: mock_verbs.c
+ * Purpose: Verbs half of the loopback mock (see mock_verbs.h): PD, MR, CQ, QP and the data path.
+ *
+ * Notes:
+ *  - Objects embed the public verbs struct as their first member, so the pointers the application
+ *    holds cast straight back to the mock object.
+ *  - ibv_post_send/ibv_post_recv/ibv_poll_cq are inline in verbs.h and call through mock_ctx.ops.
+ *  - MR keys and QP numbers carry a generation in their high bits, so a stale key or QPN does not
+ *    resolve to an object that reused the slot.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mock_verbs.h"
+
+#define MOCK_MAX_SGE 16
+#define MOCK_QP_SLOTS 4096 // 12 bits of the QPN
+#define MOCK_MR_SLOTS 65536
+#define MOCK_MAX_INLINE 256
+
+struct mock_pd
+{
+    struct ibv_pd pd;
+    int refs; // MRs and QPs
+};
+
+struct mock_mr
+{
+    struct ibv_mr mr;
+    int access;
+};
+
+struct mock_cqe
+{
+    struct ibv_wc wc;
+    uint64_t due_ns;
+    uint32_t retire; // send WRs this completion frees (signaled CQE + unsignaled WRs before it)
+};
+
+struct mock_cq
+{
+    struct ibv_cq cq;
+    struct mock_cqe *ring;
+    unsigned depth, head, tail;
+    int overrun, refs;
+};
+
+struct mock_swr
+{
+    struct mock_swr *next;
+    struct ibv_send_wr wr;
+    struct ibv_sge sge[MOCK_MAX_SGE];
+    char *inline_data;
+    uint64_t extra_ns;
+    int loss_drawn, rnr_counted;
+};
+
+struct mock_rwr
+{
+    uint64_t wr_id;
+    int num_sge;
+    struct ibv_sge sge[MOCK_MAX_SGE];
+};
+
+struct mock_qp
+{
+    struct ibv_qp qp;
+    struct ibv_qp_cap cap;
+    int sq_sig_all;
+    uint32_t dest_qpn;
+    struct mock_swr *sq_head, *sq_tail;
+    unsigned sq_outstanding, sq_unretired;
+    struct mock_rwr *rq;
+    unsigned rq_head, rq_tail;
+    int progressing; // sq_progress is on the stack for this QP
+};
+
+struct seg
+{
+    char *p;
+    size_t len;
+};
+
+static int mock_poll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *wc);
+static int mock_req_notify_cq(struct ibv_cq *cq, int solicited_only);
+static int mock_post_send(struct ibv_qp *qp, struct ibv_send_wr *wr, struct ibv_send_wr **bad_wr);
+static int mock_post_recv(struct ibv_qp *qp, struct ibv_recv_wr *wr, struct ibv_recv_wr **bad_wr);
+
+pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+struct mock_verbs_stats mock_stats;
+static struct ibv_device mock_dev = {
+    .node_type = IBV_NODE_CA, .transport_type = IBV_TRANSPORT_IB, .name = "mock0", .dev_name = "uverbs_mock0"};
+struct ibv_context mock_ctx = {.device = &mock_dev,
+                               .ops = {.poll_cq = mock_poll_cq,
+                                       .req_notify_cq = mock_req_notify_cq,
+                                       .post_send = mock_post_send,
+                                       .post_recv = mock_post_recv},
+                               .num_comp_vectors = 1};
+
+static struct mock_verbs_cfg g_cfg;
+static int g_cfg_ready;
+static unsigned g_rand;
+static struct mock_qp *g_qps[MOCK_QP_SLOTS];
+static uint32_t g_qp_gen = 1;
+static struct mock_mr *g_mrs[MOCK_MR_SLOTS];
+static uint32_t g_mr_gen = 1;
+static uint32_t g_cq_handles; // ibv_cq.handle, as the kernel numbers CQs
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+static uint64_t env_u64(const char *name)
+{
+    const char *v = getenv(name);
+    return v && *v ? strtoull(v, NULL, 10) : 0;
+}
+
+// Caller holds mock_lock.
+static void cfg_init(void)
+{
+    if (g_cfg_ready)
+        return;
+    const char *loss = getenv("MOCK_VERBS_LOSS");
+    g_cfg.latency_ns = env_u64("MOCK_VERBS_LATENCY_NS");
+    g_cfg.loss = loss && *loss ? strtod(loss, NULL) : 0.0;
+    g_cfg.retransmit_ns = env_u64("MOCK_VERBS_RETRANSMIT_NS");
+    g_cfg.loss_fatal = (int)env_u64("MOCK_VERBS_LOSS_FATAL");
+    g_cfg.seed = (unsigned)env_u64("MOCK_VERBS_SEED");
+    g_rand = g_cfg.seed ? g_cfg.seed : 1;
+    g_cfg_ready = 1;
+}
+
+void mock_verbs_set_cfg(const struct mock_verbs_cfg *cfg)
+{
+    pthread_mutex_lock(&mock_lock);
+    g_cfg = *cfg;
+    g_rand = cfg->seed ? cfg->seed : 1;
+    g_cfg_ready = 1;
+    pthread_mutex_unlock(&mock_lock);
+}
+
+const struct mock_verbs_stats *mock_verbs_stats(void)
+{
+    return &mock_stats;
+}
+
+void mock_verbs_reset_counters(void)
+{
+    pthread_mutex_lock(&mock_lock);
+    mock_stats.send_wrs = mock_stats.recv_wrs = mock_stats.completions = mock_stats.bytes = 0;
+    mock_stats.rnr_waits = mock_stats.lost = mock_stats.retry_exceeded = 0;
+    pthread_mutex_unlock(&mock_lock);
+}
+
+// xorshift32: reproducible per seed, and independent of the application's rand().
+static double draw(void)
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 17;
+    g_rand ^= g_rand << 5;
+    return (double)g_rand / 4294967296.0;
+}
+
+static struct mock_qp *mq(struct ibv_qp *qp)
+{
+    return (struct mock_qp *)qp;
+}
+
+struct ibv_qp *mock_qp_lookup(uint32_t qp_num)
+{
+    struct mock_qp *q = g_qps[qp_num % MOCK_QP_SLOTS];
+    return q && q->qp.qp_num == qp_num ? &q->qp : NULL;
+}
+
+void mock_qp_connect(struct ibv_qp *qp, uint32_t dest_qp_num)
+{
+    mq(qp)->dest_qpn = dest_qp_num;
+}
+
+// The MR behind key if it covers [addr, addr + len) with the given access in pd, else NULL.
+static struct mock_mr *mr_check(uint32_t key, uint64_t addr, uint64_t len, int access, struct ibv_pd *pd)
+{
+    struct mock_mr *m = g_mrs[key % MOCK_MR_SLOTS];
+    if (!m || m->mr.lkey != key || m->mr.pd != pd || (m->access & access) != access)
+        return NULL;
+    uint64_t base = (uintptr_t)m->mr.addr;
+    if (addr < base || len > m->mr.length || addr - base > m->mr.length - len)
+        return NULL;
+    return m;
+}
+
+static int map_sges(const struct ibv_sge *sge, int n, int access, struct ibv_pd *pd, struct seg *out, size_t *total)
+{
+    *total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (sge[i].length && !mr_check(sge[i].lkey, sge[i].addr, sge[i].length, access, pd))
+            return -1;
+        out[i] = (struct seg){.p = (char *)(uintptr_t)sge[i].addr, .len = sge[i].length};
+        *total += sge[i].length;
+    }
+    return 0;
+}
+
+static void copy_segs(struct seg *dst, int nd, const struct seg *src, int ns)
+{
+    size_t doff = 0, soff = 0;
+    for (int d = 0, s = 0; d < nd && s < ns;)
+    {
+        size_t n = dst[d].len - doff < src[s].len - soff ? dst[d].len - doff : src[s].len - soff;
+        memcpy(dst[d].p + doff, src[s].p + soff, n);
+        doff += n;
+        soff += n;
+        if (doff == dst[d].len)
+            d++, doff = 0;
+        if (soff == src[s].len)
+            s++, soff = 0;
+    }
+}
+
+static void cq_push(struct ibv_cq *cq, const struct ibv_wc *wc, uint64_t due_ns, uint32_t retire)
+{
+    struct mock_cq *c = (struct mock_cq *)cq;
+    if (c->tail - c->head == c->depth)
+    {
+        if (!c->overrun)
+            fprintf(stderr, "mock_verbs: CQ overrun (depth %u); the CQ is now unusable\n", c->depth);
+        c->overrun = 1;
+        return;
+    }
+    c->ring[c->tail++ % c->depth] = (struct mock_cqe){.wc = *wc, .due_ns = due_ns, .retire = retire};
+}
+
+static uint64_t due_after(uint64_t extra_ns)
+{
+    uint64_t d = g_cfg.latency_ns + extra_ns;
+    return d ? now_ns() + d : 0;
+}
+
+static void sq_progress(struct mock_qp *q);
+
+// Move to ERR and flush the receive queue. The send queue is flushed by sq_progress.
+static void qp_error(struct mock_qp *q)
+{
+    q->qp.state = IBV_QPS_ERR;
+    while (q->rq_head != q->rq_tail)
+    {
+        struct mock_rwr *r = &q->rq[q->rq_head++ % q->cap.max_recv_wr];
+        struct ibv_wc wc = {
+            .wr_id = r->wr_id, .status = IBV_WC_WR_FLUSH_ERR, .opcode = IBV_WC_RECV, .qp_num = q->qp.qp_num};
+        cq_push(q->qp.recv_cq, &wc, 0, 0);
+    }
+    // A peer waiting for one of our RECVs now gets no answer at all.
+    struct mock_qp *sender = (struct mock_qp *)mock_qp_lookup(q->dest_qpn);
+    if (sender && sender->dest_qpn == q->qp.qp_num)
+        sq_progress(sender);
+}
+
+void mock_qp_set_state(struct ibv_qp *qp, enum ibv_qp_state state)
+{
+    if (state == IBV_QPS_ERR)
+    {
+        qp_error(mq(qp));
+        sq_progress(mq(qp));
+    }
+    else
+        qp->state = state;
+}
+
+static int can_receive(const struct mock_qp *p)
+{
+    return p && (p->qp.state == IBV_QPS_RTR || p->qp.state == IBV_QPS_RTS || p->qp.state == IBV_QPS_SQD);
+}
+
+// The responder side failed the request: it completes the RECV with st and goes to ERR.
+static void responder_error(struct mock_qp *p, struct mock_rwr *r, enum ibv_wc_status st, uint64_t due)
+{
+    struct ibv_wc wc = {.wr_id = r->wr_id, .status = st, .opcode = IBV_WC_RECV, .qp_num = p->qp.qp_num};
+    cq_push(p->qp.recv_cq, &wc, due, 0);
+    qp_error(p);
+    sq_progress(p);
+}
+
+// Run w against the peer. Returns 1 if it has to wait for a RECV, 0 once it has a final status.
+static int execute(struct mock_qp *q, struct mock_swr *w, enum ibv_wc_status *st, uint32_t *byte_len)
+{
+    struct mock_qp *p = (struct mock_qp *)mock_qp_lookup(q->dest_qpn);
+    struct ibv_send_wr *wr = &w->wr;
+    struct seg local[MOCK_MAX_SGE], remote[MOCK_MAX_SGE];
+    size_t total = 0;
+    *st = IBV_WC_SUCCESS;
+    if (!can_receive(p))
+    {
+        // Nobody answers: the requester retries until retry_cnt runs out.
+        *st = IBV_WC_RETRY_EXC_ERR;
+        mock_stats.retry_exceeded++;
+        return 0;
+    }
+    int two_sided = wr->opcode == IBV_WR_SEND || wr->opcode == IBV_WR_SEND_WITH_IMM ||
+                    wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM;
+    int reads_local = two_sided || wr->opcode == IBV_WR_RDMA_WRITE;
+    if (reads_local)
+    {
+        if (w->inline_data)
+        {
+            for (int i = 0; i < wr->num_sge; i++)
+                total += wr->sg_list[i].length;
+            local[0] = (struct seg){.p = w->inline_data, .len = total};
+        }
+        else if (map_sges(wr->sg_list, wr->num_sge, 0, q->qp.pd, local, &total))
+        {
+            *st = IBV_WC_LOC_PROT_ERR;
+            return 0;
+        }
+    }
+    else if (map_sges(wr->sg_list, wr->num_sge, IBV_ACCESS_LOCAL_WRITE, q->qp.pd, local, &total))
+    {
+        *st = IBV_WC_LOC_PROT_ERR;
+        return 0;
+    }
+    int nlocal = w->inline_data ? 1 : wr->num_sge;
+    uint64_t due = due_after(w->extra_ns);
+
+    if (wr->opcode == IBV_WR_RDMA_WRITE || wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM)
+    {
+        if (!mr_check(wr->wr.rdma.rkey, wr->wr.rdma.remote_addr, total, IBV_ACCESS_REMOTE_WRITE, p->qp.pd))
+        {
+            *st = IBV_WC_REM_ACCESS_ERR;
+            return 0;
+        }
+    }
+    if (two_sided && p->rq_head == p->rq_tail)
+    {
+        if (!w->rnr_counted)
+            mock_stats.rnr_waits++;
+        w->rnr_counted = 1;
+        return 1;
+    }
+
+    switch (wr->opcode)
+    {
+    case IBV_WR_RDMA_WRITE:
+    case IBV_WR_RDMA_WRITE_WITH_IMM:
+        remote[0] = (struct seg){.p = (char *)(uintptr_t)wr->wr.rdma.remote_addr, .len = total};
+        copy_segs(remote, 1, local, nlocal);
+        if (wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM)
+        {
+            struct mock_rwr *r = &p->rq[p->rq_head++ % p->cap.max_recv_wr];
+            struct ibv_wc wc = {.wr_id = r->wr_id,
+                                .opcode = IBV_WC_RECV_RDMA_WITH_IMM,
+                                .byte_len = (uint32_t)total,
+                                .imm_data = wr->imm_data,
+                                .qp_num = p->qp.qp_num,
+                                .src_qp = q->qp.qp_num,
+                                .wc_flags = IBV_WC_WITH_IMM};
+            cq_push(p->qp.recv_cq, &wc, due, 0);
+        }
+        break;
+    case IBV_WR_SEND:
+    case IBV_WR_SEND_WITH_IMM:
+    {
+        struct mock_rwr *r = &p->rq[p->rq_head++ % p->cap.max_recv_wr];
+        size_t room = 0;
+        if (map_sges(r->sge, r->num_sge, IBV_ACCESS_LOCAL_WRITE, p->qp.pd, remote, &room))
+        {
+            responder_error(p, r, IBV_WC_LOC_PROT_ERR, due);
+            *st = IBV_WC_REM_OP_ERR;
+            return 0;
+        }
+        if (total > room)
+        {
+            responder_error(p, r, IBV_WC_LOC_LEN_ERR, due);
+            *st = IBV_WC_REM_INV_REQ_ERR;
+            return 0;
+        }
+        copy_segs(remote, r->num_sge, local, nlocal);
+        struct ibv_wc wc = {.wr_id = r->wr_id,
+                            .opcode = IBV_WC_RECV,
+                            .byte_len = (uint32_t)total,
+                            .qp_num = p->qp.qp_num,
+                            .src_qp = q->qp.qp_num};
+        if (wr->opcode == IBV_WR_SEND_WITH_IMM)
+        {
+            wc.imm_data = wr->imm_data;
+            wc.wc_flags = IBV_WC_WITH_IMM;
+        }
+        cq_push(p->qp.recv_cq, &wc, due, 0);
+        break;
+    }
+    case IBV_WR_RDMA_READ:
+        if (q->qp.qp_type != IBV_QPT_RC)
+        {
+            *st = IBV_WC_LOC_QP_OP_ERR;
+            return 0;
+        }
+        if (!mr_check(wr->wr.rdma.rkey, wr->wr.rdma.remote_addr, total, IBV_ACCESS_REMOTE_READ, p->qp.pd))
+        {
+            *st = IBV_WC_REM_ACCESS_ERR;
+            return 0;
+        }
+        remote[0] = (struct seg){.p = (char *)(uintptr_t)wr->wr.rdma.remote_addr, .len = total};
+        copy_segs(local, nlocal, remote, 1);
+        *byte_len = (uint32_t)total;
+        break;
+    case IBV_WR_ATOMIC_FETCH_AND_ADD:
+    case IBV_WR_ATOMIC_CMP_AND_SWP:
+    {
+        uint64_t raddr = wr->wr.atomic.remote_addr, old;
+        if (q->qp.qp_type != IBV_QPT_RC || total != 8 || nlocal != 1)
+        {
+            *st = IBV_WC_LOC_QP_OP_ERR;
+            return 0;
+        }
+        if (raddr % 8)
+        {
+            *st = IBV_WC_REM_INV_REQ_ERR;
+            return 0;
+        }
+        if (!mr_check(wr->wr.atomic.rkey, raddr, 8, IBV_ACCESS_REMOTE_ATOMIC, p->qp.pd))
+        {
+            *st = IBV_WC_REM_ACCESS_ERR;
+            return 0;
+        }
+        uint64_t *target = (uint64_t *)(uintptr_t)raddr;
+        if (wr->opcode == IBV_WR_ATOMIC_FETCH_AND_ADD)
+            old = __atomic_fetch_add(target, wr->wr.atomic.compare_add, __ATOMIC_SEQ_CST);
+        else
+        {
+            old = wr->wr.atomic.compare_add;
+            __atomic_compare_exchange_n(target, &old, wr->wr.atomic.swap, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        }
+        memcpy(local[0].p, &old, 8);
+        *byte_len = 8;
+        break;
+    }
+    default:
+        *st = IBV_WC_LOC_QP_OP_ERR;
+        return 0;
+    }
+    mock_stats.bytes += total;
+    return 0;
+}
+
+static enum ibv_wc_opcode wc_opcode(enum ibv_wr_opcode op)
+{
+    switch (op)
+    {
+    case IBV_WR_RDMA_WRITE:
+    case IBV_WR_RDMA_WRITE_WITH_IMM:
+        return IBV_WC_RDMA_WRITE;
+    case IBV_WR_RDMA_READ:
+        return IBV_WC_RDMA_READ;
+    case IBV_WR_ATOMIC_FETCH_AND_ADD:
+        return IBV_WC_FETCH_ADD;
+    case IBV_WR_ATOMIC_CMP_AND_SWP:
+        return IBV_WC_COMP_SWAP;
+    default:
+        return IBV_WC_SEND;
+    }
+}
+
+// Execute send WRs from the head until one waits for a RECV or the queue is empty.
+static void sq_progress(struct mock_qp *q)
+{
+    // Errors on the peer can call back into this QP; the outer loop carries on from the head.
+    if (q->progressing)
+        return;
+    q->progressing = 1;
+    while (q->sq_head)
+    {
+        struct mock_swr *w = q->sq_head;
+        enum ibv_wc_status st = IBV_WC_SUCCESS;
+        uint32_t byte_len = 0;
+        if (q->qp.state == IBV_QPS_ERR)
+            st = IBV_WC_WR_FLUSH_ERR;
+        else
+        {
+            if (g_cfg.loss > 0 && !w->loss_drawn)
+            {
+                w->loss_drawn = 1;
+                if (draw() < g_cfg.loss)
+                {
+                    mock_stats.lost++;
+                    if (g_cfg.loss_fatal)
+                    {
+                        st = IBV_WC_RETRY_EXC_ERR;
+                        mock_stats.retry_exceeded++;
+                    }
+                    else
+                        w->extra_ns += g_cfg.retransmit_ns;
+                }
+            }
+            if (st == IBV_WC_SUCCESS && execute(q, w, &st, &byte_len))
+                break;
+        }
+        q->sq_head = w->next;
+        if (!q->sq_head)
+            q->sq_tail = NULL;
+        q->sq_unretired++;
+        if (st != IBV_WC_SUCCESS || q->sq_sig_all || (w->wr.send_flags & IBV_SEND_SIGNALED))
+        {
+            struct ibv_wc wc = {.wr_id = w->wr.wr_id,
+                                .status = st,
+                                .opcode = wc_opcode(w->wr.opcode),
+                                .byte_len = byte_len,
+                                .qp_num = q->qp.qp_num};
+            cq_push(q->qp.send_cq, &wc, st == IBV_WC_SUCCESS ? due_after(w->extra_ns) : 0, q->sq_unretired);
+            q->sq_unretired = 0;
+        }
+        if (st != IBV_WC_SUCCESS && q->qp.state != IBV_QPS_ERR)
+            qp_error(q);
+        free(w->inline_data);
+        free(w);
+    }
+    q->progressing = 0;
+}
+
+static int mock_post_send(struct ibv_qp *qp, struct ibv_send_wr *wr, struct ibv_send_wr **bad_wr)
+{
+    struct mock_qp *q = mq(qp);
+    int rc = 0;
+    pthread_mutex_lock(&mock_lock);
+    cfg_init();
+    for (; wr; wr = wr->next)
+    {
+        // Posting in ERR is legal: the WR is flushed.
+        if ((qp->state != IBV_QPS_RTS && qp->state != IBV_QPS_ERR) || wr->num_sge < 0 ||
+            (uint32_t)wr->num_sge > q->cap.max_send_sge)
+        {
+            rc = EINVAL;
+            break;
+        }
+        if (q->sq_outstanding >= q->cap.max_send_wr)
+        {
+            rc = ENOMEM;
+            break;
+        }
+        struct mock_swr *w = calloc(1, sizeof(*w));
+        if (!w)
+        {
+            rc = ENOMEM;
+            break;
+        }
+        w->wr = *wr;
+        w->wr.next = NULL;
+        w->wr.sg_list = w->sge;
+        memcpy(w->sge, wr->sg_list, (size_t)wr->num_sge * sizeof(*w->sge));
+        if (wr->send_flags & IBV_SEND_INLINE)
+        {
+            // Inline data is copied at post time and needs no lkey.
+            size_t total = 0;
+            for (int i = 0; i < wr->num_sge; i++)
+                total += wr->sg_list[i].length;
+            if (total > q->cap.max_inline_data || !(w->inline_data = malloc(total ? total : 1)))
+            {
+                free(w);
+                rc = EINVAL;
+                break;
+            }
+            for (size_t i = 0, off = 0; i < (size_t)wr->num_sge; off += wr->sg_list[i].length, i++)
+                memcpy(w->inline_data + off, (void *)(uintptr_t)wr->sg_list[i].addr, wr->sg_list[i].length);
+        }
+        if (q->sq_tail)
+            q->sq_tail->next = w;
+        else
+            q->sq_head = w;
+        q->sq_tail = w;
+        q->sq_outstanding++;
+        mock_stats.send_wrs++;
+    }
+    if (rc && bad_wr)
+        *bad_wr = wr;
+    sq_progress(q);
+    pthread_mutex_unlock(&mock_lock);
+    return rc;
+}
+
+static int mock_post_recv(struct ibv_qp *qp, struct ibv_recv_wr *wr, struct ibv_recv_wr **bad_wr)
+{
+    struct mock_qp *q = mq(qp);
+    int rc = 0;
+    pthread_mutex_lock(&mock_lock);
+    cfg_init();
+    for (; wr; wr = wr->next)
+    {
+        if (qp->state == IBV_QPS_RESET || wr->num_sge < 0 || (uint32_t)wr->num_sge > q->cap.max_recv_sge)
+        {
+            rc = EINVAL;
+            break;
+        }
+        if (q->rq_tail - q->rq_head == q->cap.max_recv_wr)
+        {
+            rc = ENOMEM;
+            break;
+        }
+        struct mock_rwr *r = &q->rq[q->rq_tail++ % q->cap.max_recv_wr];
+        r->wr_id = wr->wr_id;
+        r->num_sge = wr->num_sge;
+        memcpy(r->sge, wr->sg_list, (size_t)wr->num_sge * sizeof(*r->sge));
+        mock_stats.recv_wrs++;
+    }
+    if (rc && bad_wr)
+        *bad_wr = wr;
+    if (qp->state == IBV_QPS_ERR)
+        qp_error(q);
+    // A sender may be waiting for exactly this RECV.
+    struct mock_qp *sender = (struct mock_qp *)mock_qp_lookup(q->dest_qpn);
+    if (sender && sender->dest_qpn == qp->qp_num && sender->sq_head)
+        sq_progress(sender);
+    pthread_mutex_unlock(&mock_lock);
+    return rc;
+}
+
+static int mock_poll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *wc)
+{
+    struct mock_cq *c = (struct mock_cq *)cq;
+    uint64_t now = 0;
+    int n = 0;
+    pthread_mutex_lock(&mock_lock);
+    if (c->overrun)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        errno = EOVERFLOW;
+        return -1;
+    }
+    while (n < num_entries && c->head != c->tail)
+    {
+        struct mock_cqe *e = &c->ring[c->head % c->depth];
+        // Completions become visible in order: a late one holds back the ones behind it.
+        if (e->due_ns && e->due_ns > (now ? now : (now = now_ns())))
+            break;
+        wc[n++] = e->wc;
+        c->head++;
+        struct mock_qp *q = e->retire ? (struct mock_qp *)mock_qp_lookup(e->wc.qp_num) : NULL;
+        if (q)
+            q->sq_outstanding -= e->retire;
+    }
+    mock_stats.completions += (uint64_t)n;
+    pthread_mutex_unlock(&mock_lock);
+    return n;
+}
+
+static int mock_req_notify_cq(struct ibv_cq *cq, int solicited_only)
+{
+    (void)cq;
+    (void)solicited_only;
+    return 0;
+}
+
+struct ibv_pd *ibv_alloc_pd(struct ibv_context *context)
+{
+    struct mock_pd *p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->pd.context = context;
+    pthread_mutex_lock(&mock_lock);
+    mock_stats.pds++;
+    pthread_mutex_unlock(&mock_lock);
+    return &p->pd;
+}
+
+int ibv_dealloc_pd(struct ibv_pd *pd)
+{
+    struct mock_pd *p = (struct mock_pd *)pd;
+    pthread_mutex_lock(&mock_lock);
+    if (p->refs)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        return EBUSY;
+    }
+    mock_stats.pds--;
+    pthread_mutex_unlock(&mock_lock);
+    free(p);
+    return 0;
+}
+
+#undef ibv_reg_mr
+struct ibv_mr *ibv_reg_mr(struct ibv_pd *pd, void *addr, size_t length, int access)
+{
+    // As on hardware, remote write and atomic access need local write.
+    if ((access & (IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC)) && !(access & IBV_ACCESS_LOCAL_WRITE))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    struct mock_mr *m = calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+    pthread_mutex_lock(&mock_lock);
+    uint32_t slot = 1;
+    while (slot < MOCK_MR_SLOTS && g_mrs[slot])
+        slot++;
+    if (slot == MOCK_MR_SLOTS)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        free(m);
+        errno = ENOMEM;
+        return NULL;
+    }
+    uint32_t key = (g_mr_gen++ & 0xffff) << 16 | slot;
+    if (key >> 16 == 0)
+        key = (g_mr_gen++ & 0xffff) << 16 | slot;
+    m->mr = (struct ibv_mr){
+        .context = pd->context, .pd = pd, .addr = addr, .length = length, .handle = slot, .lkey = key, .rkey = key};
+    m->access = access;
+    g_mrs[slot] = m;
+    ((struct mock_pd *)pd)->refs++;
+    mock_stats.mrs++;
+    pthread_mutex_unlock(&mock_lock);
+    return &m->mr;
+}
+
+struct ibv_mr *ibv_reg_mr_iova2(struct ibv_pd *pd, void *addr, size_t length, uint64_t iova, unsigned int access)
+{
+    // Only VA-based MRs: the remote address of a byte is its virtual address.
+    if (iova != (uintptr_t)addr)
+    {
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+    return ibv_reg_mr(pd, addr, length, (int)access);
+}
+
+#undef ibv_reg_mr_iova
+struct ibv_mr *ibv_reg_mr_iova(struct ibv_pd *pd, void *addr, size_t length, uint64_t iova, int access)
+{
+    return ibv_reg_mr_iova2(pd, addr, length, iova, (unsigned int)access);
+}
+
+int ibv_dereg_mr(struct ibv_mr *mr)
+{
+    struct mock_mr *m = (struct mock_mr *)mr;
+    pthread_mutex_lock(&mock_lock);
+    g_mrs[mr->handle] = NULL;
+    ((struct mock_pd *)mr->pd)->refs--;
+    mock_stats.mrs--;
+    pthread_mutex_unlock(&mock_lock);
+    free(m);
+    return 0;
+}
+
+struct ibv_cq *ibv_create_cq(struct ibv_context *context, int cqe, void *cq_context, struct ibv_comp_channel *channel,
+                             int comp_vector)
+{
+    (void)comp_vector;
+    if (cqe < 1 || channel)
+    {
+        errno = cqe < 1 ? EINVAL : EOPNOTSUPP;
+        return NULL;
+    }
+    struct mock_cq *c = calloc(1, sizeof(*c));
+    if (!c || !(c->ring = calloc((size_t)cqe, sizeof(*c->ring))))
+    {
+        free(c);
+        errno = ENOMEM;
+        return NULL;
+    }
+    c->depth = (unsigned)cqe;
+    c->cq.context = context;
+    c->cq.cq_context = cq_context;
+    c->cq.cqe = cqe;
+    pthread_mutex_lock(&mock_lock);
+    c->cq.handle = ++g_cq_handles;
+    mock_stats.cqs++;
+    pthread_mutex_unlock(&mock_lock);
+    return &c->cq;
+}
+
+int ibv_destroy_cq(struct ibv_cq *cq)
+{
+    struct mock_cq *c = (struct mock_cq *)cq;
+    pthread_mutex_lock(&mock_lock);
+    if (c->refs)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        return EBUSY;
+    }
+    mock_stats.cqs--;
+    pthread_mutex_unlock(&mock_lock);
+    free(c->ring);
+    free(c);
+    return 0;
+}
+
+struct ibv_qp *ibv_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr)
+{
+    if (attr->qp_type != IBV_QPT_RC && attr->qp_type != IBV_QPT_UC)
+    {
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+    if (attr->srq || !attr->send_cq || !attr->recv_cq || attr->cap.max_send_sge > MOCK_MAX_SGE ||
+        attr->cap.max_recv_sge > MOCK_MAX_SGE)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    struct mock_qp *q = calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
+    q->cap = attr->cap;
+    if (q->cap.max_recv_wr == 0)
+        q->cap.max_recv_wr = 1;
+    if (q->cap.max_inline_data > MOCK_MAX_INLINE)
+        q->cap.max_inline_data = MOCK_MAX_INLINE;
+    attr->cap = q->cap;
+    if (!(q->rq = calloc(q->cap.max_recv_wr, sizeof(*q->rq))))
+    {
+        free(q);
+        return NULL;
+    }
+    q->sq_sig_all = attr->sq_sig_all;
+    q->qp.context = pd->context;
+    q->qp.qp_context = attr->qp_context;
+    q->qp.pd = pd;
+    q->qp.send_cq = attr->send_cq;
+    q->qp.recv_cq = attr->recv_cq;
+    q->qp.qp_type = attr->qp_type;
+    q->qp.state = IBV_QPS_RESET;
+    pthread_mutex_init(&q->qp.mutex, NULL);
+    pthread_cond_init(&q->qp.cond, NULL);
+    pthread_mutex_lock(&mock_lock);
+    uint32_t slot = 1;
+    while (slot < MOCK_QP_SLOTS && g_qps[slot])
+        slot++;
+    if (slot == MOCK_QP_SLOTS)
+    {
+        pthread_mutex_unlock(&mock_lock);
+        free(q->rq);
+        free(q);
+        errno = ENOMEM;
+        return NULL;
+    }
+    q->qp.qp_num = (g_qp_gen++ % 4095 + 1) << 12 | slot;
+    q->qp.handle = slot;
+    g_qps[slot] = q;
+    ((struct mock_pd *)pd)->refs++;
+    ((struct mock_cq *)attr->send_cq)->refs++;
+    ((struct mock_cq *)attr->recv_cq)->refs++;
+    mock_stats.qps++;
+    pthread_mutex_unlock(&mock_lock);
+    return &q->qp;
+}
+
+int ibv_destroy_qp(struct ibv_qp *qp)
+{
+    struct mock_qp *q = mq(qp);
+    pthread_mutex_lock(&mock_lock);
+    g_qps[qp->handle] = NULL;
+    ((struct mock_pd *)qp->pd)->refs--;
+    ((struct mock_cq *)qp->send_cq)->refs--;
+    ((struct mock_cq *)qp->recv_cq)->refs--;
+    mock_stats.qps--;
+    pthread_mutex_unlock(&mock_lock);
+    while (q->sq_head)
+    {
+        struct mock_swr *w = q->sq_head;
+        q->sq_head = w->next;
+        free(w->inline_data);
+        free(w);
+    }
+    pthread_mutex_destroy(&qp->mutex);
+    pthread_cond_destroy(&qp->cond);
+    free(q->rq);
+    free(q);
+    return 0;
+}
+
+int ibv_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr, int attr_mask)
+{
+    pthread_mutex_lock(&mock_lock);
+    if ((attr_mask & IBV_QP_DEST_QPN) && (qp->qp_type == IBV_QPT_RC || qp->qp_type == IBV_QPT_UC))
+        mock_qp_connect(qp, attr->dest_qp_num);
+    if (attr_mask & IBV_QP_STATE)
+        mock_qp_set_state(qp, attr->qp_state);
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int ibv_query_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr, int attr_mask, struct ibv_qp_init_attr *init_attr)
+{
+    (void)attr_mask;
+    struct mock_qp *q = mq(qp);
+    pthread_mutex_lock(&mock_lock);
+    memset(attr, 0, sizeof(*attr));
+    attr->qp_state = attr->cur_qp_state = qp->state;
+    attr->path_mtu = IBV_MTU_4096;
+    attr->dest_qp_num = q->dest_qpn;
+    attr->cap = q->cap;
+    attr->max_rd_atomic = attr->max_dest_rd_atomic = 16;
+    attr->min_rnr_timer = 12;
+    attr->timeout = 14;
+    attr->retry_cnt = attr->rnr_retry = 7;
+    attr->port_num = 1;
+    if (init_attr)
+    {
+        memset(init_attr, 0, sizeof(*init_attr));
+        init_attr->qp_context = qp->qp_context;
+        init_attr->send_cq = qp->send_cq;
+        init_attr->recv_cq = qp->recv_cq;
+        init_attr->cap = q->cap;
+        init_attr->qp_type = qp->qp_type;
+        init_attr->sq_sig_all = q->sq_sig_all;
+    }
+    pthread_mutex_unlock(&mock_lock);
+    return 0;
+}
+
+int ibv_query_device(struct ibv_context *context, struct ibv_device_attr *device_attr)
+{
+    (void)context;
+    memset(device_attr, 0, sizeof(*device_attr));
+    snprintf(device_attr->fw_ver, sizeof(device_attr->fw_ver), "mock");
+    device_attr->max_mr_size = UINT64_MAX;
+    device_attr->page_size_cap = 4096;
+    device_attr->max_qp = MOCK_QP_SLOTS - 1;
+    device_attr->max_qp_wr = 32768;
+    device_attr->max_sge = MOCK_MAX_SGE;
+    device_attr->max_cq = 65536;
+    device_attr->max_cqe = 1 << 22;
+    device_attr->max_mr = MOCK_MR_SLOTS - 1;
+    device_attr->max_pd = 65536;
+    device_attr->max_qp_rd_atom = 16;
+    device_attr->max_qp_init_rd_atom = 16;
+    device_attr->atomic_cap = IBV_ATOMIC_HCA;
+    device_attr->phys_port_cnt = 1;
+    return 0;
+}
+
+#undef ibv_query_port
+int ibv_query_port(struct ibv_context *context, uint8_t port_num, struct _compat_ibv_port_attr *port_attr)
+{
+    (void)context;
+    if (port_num != 1)
+        return EINVAL;
+    // verbs.h passes a full struct ibv_port_attr through the compat pointer.
+    struct ibv_port_attr *a = (struct ibv_port_attr *)port_attr;
+    a->state = IBV_PORT_ACTIVE;
+    a->max_mtu = a->active_mtu = IBV_MTU_4096;
+    a->gid_tbl_len = 1;
+    a->max_msg_sz = 1u << 31;
+    a->pkey_tbl_len = 1;
+    a->active_width = 2;  // 4x
+    a->active_speed = 32; // EDR
+    a->phys_state = 5;    // LinkUp
+    a->link_layer = IBV_LINK_LAYER_ETHERNET;
+    return 0;
+}
+
+const char *ibv_get_device_name(struct ibv_device *device)
+{
+    return device->name;
+}
+
+const char *ibv_wc_status_str(enum ibv_wc_status status)
+{
+    static const char *const names[] = {
+        [IBV_WC_SUCCESS] = "success",
+        [IBV_WC_LOC_LEN_ERR] = "local length error",
+        [IBV_WC_LOC_QP_OP_ERR] = "local QP operation error",
+        [IBV_WC_LOC_EEC_OP_ERR] = "local EE context operation error",
+        [IBV_WC_LOC_PROT_ERR] = "local protection error",
+        [IBV_WC_WR_FLUSH_ERR] = "Work Request Flushed Error",
+        [IBV_WC_MW_BIND_ERR] = "memory management operation error",
+        [IBV_WC_BAD_RESP_ERR] = "bad response error",
+        [IBV_WC_LOC_ACCESS_ERR] = "local access error",
+        [IBV_WC_REM_INV_REQ_ERR] = "remote invalid request error",
+        [IBV_WC_REM_ACCESS_ERR] = "remote access error",
+        [IBV_WC_REM_OP_ERR] = "remote operation error",
+        [IBV_WC_RETRY_EXC_ERR] = "transport retry counter exceeded",
+        [IBV_WC_RNR_RETRY_EXC_ERR] = "RNR retry counter exceeded",
+        [IBV_WC_LOC_RDD_VIOL_ERR] = "local RDD violation error",
+        [IBV_WC_REM_INV_RD_REQ_ERR] = "remote invalid RD request",
+        [IBV_WC_REM_ABORT_ERR] = "aborted error",
+        [IBV_WC_INV_EECN_ERR] = "invalid EE context number",
+        [IBV_WC_INV_EEC_STATE_ERR] = "invalid EE context state",
+        [IBV_WC_FATAL_ERR] = "fatal error",
+        [IBV_WC_RESP_TIMEOUT_ERR] = "response timeout error",
+        [IBV_WC_GENERAL_ERR] = "general error",
+    };
+    if ((unsigned)status < sizeof(names) / sizeof(names[0]) && names[status])
+        return names[status];
+    return "unknown";
+}
@@ -0,0 +1,74 @@
+/**
+ * File: mock_verbs.h
+ * Purpose: Loopback mock of libibverbs + librdmacm for unit tests and CPU-side microbenchmarks.
+ *
+ * Overview:
+ * tests/mock/mock_verbs.c and mock_cm.c define the verbs and rdma_cm symbols the helpers in src/ call.
+ * Link them in place of -lrdmacm -libverbs and every endpoint lives in one process on one fake device,
+ * "mock0". Both sides of a connection therefore have to run in the same process, on one thread or
+ * several.
+ *
+ *   verbs   PD, MR (lkey/rkey, access flags, bounds), CQ, RC/UC QP with the RESET..RTS..ERR states
+ *   data    WRITE, WRITE_WITH_IMM, READ, SEND, SEND_WITH_IMM, FETCH_ADD, CMP_SWAP, RECV
+ *   cm      event channels with a real fd (epoll works), bind/listen, resolve addr/route, connect,
+ *           accept, reject, user-managed QPs (CONNECT_RESPONSE + rdma_establish), disconnect
+ *
+ * Work requests run in posting order when they reach the head of the send queue. A SEND or IMM that
+ * finds no RECV waits there, like RNR retry with rnr_retry 7, and blocks the WRs behind it. Checks
+ * that hardware makes are made here too:
+ *  - bad lkey or length: IBV_WC_LOC_PROT_ERR / IBV_WC_LOC_LEN_ERR
+ *  - bad rkey, range or access: IBV_WC_REM_ACCESS_ERR
+ *  - a SEND larger than the RECV: IBV_WC_REM_INV_REQ_ERR
+ *  - more outstanding WRs than max_send_wr: ENOMEM from ibv_post_send
+ *  - a full CQ: overrun, after which polling fails
+ *  - a PD with live MRs or QPs, or a CQ with QPs: EBUSY
+ * A failed WR moves its QP to ERR and flushes everything behind it, and so does disconnecting.
+ *
+ * Injection (mock_verbs_set_cfg, or MOCK_VERBS_LATENCY_NS / MOCK_VERBS_LOSS / MOCK_VERBS_RETRANSMIT_NS /
+ * MOCK_VERBS_LOSS_FATAL / MOCK_VERBS_SEED in the environment):
+ *  - latency_ns delays when a completion becomes visible to ibv_poll_cq. Data is placed at execution.
+ *  - loss is the chance that a WR is lost on the wire. A lost WR costs retransmit_ns more latency,
+ *    or with loss_fatal it exhausts its retries (IBV_WC_RETRY_EXC_ERR).
+ *
+ * Not modelled: UD QPs, SRQs, completion channels, memory windows, extended CQs.
+ */
+
+#pragma once
+#include <stdint.h>
+
+struct mock_verbs_cfg
+{
+    uint64_t latency_ns;    // added to every completion
+    double loss;            // 0..1, per WR
+    uint64_t retransmit_ns; // latency a lost, retransmitted WR adds
+    int loss_fatal;         // 1: lost WRs fail with IBV_WC_RETRY_EXC_ERR instead
+    unsigned seed;
+};
+
+struct mock_verbs_stats
+{
+    uint64_t send_wrs, recv_wrs; // posted
+    uint64_t completions;        // polled
+    uint64_t bytes;              // moved by executed WRs
+    uint64_t rnr_waits;          // SEND/IMM that found no RECV posted
+    uint64_t lost, retry_exceeded;
+    uint64_t pds, mrs, cqs, qps, ids, channels; // currently alive
+};
+
+// Replaces the configuration (the environment is only read before the first call).
+void mock_verbs_set_cfg(const struct mock_verbs_cfg *cfg);
+const struct mock_verbs_stats *mock_verbs_stats(void);
+void mock_verbs_reset_counters(void); // zeroes the counters, keeps the live-object gauges
+
+// ---- Shared between mock_verbs.c and mock_cm.c ----
+#include <infiniband/verbs.h>
+#include <pthread.h>
+
+extern pthread_mutex_t mock_lock; // every mock entry point runs under it
+extern struct ibv_context mock_ctx;
+extern struct mock_verbs_stats mock_stats;
+
+// Caller holds mock_lock.
+struct ibv_qp *mock_qp_lookup(uint32_t qp_num);
+void mock_qp_connect(struct ibv_qp *qp, uint32_t dest_qp_num); // sets the peer, not the state
+void mock_qp_set_state(struct ibv_qp *qp, enum ibv_qp_state state);
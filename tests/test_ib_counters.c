@@ -0,0 +1,106 @@
+// Unit test for the sysfs port counter snapshots (src/ib_counters.c): builds a fake
+// <port>/counters + hw_counters tree in a temp dir, reads it twice and checks the deltas and the report.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/ib_counters.h"
+
+static char g_dir[64];
+
+static int put(const char *sub, const char *name, const char *val)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/%s", g_dir, sub, name);
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    fprintf(f, "%s\n", val);
+    return fclose(f);
+}
+
+static void cleanup(void)
+{
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", g_dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "failed to remove %s\n", g_dir);
+}
+
+int main(void)
+{
+    int err = 0;
+    snprintf(g_dir, sizeof(g_dir), "/tmp/test_ib_counters.XXXXXX");
+    if (!mkdtemp(g_dir))
+        return 1;
+    char sub[128];
+    snprintf(sub, sizeof(sub), "%s/counters", g_dir);
+    mkdir(sub, 0700);
+    snprintf(sub, sizeof(sub), "%s/hw_counters", g_dir);
+    mkdir(sub, 0700);
+
+    static struct ib_counters a, b, none;
+    put("counters", "port_xmit_data", "1000");
+    put("counters", "port_rcv_data", "0");
+    put("hw_counters", "rcvd_seq_err", "5");
+    put("hw_counters", "duplicate_request", "1");
+    put("hw_counters", "lifespan", "not a number");
+    if (ib_counters_read_dir(&a, g_dir) != 4)
+    {
+        fprintf(stderr, "first snapshot should hold 4 counters, got %d\n", a.n);
+        err = 1;
+    }
+
+    // 1 GiB of payload and 2^28 words (1 GiB) more on the wire, 12 out-of-sequence packets.
+    put("counters", "port_xmit_data", "268436456");
+    put("hw_counters", "rcvd_seq_err", "17");
+    put("hw_counters", "duplicate_request", "1");
+    put("hw_counters", "roce_adp_retrans", "3"); // appears only after the run: no delta
+    if (ib_counters_read_dir(&b, g_dir) != 5)
+    {
+        fprintf(stderr, "second snapshot should hold 5 counters, got %d\n", b.n);
+        err = 1;
+    }
+    if (ib_counters_delta(&a, &b, "port_xmit_data") != 268435456 || ib_counters_delta(&a, &b, "rcvd_seq_err") != 12 ||
+        ib_counters_delta(&a, &b, "duplicate_request") != 0 || ib_counters_delta(&a, &b, "roce_adp_retrans") != 0 ||
+        ib_counters_delta(&a, &b, "missing") != 0)
+    {
+        fprintf(stderr, "delta mismatch\n");
+        err = 1;
+    }
+    if (ib_counters_delta(&b, &a, "rcvd_seq_err") != 0)
+    {
+        fprintf(stderr, "a counter that went backwards (reset) should give 0\n");
+        err = 1;
+    }
+
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    FILE *saved = stdout;
+    stdout = out;
+    ib_counters_report("t", &a, &b, 1ull << 30);
+    ib_counters_report("t", &none, &none, 1ull << 30);
+    stdout = saved;
+    fclose(out);
+    if (!strstr(text, "wire/payload=1.000") || !strstr(text, "out_of_sequence=12 (12.0/GiB)") ||
+        !strstr(text, "retransmit=0 (0.0/GiB)") || !strstr(text, "hw:rcvd_seq_err") ||
+        strstr(text, "duplicate_request") || !strstr(text, "port counters: unavailable"))
+    {
+        fprintf(stderr, "unexpected report:\n%s", text);
+        err = 1;
+    }
+    free(text);
+
+    if (ib_counters_read(&none, "no_such_dev", 1) != -1 || none.n != 0)
+    {
+        fprintf(stderr, "a missing device should read as unavailable\n");
+        err = 1;
+    }
+    cleanup();
+    if (!err)
+        printf("OK test_ib_counters\n");
+    return err;
+}
@@ -0,0 +1,135 @@
+// Unit test for the Prometheus exporter (src/metrics_http.c): runs WRs over the loopback mock, scrapes
+// 127.0.0.1/metrics with a plain socket, and checks the QP and CQ counters, the latency histogram and an added source.
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/metrics_http.h"
+#include "../src/rdma_ops.h"
+#include "../src/rdma_stats.h"
+#include "mock/mock_pair.h"
+
+#define PORT 17531
+
+static int fail(const char *what)
+{
+    fprintf(stderr, "%s\n", what);
+    return 1;
+}
+
+// GET path; returns the whole response (headers + body) in buf.
+static int scrape(const char *path, char *buf, size_t cap)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in a = {.sin_family = AF_INET, .sin_port = htons(PORT), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (fd < 0 || connect(fd, (struct sockaddr *)&a, sizeof(a)))
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    char req[128];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    if (send(fd, req, (size_t)n, 0) != n)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t got = 0;
+    ssize_t r;
+    while (got < cap - 1 && (r = recv(fd, buf + got, cap - 1 - got, 0)) > 0)
+        got += (size_t)r;
+    buf[got] = '\0';
+    close(fd);
+    return 0;
+}
+
+static uint64_t g_requests = 7;
+
+static void app_source(FILE *out, void *arg)
+{
+    metrics_family(out, "test_requests_total", "counter", "Requests.");
+    fprintf(out, "test_requests_total %llu\n", (unsigned long long)metrics_u64(arg));
+}
+
+int main(void)
+{
+    char port[16];
+    snprintf(port, sizeof(port), "%d", PORT);
+    unsetenv("RDMA_STATS");
+    int err = 0;
+    // Started before the first WR, as a server would: the exporter turns the QP counters on.
+    if (metrics_http_start(port) || metrics_http_add(app_source, &g_requests))
+        return fail("metrics_http_start");
+
+    struct mock_pair p;
+    struct ibv_wc wc;
+    if (mock_pair_up(&p, "17530"))
+        return 1;
+    rdma_ctx *c = &p.cli;
+    rdma_stats_label(c->qp, "cli");
+    for (int i = 0; i < 4; i++)
+    {
+        if (post_write(c->qp, c->mr_tx, c->buf_tx, c->remote_addr, c->remote_rkey, 256, i, 1) ||
+            poll_one(c->cq, &wc))
+            err |= fail("write");
+    }
+    if (post_recv(p.srv.qp, p.srv.mr_remote, p.srv.buf_remote, 64, 9) ||
+        post_send(c->qp, c->mr_tx, c->buf_tx, 40, 10, 1) || poll_one(p.srv.cq, &wc) || poll_one(c->cq, &wc))
+        err |= fail("send/recv");
+    // One RECV left posted: the client's CQ is owed one completion at scrape time.
+    if (post_recv(c->qp, c->mr_tx, c->buf_tx, 64, 11))
+        err |= fail("post_recv");
+
+    static char body[1 << 18];
+    char want[160];
+    uint32_t qpn = c->qp->qp_num;
+    if (scrape("/metrics", body, sizeof(body)) || strncmp(body, "HTTP/1.0 200 OK\r\n", 17))
+        err |= fail("GET /metrics should answer 200");
+    snprintf(want, sizeof(want), "rdma_qp_wrs_posted_total{dev=\"mock0\",qp=\"%u\",label=\"cli\",op=\"write\"} 4\n",
+             qpn);
+    if (!strstr(body, want))
+        err |= fail("per-opcode WR count");
+    snprintf(want, sizeof(want), "rdma_qp_bytes_posted_total{dev=\"mock0\",qp=\"%u\",label=\"cli\"} 1064\n", qpn);
+    if (!strstr(body, want))
+        err |= fail("bytes posted");
+    snprintf(want, sizeof(want), "rdma_qp_bytes_received_total{dev=\"mock0\",qp=\"%u\",label=\"qp\"} 40\n",
+             p.srv.qp->qp_num);
+    if (!strstr(body, want))
+        err |= fail("bytes received on the server QP");
+    snprintf(want, sizeof(want), "rdma_qp_completion_latency_seconds_count{dev=\"mock0\",qp=\"%u\",label=\"cli\"} 5\n",
+             qpn);
+    if (!strstr(body, want))
+        err |= fail("latency histogram count should match signaled sends");
+    snprintf(want, sizeof(want),
+             "rdma_qp_completion_latency_seconds_bucket{dev=\"mock0\",qp=\"%u\",label=\"cli\",le=\"+Inf\"} 5\n", qpn);
+    if (!strstr(body, want))
+        err |= fail("latency histogram +Inf bucket");
+    // The mock's CQs carry no NIC timestamps: the split histograms are there, and empty.
+    snprintf(want, sizeof(want), "rdma_qp_nic_latency_seconds_count{dev=\"mock0\",qp=\"%u\",label=\"cli\"} 0\n", qpn);
+    if (!strstr(body, want) || !strstr(body, "# TYPE rdma_qp_poll_delay_seconds histogram\n"))
+        err |= fail("NIC latency and poll delay histograms");
+    snprintf(want, sizeof(want), "rdma_cq_size{dev=\"mock0\",cq=\"%u\"} %d\n", c->cq->handle, c->cq->cqe);
+    if (!strstr(body, want))
+        err |= fail("CQ size");
+    snprintf(want, sizeof(want), "rdma_cq_owed_cqes{dev=\"mock0\",cq=\"%u\"} 1\n", c->cq->handle);
+    if (!strstr(body, want))
+        err |= fail("CQ owed completions should count the RECV still posted");
+    if (!strstr(body, "# TYPE rdma_qp_completion_latency_seconds histogram\n") ||
+        !strstr(body, "test_requests_total 7\n") || !strstr(body, "rdma_resolve_cache_lookups_total{result=\"hit\"}"))
+        err |= fail("families and added source");
+
+    if (scrape("/", body, sizeof(body)) || strncmp(body, "HTTP/1.0 404", 12))
+        err |= fail("other paths should answer 404");
+
+    metrics_http_stop();
+    if (scrape("/metrics", body, sizeof(body)) == 0)
+        err |= fail("stopped exporter should refuse connections");
+    mock_pair_down(&p);
+    if (!err)
+        printf("OK test_metrics_http\n");
+    return err;
+}
@@ -0,0 +1,209 @@
+// Unit test for the CM helpers, rdma_mem and rdma_ops, run against the loopback mock in tests/mock/. It covers the
+// connect handshake with private data, WRITE/READ/IMM/atomics, SEND before RECV, error completions and flushes, SQ
+// overflow, injected latency and loss, disconnect, and the object refcounts. No RDMA device needed.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/rdma_ops.h"
+#include "mock/mock_pair.h"
+
+static int fail(const char *what)
+{
+    fprintf(stderr, "%s\n", what);
+    return 1;
+}
+
+// One completion, whatever its status; -1 if nothing arrives within a second.
+static int poll_wc(struct ibv_cq *cq, struct ibv_wc *wc)
+{
+    for (long i = 0; i < 100000000L; i++)
+    {
+        int n = ibv_poll_cq(cq, 1, wc);
+        if (n)
+            return n < 0 ? -1 : 0;
+    }
+    return -1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int data_path(void)
+{
+    struct mock_pair p;
+    struct ibv_wc wc;
+    int err = 0;
+    if (mock_pair_up(&p, "17501"))
+        return 1;
+    char *tx = p.cli.buf_tx, *remote = p.srv.buf_remote;
+    if ((uintptr_t)tx % 4096 || tx[MOCK_PAIR_BUF - 1] != 0)
+        err |= fail("alloc_and_reg should return a zeroed, page-aligned buffer");
+
+    memset(tx, 'w', 100);
+    if (post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr + 10, p.cli.remote_rkey, 100, 1, 1) ||
+        poll_one(p.cli.cq, &wc) || wc.opcode != IBV_WC_RDMA_WRITE || wc.wr_id != 1)
+        err |= fail("write");
+    if (remote[9] != 0 || remote[10] != 'w' || remote[109] != 'w' || remote[110] != 0)
+        err |= fail("write landed in the wrong place");
+
+    memcpy(remote + 4096, "remote", 6);
+    if (post_read(p.cli.qp, p.cli.mr_tx, tx + 4096, p.cli.remote_addr + 4096, p.cli.remote_rkey, 6, 2, 1) ||
+        poll_one(p.cli.cq, &wc) || wc.opcode != IBV_WC_RDMA_READ || memcmp(tx + 4096, "remote", 6))
+        err |= fail("read");
+
+    // A SEND posted before its RECV waits (RNR) instead of failing.
+    memcpy(tx, "ping", 4);
+    if (post_send(p.cli.qp, p.cli.mr_tx, tx, 4, 3, 1) || ibv_poll_cq(p.cli.cq, 1, &wc) != 0)
+        err |= fail("send without a RECV should not complete");
+    if (mock_verbs_stats()->rnr_waits != 1)
+        err |= fail("send without a RECV should count one RNR wait");
+    if (post_recv(p.srv.qp, p.srv.mr_remote, remote + 2048, 64, 4) || poll_one(p.srv.cq, &wc) ||
+        wc.opcode != IBV_WC_RECV || wc.byte_len != 4 || memcmp(remote + 2048, "ping", 4) ||
+        poll_one(p.cli.cq, &wc) || wc.wr_id != 3)
+        err |= fail("send/recv");
+
+    if (post_recv(p.srv.qp, p.srv.mr_remote, remote, 0, 5) ||
+        post_write_imm(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr + 512, p.cli.remote_rkey, 8, 0xabcd, 6, 1) ||
+        poll_one(p.srv.cq, &wc) || wc.opcode != IBV_WC_RECV_RDMA_WITH_IMM || ntohl(wc.imm_data) != 0xabcd ||
+        wc.byte_len != 8 || poll_one(p.cli.cq, &wc))
+        err |= fail("write_imm");
+
+    uint64_t *counter = (uint64_t *)(remote + 1024), *old = (uint64_t *)(tx + 1024);
+    *counter = 40;
+    if (post_fetch_add(p.cli.qp, p.cli.mr_tx, old, p.cli.remote_addr + 1024, p.cli.remote_rkey, 2, 7, 1) ||
+        poll_one(p.cli.cq, &wc) || *old != 40 || *counter != 42)
+        err |= fail("fetch_add");
+    if (post_cmp_swap(p.cli.qp, p.cli.mr_tx, old, p.cli.remote_addr + 1024, p.cli.remote_rkey, 42, 7, 8, 1) ||
+        poll_one(p.cli.cq, &wc) || *old != 42 || *counter != 7)
+        err |= fail("cmp_swap");
+
+    // Unsignaled WRs fill the SQ until a signaled one completes and retires them.
+    int posted = 0;
+    while (post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr, p.cli.remote_rkey, 8, 9, 0) == 0)
+        posted++;
+    if (posted != 16)
+        err |= fail("SQ overflow should start at max_send_wr");
+    mock_pair_down(&p);
+    return err;
+}
+
+static int errors(void)
+{
+    struct mock_pair p;
+    struct ibv_wc wc;
+    int err = 0;
+    if (mock_pair_up(&p, "17502"))
+        return 1;
+    char *tx = p.cli.buf_tx;
+    if (ibv_dealloc_pd(p.srv.pd) == 0)
+        err |= fail("dealloc of a PD with MRs should fail");
+
+    // A bad rkey fails the WR, moves the QP to ERR and flushes what follows.
+    post_recv(p.cli.qp, p.cli.mr_tx, tx + 4096, 64, 20);
+    if (post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr, p.cli.remote_rkey + 1, 8, 21, 1) ||
+        post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr, p.cli.remote_rkey, 8, 22, 1))
+        err |= fail("post after a bad WR should still succeed");
+    if (poll_wc(p.cli.cq, &wc) || wc.wr_id != 21 || wc.status != IBV_WC_REM_ACCESS_ERR)
+        err |= fail("bad rkey should complete with REM_ACCESS_ERR");
+    if (poll_wc(p.cli.cq, &wc) || wc.wr_id != 20 || wc.status != IBV_WC_WR_FLUSH_ERR)
+        err |= fail("posted RECV should be flushed");
+    if (poll_wc(p.cli.cq, &wc) || wc.wr_id != 22 || wc.status != IBV_WC_WR_FLUSH_ERR)
+        err |= fail("WR behind the error should be flushed");
+    struct ibv_qp_attr qa;
+    struct ibv_qp_init_attr qia;
+    if (ibv_query_qp(p.cli.qp, &qa, IBV_QP_STATE, &qia) || qa.qp_state != IBV_QPS_ERR)
+        err |= fail("QP should be in ERR");
+    mock_pair_down(&p);
+    return err;
+}
+
+static int injection(void)
+{
+    struct mock_pair p;
+    struct ibv_wc wc;
+    int err = 0;
+    if (mock_pair_up(&p, "17503"))
+        return 1;
+    char *tx = p.cli.buf_tx;
+
+    // Data is placed at once; the completion shows up only after latency_ns.
+    struct mock_verbs_cfg cfg = {.latency_ns = 20 * 1000 * 1000};
+    mock_verbs_set_cfg(&cfg);
+    uint64_t t0 = now_ns();
+    if (post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr, p.cli.remote_rkey, 8, 30, 1) ||
+        ibv_poll_cq(p.cli.cq, 1, &wc) != 0 || poll_wc(p.cli.cq, &wc) || now_ns() - t0 < cfg.latency_ns)
+        err |= fail("latency should hide the completion");
+
+    cfg = (struct mock_verbs_cfg){.loss = 1.0, .retransmit_ns = 1000};
+    mock_verbs_set_cfg(&cfg);
+    if (post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr, p.cli.remote_rkey, 8, 31, 1) ||
+        poll_wc(p.cli.cq, &wc) || wc.status != IBV_WC_SUCCESS || mock_verbs_stats()->lost != 1)
+        err |= fail("retransmitted loss should still succeed");
+
+    cfg.loss_fatal = 1;
+    mock_verbs_set_cfg(&cfg);
+    if (post_write(p.cli.qp, p.cli.mr_tx, tx, p.cli.remote_addr, p.cli.remote_rkey, 8, 32, 1) ||
+        poll_wc(p.cli.cq, &wc) || wc.status != IBV_WC_RETRY_EXC_ERR)
+        err |= fail("fatal loss should exhaust retries");
+    mock_verbs_set_cfg(&(struct mock_verbs_cfg){0});
+    mock_pair_down(&p);
+    return err;
+}
+
+static int disconnect(void)
+{
+    struct mock_pair p;
+    struct ibv_wc wc;
+    struct rdma_cm_event *ev = NULL;
+    int err = 0;
+    if (mock_pair_up(&p, "17504"))
+        return 1;
+    post_recv(p.srv.qp, p.srv.mr_remote, p.srv.buf_remote, 64, 40);
+    if (rdma_disconnect(p.cli.id))
+        err |= fail("rdma_disconnect");
+    if (cm_wait_event(&p.cli, RDMA_CM_EVENT_DISCONNECTED, &ev))
+        err |= fail("client DISCONNECTED");
+    else
+        rdma_ack_cm_event(ev);
+    if (cm_wait_event(&p.srv, RDMA_CM_EVENT_DISCONNECTED, &ev))
+        err |= fail("server DISCONNECTED");
+    else
+        rdma_ack_cm_event(ev);
+    if (poll_wc(p.srv.cq, &wc) || wc.wr_id != 40 || wc.status != IBV_WC_WR_FLUSH_ERR)
+        err |= fail("disconnect should flush posted RECVs");
+    mock_pair_down(&p);
+
+    // Nobody listening: the connect is rejected.
+    rdma_ctx c = {0};
+    if (cm_create_channel_and_id(&c) || cm_client_resolve(&c, "127.0.0.1", "17599", NULL) ||
+        build_pd_cq_qp(&c, IBV_QPT_RC, 8, 4, 4, 1) || cm_client_connect_only(&c, 1, 1) ||
+        cm_wait_event(&c, RDMA_CM_EVENT_REJECTED, &ev))
+        err |= fail("connect without a listener should be rejected");
+    else
+        rdma_ack_cm_event(ev);
+    rdma_destroy_qp(c.id);
+    cq_ts_destroy(c.cq);
+    ibv_dealloc_pd(c.pd);
+    rdma_destroy_id(c.id);
+    rdma_destroy_event_channel(c.ec);
+    return err;
+}
+
+int main(void)
+{
+    int err = data_path();
+    err |= errors();
+    err |= injection();
+    err |= disconnect();
+    const struct mock_verbs_stats *st = mock_verbs_stats();
+    if (st->pds || st->mrs || st->cqs || st->qps || st->ids || st->channels)
+        err |= fail("objects leaked");
+    if (!err)
+        printf("OK test_mock_verbs\n");
+    return err;
+}
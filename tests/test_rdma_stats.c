@@ -0,0 +1,178 @@
+// Unit test for the per-QP counters (src/rdma_stats.c): drives rdma_ops over the loopback mock with RDMA_STATS set
+// and reads the results back through a second, read-only mapping of the segment, as rdma_stat does.
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/cq_ts.h"
+#include "../src/rdma_builders.h"
+#include "../src/rdma_ops.h"
+#include "../src/rdma_stats.h"
+#include "mock/mock_pair.h"
+
+static int fail(const char *what)
+{
+    fprintf(stderr, "%s\n", what);
+    return 1;
+}
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t hist_total(const uint64_t *h)
+{
+    uint64_t n = 0;
+    for (int i = 0; i < RDMA_STATS_LAT_BUCKETS; i++)
+        n += h[i];
+    return n;
+}
+
+static const struct rdma_stats_qp *find(const struct rdma_stats_seg *seg, const char *dev, uint32_t qpn)
+{
+    for (uint32_t i = 0; i < seg->nslots; i++)
+    {
+        if (seg->qp[i].in_use && seg->qp[i].qp_num == qpn && strcmp(seg->qp[i].dev, dev) == 0)
+            return &seg->qp[i];
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/rdma_stats_test.%d", (int)getpid());
+    setenv("RDMA_STATS", name, 1);
+
+    struct mock_pair p;
+    struct ibv_wc wc;
+    int err = 0;
+    if (mock_pair_up(&p, "17520"))
+        return 1;
+    rdma_ctx *c = &p.cli;
+    rdma_stats_label(c->qp, "client");
+    if (!rdma_stats_name() || strcmp(rdma_stats_name(), name))
+        err |= fail("RDMA_STATS=/name should pick the segment name");
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    const struct rdma_stats_seg *seg =
+        fd < 0 ? MAP_FAILED : mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+        close(fd);
+    if (seg == MAP_FAILED)
+    {
+        mock_pair_down(&p);
+        return fail("segment should be mappable by name");
+    }
+    if (seg->magic != RDMA_STATS_MAGIC || seg->pid != getpid() || sizeof(struct rdma_stats_qp) % 64)
+        err |= fail("header");
+
+    // 7 unsignaled WRITEs then a signaled one: 8 in flight until its CQE retires all of them.
+    for (int i = 0; i < 8; i++)
+    {
+        if (post_write(c->qp, c->mr_tx, c->buf_tx, c->remote_addr, c->remote_rkey, 100, i, i == 7))
+            err |= fail("post_write");
+    }
+    const struct rdma_stats_qp *s = find(seg, "mock0", c->qp->qp_num);
+    if (!s || strcmp(s->label, "client") || s->posted[IBV_WR_RDMA_WRITE] != 8 || s->bytes_posted != 800 ||
+        s->signaled != 1 || s->unsignaled != 7 || s->inflight != 8 || s->max_inflight != 8)
+        err |= fail("send counters after posting");
+    if (poll_one(c->cq, &wc) || !s || s->cqes != 1 || s->inflight != 0 || s->max_inflight != 8)
+        err |= fail("signaled CQE should retire the unsignaled WRs before it");
+
+    if (post_read(c->qp, c->mr_tx, c->buf_tx, c->remote_addr, c->remote_rkey, 64, 9, 1) ||
+        post_fetch_add(c->qp, c->mr_tx, (uint64_t *)c->buf_tx, c->remote_addr, c->remote_rkey, 1, 10, 1) ||
+        poll_one(c->cq, &wc) || poll_one(c->cq, &wc))
+        err |= fail("read/fetch_add");
+    if (!s || s->posted[IBV_WR_RDMA_READ] != 1 || s->posted[IBV_WR_ATOMIC_FETCH_AND_ADD] != 1 || s->cqes != 3 ||
+        s->inflight != 0)
+        err |= fail("read/fetch_add counters");
+
+    // The server's QP gets its own slot; the RECV CQE does not retire anything on the send side.
+    if (post_recv(p.srv.qp, p.srv.mr_remote, p.srv.buf_remote, 64, 11) ||
+        post_send(c->qp, c->mr_tx, c->buf_tx, 4, 12, 1) || poll_one(p.srv.cq, &wc) || poll_one(c->cq, &wc))
+        err |= fail("send/recv");
+    const struct rdma_stats_qp *srv = find(seg, "mock0", p.srv.qp->qp_num);
+    if (!srv || srv == s || srv->posted[RDMA_STATS_OP_RECV] != 1 || srv->cqes != 1 || srv->inflight != 0)
+        err |= fail("server slot");
+    if (seg->nslots != 2)
+        err |= fail("one slot per QP");
+
+    // The mock has no completion timestamps, so build_pd_cq_qp fell back to a plain CQ and only lat_hist filled.
+    if (cq_ts_enabled(c->cq) || !s || hist_total(s->nic_lat_hist) || hist_total(s->poll_lat_hist))
+        err |= fail("plain CQ: no NIC/poll split");
+    // Stamp a CQE by hand, 2 ms after its post and 1 ms before its reap: the split follows the stamp.
+    uint64_t lat0 = s ? s->lat_sum_ns : 0, stamp = 0, ts = 1;
+    struct timespec ms = {.tv_sec = 0, .tv_nsec = 1000000};
+    if (post_write(c->qp, c->mr_tx, c->buf_tx, c->remote_addr, c->remote_rkey, 8, 15, 1))
+        err |= fail("post_write");
+    nanosleep(&ms, NULL);
+    nanosleep(&ms, NULL);
+    stamp = mono_ns();
+    nanosleep(&ms, NULL);
+    if (cq_ts_poll(c->cq, 1, &wc, &ts) != 1 || ts != 0 || wc.status != IBV_WC_SUCCESS)
+        err |= fail("cq_ts_poll on a plain CQ should reap with a zero timestamp");
+    rdma_stats_on_cqes_ts(c->cq, &wc, 1, 0, &stamp);
+    if (!s || hist_total(s->nic_lat_hist) != 1 || hist_total(s->poll_lat_hist) != 1 || s->nic_lat_sum_ns < 2000000 ||
+        s->poll_lat_sum_ns < 1000000 || s->nic_lat_sum_ns + s->poll_lat_sum_ns != s->lat_sum_ns - lat0)
+        err |= fail("timestamped CQE should split post-to-reap into NIC time and poll delay");
+
+    // A bad rkey fails the WR and flushes the one behind it; both count as errors and nothing stays in flight.
+    post_write(c->qp, c->mr_tx, c->buf_tx, c->remote_addr, c->remote_rkey + 1, 8, 13, 1);
+    post_write(c->qp, c->mr_tx, c->buf_tx, c->remote_addr, c->remote_rkey, 8, 14, 0);
+    if (poll_one(c->cq, &wc) == 0 || poll_one(c->cq, &wc) == 0)
+        err |= fail("bad rkey should complete with errors");
+    if (!s || s->error_cqes != 2 || s->inflight != 0)
+        err |= fail("error counters");
+
+    // QPNs are per device: the same number on a second device is another QP with its own slot.
+    struct ibv_device dev1 = *mock_ctx.device;
+    snprintf(dev1.name, sizeof(dev1.name), "mock1");
+    struct ibv_context ctx1 = {.device = &dev1};
+    struct ibv_qp twin = {.context = &ctx1, .qp_num = c->qp->qp_num};
+    rdma_stats_label(&twin, "twin");
+    const struct rdma_stats_qp *tw = find(seg, "mock1", twin.qp_num);
+    if (!tw || tw == s || tw->cqes || !s || strcmp(s->label, "client") || seg->nslots != 3)
+        err |= fail("same QPN on another device should get its own slot");
+    rdma_stats_release(&twin);
+    if (!tw || tw->in_use || find(seg, "mock1", twin.qp_num))
+        err |= fail("released slot should be free");
+
+    // Connection churn: each destroyed QP gives its slot back, so many more QPs than slots come and go.
+    struct ibv_qp_init_attr qa = {.send_cq = c->cq,
+                                  .recv_cq = c->cq,
+                                  .cap = {.max_send_wr = 4, .max_recv_wr = 4, .max_send_sge = 1, .max_recv_sge = 1},
+                                  .qp_type = IBV_QPT_RC};
+    for (int i = 0; i < 3 * RDMA_STATS_MAX_QPS; i++)
+    {
+        rdma_ctx x = {.pd = c->pd, .cq = c->cq};
+        x.qp = ibv_create_qp(c->pd, &qa);
+        if (!x.qp)
+        {
+            err |= fail("ibv_create_qp");
+            break;
+        }
+        rdma_stats_label(x.qp, "churn");
+        const struct rdma_stats_qp *q = find(seg, "mock0", x.qp->qp_num);
+        if (q != tw || q->cqes || q->signaled || strcmp(q->label, "churn"))
+            err |= fail("a new QP should take the free slot with zeroed counters");
+        destroy_qp(&x);
+    }
+    if (seg->dropped || seg->nslots != 3 || !tw || tw->in_use || tw->gen != 1 + 3 * RDMA_STATS_MAX_QPS)
+        err |= fail("churned QPs should reuse one slot");
+
+    mock_pair_down(&p);
+    if (seg->qp[0].in_use || seg->qp[1].in_use)
+        err |= fail("destroy_qp should free the pair's slots");
+    munmap((void *)seg, sizeof(*seg));
+    if (!err)
+        printf("OK test_rdma_stats\n");
+    return err;
+}
@@ -0,0 +1,69 @@
+// Minimal unit test for cm_resolve_cache: address hits/misses, TTL expiry, invalidation. No RDMA device needed.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/cm_resolve_cache.h"
+
+static int fail(const char *what)
+{
+    fprintf(stderr, "%s\n", what);
+    return 1;
+}
+
+int main(void)
+{
+    int err = 0;
+    struct cm_resolve_cfg cfg = {.addr_timeout_ms = 1000, .route_timeout_ms = 1000, .ttl_ms = 50};
+    cm_resolve_set_cfg(&cfg);
+    const struct cm_rcache_stats *st = cm_rcache_stats();
+
+    struct cm_rcache_key k;
+    struct sockaddr_storage dst, src;
+    int has_src = -1;
+    cm_rcache_key_set(&k, "127.0.0.1", "7471", NULL);
+    if (cm_rcache_addrs(&k, &dst, &src, &has_src) || st->misses != 1 || st->hits != 0)
+        err |= fail("first lookup should miss");
+    const struct sockaddr_in *sin = (const struct sockaddr_in *)&dst;
+    if (sin->sin_family != AF_INET || ntohs(sin->sin_port) != 7471 || sin->sin_addr.s_addr != htonl(INADDR_LOOPBACK) ||
+        has_src)
+        err |= fail("wrong resolved address");
+    if (cm_rcache_addrs(&k, &dst, &src, &has_src) || st->hits != 1)
+        err |= fail("second lookup should hit");
+
+    // Source address is part of the key.
+    struct cm_rcache_key ks;
+    cm_rcache_key_set(&ks, "127.0.0.1", "7471", "127.0.0.1");
+    if (cm_rcache_addrs(&ks, &dst, &src, &has_src) || st->misses != 2 || has_src != 1)
+        err |= fail("src key should miss and return a source address");
+
+    cm_rcache_invalidate(&k);
+    if (cm_rcache_addrs(&k, &dst, &src, &has_src) || st->misses != 3 || st->invalidations != 1)
+        err |= fail("invalidated entry should miss");
+
+    // Dropping by destination catches every key that resolved to it.
+    cm_rcache_invalidate_dst((const struct sockaddr *)&dst);
+    if (st->invalidations != 3)
+        err |= fail("invalidate_dst should drop both entries");
+
+    struct timespec ts = {.tv_nsec = 80 * 1000 * 1000};
+    cm_rcache_addrs(&k, &dst, &src, &has_src);
+    nanosleep(&ts, NULL);
+    if (cm_rcache_addrs(&k, &dst, &src, &has_src) || st->expired != 1)
+        err |= fail("entry should expire after ttl_ms");
+
+    cfg.ttl_ms = 0; // disabled: plain getaddrinfo, no accounting
+    cm_resolve_set_cfg(&cfg);
+    uint64_t hits = st->hits, misses = st->misses;
+    if (cm_rcache_addrs(&k, &dst, &src, &has_src) || st->hits != hits || st->misses != misses)
+        err |= fail("disabled cache should bypass");
+
+    cm_rcache_key_set(&k, "no-such-host.invalid", "1", NULL);
+    if (cm_rcache_addrs(&k, &dst, &src, &has_src) == 0)
+        err |= fail("bad host should fail");
+
+    if (!err)
+        printf("OK test_resolve_cache\n");
+    return err;
+}
@@ -0,0 +1,202 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/uring_io.h"
+
+#define BLK 4096
+#define NBLK 8
+
+int main(void)
+{
+    int err = 0;
+    struct uring r = {0};
+    int ring_ok = 0;
+    int skip = 0;
+    char path[] = "/tmp/test_uring_XXXXXX";
+    int fd = mkstemp(path);
+    char *wbuf = NULL, *rbuf = NULL;
+    if (fd < 0)
+    {
+        fprintf(stderr, "FAIL: mkstemp at %s:%d\n", __FILE__, __LINE__);
+        return 1;
+    }
+    unlink(path);
+    int rc = uring_init(&r, 16, 0, 0);
+    if (rc == -ENOSYS || rc == -EPERM)
+    {
+        puts("SKIP test_uring (io_uring unavailable)");
+        skip = 1;
+        goto cleanup;
+    }
+    if (rc)
+    {
+        fprintf(stderr, "FAIL: uring_init rc=%d at %s:%d\n", rc, __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+    ring_ok = 1;
+    if (posix_memalign((void **)&wbuf, BLK, BLK * NBLK) || posix_memalign((void **)&rbuf, BLK, BLK * NBLK))
+    {
+        fprintf(stderr, "FAIL: posix_memalign at %s:%d\n", __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < BLK * NBLK; i++)
+        wbuf[i] = (char)(i * 7 + 3);
+    memset(rbuf, 0, BLK * NBLK);
+
+    // One plain WRITE per block, submitted as a single batch.
+    for (int i = 0; i < NBLK; i++)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe(&r);
+        if (!sqe)
+        {
+            fprintf(stderr, "FAIL: SQ full at %s:%d\n", __FILE__, __LINE__);
+            err = 1;
+            goto cleanup;
+        }
+        uring_prep_write(sqe, fd, wbuf + i * BLK, BLK, (uint64_t)i * BLK, (uint64_t)i);
+    }
+    rc = uring_submit(&r, NBLK);
+    if (rc != NBLK)
+    {
+        fprintf(stderr, "FAIL: submit rc=%d at %s:%d\n", rc, __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+    unsigned seen = 0;
+    for (int i = 0; i < NBLK; i++)
+    {
+        struct io_uring_cqe *cqe = NULL;
+        if (uring_wait_cqe(&r, &cqe) || cqe->res != BLK || cqe->user_data >= NBLK)
+        {
+            fprintf(stderr, "FAIL: write cqe at %s:%d\n", __FILE__, __LINE__);
+            err = 1;
+            goto cleanup;
+        }
+        seen |= 1u << cqe->user_data;
+        uring_cqe_seen(&r);
+    }
+    if (seen != (1u << NBLK) - 1)
+    {
+        fprintf(stderr, "FAIL: missing write completions at %s:%d\n", __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+
+    // Read everything back through a registered (fixed) buffer.
+    struct iovec iov = {.iov_base = rbuf, .iov_len = BLK * NBLK};
+    rc = uring_register_buffers(&r, &iov, 1);
+    if (rc)
+    {
+        fprintf(stderr, "FAIL: register_buffers rc=%d at %s:%d\n", rc, __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(&r);
+    uring_prep_read_fixed(sqe, fd, rbuf, BLK * NBLK, 0, 0, 99);
+    sqe = uring_get_sqe(&r);
+    uring_prep_fsync(sqe, fd, 100);
+    if (uring_submit(&r, 0) != 2)
+    {
+        fprintf(stderr, "FAIL: submit read/fsync at %s:%d\n", __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        struct io_uring_cqe *cqe = NULL;
+        if (uring_wait_cqe(&r, &cqe) || cqe->res < 0 || (cqe->user_data == 99 && cqe->res != BLK * NBLK))
+        {
+            fprintf(stderr, "FAIL: read/fsync cqe at %s:%d\n", __FILE__, __LINE__);
+            err = 1;
+            goto cleanup;
+        }
+        uring_cqe_seen(&r);
+    }
+    if (memcmp(wbuf, rbuf, BLK * NBLK) != 0)
+    {
+        fprintf(stderr, "FAIL: data mismatch at %s:%d\n", __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+
+    // Sockets: three SENDs land in a provided-buffer ring through one multishot RECV.
+    int sv[2] = {-1, -1};
+    struct uring_buf_ring br = {0};
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+    {
+        fprintf(stderr, "FAIL: socketpair at %s:%d\n", __FILE__, __LINE__);
+        err = 1;
+        goto cleanup;
+    }
+    rc = uring_buf_ring_init(&r, &br, 7, 4, BLK);
+    if (rc == -EINVAL)
+    {
+        puts("SKIP test_uring sockets (no provided-buffer rings before Linux 5.19)");
+        goto sockets_done;
+    }
+    if (rc)
+    {
+        fprintf(stderr, "FAIL: buf_ring_init rc=%d at %s:%d\n", rc, __FILE__, __LINE__);
+        err = 1;
+        goto sockets_done;
+    }
+    uring_prep_recv_multishot(uring_get_sqe(&r), sv[1], 7, 200);
+    for (int i = 0; i < 3; i++)
+        uring_prep_send(uring_get_sqe(&r), sv[0], wbuf + i * BLK, BLK, 0, 300 + (uint64_t)i);
+    if (uring_submit(&r, 0) != 4)
+    {
+        fprintf(stderr, "FAIL: submit sockets at %s:%d\n", __FILE__, __LINE__);
+        err = 1;
+        goto sockets_done;
+    }
+    int sent = 0, got = 0;
+    while (sent < 3 * BLK || got < 3 * BLK)
+    {
+        struct io_uring_cqe *cqe = NULL;
+        if (uring_wait_cqe(&r, &cqe) || cqe->res <= 0)
+        {
+            fprintf(stderr, "FAIL: socket cqe res=%d at %s:%d\n", cqe ? cqe->res : 0, __FILE__, __LINE__);
+            err = 1;
+            goto sockets_done;
+        }
+        if (cqe->user_data == 200)
+        {
+            unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            if (!(cqe->flags & IORING_CQE_F_BUFFER) || !(cqe->flags & IORING_CQE_F_MORE) ||
+                memcmp(uring_buf_ring_addr(&br, bid), wbuf + got, (size_t)cqe->res))
+            {
+                fprintf(stderr, "FAIL: multishot recv at %s:%d\n", __FILE__, __LINE__);
+                err = 1;
+                goto sockets_done;
+            }
+            got += cqe->res;
+            uring_buf_ring_recycle(&br, bid);
+        }
+        else
+            sent += cqe->res;
+        uring_cqe_seen(&r);
+    }
+
+sockets_done:
+    uring_buf_ring_exit(&r, &br);
+    close(sv[0]);
+    close(sv[1]);
+
+cleanup:
+    if (ring_ok)
+        uring_exit(&r);
+    free(wbuf);
+    free(rbuf);
+    close(fd);
+    if (!err && !skip)
+        puts("OK test_uring");
+    return err;
+}
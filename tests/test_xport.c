@@ -0,0 +1,131 @@
+// Minimal unit test for the xport shm and tcp backends: expose, WRITE, READ, SEND/RECV (including a SEND
+// that arrives before its RECV), completion order behind a READ, and out-of-region rejection. No RDMA device needed.
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/xport.h"
+
+struct peer
+{
+    const char *backend, *port;
+    char region[4096];
+    char msg[256];
+    int rc;
+};
+
+static int fail(const char *what)
+{
+    fprintf(stderr, "%s\n", what);
+    return 1;
+}
+
+// Server side: expose a region, answer one SEND with its length, wait for the "bye" SEND, then a last one.
+static void *server(void *arg)
+{
+    struct peer *p = arg;
+    struct xport x;
+    struct xport_mr region, msg;
+    struct xport_wc wc;
+    p->rc = 1;
+    if (xport_open(&x, p->backend))
+        return NULL;
+    if (xport_listen(&x, "127.0.0.1", p->port) || xport_reg(&x, p->region, sizeof(p->region), &region) ||
+        xport_reg(&x, p->msg, sizeof(p->msg), &msg) || xport_expose(&x, &region) ||
+        xport_recv(&x, &msg, p->msg, 128, 1) || xport_wait(&x, &wc) || wc.op != XPORT_OP_RECV)
+        goto out;
+    p->msg[128] = (char)wc.byte_len;
+    // Post the "bye" RECV well after the reply: the client sends it without waiting, and on tcp this side's
+    // receive thread holds the stream (RNR) until it is posted.
+    if (xport_send(&x, &msg, &p->msg[128], 1, 2, 1) || xport_wait(&x, &wc) || wc.op != XPORT_OP_SEND)
+        goto out;
+    usleep(50 * 1000);
+    if (xport_recv(&x, &msg, p->msg, 128, 3) || xport_wait(&x, &wc) || wc.wr_id != 3 || wc.byte_len != 3)
+        goto out;
+    // Stay up until the client has the READ it posted behind "bye".
+    if (xport_recv(&x, &msg, p->msg + 64, 1, 4) || xport_wait(&x, &wc) || wc.wr_id != 4)
+        goto out;
+    p->rc = 0;
+out:
+    xport_close(&x);
+    return NULL;
+}
+
+static int run(const char *backend, const char *port)
+{
+    struct peer p = {.backend = backend, .port = port};
+    struct xport x;
+    struct xport_mr mr;
+    struct xport_wc wc;
+    char buf[512] = {0};
+    int err = 0;
+    pthread_t th;
+    pthread_create(&th, NULL, server, &p);
+    if (xport_open(&x, backend))
+        return fail("open");
+    // tcp: the server thread may not be listening yet.
+    for (int i = 0; xport_connect(&x, "127.0.0.1", port); i++)
+    {
+        xport_close(&x);
+        if (i == 50 || xport_open(&x, backend))
+            return fail("connect");
+        usleep(20 * 1000);
+    }
+    if (xport_reg(&x, buf, sizeof(buf), &mr) || xport_expose(&x, NULL))
+        err |= fail("expose");
+    if (x.remote_len != sizeof(p.region))
+        err |= fail("wrong remote region length");
+
+    memset(buf, 'w', 64);
+    if (xport_write(&x, &mr, buf, 100, 64, 7, 1) || xport_wait(&x, &wc) || wc.wr_id != 7 || wc.op != XPORT_OP_WRITE)
+        err |= fail("write");
+    // The READ is ordered after the WRITE, so it must see the written bytes.
+    if (xport_read(&x, &mr, buf + 256, 96, 72, 8) || xport_wait(&x, &wc) || wc.op != XPORT_OP_READ)
+        err |= fail("read");
+    if (memcmp(buf + 256, "\0\0\0\0wwww", 8) || buf[256 + 4 + 63] != 'w' || buf[256 + 68] != 0)
+        err |= fail("read returned the wrong bytes");
+    if (xport_write(&x, &mr, buf, sizeof(p.region) - 8, 16, 9, 1) == 0)
+        err |= fail("write past the region should be refused");
+
+    // SEND 5 bytes, expect a 1-byte reply carrying the length. The reply RECV is posted after the SEND.
+    memcpy(buf, "hello", 5);
+    if (xport_send(&x, &mr, buf, 5, 10, 0) || xport_recv(&x, &mr, buf + 128, 1, 11) || xport_wait(&x, &wc) ||
+        wc.wr_id != 11 || buf[128] != 5)
+        err |= fail("send/recv");
+    // The READ behind "bye" waits for the server's late RECV; the signaled WRITE behind both completes last anyway
+    // (tcp holds its completion until the READ is in).
+    memcpy(buf, "bye", 3);
+    if (xport_send(&x, &mr, buf, 3, 12, 1) || xport_read(&x, &mr, buf + 256, 96, 8, 20) ||
+        xport_write(&x, &mr, buf, 200, 8, 21, 1))
+        err |= fail("send bye/read/write");
+    static const uint64_t order[] = {12, 20, 21};
+    for (int k = 0; k < 3; k++)
+    {
+        if (xport_wait(&x, &wc) || wc.wr_id != order[k])
+        {
+            err |= fail("completions should come in posting order");
+            break;
+        }
+    }
+    if (xport_send(&x, &mr, buf, 1, 13, 1) || xport_wait(&x, &wc) || wc.wr_id != 13)
+        err |= fail("send last");
+    pthread_join(th, NULL);
+    if (p.rc || memcmp(p.msg, "bye", 3))
+        err |= fail("server side failed");
+    if (p.region[99] != 0 || p.region[100] != 'w' || p.region[163] != 'w' || p.region[164] != 0)
+        err |= fail("write landed in the wrong place");
+    xport_dereg(&x, &mr);
+    xport_close(&x);
+    if (err)
+        fprintf(stderr, "  (backend %s)\n", backend);
+    return err;
+}
+
+int main(void)
+{
+    int err = run("shm", "test") | run("tcp", "17490");
+    if (!err)
+        printf("OK test_xport\n");
+    return err;
+}